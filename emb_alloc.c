@@ -113,6 +113,19 @@ static void EmbAllocInitializeInternal (void* mempool, size_t allocated_size,
  */
 static void EmbAllocInitializeBlockCategoriesInternal (void* mempool);
 
+/**
+ * Lays the block metadata of every category out from a certain address: the free
+ * bitmaps, the allocation-start bitmaps, the free-bitmap summaries and the counters
+ * of the compact layout, in the order EmbAllocGetMemoryRequirementsInternal sizes
+ * them, and initializes the bitmaps and the summaries.
+ * @param block_category the block categories, with their block counts set.
+ * @param settings the mempool creation settings.
+ * @param metadata_start the start of the block metadata region.
+ * @return the end of the block metadata.
+ */
+static unsigned char* EmbAllocInitializeBlockMetadataInternal (EmbAllocBlockCategory* block_category,
+    const EmbAllocMemPoolSettings* settings, unsigned char* metadata_start);
+
 /**
  * Initializes the aux data inside the mempool.
  * @param mempool the newly created mempool that needs to be initialized.
@@ -149,6 +162,30 @@ static void EmbAllocGetCategorySettingsInternal (const EmbAllocMemPoolSettings*
 static void EmbAllocDumpMempoolInternal (void* mempool, size_t mempool_size,
     FILE* file, size_t mark_point_idx);
 
+/**
+ * Prints a region of the mempool, in the format of EmbAllocDumpMempoolInternal (the
+ * lines are numbered from the mempool start).
+ * @param mempool the mempool that holds the region.
+ * @param offset the offset of the region from the mempool start.
+ * @param size the size of the region.
+ * @param file the file pointer where to dump the region.
+ * @param mark_point_idx the mempool index to mark, as for EmbAllocDumpMempoolInternal.
+ */
+static void EmbAllocDumpRegionInternal (void* mempool, size_t offset, size_t size,
+    FILE* file, size_t mark_point_idx);
+
+/**
+ * Prints the parts of a threadsafe mempool that the calling thread can read while other
+ * threads use the mempool: the settings and, for every category whose lock the thread
+ * holds, the category, its block metadata and its blocks. The other categories change
+ * under their own locks, which the error path cannot take without risking a deadlock.
+ * @param mempool the mempool that will be printed out.
+ * @param file the file pointer where to dump the mempool data.
+ * @param mark_point_idx the mempool index to mark, as for EmbAllocDumpMempoolInternal.
+ */
+static void EmbAllocDumpLockedCategoriesInternal (void* mempool, FILE* file,
+    size_t mark_point_idx);
+
 /**
  * Allocates a memory chunk.
  * @param settings used for full_overflow_checks and to call error_callback_fn.
@@ -160,6 +197,39 @@ static void EmbAllocDumpMempoolInternal (void* mempool, size_t mempool_size,
 static void* EmbAllocMallocInternal (const EmbAllocMemPoolSettings* settings, 
     EmbAllocBlockCategory* categories, size_t size);
 
+/**
+ * kEmbAllocPlaceMaxFreeAfter placement policy: allocate where the category keeps
+ * more free memory after the allocation.
+ * @see EmbAllocPlacementFn for the parameters and the return value.
+ */
+static bool EmbAllocPlaceMaxFreeAfterInternal (const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count);
+
+/**
+ * kEmbAllocPlaceBestFit placement policy: allocate where fewer bytes are wasted.
+ * @see EmbAllocPlacementFn for the parameters and the return value.
+ */
+static bool EmbAllocPlaceBestFitInternal (const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count);
+
+/**
+ * kEmbAllocPlaceLowestOccupancyBefore placement policy: allocate in the category with
+ * the smaller percentage of occupied blocks before the allocation.
+ * @see EmbAllocPlacementFn for the parameters and the return value.
+ */
+static bool EmbAllocPlaceLowestOccupancyBeforeInternal (
+    const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count);
+
+/**
+ * kEmbAllocPlaceLowestOccupancyAfter placement policy: allocate in the category with
+ * the smaller percentage of occupied blocks after the allocation.
+ * @see EmbAllocPlacementFn for the parameters and the return value.
+ */
+static bool EmbAllocPlaceLowestOccupancyAfterInternal (
+    const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count);
+
 /**
  * Merge free blocks and performs the sanity checks on them.
  * @param settings used for full_overflow_checks and to call error_callback_fn.
@@ -184,11 +254,26 @@ static void EmbAllocMergeFreeBlocksInternal (const EmbAllocMemPoolSettings* sett
 static void* EmbAllocMallocOneBlockInternal (const EmbAllocMemPoolSettings* settings, 
     EmbAllocBlockCategory* category, size_t size);
 
+/**
+ * Allocates up to count memory chunks, each in a single memory block of a category,
+ * claiming the free blocks one free bitmap word at a time.
+ * @param settings used for full_overflow_checks and to call error_callback_fn.
+ * @param category mempool blocks management data to be updated.
+ * @param size the actual size of the data to be allocated in each block.
+ * @param count the number of chunks wanted.
+ * @param ptrs receives the pointers to the allocated chunks.
+ * @return the number of chunks allocated (less than count when the category fills up).
+ */
+static size_t EmbAllocMallocBlocksInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* category, size_t size, size_t count, void** ptrs);
+
 /**
  * Checks whether a chunck of a certain size can be allocated within 
  * multiple continous blocks in a certain category.
  * If the allocation process can be done, the valid start block and
  * the actual used blocks requirements are returned as output params.
+ * Requests longer than the category's max_free_run bound are rejected without
+ * scanning; a failed scan tightens that bound.
  * @param mempool used for setting the mempool error.
  * @param category the category within which the check is made.
  * @param size the size that needs to be allocated.
@@ -214,6 +299,16 @@ static bool EmbAllocCanAllocInMultipleBlocksInternal (void* mempool,
 static void* EmbAllocMallocMultiBlocksInternal (const EmbAllocMemPoolSettings* settings, 
     EmbAllocBlockCategory* category, size_t size, void* block, size_t blocks_count);
 
+/**
+ * Finds the category whose blocks area holds a pointer, by address alone. The areas do
+ * not change after the mempool creation, so no lock is needed.
+ * @param categories mempool blocks management data.
+ * @param ptr the actual memory chunk address.
+ * @return the index of the category, EMB_ALLOC_NUM_BLOCK_CATEGORIES if there is none.
+ */
+static unsigned char EmbAllocCategoryIndexForPtrInternal (
+    const EmbAllocBlockCategory* categories, const void* ptr);
+
 /**
  * Gets the category to which the pointer belongs to.
  * @param categories mempool blocks management data used for verification verified.
@@ -233,6 +328,29 @@ static EmbAllocBlockCategory* EmbAllocGetCategoryForPtr (EmbAllocBlockCategory*
 static void EmbAllocFreeInternal (const EmbAllocMemPoolSettings* settings, 
     EmbAllocBlockCategory* categories, void* ptr);
 
+/**
+ * Frees a single-block allocation of a category known from its size, checking only
+ * that the pointer is the head of a live single-block allocation of that category.
+ * @param category mempool blocks management data to be updated.
+ * @param ptr the actual memory chunk address, inside the category's blocks area.
+ * @return true if the chunk was freed, false if it has to go through the regular
+ *         (fully validated) free.
+ */
+static bool EmbAllocFreeSizedInternal (EmbAllocBlockCategory* category, void* ptr);
+
+/**
+ * Returns a run of blocks to their category: wipes the run to EMB_ALLOC_INIT_VALUE,
+ * re-stamps every block as an individual free block, clears the run in the free
+ * bitmap and updates the occupied blocks count, the free hints and the longest
+ * free run bound.
+ * @param category mempool blocks management data to be updated.
+ * @param block the first block of the run.
+ * @param blocks_count the number of blocks in the run.
+ * @note The allocation-start bit of the run's first block is left to the caller.
+ */
+static void EmbAllocReleaseBlocksInternal (EmbAllocBlockCategory* category, 
+    void* block, size_t blocks_count);
+
 /**
  * Frees a memory chunk in a specific category.
  * @param settings used for full_overflow_checks and to call error_callback_fn.
@@ -242,6 +360,54 @@ static void EmbAllocFreeInternal (const EmbAllocMemPoolSettings* settings,
 static void EmbAllocFreeBlockInternal (const EmbAllocMemPoolSettings* settings, 
     EmbAllocBlockCategory* category, void* ptr);
 
+/**
+ * Checks the unused tail of an allocation being freed (full_overflow_checks only) and
+ * reports an overflow at its first written byte.
+ * @param settings used for full_overflow_checks and to call error_callback_fn.
+ * @param category the category of the allocation.
+ * @param ptr the allocation; its header must already be validated.
+ * @return the number of blocks of the allocation.
+ */
+static size_t EmbAllocCheckFreedTailInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* category, void* ptr);
+
+/**
+ * Wipes a run of blocks to EMB_ALLOC_INIT_VALUE and re-stamps every block as an
+ * individual free block. The block bitmaps, counters and hints are left to the caller.
+ * @param category the category of the run.
+ * @param block the first block of the run.
+ * @param blocks_count the number of blocks in the run.
+ */
+static void EmbAllocWipeBlocksInternal (EmbAllocBlockCategory* category, 
+    void* block, size_t blocks_count);
+
+/**
+ * Clears bits of a free bitmap word (marks their blocks free) and syncs the summary.
+ * @param category the category that owns the word.
+ * @param word the index of the bitmap word.
+ * @param mask the bits to clear.
+ */
+static void EmbAllocClearFreeBitsInternal (EmbAllocBlockCategory* category, 
+    size_t word, uint64_t mask);
+
+/**
+ * Frees the pointers of an EmbAllocFreeBatch group that lie in one category. Every
+ * pointer is validated like in EmbAllocFreeInternal, then the freed runs are cleared
+ * with one write per free bitmap word, and the occupied blocks count, the free hints
+ * and the longest free run bound are updated once for the group (the bound once per
+ * run of neighbouring allocations).
+ * @param settings used for full_overflow_checks and to call error_callback_fn.
+ * @param categories mempool blocks management data, for the validation.
+ * @param category the category the pointers lie in.
+ * @param ptrs the pointers of the group.
+ * @param order the positions in @p ptrs of the category's pointers; sorted by address.
+ * @param order_count the number of entries in @p order.
+ * @param run_counts scratch space for @p order_count block counts.
+ */
+static void EmbAllocFreeBatchCategoryInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* categories, EmbAllocBlockCategory* category, 
+    void* const* ptrs, unsigned char* order, size_t order_count, EmbAllocCounter* run_counts);
+
 /**
  * Reallocates a memory chunk.
  * @param settings used for full_overflow_checks and to call error_callback_fn.
@@ -260,21 +426,420 @@ static void* EmbAllocReallocInternal (const EmbAllocMemPoolSettings* settings,
  * @param settings used for full_overflow_checks and to call error_callback_fn.
  * @param category mempool blocks management data that contains the ptr address 
  *                 to be updated after the chunk is reallocated.
- * @param categories mempool blocks management data to be updated after the chunk is reallocated.
+ * @param categories mempool blocks management data to be updated after the chunk is
+ *                   reallocated. NULL when only the category's lock is held: the
+ *                   chunk is then only resized in place.
  * @param ptr the actual memory chunk address to be reallocated.
   * @param size number of bytes to reallocated.
  * @return the pointer to the beginning of newly allocated memory on success, 
- *         NULL otherwise
+ *         NULL otherwise (with NULL categories: the chunk has to move, it is left as is)
  */
 static void* EmbAllocReallocBlockInternal (const EmbAllocMemPoolSettings* settings, 
     EmbAllocBlockCategory* category, EmbAllocBlockCategory* categories, 
     void* ptr, size_t size);
 
+/**
+ * Grows a memory chunk forward over the free blocks right after its run, in place.
+ * Updates the use count and the end padding of the run, the free bitmap, the occupied
+ * blocks count and the free hints; the data size is left to the caller.
+ * @param settings used for full_overflow_checks and to call error_callback_fn.
+ * @param category mempool blocks management data to be updated.
+ * @param block the first block of the run.
+ * @param extra_blocks the number of free blocks after the run to be claimed.
+ * @note The caller must make sure the extra_blocks blocks after the run are free.
+ */
+static void EmbAllocGrowForwardInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* category, void* block, size_t extra_blocks);
+
+/**
+ * Expands a memory chunk in place, without ever moving it.
+ * @param settings used for full_overflow_checks and to call error_callback_fn.
+ * @param categories mempool blocks management data to be updated.
+ * @param ptr the actual memory chunk address to be expanded.
+ * @param min_size the size below which the chunk is left unchanged.
+ * @param max_size the size to expand to, as far as the free blocks allow.
+ * @return the chunk size after the call, 0 if ptr is invalid.
+ */
+static size_t EmbAllocExpandInPlaceInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* categories, void* ptr, size_t min_size, size_t max_size);
+
+/**
+ * Gets the capacity of a memory chunk (the bytes its blocks can hold).
+ * @param categories mempool blocks management data used for verification.
+ * @param ptr the actual memory chunk address.
+ * @return the capacity of the chunk, 0 if ptr is invalid.
+ */
+static size_t EmbAllocUsableSizeInternal (EmbAllocBlockCategory* categories, void* ptr);
+
+/**
+ * Gets the capacity a chunk of a certain size gets in its preferred placement: a single
+ * block of the best fit category or, for sizes above the largest block, a multi-block
+ * run in the largest category that has enough blocks.
+ * @param categories mempool blocks management data.
+ * @param size the size to be allocated.
+ * @return the capacity of the chunk, 0 if the size never fits in the mempool.
+ */
+static size_t EmbAllocGoodSizeInternal (const EmbAllocBlockCategory* categories, size_t size);
+
+/**
+ * Checks, without the category lock, whether a pointer is a live single-block allocation
+ * that a thread cache can take back: the same geometric and allocation-start checks as
+ * EmbAllocGetCategoryForPtr plus the overflow checks done on free.
+ * @param mempool the mempool the pointer should belong to.
+ * @param ptr the actual memory chunk address to be checked.
+ * @return the category of the block, NULL if the pointer must take the regular free path.
+ */
+static EmbAllocBlockCategory* EmbAllocCacheableBlockInternal (void* mempool, void* ptr);
+
+/**
+ * Fills an empty thread cache magazine, under the mempool lock: with a full magazine
+ * from the depot if there is one, otherwise with free blocks claimed from the category
+ * under its lock.
+ * @param cache the thread cache that owns the magazine.
+ * @param category_idx the category of the magazine.
+ */
+static void EmbAllocCacheRefillInternal (EmbAllocThreadCacheData* cache,
+    unsigned char category_idx);
+
+/**
+ * Empties a full thread cache magazine, under the mempool lock: into the depot if it
+ * has room, otherwise back into the category under its lock.
+ * @param cache the thread cache that owns the magazine.
+ * @param category_idx the category of the magazine.
+ * @param magazine the magazine to be emptied.
+ * @return true if the magazine was emptied, false if the lock could not be taken.
+ */
+static bool EmbAllocCacheFlushInternal (EmbAllocThreadCacheData* cache,
+    unsigned char category_idx, EmbAllocMagazine* magazine);
+
+/**
+ * Returns the blocks of a magazine to their category (the category lock must be held).
+ * @param settings used for full_overflow_checks and to call error_callback_fn.
+ * @param category mempool blocks management data to be updated.
+ * @param magazine the magazine to be emptied.
+ */
+static void EmbAllocReleaseMagazineInternal (const EmbAllocMemPoolSettings* settings,
+    EmbAllocBlockCategory* category, EmbAllocMagazine* magazine);
+
+/**
+ * Locks the categories of a mask in ascending category index order, the order every
+ * call follows, so that two calls never wait for each other. For a
+ * lock_free_single_blocks mempool it also shuts the lock-free single-block calls out of
+ * those categories and waits for the ones in progress, so the caller has them to itself
+ * until EmbAllocUnlockCategoriesInternal.
+ * @param aux_data the auxiliary data of the mempool to be locked.
+ * @param mask the EMB_ALLOC_CATEGORY_MASK bits of the categories (0 locks nothing).
+ * @return 0 in case of success, -1 otherwise (then no category is left locked).
+ */
+static int EmbAllocLockCategoriesInternal (EmbAllocMempoolAuxData* aux_data,
+    unsigned int mask);
+
+/**
+ * Unlocks the categories of a mask, letting the lock-free single-block calls in again.
+ * @param aux_data the auxiliary data of the mempool to be unlocked.
+ * @param mask the mask the categories were locked with.
+ * @return 0 in case of success, -1 otherwise.
+ */
+static int EmbAllocUnlockCategoriesInternal (EmbAllocMempoolAuxData* aux_data,
+    unsigned int mask);
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+/**
+ * Registers a lock-free single-block call on a category, unless the holder of the
+ * category lock has shut them out (see EmbAllocLockCategoriesInternal).
+ * @param category_lock the lock of the category.
+ * @return true if the call may go on without the lock, false if it must take it.
+ */
+static bool EmbAllocEnterLockFreeInternal (EmbAllocCategoryLock* category_lock);
+
+/**
+ * Ends a lock-free single-block call started with EmbAllocEnterLockFreeInternal.
+ * @param category_lock the lock of the category.
+ */
+static void EmbAllocLeaveLockFreeInternal (EmbAllocCategoryLock* category_lock);
+
+/**
+ * Atomically sets or clears one bit of a bitmap that other threads update concurrently.
+ * @param word the bitmap word that holds the bit.
+ * @param index the index of the bit in the bitmap (only index % 64 is used).
+ * @param set true to set the bit, false to clear it.
+ */
+static void EmbAllocUpdateBitAtomicInternal (uint64_t* word, size_t index, bool set);
+
+/**
+ * Claims a free block of a category by setting its free bitmap bit with a
+ * compare-and-swap, starting from the category's next_free_word hint and wrapping
+ * around once.
+ * @param category the category to allocate from.
+ * @return the block-start address of the claimed block, NULL if no free block was found.
+ */
+static void* EmbAllocClaimFreeBlockInternal (EmbAllocBlockCategory* category);
+
+/**
+ * Allocates a single block without the category lock, in the size class' preferred
+ * category (see EmbAllocMempoolAuxData::size_class_category).
+ * @param mempool the mempool to allocate from.
+ * @param size the size that needs to be allocated (not 0).
+ * @return a pointer to the allocated memory, NULL if the regular (locked) path must
+ *         handle the request.
+ */
+static void* EmbAllocMallocLockFreeInternal (void* mempool, size_t size);
+
+/**
+ * Frees a single-block allocation without the category lock.
+ * @param mempool the mempool the pointer belongs to.
+ * @param ptr the actual memory chunk address to be freed (not NULL).
+ * @return true if the block was freed, false if the regular (locked) path must handle
+ *         (and validate) the pointer.
+ */
+static bool EmbAllocFreeLockFreeInternal (void* mempool, void* ptr);
+
+/**
+ * Queues a single-block free from a thread other than the owner onto the remote free
+ * queue of its category, without any lock. The block is formatted like a cached block
+ * (see EmbAllocMagazine), except for the queue link in the first word of its payload.
+ * @param mempool the mempool the pointer belongs to.
+ * @param ptr the actual memory chunk address to be freed (not NULL).
+ * @return true if the block was queued, false if the regular path must handle (and
+ *         validate) the pointer.
+ */
+static bool EmbAllocQueueRemoteFreeInternal (void* mempool, void* ptr);
+
+/**
+ * Returns the blocks of the remote free queues to their categories, in one batch per
+ * category under that category's lock (only called by the owner thread).
+ * @param mempool the mempool whose queues are drained.
+ */
+static void EmbAllocDrainRemoteFreesInternal (void* mempool);
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+/**
+ * Picks the sub-pool of the calling thread (see EmbAllocPoolSelection).
+ * @param pool_set the pool set.
+ * @return the index of the sub-pool in pool_set->pools.
+ */
+static size_t EmbAllocPoolSetHomeInternal (const EmbAllocPoolSetData* pool_set);
+
+/**
+ * Finds the sub-pool that owns a pointer: a binary search for the last sub-pool that
+ * starts at or below the pointer, then the EMB_ALLOC_PTR_IS_IN_MEMPOOL range check.
+ * @param pool_set the pool set.
+ * @param ptr the pointer (not NULL).
+ * @return the sub-pool, NULL if no sub-pool owns the pointer.
+ */
+static void* EmbAllocPoolSetFindPoolInternal (const EmbAllocPoolSetData* pool_set, const void* ptr);
+
+/**
+ * @brief Returns the index of the lowest set bit of a non-zero bitmap word.
+ *
+ * Uses the compiler's count-trailing-zeros intrinsic where one is available (a single
+ * tzcnt / bsf / rbit+clz instruction on the common targets) and a portable de Bruijn
+ * multiply-and-lookup otherwise, so the word scans stay O(1) per word everywhere.
+ *
+ * @param word the bitmap word to inspect; must NOT be 0 (the result is undefined).
+ * @return the 0-based position of the lowest set bit of @p word.
+ */
+static unsigned EmbAllocCountTrailingZerosInternal (uint64_t word)
+{
+#if defined (__GNUC__) || defined (__clang__)
+    return (unsigned) __builtin_ctzll ((unsigned long long) word);
+#elif defined (_MSC_VER) && (defined (_M_X64) || defined (_M_ARM64))
+    unsigned long index = 0;
+    _BitScanForward64 (&index, word);
+    return (unsigned) index;
+#elif defined (_MSC_VER)
+    unsigned long index = 0;
+    if (_BitScanForward (&index, (unsigned long) word)) {
+        return (unsigned) index;
+    }
+    _BitScanForward (&index, (unsigned long) (word >> 32));
+    return (unsigned) index + 32u;
+#else /** No count-trailing-zeros intrinsic: portable de Bruijn fallback. */
+    static const unsigned char kDeBruijnPositions [64] = {
+         0,  1,  2, 53,  3,  7, 54, 27,  4, 38, 41,  8, 34, 55, 48, 28,
+        62,  5, 39, 46, 44, 42, 22,  9, 24, 35, 59, 56, 49, 18, 29, 11,
+        63, 52,  6, 26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+        51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12 };
+
+    /** Isolate the lowest set bit, then map it through the de Bruijn sequence. */
+    return kDeBruijnPositions [((word & (~word + 1u)) * UINT64_C (0x022FDD63CC95386D)) >> 58];
+#endif /** __GNUC__ || __clang__ / _MSC_VER */
+}
+
+/**
+ * @brief Returns the number of leading (most significant) zero bits of a non-zero word.
+ *
+ * The count-leading-zeros counterpart of EmbAllocCountTrailingZerosInternal, used by
+ * the run search to measure the free run that reaches the top of a bitmap word.
+ *
+ * @param word the bitmap word to inspect; must NOT be 0 (the result is undefined).
+ * @return the number of zero bits above the highest set bit of @p word.
+ */
+static unsigned EmbAllocCountLeadingZerosInternal (uint64_t word)
+{
+#if defined (__GNUC__) || defined (__clang__)
+    return (unsigned) __builtin_clzll ((unsigned long long) word);
+#elif defined (_MSC_VER) && (defined (_M_X64) || defined (_M_ARM64))
+    unsigned long index = 0;
+    _BitScanReverse64 (&index, word);
+    return 63u - (unsigned) index;
+#elif defined (_MSC_VER)
+    unsigned long index = 0;
+    if (_BitScanReverse (&index, (unsigned long) (word >> 32))) {
+        return 31u - (unsigned) index;
+    }
+    _BitScanReverse (&index, (unsigned long) word);
+    return 63u - (unsigned) index;
+#else /** No count-leading-zeros intrinsic: portable binary search. */
+    unsigned count = 0;
+    unsigned shift = 32;
+
+    /** Halve the window each step, shifting the word up while its top half is empty. */
+    for (; shift; shift >>= 1) {
+        if (0 == (word >> (64u - shift))) {
+            count += shift;
+            word <<= shift;
+        }
+    }
+    return count;
+#endif /** __GNUC__ || __clang__ / _MSC_VER */
+}
+
+/**
+ * @brief Rounds a block stride up to a power of two.
+ *
+ * @param stride the block stride (block data size plus the block control bytes).
+ * @return the smallest power of two not below @p stride, or 0 if it does not fit.
+ */
+static size_t EmbAllocPowerOfTwoStrideInternal (size_t stride)
+{
+    size_t power = EMB_ALLOC_ALIGN_AMOUNT;
+
+    while (power < stride) {
+        if (power > (SIZE_MAX >> 1)) {
+            return 0;
+        }
+        power <<= 1;
+    }
+
+    return power;
+}
+
+/**
+ * @brief Precomputes the multiply-shift division by a category's block stride.
+ *
+ * The default strides (block_data_size plus the block control bytes) are not powers
+ * of two, so a plain division costs tens of cycles. For a divisor d and dividends n < 2^k,
+ * with l = ceil(log2 d), s = k + l and m = floor(2^s / d) + 1, the error
+ * e = m * d - 2^s is at most d <= 2^l, so n * e < 2^s and
+ * floor(n * m / 2^s) == floor(n / d) for every such n. k is the bit length of the
+ * category's size in bytes, so every offset inside it qualifies. The product n * m
+ * takes up to 2k + 1 bits: 64-bit for k <= 31, 128-bit up to k == 62 where the
+ * compiler provides it; otherwise stride_magic stays 0 and the division is used.
+ * A power-of-two stride (see EmbAllocMemPoolSettings::power_of_two_strides and
+ * EmbAllocMemPoolSettings::compact_metadata) gets stride_magic 1 and stride_shift
+ * log2(stride): the offset is only shifted.
+ *
+ * @param category the category to set up; block_data_size, total_blocks and stride
+ *                 are set.
+ */
+static void EmbAllocInitStrideDivisionInternal (EmbAllocBlockCategory* category)
+{
+    size_t stride = category->stride;
+    uint64_t area = (uint64_t) category->total_blocks * stride;
+    unsigned k = 0;
+    unsigned l = 0;
+
+    category->stride_magic = 0;
+    category->stride_shift = 0;
+    category->stride_dividend_bits = 0;
+
+    if ((0 == category->total_blocks) ||
+        (category->total_blocks > (UINT64_MAX / stride))) {
+        return;
+    }
+
+    while ((k < 64u) && (0 != (area >> k))) {
+        k++;
+    }
+
+    while (((uint64_t) 1 << l) < stride) {
+        l++;
+    }
+
+    if (((uint64_t) 1 << l) == stride) {
+        category->stride_magic = 1u;
+        category->stride_shift = (unsigned char) l;
+        category->stride_dividend_bits = (unsigned char) k;
+        return;
+    }
+
+    if ((k <= EMB_ALLOC_STRIDE_DIVIDEND_BITS_64) && ((k + l) < 64u)) {
+        category->stride_magic = ((UINT64_C (1) << (k + l)) / stride) + 1u;
+#if EMB_ALLOC_UINT128_SUPPORTED
+    } else if ((k <= EMB_ALLOC_STRIDE_DIVIDEND_BITS_128) && ((k + l) < 128u)) {
+        category->stride_magic = (uint64_t) ((((EmbAllocUint128) 1) << (k + l)) / stride) + 1u;
+#endif /** EMB_ALLOC_UINT128_SUPPORTED */
+    } else {
+        return;
+    }
+
+    category->stride_shift = (unsigned char) (k + l);
+    category->stride_dividend_bits = (unsigned char) k;
+}
+
+/**
+ * @brief Divides a byte count by a category's block stride.
+ *
+ * Uses the multiply-shift precomputed by EmbAllocInitStrideDivisionInternal, and the
+ * division only for a value larger than the category itself (an oversized request)
+ * or a category without a usable magic number.
+ *
+ * @param category the category whose stride divides @p bytes.
+ * @param bytes    the dividend.
+ * @return bytes / stride, rounded down.
+ */
+static size_t EmbAllocDivideByStrideInternal (const EmbAllocBlockCategory* category,
+    size_t bytes)
+{
+    if (1u == category->stride_magic) {
+        return bytes >> category->stride_shift;
+    }
+
+    if ((0 != category->stride_magic) &&
+        (0 == ((uint64_t) bytes >> category->stride_dividend_bits))) {
+        if (category->stride_dividend_bits <= EMB_ALLOC_STRIDE_DIVIDEND_BITS_64) {
+            return (size_t) (((uint64_t) bytes * category->stride_magic) >> category->stride_shift);
+        }
+#if EMB_ALLOC_UINT128_SUPPORTED
+        return (size_t) (((EmbAllocUint128) bytes * category->stride_magic) >> category->stride_shift);
+#endif /** EMB_ALLOC_UINT128_SUPPORTED */
+    }
+
+    return bytes / category->stride;
+}
+
+/**
+ * @brief Counts the blocks of a category needed to span a number of bytes.
+ *
+ * @param category the category whose stride divides @p bytes.
+ * @param bytes    the byte count.
+ * @return bytes / stride, rounded up.
+ */
+static size_t EmbAllocStrideBlocksInternal (const EmbAllocBlockCategory* category,
+    size_t bytes)
+{
+    size_t blocks = EmbAllocDivideByStrideInternal (category, bytes);
+
+    return blocks + 
+        ((bytes != (blocks * category->stride)) ? 1 : 0);
+}
+
 /**
  * @brief Computes the 0-based index of a block within its category.
  *
  * Blocks of one category are laid out contiguously with a fixed stride of
- * EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE(block_data_size) bytes, so the index is just the
+ * EmbAllocBlockCategory::stride bytes, so the index is just the
  * byte offset from the category's first block divided by that stride.
  *
  * @param category the category that owns @p block; must have a valid start_address
@@ -287,8 +852,89 @@ static size_t EmbAllocBlockIndexInternal (const EmbAllocBlockCategory* category,
     const void* block)
 {
     /** Fixed-stride layout: index == (byte offset from the first block) / stride. */
-    return ((size_t) ((uintptr_t) block - (uintptr_t) category->start_address)) /
-        EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size);
+    return EmbAllocDivideByStrideInternal (category,
+        (size_t) ((uintptr_t) block - (uintptr_t) category->start_address));
+}
+
+/**
+ * @brief Computes the block-start address of the block with a given category index.
+ *
+ * The inverse of EmbAllocBlockIndexInternal.
+ *
+ * @param category the category that owns the block.
+ * @param index    the 0-based block index; the caller guarantees index < total_blocks.
+ * @return the block-start address of block @p index.
+ */
+static void* EmbAllocBlockFromIndexInternal (const EmbAllocBlockCategory* category,
+    size_t index)
+{
+    return (void*) ((unsigned char*) category->start_address +
+        (index * category->stride));
+}
+
+/**
+ * @brief Retrieves the use_count slot of a block.
+ *
+ * The slot sits in the block header, or in the use_counts array of the category in
+ * the compact layout (see EmbAllocMemPoolSettings::compact_metadata).
+ *
+ * @param category the category that owns @p block.
+ * @param block    a block-start address on the grid of @p category.
+ * @return the address of the use_count of @p block.
+ */
+static EmbAllocCounter* EmbAllocUseCountInternal (const EmbAllocBlockCategory* category,
+    void* block)
+{
+    if (NULL != category->use_counts) {
+        return category->use_counts + EmbAllocBlockIndexInternal (category, block);
+    }
+
+    return EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (block);
+}
+
+/**
+ * @brief Retrieves the data_size slot of a block.
+ *
+ * Same placement as the use_count (see EmbAllocUseCountInternal).
+ *
+ * @param category the category that owns @p block.
+ * @param block    a block-start address on the grid of @p category.
+ * @return the address of the data_size of @p block.
+ */
+static EmbAllocCounter* EmbAllocDataSizeInternal (const EmbAllocBlockCategory* category,
+    void* block)
+{
+    if (NULL != category->data_sizes) {
+        return category->data_sizes + EmbAllocBlockIndexInternal (category, block);
+    }
+
+    return EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (block);
+}
+
+/**
+ * @brief Formats a block as free: its markers (if the layout has them) are stamped
+ *        and its use_count and data_size are set to EMB_ALLOC_COUNTER_NOT_SET.
+ *
+ * The payload is left alone; the callers fill it with EMB_ALLOC_INIT_VALUE.
+ *
+ * @param category the category that owns @p block.
+ * @param block    a block-start address on the grid of @p category.
+ */
+static void EmbAllocFormatFreeBlockInternal (const EmbAllocBlockCategory* category,
+    void* block)
+{
+    if (EMB_ALLOC_CATEGORY_HAS_MARKERS (category)) {
+        /** 
+         * kEmbAllocBlockStart and kEmbAllocBlockEnd are definitely smaller or equal
+         * than EMB_ALLOC_ALIGN_AMOUNT.
+         */
+        memcpy (block, kEmbAllocBlockStart, EMB_ALLOC_BLOCK_START_MARKER_SIZE);
+        memcpy (EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (block, category->block_data_size),
+            kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT);
+    }
+
+    *EmbAllocUseCountInternal (category, block) = EMB_ALLOC_COUNTER_NOT_SET;
+    *EmbAllocDataSizeInternal (category, block) = EMB_ALLOC_COUNTER_NOT_SET;
 }
 
 /**
@@ -298,9 +944,9 @@ static size_t EmbAllocBlockIndexInternal (const EmbAllocBlockCategory* category,
  * ONLY source of truth for free/occupied state. It exists because the inner blocks of
  * a multi-block allocation overlay user data on their in-band use_count slot, so
  * reading use_count to detect free blocks is unreliable: user data equal to
- * EMB_ALLOC_VALUE_NOT_SET (0xFF..FF) would masquerade as "free" and let a scanner hand
+ * EMB_ALLOC_COUNTER_NOT_SET (0xFF..FF) would masquerade as "free" and let a scanner hand
  * out an allocation overlapping live memory. No scanner reads use_count; they all test
- * free/occupied through this helper.
+ * free/occupied through this helper or the word scans built on the same bitmap.
  *
  * @param category the category to consult. A NULL free_bitmap (empty category) is
  *                 treated as "not free".
@@ -311,7 +957,6 @@ static size_t EmbAllocBlockIndexInternal (const EmbAllocBlockCategory* category,
 static bool EmbAllocBlockIsFreeInternal (const EmbAllocBlockCategory* category,
     const void* block)
 {
-    const unsigned char* bitmap = (const unsigned char*) category->free_bitmap;
     size_t index;
 
     /**
@@ -320,66 +965,302 @@ static bool EmbAllocBlockIsFreeInternal (const EmbAllocBlockCategory* category,
      * but bounding the access here keeps a future misuse from becoming a wild read.
      * An out-of-range block, or an empty category (NULL bitmap), reports "not free".
      */
-    if ((NULL == bitmap) ||
+    if ((NULL == category->free_bitmap) ||
         ((uintptr_t) block < (uintptr_t) category->start_address) ||
         ((uintptr_t) block > (uintptr_t) category->last_address)) {
         return false;
     }
 
-    /** Bit lives at byte (index / 8), position (index % 8); a clear bit means free. */
+    /** Bit lives at word (index / 64), position (index % 64); a clear bit means free. */
     index = EmbAllocBlockIndexInternal (category, block);
-    return (0 == (bitmap [index >> 3] & (unsigned char) (1u << (index & 7u))));
+    return (0 == (EMB_ALLOC_FREE_BITMAP_WORD (category, index / EMB_ALLOC_BITMAP_WORD_BITS) &
+        (UINT64_C (1) << (index % EMB_ALLOC_BITMAP_WORD_BITS))));
 }
 
 /**
- * @brief Marks a run of consecutive blocks occupied or free in the free bitmap.
- *
- * Sets (@p occupied == true) or clears (@p occupied == false) the bitmap bits for the
- * @p blocks_count blocks starting at @p block. Allocation marks its whole span
- * occupied; free clears the span. The bitmap is kept in lockstep with the
- * occupied_blocks counter and the head's in-band use_count, which is what lets the
- * bitmap serve as the authoritative free/occupied oracle.
+ * @brief Sets the lowest @p bit_count bits of a word array, leaving the rest untouched.
  *
- * @param category     the category that owns the run. A NULL free_bitmap (empty
- *                     category) makes this a no-op.
- * @param block        the block-start address of the first block in the run.
- * @param blocks_count the number of consecutive blocks to mark.
- * @param occupied     true to set the bits (occupied), false to clear them (free).
- * @note No bounds check: the caller guarantees [block, block + blocks_count) stays
- *       within the category's grid.
+ * @param words     the word array (already zeroed by the caller).
+ * @param bit_count how many leading bits to set.
  */
-static void EmbAllocMarkBlocksInternal (EmbAllocBlockCategory* category,
-    const void* block, size_t blocks_count, bool occupied)
+static void EmbAllocSetLowBitsInternal (uint64_t* words, size_t bit_count)
 {
-    unsigned char* bitmap = (unsigned char*) category->free_bitmap;
-    size_t index = EmbAllocBlockIndexInternal (category, block);
-    size_t i = 0;
+    size_t word = 0;
 
-    /** Empty category (no blocks): nothing to track. */
-    if (NULL == bitmap) {
-        return;
+    for (; bit_count >= EMB_ALLOC_BITMAP_WORD_BITS; bit_count -= EMB_ALLOC_BITMAP_WORD_BITS) {
+        words [word++] = ~UINT64_C (0);
     }
 
-    /** Flip one bit per block across the run: OR-in the mask to set, AND-NOT to clear. */
-    for (i = 0; i < blocks_count; i++) {
-        size_t bit = index + i;
-        unsigned char mask = (unsigned char) (1u << (bit & 7u));
-
-        if (occupied) {
-            bitmap [bit >> 3] = (unsigned char) (bitmap [bit >> 3] | mask);
-        } else {
-            bitmap [bit >> 3] = (unsigned char) (bitmap [bit >> 3] & (unsigned char) ~mask);
-        }
+    if (bit_count) {
+        words [word] = ~(~UINT64_C (0) << bit_count);
     }
 }
 
 /**
- * @brief Tests whether a block is recorded as a live allocation head.
+ * @brief Re-derives the summary bits that describe one free-bitmap word.
  *
- * The allocation-start bitmap holds one bit per block, set ONLY on the first (head)
- * block of a live allocation. It is the out-of-band oracle that defeats forged
- * inner-block frees: a multi-block allocation's inner-block header (start marker,
- * use_count, data_size, end marker) is overlaid by user data and can be forged to
+ * Sets the word's free_summary bit iff the word still has a free (clear) bit, then
+ * sets the owning free_summary word's free_summary_top bit iff that summary word is
+ * non-zero. Must run after every change to a free-bitmap word so the upper levels
+ * never hide a free block nor advertise a full word.
+ *
+ * @param category the category that owns the word; must have summary levels.
+ * @param word     the index of the free-bitmap word that was just written.
+ */
+static void EmbAllocSyncSummaryInternal (EmbAllocBlockCategory* category, size_t word)
+{
+    size_t summary_word = word / EMB_ALLOC_BITMAP_WORD_BITS;
+    uint64_t summary_mask = UINT64_C (1) << (word % EMB_ALLOC_BITMAP_WORD_BITS);
+    uint64_t top_mask = UINT64_C (1) << (summary_word % EMB_ALLOC_BITMAP_WORD_BITS);
+
+    if (~UINT64_C (0) != EMB_ALLOC_FREE_BITMAP_WORD (category, word)) {
+        category->free_summary [summary_word] |= summary_mask;
+    } else {
+        category->free_summary [summary_word] &= ~summary_mask;
+    }
+
+    if (0 != category->free_summary [summary_word]) {
+        category->free_summary_top [summary_word / EMB_ALLOC_BITMAP_WORD_BITS] |= top_mask;
+    } else {
+        category->free_summary_top [summary_word / EMB_ALLOC_BITMAP_WORD_BITS] &= ~top_mask;
+    }
+}
+
+/**
+ * @brief Finds the first free-bitmap word, at or after a given one, that has a free bit.
+ *
+ * Without summary levels this is a flat walk over the bitmap words. With them, the
+ * search reads the word's free_summary word and, if that is empty, walks the
+ * free_summary_top words instead: each top bit covers 4096 blocks, so the cost is a
+ * few word reads no matter how large or how full the category is.
+ *
+ * @param category the category to search.
+ * @param word     the first free-bitmap word index to consider (may be past the end).
+ * @return the index of the first word >= @p word that has a free bit, or the bitmap
+ *         word count if there is none.
+ */
+static size_t EmbAllocNextFreeWordInternal (const EmbAllocBlockCategory* category,
+    size_t word)
+{
+    size_t word_count = EMB_ALLOC_CATEGORY_BITMAP_WORDS (category->total_blocks);
+    size_t summary_word = 0;
+    size_t summary_count = 0;
+    size_t top_word = 0;
+    uint64_t bits = 0;
+
+    if (word >= word_count) {
+        return word_count;
+    }
+
+    if (NULL == category->free_summary) {
+        while ((word < word_count) && (~UINT64_C (0) == EMB_ALLOC_FREE_BITMAP_WORD (category, word))) {
+            word++;
+        }
+        return word;
+    }
+
+    summary_count = EMB_ALLOC_CATEGORY_SUMMARY_WORDS (category->total_blocks);
+
+    while (word < word_count) {
+        /** Level 2: the rest of the summary word that covers `word`. */
+        summary_word = word / EMB_ALLOC_BITMAP_WORD_BITS;
+        bits = category->free_summary [summary_word] &
+            (~UINT64_C (0) << (word % EMB_ALLOC_BITMAP_WORD_BITS));
+
+        if (0 == bits) {
+            /** Level 3: the first non-empty summary word after it. */
+            summary_word++;
+
+            if (summary_word >= summary_count) {
+                return word_count;
+            }
+
+            top_word = summary_word / EMB_ALLOC_BITMAP_WORD_BITS;
+            bits = category->free_summary_top [top_word] &
+                (~UINT64_C (0) << (summary_word % EMB_ALLOC_BITMAP_WORD_BITS));
+
+            while (0 == bits) {
+                if (++top_word >= EMB_ALLOC_CATEGORY_SUMMARY_TOP_WORDS (category->total_blocks)) {
+                    return word_count;
+                }
+                bits = category->free_summary_top [top_word];
+            }
+
+            summary_word = (top_word * EMB_ALLOC_BITMAP_WORD_BITS) +
+                EmbAllocCountTrailingZerosInternal (bits);
+            bits = category->free_summary [summary_word];
+
+            if (0 == bits) {
+                word = (summary_word + 1) * EMB_ALLOC_BITMAP_WORD_BITS;
+                continue;
+            }
+        }
+
+        word = (summary_word * EMB_ALLOC_BITMAP_WORD_BITS) +
+            EmbAllocCountTrailingZerosInternal (bits);
+
+        /**
+         * The lock-free allocations fill words without clearing their summary bits
+         * (see EmbAllocMallocLockFreeInternal), so a set bit may be stale: skip it.
+         */
+        if (~UINT64_C (0) != EMB_ALLOC_FREE_BITMAP_WORD (category, word)) {
+            return word;
+        }
+        word++;
+    }
+
+    return word_count;
+}
+
+/**
+ * @brief Marks a run of consecutive blocks occupied or free in the free bitmap.
+ *
+ * Sets (@p occupied == true) or clears (@p occupied == false) the bitmap bits for the
+ * @p blocks_count blocks starting at @p block. Allocation marks its whole span
+ * occupied; free clears the span. The bitmap is kept in lockstep with the
+ * occupied_blocks counter and the head's in-band use_count, which is what lets the
+ * bitmap serve as the authoritative free/occupied oracle. The run is applied one
+ * 64-bit word at a time (a partial mask for the first and last word, full words in
+ * between), so marking a long multi-block run costs O(blocks_count / 64). The
+ * summary levels, when the category has them, are re-derived for every touched word.
+ *
+ * @param category     the category that owns the run. A NULL free_bitmap (empty
+ *                     category) makes this a no-op.
+ * @param block        the block-start address of the first block in the run.
+ * @param blocks_count the number of consecutive blocks to mark.
+ * @param occupied     true to set the bits (occupied), false to clear them (free).
+ * @note No bounds check: the caller guarantees [block, block + blocks_count) stays
+ *       within the category's grid.
+ */
+static void EmbAllocMarkBlocksInternal (EmbAllocBlockCategory* category,
+    const void* block, size_t blocks_count, bool occupied)
+{
+    size_t index = 0;
+
+    /** Empty category (no blocks) or empty run: nothing to track. */
+    if ((NULL == category->free_bitmap) || (0 == blocks_count)) {
+        return;
+    }
+
+    index = EmbAllocBlockIndexInternal (category, block);
+
+    while (blocks_count) {
+        size_t word = index / EMB_ALLOC_BITMAP_WORD_BITS;
+        size_t bit = index % EMB_ALLOC_BITMAP_WORD_BITS;
+        size_t span = EMB_ALLOC_BITMAP_WORD_BITS - bit;
+        uint64_t mask = ~UINT64_C (0);
+
+        /** Bits [bit, bit + span) of this word belong to the run. */
+        if (span > blocks_count) {
+            span = blocks_count;
+        }
+        if (span < EMB_ALLOC_BITMAP_WORD_BITS) {
+            mask = ((UINT64_C (1) << span) - 1u) << bit;
+        }
+
+        /** OR-in the mask to set, AND-NOT to clear. */
+        if (occupied) {
+            EMB_ALLOC_FREE_BITMAP_WORD (category, word) |= mask;
+        } else {
+            EMB_ALLOC_FREE_BITMAP_WORD (category, word) &= ~mask;
+        }
+
+        if (NULL != category->free_summary) {
+            EmbAllocSyncSummaryInternal (category, word);
+        }
+
+        index += span;
+        blocks_count -= span;
+    }
+}
+
+/**
+ * @brief Reads a bitmap word that other threads may update under the category lock.
+ *
+ * Used by the lock-free thread cache paths, which only read bits that no other thread
+ * is allowed to change at that moment (the allocation-start bit of a live allocation the
+ * caller owns), while neighbouring bits of the same word can change concurrently, and
+ * by the free-run walks that the lock-free single-block frees share with the locked
+ * paths. The read is a sequentially consistent atomic load where the compiler provides
+ * one, so a lock-free free that clears its free bit with a sequentially consistent
+ * fetch_and and then walks the neighbouring words sees the bit a concurrent free next
+ * to it cleared first (see EmbAllocFreeLockFreeInternal). It is a volatile read
+ * otherwise (even a torn read only mixes values that agree on the bit of interest).
+ *
+ * @param word the bitmap word to read.
+ * @return the current value of @p word.
+ */
+static uint64_t EmbAllocLoadBitmapWordInternal (const uint64_t* word)
+{
+#if defined (__GNUC__) || defined (__clang__)
+    return __atomic_load_n (word, __ATOMIC_SEQ_CST);
+#else
+    return *((const volatile uint64_t*) word);
+#endif
+}
+
+/**
+ * @brief Reads an allocation-start bitmap word.
+ *
+ * In a threadsafe mempool the thread caches, the remote free queues and the lock-free
+ * single-block calls read and write the start bits without the category lock, so every
+ * access to them is atomic there (see EmbAllocBlockCategory::concurrent_start_bitmap).
+ *
+ * @param category the category that owns the word.
+ * @param word     the number of the word.
+ * @return the current value of the word.
+ */
+static uint64_t EmbAllocLoadStartWordInternal (const EmbAllocBlockCategory* category,
+    size_t word)
+{
+    if (category->concurrent_start_bitmap) {
+        return EmbAllocLoadBitmapWordInternal (&EMB_ALLOC_START_BITMAP_WORD (category, word));
+    }
+
+    return EMB_ALLOC_START_BITMAP_WORD (category, word);
+}
+
+/**
+ * @brief Sets or clears bits of an allocation-start bitmap word.
+ *
+ * A relaxed atomic read-modify-write where lock-free readers can exist (see
+ * EmbAllocLoadStartWordInternal), a plain one otherwise.
+ *
+ * @param category the category that owns the word.
+ * @param word     the number of the word.
+ * @param mask     the bits to update.
+ * @param set      true to set the bits, false to clear them.
+ */
+static void EmbAllocUpdateStartWordInternal (EmbAllocBlockCategory* category,
+    size_t word, uint64_t mask, bool set)
+{
+    uint64_t* start_word = &EMB_ALLOC_START_BITMAP_WORD (category, word);
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+    if (category->concurrent_start_bitmap) {
+        if (set) {
+            __atomic_fetch_or (start_word, mask, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_and (start_word, ~mask, __ATOMIC_RELAXED);
+        }
+        return;
+    }
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+    if (set) {
+        *start_word |= mask;
+    } else {
+        *start_word &= ~mask;
+    }
+}
+
+/**
+ * @brief Tests whether a block is recorded as a live allocation head.
+ *
+ * The allocation-start bitmap holds one bit per block, set ONLY on the first (head)
+ * block of a live allocation. It is the out-of-band oracle that defeats forged
+ * inner-block frees: a multi-block allocation's inner-block header (start marker,
+ * use_count, data_size, end marker) is overlaid by user data and can be forged to
  * look like a valid 1-block allocation, but the start bitmap is not addressable by
  * the caller -- only a genuine head carries the bit. EmbAllocGetCategoryForPtr
  * requires this bit before accepting a Free/Realloc pointer, which also rejects
@@ -396,12 +1277,11 @@ static void EmbAllocMarkBlocksInternal (EmbAllocBlockCategory* category,
 static bool EmbAllocBlockIsAllocStartInternal (const EmbAllocBlockCategory* category,
     const void* block)
 {
-    const unsigned char* bitmap = (const unsigned char*) category->alloc_start_bitmap;
     size_t index;
 
     /** Defensive bounds check (see EmbAllocBlockIsFreeInternal): an out-of-range block
      *  or empty category reports "not a start" instead of indexing out of range. */
-    if ((NULL == bitmap) ||
+    if ((NULL == category->alloc_start_bitmap) ||
         ((uintptr_t) block < (uintptr_t) category->start_address) ||
         ((uintptr_t) block > (uintptr_t) category->last_address)) {
         return false;
@@ -409,7 +1289,8 @@ static bool EmbAllocBlockIsAllocStartInternal (const EmbAllocBlockCategory* cate
 
     /** A set bit means this block is the head of a live allocation. */
     index = EmbAllocBlockIndexInternal (category, block);
-    return (0 != (bitmap [index >> 3] & (unsigned char) (1u << (index & 7u))));
+    return (0 != (EmbAllocLoadStartWordInternal (category, index / EMB_ALLOC_BITMAP_WORD_BITS) &
+        (UINT64_C (1) << (index % EMB_ALLOC_BITMAP_WORD_BITS))));
 }
 
 /**
@@ -428,31 +1309,30 @@ static bool EmbAllocBlockIsAllocStartInternal (const EmbAllocBlockCategory* cate
 static void EmbAllocSetAllocStartInternal (EmbAllocBlockCategory* category,
     const void* block, bool is_start)
 {
-    unsigned char* bitmap = (unsigned char*) category->alloc_start_bitmap;
-    size_t index = EmbAllocBlockIndexInternal (category, block);
-    unsigned char mask;
+    size_t index = 0;
 
     /** Empty category (no blocks): nothing to track. */
-    if (NULL == bitmap) {
+    if (NULL == category->alloc_start_bitmap) {
         return;
     }
 
     /** Single head bit: OR-in the mask to set it, AND-NOT to clear it. */
-    mask = (unsigned char) (1u << (index & 7u));
-    if (is_start) {
-        bitmap [index >> 3] = (unsigned char) (bitmap [index >> 3] | mask);
-    } else {
-        bitmap [index >> 3] = (unsigned char) (bitmap [index >> 3] & (unsigned char) ~mask);
-    }
+    index = EmbAllocBlockIndexInternal (category, block);
+    EmbAllocUpdateStartWordInternal (category, index / EMB_ALLOC_BITMAP_WORD_BITS,
+        UINT64_C (1) << (index % EMB_ALLOC_BITMAP_WORD_BITS), is_start);
 }
 
 /**
  * @brief Finds the first genuinely free block at or after a starting block.
  *
- * Walks the category's blocks from @p from up to and including the absolute last
- * block, returning the first whose free-bitmap bit is clear. The scan is bounded by
- * last_address (the category's fixed last block), NOT by the drift-prone
- * last_free_address hint, so it stays correct even when that hint is stale.
+ * Scans the category's free bitmap one 64-bit word at a time from @p from up to the
+ * absolute last block: all-ones (fully occupied) words are skipped (with a single
+ * compare each, or wholesale through the summary levels of a large category -- see
+ * EmbAllocNextFreeWordInternal), and the first clear bit of the first word that has
+ * one is located with EmbAllocCountTrailingZerosInternal. The scan is bounded by the bitmap length
+ * (i.e. by last_address, the category's fixed last block), NOT by the drift-prone
+ * last_free_address hint, so it stays correct even when that hint is stale. The
+ * padding bits past total_blocks are permanently set, so they are never reported.
  *
  * @param category the category to scan. A NULL start_address (empty category) yields
  *                 NULL.
@@ -464,24 +1344,311 @@ static void EmbAllocSetAllocStartInternal (EmbAllocBlockCategory* category,
 static void* EmbAllocFirstFreeFromInternal (const EmbAllocBlockCategory* category,
     void* from)
 {
-    unsigned char* candidate = (unsigned char*) from;
-
-    /** Nothing to scan for an empty category or a NULL starting point. */
-    if ((NULL == from) || (NULL == category->start_address)) {
+    size_t index = 0;
+    size_t word = 0;
+    size_t word_count = 0;
+    uint64_t free_bits = 0;
+
+    /** Nothing to scan for an empty category or a NULL / out-of-range starting point. */
+    if ((NULL == from) || (NULL == category->free_bitmap) ||
+        ((uintptr_t) from < (uintptr_t) category->start_address) ||
+        ((uintptr_t) from > (uintptr_t) category->last_address)) {
         return NULL;
     }
 
-    /** Step block-by-block up to the absolute last block; return the first free one. */
-    while ((uintptr_t) candidate <= (uintptr_t) category->last_address) {
-        if (EmbAllocBlockIsFreeInternal (category, candidate)) {
-            return (void*) candidate;
+    index = EmbAllocBlockIndexInternal (category, from);
+    word = index / EMB_ALLOC_BITMAP_WORD_BITS;
+    word_count = EMB_ALLOC_CATEGORY_BITMAP_WORDS (category->total_blocks);
+
+    /** First word: ignore the blocks below `from` by treating them as occupied. */
+    free_bits = ~EMB_ALLOC_FREE_BITMAP_WORD (category, word) &
+        (~UINT64_C (0) << (index % EMB_ALLOC_BITMAP_WORD_BITS));
+
+    /** Skip fully occupied words; the first non-zero free mask holds the answer. */
+    if (0 == free_bits) {
+        word = EmbAllocNextFreeWordInternal (category, word + 1);
+
+        if (word >= word_count) {
+            return NULL;
+        }
+        free_bits = ~EMB_ALLOC_FREE_BITMAP_WORD (category, word);
+    }
+
+    return EmbAllocBlockFromIndexInternal (category,
+        (word * EMB_ALLOC_BITMAP_WORD_BITS) + EmbAllocCountTrailingZerosInternal (free_bits));
+}
+
+/**
+ * @brief Finds the first run of @p count consecutive free blocks at or after a block index.
+ *
+ * Word-parallel search over the free bitmap (a set bit is an occupied block):
+ *   - a run that crosses word boundaries is tracked as a carry: the free bits reaching
+ *     the top of the previous words, extended by whole free words and closed by the
+ *     trailing free bits (count-trailing-zeros) of the next partially occupied word;
+ *   - a run that fits inside one word is detected with shift-and-AND: after ANDing
+ *     the free mask with itself shifted right by 1, 2, 4, ... (count - 1 positions in
+ *     total), bit i is still set iff bits [i, i + count) are all free;
+ *   - fully occupied words break the carry and are skipped in bulk (through the
+ *     summary levels when the category has them).
+ * The cost is O(words) rather than O(blocks), plus O(log count) per partial word.
+ *
+ * @param category  the category to search; must have a free bitmap.
+ * @param from      the first block index a run may start at.
+ * @param count     the run length in blocks; must be > 0.
+ * @param run_start receives the index of the first block of the run on success.
+ * @return true if a run was found, false otherwise.
+ * @note The padding bits past total_blocks are permanently set, so a run never
+ *       extends past the category's last block.
+ */
+static bool EmbAllocFindFreeRunInternal (const EmbAllocBlockCategory* category,
+    size_t from, size_t count, size_t* run_start)
+{
+    size_t word_count = EMB_ALLOC_CATEGORY_BITMAP_WORDS (category->total_blocks);
+    size_t word = from / EMB_ALLOC_BITMAP_WORD_BITS;
+    size_t carry = 0;
+    size_t carry_start = 0;
+    uint64_t free_bits = 0;
+
+    if (from >= category->total_blocks) {
+        return false;
+    }
+
+    /** First word: ignore the blocks below `from` by treating them as occupied. */
+    free_bits = ~EMB_ALLOC_FREE_BITMAP_WORD (category, word) &
+        (~UINT64_C (0) << (from % EMB_ALLOC_BITMAP_WORD_BITS));
+
+    for (;;) {
+        size_t word_base = word * EMB_ALLOC_BITMAP_WORD_BITS;
+
+        if (~UINT64_C (0) == free_bits) {
+            /** Whole word free: extend (or open) the carried run. */
+            if (0 == carry) {
+                carry_start = word_base;
+            }
+            carry += EMB_ALLOC_BITMAP_WORD_BITS;
+
+            if (carry >= count) {
+                *run_start = carry_start;
+                return true;
+            }
+        } else if (0 == free_bits) {
+            /** Whole word occupied: the carried run ends, jump to the next word with a
+             * free block. */
+            carry = 0;
+            word = EmbAllocNextFreeWordInternal (category, word + 1);
+
+            if ((word >= word_count) ||
+                ((category->total_blocks - (word * EMB_ALLOC_BITMAP_WORD_BITS)) < count)) {
+                return false;
+            }
+            free_bits = ~EMB_ALLOC_FREE_BITMAP_WORD (category, word);
+            continue;
+        } else {
+            /** Partially occupied word: close the carried run with its low free bits... */
+            size_t low_free = EmbAllocCountTrailingZerosInternal (~free_bits);
+
+            if ((carry + low_free) >= count) {
+                *run_start = carry ? carry_start : word_base;
+                return true;
+            }
+
+            /** ...then look for a run entirely inside the word... */
+            if (count <= EMB_ALLOC_BITMAP_WORD_BITS) {
+                uint64_t starts = free_bits;
+                size_t length = 1;
+
+                while ((length < count) && (0 != starts)) {
+                    size_t shift = (length < (count - length)) ? length : (count - length);
+
+                    starts &= starts >> shift;
+                    length += shift;
+                }
+
+                if (0 != starts) {
+                    *run_start = word_base + EmbAllocCountTrailingZerosInternal (starts);
+                    return true;
+                }
+            }
+
+            /** ...and carry the free bits reaching the top of the word. */
+            carry = EmbAllocCountLeadingZerosInternal (~free_bits);
+            carry_start = word_base + EMB_ALLOC_BITMAP_WORD_BITS - carry;
+        }
+
+        if (++word >= word_count) {
+            return false;
+        }
+        free_bits = ~EMB_ALLOC_FREE_BITMAP_WORD (category, word);
+    }
+}
+
+/**
+ * @brief Tests whether every block of a run is free, one bitmap word at a time.
+ *
+ * @param category the category that owns the run; must have a free bitmap.
+ * @param from     the index of the first block of the run.
+ * @param count    the run length in blocks.
+ * @return true iff [from, from + count) lies inside the category and all its blocks are
+ *         free; false otherwise (including a run that would pass the last block).
+ */
+static bool EmbAllocRunIsFreeInternal (const EmbAllocBlockCategory* category,
+    size_t from, size_t count)
+{
+    if ((from > category->total_blocks) || (count > (category->total_blocks - from))) {
+        return false;
+    }
+
+    while (count) {
+        size_t bit = from % EMB_ALLOC_BITMAP_WORD_BITS;
+        size_t span = EMB_ALLOC_BITMAP_WORD_BITS - bit;
+        uint64_t mask = ~UINT64_C (0);
+
+        /** Bits [bit, bit + span) of this word belong to the run; any set one fails. */
+        if (span > count) {
+            span = count;
+        }
+        if (span < EMB_ALLOC_BITMAP_WORD_BITS) {
+            mask = ((UINT64_C (1) << span) - 1u) << bit;
+        }
+
+        if (0 != (EMB_ALLOC_FREE_BITMAP_WORD (category, from / EMB_ALLOC_BITMAP_WORD_BITS) & mask)) {
+            return false;
         }
 
-        candidate = candidate +
-            EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size);
+        from += span;
+        count -= span;
     }
 
-    return NULL;
+    return true;
+}
+
+/**
+ * @brief Counts the free blocks directly below a block index.
+ *
+ * Walks the free bitmap down from @p index - 1 a word at a time (count-leading zeros
+ * on the occupied bits) until an occupied block, the category start or @p limit.
+ *
+ * @param category the category to inspect; must have a free bitmap.
+ * @param index    the block index just above the counted blocks.
+ * @param limit    the count at which the walk may stop.
+ * @return the number of consecutive free blocks ending at @p index - 1, at most @p limit.
+ */
+static size_t EmbAllocFreeBlocksBeforeInternal (const EmbAllocBlockCategory* category,
+    size_t index, size_t limit)
+{
+    size_t length = 0;
+
+    /** Bits [0, bit] of each word, highest first. */
+    while (index && (length < limit)) {
+        size_t bit = (index - 1) % EMB_ALLOC_BITMAP_WORD_BITS;
+        uint64_t occupied = EmbAllocLoadBitmapWordInternal (
+            &EMB_ALLOC_FREE_BITMAP_WORD (category, (index - 1) / EMB_ALLOC_BITMAP_WORD_BITS)) &
+            (~UINT64_C (0) >> (EMB_ALLOC_BITMAP_WORD_BITS - 1 - bit));
+
+        if (0 != occupied) {
+            length += bit - (EMB_ALLOC_BITMAP_WORD_BITS - 1 -
+                EmbAllocCountLeadingZerosInternal (occupied));
+            break;
+        }
+        length += bit + 1;
+        index -= bit + 1;
+    }
+
+    return (length < limit) ? length : limit;
+}
+
+/**
+ * @brief Counts the free blocks starting at a block index.
+ *
+ * Walks the free bitmap up from @p index a word at a time (count-trailing zeros on
+ * the occupied bits) until an occupied block or @p limit. The permanently set padding
+ * bits stop the walk at the category's last block. Both walks read the words
+ * atomically, as the lock-free frees measure their merged run with them.
+ *
+ * @param category the category to inspect; must have a free bitmap.
+ * @param index    the first block index to count.
+ * @param limit    the count at which the walk may stop.
+ * @return the number of consecutive free blocks starting at @p index, at most @p limit.
+ */
+static size_t EmbAllocFreeBlocksAfterInternal (const EmbAllocBlockCategory* category,
+    size_t index, size_t limit)
+{
+    size_t length = 0;
+
+    /** Bits [bit, 64) of each word, lowest first. */
+    while ((index < category->total_blocks) && (length < limit)) {
+        size_t bit = index % EMB_ALLOC_BITMAP_WORD_BITS;
+        uint64_t occupied = EmbAllocLoadBitmapWordInternal (
+            &EMB_ALLOC_FREE_BITMAP_WORD (category, index / EMB_ALLOC_BITMAP_WORD_BITS)) &
+            (~UINT64_C (0) << bit);
+
+        if (0 != occupied) {
+            length += EmbAllocCountTrailingZerosInternal (occupied) - bit;
+            break;
+        }
+        length += EMB_ALLOC_BITMAP_WORD_BITS - bit;
+        index += EMB_ALLOC_BITMAP_WORD_BITS - bit;
+    }
+
+    return (length < limit) ? length : limit;
+}
+
+/**
+ * @brief Measures the free run that contains a span of just-freed blocks.
+ *
+ * @param category the category that owns the span; must have a free bitmap.
+ * @param from     the index of the first block of the span (already marked free).
+ * @param count    the span length in blocks.
+ * @return the length of the maximal free run covering [from, from + count).
+ */
+static size_t EmbAllocFreeRunAroundInternal (const EmbAllocBlockCategory* category,
+    size_t from, size_t count)
+{
+    return EmbAllocFreeBlocksBeforeInternal (category, from, SIZE_MAX) + count +
+        EmbAllocFreeBlocksAfterInternal (category, from + count, SIZE_MAX);
+}
+
+/**
+ * @brief Measures the longest run of consecutive free blocks in a category.
+ *
+ * Exact counterpart of the max_free_run bound, for the statistics: fully free and
+ * fully occupied words are handled as a whole, partially occupied words bit by bit.
+ *
+ * @param category the category to measure. An empty category yields 0.
+ * @return the length of the longest free run, in blocks.
+ */
+static size_t EmbAllocLongestFreeRunInternal (const EmbAllocBlockCategory* category)
+{
+    size_t word_count = EMB_ALLOC_CATEGORY_BITMAP_WORDS (category->total_blocks);
+    size_t longest = 0;
+    size_t current = 0;
+    size_t word = 0;
+
+    for (word = 0; (NULL != category->free_bitmap) && (word < word_count); word++) {
+        uint64_t occupied = EMB_ALLOC_FREE_BITMAP_WORD (category, word);
+
+        if (0 == occupied) {
+            current += EMB_ALLOC_BITMAP_WORD_BITS;
+        } else if (~UINT64_C (0) == occupied) {
+            current = 0;
+        } else {
+            unsigned bit = 0;
+
+            for (bit = 0; bit < EMB_ALLOC_BITMAP_WORD_BITS; bit++) {
+                if (occupied & (UINT64_C (1) << bit)) {
+                    current = 0;
+                } else if (++current > longest) {
+                    longest = current;
+                }
+            }
+        }
+
+        if (current > longest) {
+            longest = current;
+        }
+    }
+
+    return longest;
 }
 
 /**
@@ -526,8 +1693,37 @@ void ClearMempoolErrorInternal (EmbAllocMempoolAuxData* aux_data)
      * Callers should make sure that the params are valid.
      */
 
+    EmbAllocErrorCallback error_callback_fn = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (
+        EMB_ALLOC_GET_MEMPOOL_FROM_AUX_DATA_PTR (aux_data))->error_callback_fn;
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+    /** Most calls find no error to clear, and skip the error lock. */
+    if (aux_data->thread_sync_mutex_initialized &&
+        (kEmbAllocNoErr == __atomic_load_n (&(aux_data->last_error), __ATOMIC_RELAXED))) {
+        return;
+    }
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocAcquireLock (&(aux_data->error_sync_mutex.lock))) {
+        if (NULL != error_callback_fn) {
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+        }
+        return;
+    }
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+    __atomic_store_n (&(aux_data->last_error), kEmbAllocNoErr, __ATOMIC_RELAXED);
+#else
     aux_data->last_error = kEmbAllocNoErr;
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
     memset (aux_data->last_error_message, 0, sizeof (aux_data->last_error_message));
+
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocReleaseLock (&(aux_data->error_sync_mutex.lock)) &&
+        (NULL != error_callback_fn)) {
+        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+    }
 }
 
 void EmbAllocSetErrorInternal (void* mempool, EmbAllocErrors error,
@@ -548,7 +1744,20 @@ void EmbAllocSetErrorInternal (void* mempool, EmbAllocErrors error,
     aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
     settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
 
+    /** The error lock is a leaf: it is taken under any category locks the caller holds. */
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocAcquireLock (&(aux_data->error_sync_mutex.lock))) {
+        if (NULL != settings->error_callback_fn) {
+            settings->error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+        }
+        return;
+    }
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+    __atomic_store_n (&(aux_data->last_error), error, __ATOMIC_RELAXED);
+#else
     aux_data->last_error = error;
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
     memset (aux_data->last_error_message, 0, sizeof (aux_data->last_error_message));
     strncpy (aux_data->last_error_message, error_message, sizeof (aux_data->last_error_message));
     aux_data->last_error_message [EMB_ALLOC_ERROR_MESSAGE_SIZE - 1] = '\0';
@@ -565,9 +1774,9 @@ void EmbAllocSetErrorInternal (void* mempool, EmbAllocErrors error,
     }
 
     if (NULL != settings->error_callback_fn) {
-        /** Synchronous, possibly with the pool mutex held: the callback must not
+        /** Synchronous, possibly with the pool mutexes held: the callback must not
          * re-enter any EmbAlloc function on this pool (see EmbAllocErrorCallback). */
-        settings->error_callback_fn (aux_data->last_error, aux_data->last_error_message);
+        settings->error_callback_fn (error, aux_data->last_error_message);
     }
 
     if (strlen (settings->error_dump_file_name)) {
@@ -577,14 +1786,28 @@ void EmbAllocSetErrorInternal (void* mempool, EmbAllocErrors error,
             fputs ("\n", error_file);
             fputs (aux_data->last_error_message, error_file);
             fputs ("\n", error_file);
-            EmbAllocDumpMempoolInternal (mempool,  EmbAllocGetMemoryRequirementsInternal (settings), 
-                    error_file, memory_offset);
+            /**
+             * With its category locks, a threadsafe mempool is only safe to read in the
+             * categories this thread has locked.
+             */
+            if (aux_data->thread_sync_mutex_initialized) {
+                EmbAllocDumpLockedCategoriesInternal (mempool, error_file, memory_offset);
+            } else {
+                EmbAllocDumpMempoolInternal (mempool,  EmbAllocGetMemoryRequirementsInternal (settings), 
+                        error_file, memory_offset);
+            }
             fflush (error_file);
             fclose (error_file);
         } else {
             perror ("Error writing the error message in the mempool error dump file");
         }
     }  
+
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocReleaseLock (&(aux_data->error_sync_mutex.lock)) &&
+        (NULL != settings->error_callback_fn)) {
+        settings->error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+    }
 }
 
 #define SIZE_T_SUM_OVERFLOW(lhs, rhs) ((lhs) > (SIZE_MAX - (rhs)))
@@ -597,6 +1820,7 @@ bool EmbAllocSanitizeSettingsInternal (EmbAllocMemPoolSettings* settings, bool *
      * Callers should make sure that the params are valid.
      */
     bool error = false;
+    bool inconsistent_policy = false;
     size_t initial_total_size = settings->total_size;
     settings->total_size = 0;
 
@@ -673,15 +1897,45 @@ bool EmbAllocSanitizeSettingsInternal (EmbAllocMemPoolSettings* settings, bool *
         }
     }
 
-    /** 
-     * For the moment just align the total size with the one deducted 
-     * from the blockes counters. The total size is adjusted.
-     * If this logic needs to change in the future, 
-     * then this function needs to be adjusted.
-     */
-    *overflow = error;
-    return (!error && (settings->total_size == initial_total_size));
-}
+    /** An unknown placement policy falls back to the default one. */
+    switch (settings->placement_policy) {
+        case kEmbAllocPlaceMaxFreeAfter:
+        case kEmbAllocPlaceBestFit:
+        case kEmbAllocPlaceLowestOccupancyBefore:
+        case kEmbAllocPlaceLowestOccupancyAfter:
+        case kEmbAllocPlaceSingleBlockFirst:
+            break;
+        default:
+            settings->placement_policy = kEmbAllocPlaceMaxFreeAfter;
+            inconsistent_policy = true;
+            break;
+    }
+
+    /**
+     * So does an unknown lock backend. A known one that the platform lacks is
+     * replaced when the locks are initialized, without an error.
+     */
+    switch (settings->lock_backend) {
+        case kEmbAllocLockBackendMutex:
+        case kEmbAllocLockBackendSpin:
+        case kEmbAllocLockBackendAdaptiveMutex:
+        case kEmbAllocLockBackendFutex:
+            break;
+        default:
+            settings->lock_backend = kEmbAllocLockBackendMutex;
+            inconsistent_policy = true;
+            break;
+    }
+
+    /** 
+     * For the moment just align the total size with the one deducted 
+     * from the blockes counters. The total size is adjusted.
+     * If this logic needs to change in the future, 
+     * then this function needs to be adjusted.
+     */
+    *overflow = error;
+    return (!error && !inconsistent_policy && (settings->total_size == initial_total_size));
+}
 
 size_t EmbAllocGetMemoryRequirementsInternal (const EmbAllocMemPoolSettings* settings)
 {
@@ -690,40 +1944,68 @@ size_t EmbAllocGetMemoryRequirementsInternal (const EmbAllocMemPoolSettings* set
      * Callers should make sure that the params are valid.
      */
     size_t total_size = EMB_ALLOC_MEMPOOL_CONTROL_ALIGN_SIZE;
-    const size_t block_counts [EMB_ALLOC_NUM_BLOCK_CATEGORIES] = {
-        settings->num_32_bytes_blocks,  settings->num_64_bytes_blocks,
-        settings->num_128_bytes_blocks, settings->num_256_bytes_blocks,
-        settings->num_512_bytes_blocks, settings->num_1k_bytes_blocks,
-        settings->num_2k_bytes_blocks,  settings->num_4k_bytes_blocks };
-    size_t total_blocks = 0;
-    size_t control_size = 0;
+    size_t blocks_size = 0;
     size_t bitmap_size = 0;
+    size_t summary_size = 0;
+    size_t counters_size = 0;
     unsigned char i = 0;
 
-    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {        /** checked count sum */
-        if (SIZE_T_SUM_OVERFLOW (total_blocks, block_counts [i])) { return 0; }
-        total_blocks += block_counts [i];
-        /** Per-category, byte-aligned free bitmap (ceil(n/8) bytes). ceil(n/8) <= n,
-         * so this running sum stays <= total_blocks (sum-overflow-checked just above).
-         * The (n + 7) inside EMB_ALLOC_CATEGORY_BITMAP_BYTES could only wrap for n
-         * near SIZE_MAX, which EmbAllocSanitizeSettingsInternal (run earlier in
-         * EmbAllocCreate) already rejects via its count*block_size overflow check --
-         * so it is unreachable here. */
-        bitmap_size += EMB_ALLOC_CATEGORY_BITMAP_BYTES (block_counts [i]);
-    }
-    if (SIZE_T_MUL_OVERFLOW (total_blocks, EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE)) { return 0; }
-    control_size = total_blocks * EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE;
-    if (SIZE_T_SUM_OVERFLOW (total_size, control_size)) { return 0; }
-    total_size += control_size;
-    if (SIZE_T_SUM_OVERFLOW (total_size, settings->total_size)) { return 0; }
-    total_size += settings->total_size;
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        size_t data_size = 0;
+        size_t num_blocks = 0;
+        size_t stride = 0;
+
+        /** Checked sum of the category sizes (blocks and block control bytes). */
+        EmbAllocGetCategorySettingsInternal (settings, i, &data_size, &num_blocks);
+        if (0 == data_size) { return 0; }
+        stride = data_size + EMB_ALLOC_BLOCK_CONTROL_SIZE_FROM_SETTINGS_PTR (settings);
+        if (SIZE_T_MUL_OVERFLOW (num_blocks, stride)) { return 0; }
+        if (SIZE_T_SUM_OVERFLOW (blocks_size, num_blocks * stride)) { return 0; }
+        blocks_size += num_blocks * stride;
+        /** A power-of-two stride category starts at a multiple of its stride. The
+         * blocks before it end on an EMB_ALLOC_ALIGN_AMOUNT boundary, so at most
+         * stride - EMB_ALLOC_ALIGN_AMOUNT bytes of padding go in front of it. */
+        if (settings->power_of_two_strides && num_blocks) {
+            if (SIZE_T_SUM_OVERFLOW (blocks_size, stride - EMB_ALLOC_ALIGN_AMOUNT)) { return 0; }
+            blocks_size += stride - EMB_ALLOC_ALIGN_AMOUNT;
+        }
+        /** Per-category free bitmap, rounded up to whole 64-bit words
+         * (8 * ceil(n/64) bytes, i.e. at most n/8 + 8). The (n + 63) inside
+         * EMB_ALLOC_CATEGORY_BITMAP_WORDS could only wrap for n near SIZE_MAX, which
+         * EmbAllocSanitizeSettingsInternal (run earlier in EmbAllocCreate) already
+         * rejects via its count*block_size overflow check -- so it is unreachable here. */
+        if (SIZE_T_SUM_OVERFLOW (bitmap_size, EMB_ALLOC_CATEGORY_BITMAP_BYTES (num_blocks))) {
+            return 0;
+        }
+        bitmap_size += EMB_ALLOC_CATEGORY_BITMAP_BYTES (num_blocks);
+        /** Summary levels of the large categories (about 1/64 of the free bitmap). */
+        summary_size += EMB_ALLOC_CATEGORY_SUMMARY_BYTES (num_blocks);
+        /** The use_count and data_size arrays of the compact layout. The blocks are
+         * at least 32 bytes, so the count fits once the blocks have been summed. */
+        if (settings->compact_metadata) {
+            counters_size += 2 * num_blocks * sizeof (EmbAllocCounter);
+        }
+    }
+    /** Every block count, size and offset of the categories fits an EmbAllocCounter,
+     * and none of them equals EMB_ALLOC_COUNTER_NOT_SET. */
+    if (blocks_size >= (size_t) EMB_ALLOC_COUNTER_NOT_SET) { return 0; }
+    if (SIZE_T_SUM_OVERFLOW (total_size, blocks_size)) { return 0; }
+    total_size += blocks_size;
     /** Reserve the aligned bitmap region. It holds TWO per-block bitmaps -- the free
-     * bitmap and the allocation-start bitmap -- each Sum(ceil(n/8)) bytes. It sits
-     * after the data blocks and before the mempool end marker, so block offsets and
-     * the marker are unchanged. 2*bitmap_size cannot overflow: bitmap_size <=
-     * total_blocks <= SIZE_MAX/EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE (guaranteed by the
-     * control-size multiply check above). */
-    bitmap_size = EMB_ALLOC_ALIGN_SIZE (2 * bitmap_size);
+     * bitmap and the allocation-start bitmap -- each Sum(8 * ceil(n/64)) bytes -- plus
+     * the free-bitmap summary levels. It sits after the data blocks and before the
+     * mempool end marker, so block offsets and the marker are unchanged. The summary
+     * is bounded by the bitmap size, so the final sum cannot wrap once the doubling
+     * has been checked. With metadata_before_blocks the region sits between the
+     * control data and the first block instead, padded so that the first block still
+     * starts on a cache line. */
+    if (SIZE_T_MUL_OVERFLOW (bitmap_size, 2)) { return 0; }
+    if (SIZE_T_SUM_OVERFLOW (2 * bitmap_size, summary_size)) { return 0; }
+    if (SIZE_T_SUM_OVERFLOW (2 * bitmap_size + summary_size, counters_size)) { return 0; }
+    bitmap_size = 2 * bitmap_size + summary_size + counters_size;
+    if (bitmap_size > (SIZE_MAX - EMB_ALLOC_CACHE_LINE_SIZE)) { return 0; }
+    bitmap_size = settings->metadata_before_blocks ?
+        EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (bitmap_size) : EMB_ALLOC_ALIGN_SIZE (bitmap_size);
     if (SIZE_T_SUM_OVERFLOW (total_size, bitmap_size)) { return 0; }
     total_size += bitmap_size;
 
@@ -775,27 +2057,65 @@ void EmbAllocInitializeBlockCategoriesInternal (void* mempool)
     /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
     unsigned char i = 0;
     EmbAllocBlockCategory* block_category = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
     /** Use this to calculate the start address of the first block of its kind. */
-    unsigned char* current_start_address = (unsigned char*) EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR (mempool);
+    unsigned char* current_start_address = (unsigned char*) EMB_ALLOC_GET_MEMPOOL_CONTROL_END_PTR (mempool);
+    const EmbAllocMemPoolSettings* settings = 
+        (const EmbAllocMemPoolSettings*) EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
 
     for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        size_t block_data_size = 0;
+        size_t total_blocks = 0;
+
         /** Init the block category data related to the creation settings. */
         EmbAllocGetCategorySettingsInternal (
-            (const EmbAllocMemPoolSettings*) EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool), 
+            settings, 
             i, 
-            &(block_category [i].block_data_size), 
-            &(block_category [i].total_blocks));
+            &block_data_size, 
+            &total_blocks);
+
+        /** Both fit an EmbAllocCounter (see EmbAllocGetMemoryRequirementsInternal). */
+        block_category [i].block_data_size = (EmbAllocCounter) block_data_size;
+        block_category [i].total_blocks = (EmbAllocCounter) total_blocks;
 
         block_category [i].occupied_blocks = 0;
+        /** Every block starts free, so the whole category is one run. */
+        block_category [i].max_free_run = block_category [i].total_blocks;
+        block_category [i].next_free_word = 0;
+        block_category [i].stride = (EmbAllocCounter) (block_data_size +
+            EMB_ALLOC_BLOCK_CONTROL_SIZE_FROM_SETTINGS_PTR (settings));
+        block_category [i].header_size = (EmbAllocCounter) (settings->compact_metadata ?
+            0 : EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE);
+        EmbAllocInitStrideDivisionInternal (block_category + i);
+    }
+
+    /** The block metadata goes first, if asked to, and the blocks start on the next
+     * cache line after it. */
+    if (settings->metadata_before_blocks) {
+        unsigned char* metadata_end = EmbAllocInitializeBlockMetadataInternal (
+            block_category, settings, current_start_address);
 
+        current_start_address += EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (
+            (size_t) (metadata_end - current_start_address));
+    }
+
+    aux_data->first_block = (void*) current_start_address;
+
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
         /** Init everything else that requires the above initialization as a start point. */
         if (block_category [i].total_blocks) {
+            if (settings->power_of_two_strides) {
+                size_t stride = block_category [i].stride;
+
+                current_start_address += 
+                    (stride - ((uintptr_t) current_start_address & (stride - 1))) & (stride - 1);
+            }
             block_category [i].start_address = (void*) current_start_address;
             block_category [i].first_free_address = block_category [i].start_address;
             block_category [i].last_address = (void*) 
                 (current_start_address + 
                     (   (block_category [i].total_blocks - 1) * 
-                        EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (block_category [i].block_data_size)));
+                        block_category [i].stride));
             block_category [i].last_free_address = block_category [i].last_address;
         } else {
             block_category [i].start_address = NULL;
@@ -807,48 +2127,135 @@ void EmbAllocInitializeBlockCategoriesInternal (void* mempool)
         /** Update the carry-over start address. */
         current_start_address +=
             (block_category [i].total_blocks *
-            EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (block_category [i].block_data_size));
+            block_category [i].stride);
+    }
+
+    /** The data-block region ends here, the bitmaps follow it unless they lead it. */
+    aux_data->blocks_size = (size_t)
+        (current_start_address - (unsigned char*) aux_data->first_block);
+
+    if (!settings->metadata_before_blocks) {
+        EmbAllocInitializeBlockMetadataInternal (block_category, settings, current_start_address);
     }
+}
+
+unsigned char* EmbAllocInitializeBlockMetadataInternal (EmbAllocBlockCategory* block_category,
+    const EmbAllocMemPoolSettings* settings, unsigned char* metadata_start)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+    unsigned char* bitmap_cursor = metadata_start;
 
     /**
-     * Wire each category's free bitmap into the region that follows the data
-     * blocks (current_start_address now points just past the last block) and
-     * clear it so every block starts free. The whole mempool was memset to
+     * Wire each category's free bitmap into the metadata region and clear it so
+     * every block starts free. The whole mempool was memset to
      * EMB_ALLOC_INIT_VALUE earlier, so the bitmap MUST be explicitly zeroed --
      * a stray set bit would read as "occupied" and that block would never be
-     * handed out. Slices are laid out in the same per-category, byte-aligned
+     * handed out. Slices are laid out in the same per-category, word-aligned
      * order used to size the region in EmbAllocGetMemoryRequirementsInternal.
      */
-    {
-        unsigned char* bitmap_cursor = current_start_address;
 
-        /** Free bitmap slices. */
-        for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
-            if (block_category [i].total_blocks) {
-                block_category [i].free_bitmap = (void*) bitmap_cursor;
-                bitmap_cursor +=
-                    EMB_ALLOC_CATEGORY_BITMAP_BYTES (block_category [i].total_blocks);
-            } else {
-                block_category [i].free_bitmap = NULL;
-            }
+    /** Free bitmap slices. */
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        block_category [i].bitmap_word_shift = settings->interleaved_bitmaps ? 1 : 0;
+        block_category [i].concurrent_start_bitmap =
+            (EMB_ALLOC_LOCK_FREE_SUPPORTED && settings->threadsafe) ? 1 : 0;
+
+        if (block_category [i].total_blocks) {
+            block_category [i].free_bitmap = (void*) bitmap_cursor;
+            bitmap_cursor +=
+                EMB_ALLOC_CATEGORY_BITMAP_BYTES (block_category [i].total_blocks);
+        } else {
+            block_category [i].free_bitmap = NULL;
         }
 
-        /** Allocation-start bitmap slices (same per-category, byte-aligned layout,
-         * placed immediately after all the free-bitmap slices). */
-        for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
-            if (block_category [i].total_blocks) {
-                block_category [i].alloc_start_bitmap = (void*) bitmap_cursor;
-                bitmap_cursor +=
-                    EMB_ALLOC_CATEGORY_BITMAP_BYTES (block_category [i].total_blocks);
-            } else {
-                block_category [i].alloc_start_bitmap = NULL;
-            }
+        /** Interleaved: the slice holds the free and the start word of every 64 blocks,
+         * in this order, so it takes the size of both bitmaps. Every slice is then a
+         * whole number of 16-byte pairs. */
+        if (settings->interleaved_bitmaps) {
+            block_category [i].alloc_start_bitmap = (NULL == block_category [i].free_bitmap) ?
+                NULL : (block_category [i].free_bitmap + 1);
+            bitmap_cursor +=
+                EMB_ALLOC_CATEGORY_BITMAP_BYTES (block_category [i].total_blocks);
+        }
+    }
+
+    /** Allocation-start bitmap slices (same per-category, word-aligned layout,
+     * placed immediately after all the free-bitmap slices). */
+    for (i = 0; (i < EMB_ALLOC_NUM_BLOCK_CATEGORIES) && !settings->interleaved_bitmaps; i++) {
+        if (block_category [i].total_blocks) {
+            block_category [i].alloc_start_bitmap = (void*) bitmap_cursor;
+            bitmap_cursor +=
+                EMB_ALLOC_CATEGORY_BITMAP_BYTES (block_category [i].total_blocks);
+        } else {
+            block_category [i].alloc_start_bitmap = NULL;
+        }
+    }
+
+    /** Summary slices (free summary, then its top level) for the categories
+     * large enough to have them, placed after all the alloc-start slices. */
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        if (EMB_ALLOC_CATEGORY_HAS_SUMMARY (block_category [i].total_blocks)) {
+            block_category [i].free_summary = (void*) bitmap_cursor;
+            block_category [i].free_summary_top = block_category [i].free_summary +
+                EMB_ALLOC_CATEGORY_SUMMARY_WORDS (block_category [i].total_blocks);
+            bitmap_cursor +=
+                EMB_ALLOC_CATEGORY_SUMMARY_BYTES (block_category [i].total_blocks);
+        } else {
+            block_category [i].free_summary = NULL;
+            block_category [i].free_summary_top = NULL;
+        }
+    }
+
+    /** Zero all bitmaps: every block starts free and is not an allocation head. */
+    memset (metadata_start, 0, (size_t) (bitmap_cursor - metadata_start));
+
+    /** The counters of the compact layout follow the summaries. Every bitmap slice
+     * is made of whole 64-bit words, so the arrays are EmbAllocCounter aligned. They
+     * are set by EmbAllocInitializeDataBlocksInternal with the rest of the block
+     * formatting. */
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        if (settings->compact_metadata && block_category [i].total_blocks) {
+            block_category [i].use_counts = (EmbAllocCounter*) (void*) bitmap_cursor;
+            block_category [i].data_sizes = block_category [i].use_counts +
+                block_category [i].total_blocks;
+            bitmap_cursor += 2 * (size_t) block_category [i].total_blocks *
+                sizeof (EmbAllocCounter);
+        } else {
+            block_category [i].use_counts = NULL;
+            block_category [i].data_sizes = NULL;
+        }
+    }
+
+    /** Permanently mark the padding bits of each last free-bitmap word occupied,
+     * so the word scans never hand out a block past total_blocks. */
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        size_t used_bits = block_category [i].total_blocks % EMB_ALLOC_BITMAP_WORD_BITS;
+
+        if (block_category [i].total_blocks && used_bits) {
+            EMB_ALLOC_FREE_BITMAP_WORD (block_category + i,
+                EMB_ALLOC_CATEGORY_BITMAP_WORDS (block_category [i].total_blocks) - 1) =
+                ~UINT64_C (0) << used_bits;
         }
+    }
 
-        /** Zero both bitmaps: every block starts free and is not an allocation head. */
-        memset (current_start_address, 0,
-            (size_t) (bitmap_cursor - current_start_address));
+    /** Every bitmap word starts with a free bit, so the summaries start full:
+     * one set bit per free-bitmap word and one per summary word. */
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        if (NULL != block_category [i].free_summary) {
+            EmbAllocSetLowBitsInternal (block_category [i].free_summary,
+                EMB_ALLOC_CATEGORY_BITMAP_WORDS (block_category [i].total_blocks));
+            EmbAllocSetLowBitsInternal (block_category [i].free_summary_top,
+                EMB_ALLOC_CATEGORY_SUMMARY_WORDS (block_category [i].total_blocks));
+        }
     }
+
+    return bitmap_cursor;
 }
 
 void EmbAllocInitializeAuxDataInternal (void* mempool)
@@ -862,13 +2269,110 @@ void EmbAllocInitializeAuxDataInternal (void* mempool)
     const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
 
     aux_data->thread_sync_mutex_initialized = false;
+    aux_data->lock_free_single_blocks = false;
+    aux_data->remote_free_queues = false;
+    aux_data->owner_thread = EmbAllocGetThreadIndex ();
+    memset (aux_data->remote_frees, 0, sizeof (aux_data->remote_frees));
+    aux_data->depot = NULL;
+    aux_data->thread_cache_count = 0;
+
+    /** Resolve the placement policy once, so the allocation path only makes an indirect call. */
+    switch (settings->placement_policy) {
+        case kEmbAllocPlaceBestFit:
+            aux_data->placement_fn = EmbAllocPlaceBestFitInternal;
+            break;
+        case kEmbAllocPlaceLowestOccupancyBefore:
+            aux_data->placement_fn = EmbAllocPlaceLowestOccupancyBeforeInternal;
+            break;
+        case kEmbAllocPlaceLowestOccupancyAfter:
+            aux_data->placement_fn = EmbAllocPlaceLowestOccupancyAfterInternal;
+            break;
+        case kEmbAllocPlaceSingleBlockFirst:
+            aux_data->placement_fn = NULL;
+            break;
+        case kEmbAllocPlaceMaxFreeAfter:
+        default:
+            aux_data->placement_fn = EmbAllocPlaceMaxFreeAfterInternal;
+            break;
+    }
+
+    /**
+     * Size-to-category table. For each size class take the smallest non-empty
+     * category that holds it in one block. That category is the allocation's
+     * unconditional choice when it is the exact best fit, and otherwise only when no
+     * placement decision can arise: under kEmbAllocPlaceSingleBlockFirst, or when no
+     * smaller non-empty category could offer a multi-block run instead.
+     */
+    {
+        const EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+        size_t size_class = 0;
+
+        for (size_class = 0; size_class < EMB_ALLOC_SIZE_CLASS_COUNT; size_class++) {
+            size_t size = (size_class + 1) * EMB_ALLOC_SIZE_CLASS_BYTES;
+            unsigned char best_fit = 0;
+            unsigned char preferred = 0;
+            bool smaller_blocks = false;
+
+            while ((best_fit < EMB_ALLOC_NUM_BLOCK_CATEGORIES) &&
+                (categories [best_fit].block_data_size < size)) {
+                smaller_blocks = smaller_blocks || (0 != categories [best_fit].total_blocks);
+                best_fit++;
+            }
+
+            preferred = best_fit;
+            while ((preferred < EMB_ALLOC_NUM_BLOCK_CATEGORIES) &&
+                (0 == categories [preferred].total_blocks)) {
+                preferred++;
+            }
 
-    /** Mark the mutex as being initialized only if the mempool is threadsafe 
-     * and the initialization completed successfully. 
+            if ((preferred != best_fit) && (NULL != aux_data->placement_fn) && smaller_blocks) {
+                preferred = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+            }
+
+            aux_data->size_class_category [size_class] = preferred;
+        }
+    }
+
+    /** Mark the mutexes as being initialized only if the mempool is threadsafe 
+     * and the initialization of all of them completed successfully. 
      */
     if (settings->threadsafe) {
-        aux_data->thread_sync_mutex_initialized = 
-            (0 == EmbAllocInitMutex (&(aux_data->thread_sync_mutex)));
+        /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+        unsigned char i = 0;
+
+        if (0 == EmbAllocInitLock (&(aux_data->thread_sync_mutex.lock), settings->lock_backend)) {
+            if (0 == EmbAllocInitLock (&(aux_data->error_sync_mutex.lock), settings->lock_backend)) {
+                for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+                    aux_data->category_locks [i].lock.lock_free_excluded = false;
+                    aux_data->category_locks [i].lock.lock_free_calls = 0;
+                    aux_data->category_locks [i].lock.holder_thread = EMB_ALLOC_NO_OWNER_THREAD;
+
+                    if (EmbAllocInitLock (&(aux_data->category_locks [i].lock.mutex), settings->lock_backend)) {
+                        break;
+                    }
+                }
+
+                aux_data->thread_sync_mutex_initialized = (EMB_ALLOC_NUM_BLOCK_CATEGORIES == i);
+
+                if (!aux_data->thread_sync_mutex_initialized) {
+                    /** Roll back: the mempool is created without thread sync. */
+                    while (0 != i) {
+                        EmbAllocDestroyLock (&(aux_data->category_locks [--i].lock.mutex));
+                    }
+
+                    EmbAllocDestroyLock (&(aux_data->error_sync_mutex.lock));
+                }
+            }
+
+            if (!aux_data->thread_sync_mutex_initialized) {
+                EmbAllocDestroyLock (&(aux_data->thread_sync_mutex.lock));
+            }
+        }
+
+        aux_data->lock_free_single_blocks = EMB_ALLOC_LOCK_FREE_SUPPORTED &&
+            aux_data->thread_sync_mutex_initialized && settings->lock_free_single_blocks;
+        aux_data->remote_free_queues = EMB_ALLOC_LOCK_FREE_SUPPORTED &&
+            aux_data->thread_sync_mutex_initialized && settings->remote_free_queues;
     }
 
     /** No errors */
@@ -888,37 +2392,18 @@ void EmbAllocInitializeDataBlocksInternal (void* mempool)
 
     /**
      * Stamp every data block in every category into the "free / unallocated" state:
-     * write its start and end padding markers and set both the use_count and the
-     * data_size slots to EMB_ALLOC_VALUE_NOT_SET. The out-of-band free and start
-     * bitmaps are zeroed separately (in EmbAllocInitializeBlockCategoriesInternal), so
-     * together every block starts out free and not an allocation head.
+     * write its start and end padding markers (the compact layout has none) and set
+     * both the use_count and the data_size slots to EMB_ALLOC_COUNTER_NOT_SET. The
+     * out-of-band free and start bitmaps are zeroed separately (in
+     * EmbAllocInitializeBlockCategoriesInternal), so together every block starts out
+     * free and not an allocation head.
      */
     for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
         size_t j = 0;
 
         for (j = 0; j < block_category [i].total_blocks; j++) {
-            unsigned char* current_block_address = (unsigned char*) block_category [i].start_address + 
-                (j * EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (block_category [i].block_data_size));
-            size_t* used_block_count = EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (current_block_address);
-            size_t* data_size = EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (current_block_address);
-
-            /** 
-             * Add the block start padding marker.
-             * kEmbAllocBlockStart is definitely smaller or equal than EMB_ALLOC_ALIGN_AMOUNT.
-             */
-            memcpy ((void*) current_block_address, kEmbAllocBlockStart, 
-                EMB_ALLOC_ALIGN_AMOUNT);
-            /** 
-             * Add the block end padding marker.
-             * kEmbAllocBlockEnd is definitely smaller or equal than EMB_ALLOC_ALIGN_AMOUNT.
-             */
-            memcpy (EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (current_block_address, 
-                        block_category [i].block_data_size), 
-                kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT);
-
-
-            *used_block_count = EMB_ALLOC_VALUE_NOT_SET;
-            *data_size = EMB_ALLOC_VALUE_NOT_SET;
+            EmbAllocFormatFreeBlockInternal (block_category + i,
+                EmbAllocBlockFromIndexInternal (block_category + i, j));
         }
     }
 }
@@ -983,6 +2468,14 @@ void EmbAllocGetCategorySettingsInternal (const EmbAllocMemPoolSettings* setting
             *num_blocks = 0;
         }
     }
+
+    /** The stride padding is usable payload (0 if the stride does not fit). */
+    if (settings->power_of_two_strides && *data_size) {
+        size_t control_size = EMB_ALLOC_BLOCK_CONTROL_SIZE_FROM_SETTINGS_PTR (settings);
+        size_t stride = EmbAllocPowerOfTwoStrideInternal (*data_size + control_size);
+
+        *data_size = stride ? (stride - control_size) : 0;
+    }
 }
 
 void EmbAllocDumpMempoolInternal (void* mempool, size_t mempool_size,
@@ -993,9 +2486,7 @@ void EmbAllocDumpMempoolInternal (void* mempool, size_t mempool_size,
      * Callers should make sure that the params are valid.
      */
 
-    size_t i = 0;
     FILE* appendable_file = file;
-    unsigned char* printable_mempool = (unsigned char*) mempool;
     const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
 
     if ((NULL == file) &&
@@ -1014,24 +2505,110 @@ void EmbAllocDumpMempoolInternal (void* mempool, size_t mempool_size,
 
     fprintf (appendable_file, "Mempool dump at location 0x%p (%zu lines)",
         mempool, (mempool_size / EMB_ALLOC_ALIGN_AMOUNT));
+    EmbAllocDumpRegionInternal (mempool, 0, mempool_size, appendable_file, mark_point_idx);
+    fprintf (appendable_file, "\n");
+
+    if (NULL == file) {
+        fflush (appendable_file);
+        fclose (appendable_file);
+    }
+}
+
+void EmbAllocDumpRegionInternal (void* mempool, size_t offset, size_t size,
+    FILE* file, size_t mark_point_idx)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    size_t i = 0;
+    unsigned char* printable_mempool = (unsigned char*) mempool;
 
-    for (i = 0; i < mempool_size; i++) {
-        if (0 == i % EMB_ALLOC_ALIGN_AMOUNT) {
-            fprintf (appendable_file, "\n%zu: ", (i / EMB_ALLOC_ALIGN_AMOUNT));
+    for (i = offset; i < (offset + size); i++) {
+        if ((0 == i % EMB_ALLOC_ALIGN_AMOUNT) || (offset == i)) {
+            fprintf (file, "\n%zu: ", (i / EMB_ALLOC_ALIGN_AMOUNT));
         }
 
-        fprintf (appendable_file, " %s%02x", 
+        fprintf (file, " %s%02x", 
             ((  (EMB_ALLOC_VALUE_NOT_SET != mark_point_idx) &&
                 (mark_point_idx == i))? "(!!!MARK POINT!!!)": "" ), 
             printable_mempool [i]);
     }
+}
 
-    fprintf (appendable_file, "\n");
+void EmbAllocDumpLockedCategoriesInternal (void* mempool, FILE* file,
+    size_t mark_point_idx)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
 
-    if (NULL == file) {
-        fflush (appendable_file);
-        fclose (appendable_file);
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+    EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+    unsigned char* start = (unsigned char*) mempool;
+    size_t thread_index = EmbAllocGetThreadIndex ();
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+
+    fprintf (file, "Mempool dump at location 0x%p (settings and locked categories only)",
+        mempool);
+    EmbAllocDumpRegionInternal (mempool, 0,
+        EMB_ALLOC_ALIGN_AMOUNT + EMB_ALLOC_MEMPOOL_SETTINGS_ALIGN_SIZE, file, mark_point_idx);
+
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        EmbAllocBlockCategory* category = categories + i;
+        size_t bitmap_bytes = EMB_ALLOC_CATEGORY_BITMAP_BYTES (category->total_blocks);
+        size_t holder_thread = 0;
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+        holder_thread = __atomic_load_n (&(aux_data->category_locks [i].lock.holder_thread),
+            __ATOMIC_RELAXED);
+#else
+        holder_thread = aux_data->category_locks [i].lock.holder_thread;
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+        /** Only this thread stores its own index, so a match cannot be stale. */
+        if ((thread_index != holder_thread) || (0 == category->total_blocks)) {
+            continue;
+        }
+
+        fprintf (file, "\nCategory %u (%zu bytes blocks):", (unsigned) i,
+            (size_t) category->block_data_size);
+        EmbAllocDumpRegionInternal (mempool, (size_t) ((unsigned char*) category - start),
+            sizeof (EmbAllocBlockCategory), file, mark_point_idx);
+        /** The interleaved free bitmap slice holds the start words too. */
+        EmbAllocDumpRegionInternal (mempool,
+            (size_t) ((unsigned char*) category->free_bitmap - start),
+            (0 != category->bitmap_word_shift) ? (2 * bitmap_bytes) : bitmap_bytes,
+            file, mark_point_idx);
+
+        if (0 == category->bitmap_word_shift) {
+            EmbAllocDumpRegionInternal (mempool,
+                (size_t) ((unsigned char*) category->alloc_start_bitmap - start),
+                bitmap_bytes, file, mark_point_idx);
+        }
+
+        if (NULL != category->free_summary) {
+            EmbAllocDumpRegionInternal (mempool,
+                (size_t) ((unsigned char*) category->free_summary - start),
+                EMB_ALLOC_CATEGORY_SUMMARY_BYTES (category->total_blocks), file, mark_point_idx);
+        }
+
+        if (NULL != category->use_counts) {
+            EmbAllocDumpRegionInternal (mempool,
+                (size_t) ((unsigned char*) category->use_counts - start),
+                2 * (size_t) category->total_blocks * sizeof (EmbAllocCounter),
+                file, mark_point_idx);
+        }
+
+        EmbAllocDumpRegionInternal (mempool,
+            (size_t) ((unsigned char*) category->start_address - start),
+            (size_t) category->total_blocks * category->stride, file, mark_point_idx);
     }
+
+    fprintf (file, "\n");
 }
 
 EmbAllocMempool EmbAllocCreate (const EmbAllocMemPoolSettings* settings)
@@ -1046,6 +2623,7 @@ EmbAllocMempool EmbAllocCreate (const EmbAllocMemPoolSettings* settings)
         EmbAllocMemPoolSettings sanitized_settings = *settings;
         size_t allocated_size = 0;
         EmbAllocMempool return_value = NULL;
+        void* allocation = NULL;
         bool overflow = false;
         bool consistent_settings = EmbAllocSanitizeSettingsInternal (&sanitized_settings, &overflow);
 
@@ -1060,10 +2638,20 @@ EmbAllocMempool EmbAllocCreate (const EmbAllocMemPoolSettings* settings)
             return NULL;
         }
 
-        return_value = (void*) malloc (allocated_size);
-        
-        if (NULL != return_value) {
+        /**
+         * Slack for moving the mempool start up to a cache line boundary, so that the
+         * control data cache line layout (see EMB_ALLOC_CACHE_LINE_SIZE) holds in memory.
+         */
+        if (allocated_size <= (SIZE_MAX - EMB_ALLOC_CACHE_LINE_SIZE)) {
+            allocation = malloc (allocated_size + EMB_ALLOC_CACHE_LINE_SIZE - 1);
+        }
+
+        if (NULL != allocation) {
+            return_value = (void*) ((unsigned char*) allocation +
+                (EMB_ALLOC_CACHE_LINE_ALIGN_SIZE ((uintptr_t) allocation) - (uintptr_t) allocation));
+
             EmbAllocInitializeInternal (return_value, allocated_size, &sanitized_settings);
+            EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (return_value)->allocation = allocation;
 
             if (!consistent_settings) {
                 EmbAllocSetErrorInternal (return_value, kEmbAllocInconsistentSettings,
@@ -1112,10 +2700,18 @@ bool EmbAllocDestroy (EmbAllocMempool mempool)
         EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
         const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
         EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        void* allocation = aux_data->allocation;
         bool lock_acquired = true;
 
         if (aux_data->thread_sync_mutex_initialized) {
-            lock_acquired = !EmbAllocLockMutex ( &(aux_data->thread_sync_mutex));
+            /** Every lock, in the lock order (see EmbAllocMempoolAuxData). */
+            lock_acquired = !EmbAllocAcquireLock ( &(aux_data->thread_sync_mutex.lock));
+
+            if (lock_acquired &&
+                EmbAllocLockCategoriesInternal (aux_data, EMB_ALLOC_ALL_CATEGORIES_MASK)) {
+                EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock));
+                lock_acquired = false;
+            }
 
             if (!lock_acquired) {
                 /** Lock failed: report (if a callback is set) and fail immediately, without
@@ -1137,34 +2733,54 @@ bool EmbAllocDestroy (EmbAllocMempool mempool)
              * did not cause a memory access violation.
              */
             if (aux_data->thread_sync_mutex_initialized) {
-                EmbAllocUnlockMutex ( &(aux_data->thread_sync_mutex));
+                EmbAllocUnlockCategoriesInternal (aux_data, EMB_ALLOC_ALL_CATEGORIES_MASK);
+                EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock));
             }
             return false;
         }
 
+        /** Thread caches still alive at this point are dangling; only their depot is released. */
+        if (NULL != aux_data->depot) {
+            free (aux_data->depot);
+            aux_data->depot = NULL;
+        }
+
         memset (mempool, 0, EMB_ALLOC_MEMPOOL_NO_THREADSAFE_CONTROL_ALIGN_SIZE);
 
-        if (aux_data->thread_sync_mutex_initialized &&
-            EmbAllocUnlockMutex ( &(aux_data->thread_sync_mutex)) &&
-            (NULL != error_callback_fn)) {
-            /** 
-             * There will be no more mempool aux data, 
-             * so just call the error callback.
-             */
-            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
-        }
+        if (aux_data->thread_sync_mutex_initialized) {
+            /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+            unsigned char i = 0;
+            int unlock_failed = EmbAllocUnlockCategoriesInternal (aux_data,
+                EMB_ALLOC_ALL_CATEGORIES_MASK);
+            int destroy_failed = 0;
+
+            unlock_failed |= EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock));
+
+            if (unlock_failed && (NULL != error_callback_fn)) {
+                /** 
+                 * There will be no more mempool aux data, 
+                 * so just call the error callback.
+                 */
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+            }
 
-        if (aux_data->thread_sync_mutex_initialized &&
-            EmbAllocDestroyMutex ( &(aux_data->thread_sync_mutex)) &&
-            (NULL != error_callback_fn)) {
-            /** 
-             * There will be no more mempool aux data, 
-             * so just call the error callback.
-             */
-            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_DESTROY_ERROR);
+            for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+                destroy_failed |= EmbAllocDestroyLock ( &(aux_data->category_locks [i].lock.mutex));
+            }
+
+            destroy_failed |= EmbAllocDestroyLock ( &(aux_data->error_sync_mutex.lock));
+            destroy_failed |= EmbAllocDestroyLock ( &(aux_data->thread_sync_mutex.lock));
+
+            if (destroy_failed && (NULL != error_callback_fn)) {
+                /** 
+                 * There will be no more mempool aux data, 
+                 * so just call the error callback.
+                 */
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_DESTROY_ERROR);
+            }
         }
 
-        free (mempool);
+        free (allocation);
         return true;
     } else {
         /** This is not a mempool, so we cannot send back a more detailed error message. */
@@ -1172,6 +2788,66 @@ bool EmbAllocDestroy (EmbAllocMempool mempool)
     }
 }
 
+bool EmbAllocPlaceMaxFreeAfterInternal (const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count)
+{
+    (void) size;
+
+    /**
+     * Compare how much memory will be free after a potential allocation, which
+     * maximizes the free space left in the chosen category.
+     */
+    return (    (   single_block_category->block_data_size * 
+                    (   single_block_category->total_blocks - 
+                        single_block_category->occupied_blocks - 
+                        1)) > 
+                (   multi_block_category->block_data_size * 
+                    (   multi_block_category->total_blocks - 
+                        multi_block_category->occupied_blocks - 
+                        multi_block_count)));
+}
+
+bool EmbAllocPlaceBestFitInternal (const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count)
+{
+    /**
+     * A run of n blocks holds n data areas plus the n - 1 inner control areas,
+     * so both sides of the comparison are >= size.
+     */
+    return (    (single_block_category->block_data_size - size) <
+                (   (   multi_block_category->block_data_size * 
+                        multi_block_count) + 
+                    (   (multi_block_count - 1) * 
+                        EMB_ALLOC_CATEGORY_CONTROL_SIZE (multi_block_category)) - 
+                    size));
+}
+
+bool EmbAllocPlaceLowestOccupancyBeforeInternal (
+    const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count)
+{
+    (void) size;
+    (void) multi_block_count;
+
+    return (    (   (double) (single_block_category->occupied_blocks) / 
+                    (double) (single_block_category->total_blocks)) < 
+                (   (double) (multi_block_category->occupied_blocks) / 
+                    (double) (multi_block_category->total_blocks)));
+}
+
+bool EmbAllocPlaceLowestOccupancyAfterInternal (
+    const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count)
+{
+    (void) size;
+
+    return (    (   (double) (single_block_category->occupied_blocks + 1) / 
+                    (double) (single_block_category->total_blocks)) < 
+                (   (double) (  multi_block_category->occupied_blocks + 
+                                multi_block_count) / 
+                    (double) (multi_block_category->total_blocks)));
+}
+
 void* EmbAllocMallocInternal (const EmbAllocMemPoolSettings* settings, 
     EmbAllocBlockCategory* categories, size_t size)
 {
@@ -1194,6 +2870,10 @@ void* EmbAllocMallocInternal (const EmbAllocMemPoolSettings* settings,
      * can be used for allocation.
      */
     unsigned char small_size_block_idx = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+    const EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (
+        EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings));
+    /** The placement policy chosen at creation (NULL: single block first). */
+    EmbAllocPlacementFn placement_fn = aux_data->placement_fn;
 
     /**
      * Allocation strategy, in order of preference:
@@ -1201,11 +2881,24 @@ void* EmbAllocMallocInternal (const EmbAllocMemPoolSettings* settings,
      *      it -- that is the least-waste fit.
      *   2. Otherwise scan the categories from largest to smallest, remembering the best
      *      single-block fit (large_size_block_idx) and the largest category that can
-     *      satisfy `size` across a multi-block run (small_size_block_idx).
-     *   3. If both candidates exist, pick whichever leaves its category with more free
-     *      memory afterwards (the heuristic below); if only one exists, use it.
+     *      satisfy `size` across a multi-block run (small_size_block_idx). Under
+     *      kEmbAllocPlaceSingleBlockFirst the multi-block runs are not searched at all
+     *      once a single block fits.
+     *   3. If both candidates exist, let the placement policy pick one (see
+     *      EmbAllocPlacementPolicy); if only one exists, use it.
      *   4. If nothing fits, report kEmbAllocNoMemory.
+     * Step 0, the common case, short-cuts all of it: the size class table names the
+     * category to use when it has a free block.
      */
+    if (size <= (EMB_ALLOC_SIZE_CLASS_COUNT * EMB_ALLOC_SIZE_CLASS_BYTES)) {
+        i = aux_data->size_class_category [EMB_ALLOC_SIZE_CLASS (size)];
+
+        if ((EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) &&
+            (categories [i].occupied_blocks < categories [i].total_blocks)) {
+            return EmbAllocMallocOneBlockInternal (settings, categories + i, size);
+        }
+    }
+
     if (EMB_ALLOC_CAN_ALLOC_IN_A_BLOCK (categories [0], size)) {
         return EmbAllocMallocOneBlockInternal (settings, categories, size);
     }
@@ -1222,6 +2915,10 @@ void* EmbAllocMallocInternal (const EmbAllocMemPoolSettings* settings,
                 } else {
                     large_size_block_idx = i;
                 }
+            } else if ((NULL == placement_fn) &&
+                (EMB_ALLOC_NUM_BLOCK_CATEGORIES != large_size_block_idx)) {
+                /** A single block fits: never go multi-block. */
+                break;
             } else if (EmbAllocCanAllocInMultipleBlocksInternal (
                 EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings),
                 categories + i, size, &multi_block_alloc_address, 
@@ -1233,63 +2930,24 @@ void* EmbAllocMallocInternal (const EmbAllocMemPoolSettings* settings,
     }
 
     if ((EMB_ALLOC_NUM_BLOCK_CATEGORIES == small_size_block_idx) &&
+        ((NULL != placement_fn) || (EMB_ALLOC_NUM_BLOCK_CATEGORIES == large_size_block_idx)) &&
         (categories [0].occupied_blocks < categories [0].total_blocks) &&
         EmbAllocCanAllocInMultipleBlocksInternal (
             EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings),
             categories, size, &multi_block_alloc_address, 
             &multi_block_alloc_count)) {
-        small_size_block_idx = i;
+        small_size_block_idx = 0;
     }
 
     /**
-     * If there is not a perfect fit block available, minimise the waste by 
-     * choosing the closest block category with the largest percentage of free blocks.
+     * If there is not a perfect fit block available, the placement policy chooses
+     * between the larger single block and the multi-block run.
      */
     if ((EMB_ALLOC_NUM_BLOCK_CATEGORIES != large_size_block_idx) && 
         (EMB_ALLOC_NUM_BLOCK_CATEGORIES != small_size_block_idx)) {
-            /**
-             * Choose the category to allocate depending on how much memory
-             * will be free after a potential allocation.
-             * This method maximizes the free space left in the caategory.
-             * If the category [large_size_block_idx] remains with more free memory, 
-             * then the allocation will be done in that category, 
-             * otherwise it will be allocated in the category [small_size_block_idx].
-             * 
-             * This logic can also be changed so that the wasted memory is minimized 
-             * (best fit case).
-             * if ( (categories [large_size_block_idx].block_data_size - size) <
-             *      (   (   categories [small_size_block_idx].block_data_size * 
-             *              multi_block_alloc_count) + 
-             *          (   (multi_block_alloc_count - 1) * 
-             *              EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE) - 
-             *          size))
-             * 
-             * Another option could be to allocate where the percent of occupied blocks 
-             * before allocation is smaller.
-             * if ( (   (double) (categories [large_size_block_idx].occupied_blocks) / 
-             *          (double) (categories [large_size_block_idx].total_blocks)) < 
-             *      (   (double) (categories [small_size_block_idx].occupied_blocks) / 
-             *          (double) (categories [small_size_block_idx].total_blocks)))
-             * 
-             * Or the percent of occupied blocks after the allocation is smaller...
-             * if ( (   (double) (categories [large_size_block_idx].occupied_blocks + 1) / 
-             *          (double) (categories [large_size_block_idx].total_blocks)) < 
-             *      (   (double) (  categories [small_size_block_idx].occupied_blocks + 
-             *                      multi_block_alloc_count) / 
-             *          (double) (categories [small_size_block_idx].total_blocks)))
-             * 
-             * The user can decide the allocation logic later on.
-             * TODO: Maybe add an enum param in the mempool settings 
-             * to make the allocation logic configurable.
-             */
-            if (    (   categories [large_size_block_idx].block_data_size * 
-                        (   categories [large_size_block_idx].total_blocks - 
-                            categories [large_size_block_idx].occupied_blocks - 
-                            1)) > 
-                    (   categories [small_size_block_idx].block_data_size * 
-                        (   categories [small_size_block_idx].total_blocks - 
-                            categories [small_size_block_idx].occupied_blocks - 
-                            multi_block_alloc_count))) {
+            if ((NULL == placement_fn) ||
+                placement_fn (categories + large_size_block_idx,
+                    categories + small_size_block_idx, size, multi_block_alloc_count)) {
                 return EmbAllocMallocOneBlockInternal (settings, 
                     categories + large_size_block_idx, size);
             } else {
@@ -1329,39 +2987,41 @@ void EmbAllocMergeFreeBlocksInternal (const EmbAllocMemPoolSettings* settings,
      */
     for (i = 0; i < blocks_count; i++) {
         void* current_block = (void*) ((unsigned char*) block + 
-            (i * EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size)));
-        size_t* used_block_count = EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (current_block);
-        size_t* data_size = EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (current_block);
+            (i * category->stride));
+        EmbAllocCounter* used_block_count = EmbAllocUseCountInternal (category, current_block);
+        EmbAllocCounter* data_size = EmbAllocDataSizeInternal (category, current_block);
         void* block_end_padding = EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (current_block, 
             category->block_data_size);
-        void* data_pointer = EMB_ALLOC_GET_PTR_FROM_BLOCK (current_block);
+        void* data_pointer = EMB_ALLOC_GET_CATEGORY_PTR_FROM_BLOCK (category, current_block);
+        bool has_markers = EMB_ALLOC_CATEGORY_HAS_MARKERS (category);
         
         /**
          * Corruption / overflow detection on the block about to be claimed. A truly
          * free block still carries intact start and end markers and has its use_count /
-         * data_size slots at the EMB_ALLOC_VALUE_NOT_SET sentinel; any mismatch means a
+         * data_size slots at the EMB_ALLOC_COUNTER_NOT_SET sentinel; any mismatch means a
          * neighbour overflowed into it. Each check reports the exact offending offset.
          * Errors here are advisory -- the allocation still proceeds.
          */
-        if (memcmp (current_block, kEmbAllocBlockStart, EMB_ALLOC_ALIGN_AMOUNT)) {
+        if (has_markers &&
+            memcmp (current_block, kEmbAllocBlockStart, EMB_ALLOC_BLOCK_START_MARKER_SIZE)) {
             /** Start marker clobbered (typically an underflow from the previous block). */
             EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
                 EMB_ALLOC_OVERFLOW_ERROR, current_block);
         }
 
-        if (memcmp (block_end_padding, kEmbAllocBlockEnd , EMB_ALLOC_ALIGN_AMOUNT)) {
+        if (has_markers && memcmp (block_end_padding, kEmbAllocBlockEnd , EMB_ALLOC_ALIGN_AMOUNT)) {
             /** End marker clobbered (an overflow past this block's payload). */
             EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
                 EMB_ALLOC_OVERFLOW_ERROR, block_end_padding);
         }
 
-        if (EMB_ALLOC_VALUE_NOT_SET != *used_block_count) {
+        if (EMB_ALLOC_COUNTER_NOT_SET != *used_block_count) {
             /** use_count slot not at the free sentinel: the block was not really free. */
             EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
                 EMB_ALLOC_OVERFLOW_ERROR, (void*) used_block_count);
         }
 
-        if (EMB_ALLOC_VALUE_NOT_SET != *data_size) {
+        if (EMB_ALLOC_COUNTER_NOT_SET != *data_size) {
             /** data_size slot not at the free sentinel: likewise a corruption signal. */
             EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
                 EMB_ALLOC_OVERFLOW_ERROR, (void*) data_size);
@@ -1384,6 +3044,16 @@ void EmbAllocMergeFreeBlocksInternal (const EmbAllocMemPoolSettings* settings,
                 EMB_ALLOC_INIT_VALUE, category->block_data_size);
         }
 
+        if (!has_markers) {
+            /**
+             * The compact layout has no in-band control to merge: the counters of the
+             * inner blocks stay at EMB_ALLOC_COUNTER_NOT_SET in the counter arrays.
+             */
+            *used_block_count = EMB_ALLOC_COUNTER_NOT_SET;
+            *data_size = EMB_ALLOC_COUNTER_NOT_SET;
+            continue;
+        }
+
         if (!keep_start || 
             i) {
             /** 
@@ -1396,9 +3066,9 @@ void EmbAllocMergeFreeBlocksInternal (const EmbAllocMemPoolSettings* settings,
             /**
              * Else make sure that the first block control is properly set.
              */
-            memcpy (current_block, kEmbAllocBlockStart, EMB_ALLOC_ALIGN_AMOUNT);
-            *used_block_count = EMB_ALLOC_VALUE_NOT_SET;
-            *data_size = EMB_ALLOC_VALUE_NOT_SET;
+            memcpy (current_block, kEmbAllocBlockStart, EMB_ALLOC_BLOCK_START_MARKER_SIZE);
+            *used_block_count = EMB_ALLOC_COUNTER_NOT_SET;
+            *data_size = EMB_ALLOC_COUNTER_NOT_SET;
         }
 
         if (!keep_end || (blocks_count - 1 != i)) {
@@ -1427,8 +3097,8 @@ void* EmbAllocMallocOneBlockInternal (const EmbAllocMemPoolSettings* settings,
 
     void* free_block = category->first_free_address;
     void* return_value = NULL;
-    size_t* used_block_count = NULL;
-    size_t* data_size = NULL;
+    EmbAllocCounter* used_block_count = NULL;
+    EmbAllocCounter* data_size = NULL;
 
     if (category->total_blocks <= category->occupied_blocks) {
         EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings),
@@ -1445,6 +3115,7 @@ void* EmbAllocMallocOneBlockInternal (const EmbAllocMemPoolSettings* settings,
         EmbAllocMarkBlocksInternal (category, category->start_address,
             category->total_blocks, true);
         category->occupied_blocks = category->total_blocks;
+        category->max_free_run = 0;
         category->first_free_address = NULL;
         category->last_free_address = NULL;
         return NULL;
@@ -1467,9 +3138,9 @@ void* EmbAllocMallocOneBlockInternal (const EmbAllocMemPoolSettings* settings,
     }
 
     category->first_free_address = free_block;
-    return_value = EMB_ALLOC_GET_PTR_FROM_BLOCK (free_block);
-    used_block_count = EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (free_block);
-    data_size = EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (free_block);
+    return_value = EMB_ALLOC_GET_CATEGORY_PTR_FROM_BLOCK (category, free_block);
+    used_block_count = EmbAllocUseCountInternal (category, free_block);
+    data_size = EmbAllocDataSizeInternal (category, free_block);
 
     EmbAllocMergeFreeBlocksInternal (settings, category, free_block, 1, true, true);
 
@@ -1478,7 +3149,7 @@ void* EmbAllocMallocOneBlockInternal (const EmbAllocMemPoolSettings* settings,
     }
 
     *used_block_count = 1;
-    *data_size = size;
+    *data_size = (EmbAllocCounter) size;
 
     /** Record the block as occupied, and as a 1-block allocation head, in the
      * authoritative out-of-band bitmaps. */
@@ -1501,94 +3172,170 @@ void* EmbAllocMallocOneBlockInternal (const EmbAllocMemPoolSettings* settings,
 
 }
 
-bool EmbAllocCanAllocInMultipleBlocksInternal (void* mempool, EmbAllocBlockCategory* category,
-    size_t size, void** block, size_t* blocks_count)
+size_t EmbAllocMallocBlocksInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* category, size_t size, size_t count, void** ptrs)
 {
     /** 
      * No need to check for the (pointer) param validity inside static functions.
      * Callers should make sure that the params are valid.
      */
 
-    unsigned char* verified_block = category->first_free_address;
-    size_t counter = 0; 
-    *block = NULL;
-    *blocks_count = 0;
+    size_t word_count = EMB_ALLOC_CATEGORY_BITMAP_WORDS (category->total_blocks);
+    size_t first_word = 0;
+    size_t word = 0;
+    size_t allocated = 0;
+    bool wrapped = false;
 
-    if (category->total_blocks <= category->occupied_blocks) {
-        EmbAllocSetErrorInternal (mempool, 
-            kEmbAllocInconsistentBlocks, EMB_ALLOC_BLOCK_INCONSISTENCY_ERROR, (void*) category);
-        return false;
+    if ((NULL == category->free_bitmap) || (0 == word_count)) {
+        return 0;
     }
 
-    if ((NULL == category->first_free_address) ||
-        (NULL == category->last_free_address)) {
-        EmbAllocSetErrorInternal (mempool, 
-            kEmbAllocInconsistentBlocks, EMB_ALLOC_BLOCK_INCONSISTENCY_ERROR, (void*) category);
-        /** Damage containment for already-corrupt metadata: drive the authoritative
-         * bitmap to the forced "full" state too, so popcount stays == occupied_blocks. */
-        EmbAllocMarkBlocksInternal (category, category->start_address,
-            category->total_blocks, true);
-        category->occupied_blocks = category->total_blocks;
-        category->first_free_address = NULL;
-        category->last_free_address = NULL;
-        return false;
+    /**
+     * Start at the lower-bound hint and wrap around once, in case the hint drifted
+     * above a free block (see EmbAllocRefreshFirstFreeInternal).
+     */
+    if ((NULL != category->first_free_address) &&
+        ((uintptr_t) category->first_free_address >= (uintptr_t) category->start_address) &&
+        ((uintptr_t) category->first_free_address <= (uintptr_t) category->last_address)) {
+        first_word = EmbAllocBlockIndexInternal (category, category->first_free_address) /
+            EMB_ALLOC_BITMAP_WORD_BITS;
     }
 
-    if (SIZE_T_SUM_OVERFLOW (size, EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE)) {
-        EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
-            EMB_ALLOC_OVERFLOW_ERROR, (void*) category);
-        return false;
-    }
+    word = EmbAllocNextFreeWordInternal (category, first_word);
 
-    /**
+    while ((allocated < count) && (category->occupied_blocks < category->total_blocks)) {
+        uint64_t free_bits = 0;
+        uint64_t claimed_bits = 0;
+
+        if (word >= (wrapped ? first_word : word_count)) {
+            if (wrapped || (0 == first_word)) {
+                break;
+            }
+
+            wrapped = true;
+            word = EmbAllocNextFreeWordInternal (category, 0);
+            continue;
+        }
+
+        /** The padding bits past total_blocks are permanently set, so they never show. */
+        free_bits = ~EMB_ALLOC_FREE_BITMAP_WORD (category, word);
+
+        while ((0 != free_bits) && (allocated < count) &&
+            (category->occupied_blocks < category->total_blocks)) {
+            void* block = EmbAllocBlockFromIndexInternal (category, 
+                (word * EMB_ALLOC_BITMAP_WORD_BITS) + EmbAllocCountTrailingZerosInternal (free_bits));
+            void* ptr = EMB_ALLOC_GET_CATEGORY_PTR_FROM_BLOCK (category, block);
+
+            claimed_bits |= free_bits & (~free_bits + 1u);
+            free_bits &= free_bits - 1u;
+
+            /** Same checks and formatting as EmbAllocMallocOneBlockInternal. */
+            EmbAllocMergeFreeBlocksInternal (settings, category, block, 1, true, true);
+
+            if (settings->init_allocated_memory) {
+                memset (ptr, 0, size);
+            }
+
+            *EmbAllocUseCountInternal (category, block) = 1;
+            *EmbAllocDataSizeInternal (category, block) = (EmbAllocCounter) size;
+
+            ptrs [allocated++] = ptr;
+            category->occupied_blocks++;
+        }
+
+        /** One write per bitmap word for all the blocks claimed in it. */
+        EMB_ALLOC_FREE_BITMAP_WORD (category, word) |= claimed_bits;
+        EmbAllocUpdateStartWordInternal (category, word, claimed_bits, true);
+
+        if (NULL != category->free_summary) {
+            EmbAllocSyncSummaryInternal (category, word);
+        }
+
+        word = EmbAllocNextFreeWordInternal (category, word + 1);
+    }
+
+    if (category->occupied_blocks < category->total_blocks) {
+        EmbAllocRefreshFirstFreeInternal (category);
+    } else {
+        category->first_free_address = NULL;
+        category->last_free_address = NULL;
+    }
+
+    return allocated;
+}
+
+bool EmbAllocCanAllocInMultipleBlocksInternal (void* mempool, EmbAllocBlockCategory* category,
+    size_t size, void** block, size_t* blocks_count)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    size_t run_start = 0;
+    *block = NULL;
+    *blocks_count = 0;
+
+    if (category->total_blocks <= category->occupied_blocks) {
+        EmbAllocSetErrorInternal (mempool, 
+            kEmbAllocInconsistentBlocks, EMB_ALLOC_BLOCK_INCONSISTENCY_ERROR, (void*) category);
+        return false;
+    }
+
+    if ((NULL == category->first_free_address) ||
+        (NULL == category->last_free_address)) {
+        EmbAllocSetErrorInternal (mempool, 
+            kEmbAllocInconsistentBlocks, EMB_ALLOC_BLOCK_INCONSISTENCY_ERROR, (void*) category);
+        /** Damage containment for already-corrupt metadata: drive the authoritative
+         * bitmap to the forced "full" state too, so popcount stays == occupied_blocks. */
+        EmbAllocMarkBlocksInternal (category, category->start_address,
+            category->total_blocks, true);
+        category->occupied_blocks = category->total_blocks;
+        category->max_free_run = 0;
+        category->first_free_address = NULL;
+        category->last_free_address = NULL;
+        return false;
+    }
+
+    if (SIZE_T_SUM_OVERFLOW (size, EMB_ALLOC_CATEGORY_CONTROL_SIZE (category))) {
+        EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
+            EMB_ALLOC_OVERFLOW_ERROR, (void*) category);
+        return false;
+    }
+
+    /**
      * Round up: how many whole blocks of this category are needed to hold `size`
      * bytes. Numerator and denominator are both block-total sizes (data + control), so
      * the inner blocks' control bytes count as usable payload -- an n-block run holds
      * block_data_size + (n-1)*stride bytes.
      */
-    *blocks_count = (EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (size) /
-        EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size)) + 
-        (( EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (size) %
-            EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size)) ?
-            1 : 0);
+    *blocks_count = EmbAllocStrideBlocksInternal (category,
+        size + EMB_ALLOC_CATEGORY_CONTROL_SIZE (category));
     *block = NULL;
 
-    if ((category->occupied_blocks + *blocks_count) > category->total_blocks) {
+    /** O(1) rejection: not enough free blocks at all, or no free run long enough. */
+    if (((category->occupied_blocks + *blocks_count) > category->total_blocks) ||
+        (*blocks_count > category->max_free_run)) {
         return false;
     }
 
-    while (verified_block <= (unsigned char*) category->last_address) {
-        /** Authoritative free test via the bitmap. Reading use_count here was the
-         * root cause of multi-block aliasing: an inner block of a live multi-block
-         * allocation holds user data, and user data of 0xFF..FF (== NOT_SET) made
-         * this scanner treat a live inner block as free and hand out overlapping
-         * memory. The bitmap is immune to whatever the user writes into the block. */
-        if (EmbAllocBlockIsFreeInternal (category, verified_block)) {
-            if (NULL == *block) {
-                *block = (void*) verified_block;
-            }
-
-            counter++;
-
-            if (counter >= *blocks_count) {
-                return true;
-            }
-        } else {
-            counter = 0;
-            *block = NULL;
-
-            if ((   ((size_t) category->last_address - (size_t) verified_block) /
-                    (size_t) EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size)) <
-                *blocks_count) {
-                    /** There is simply not enough space, so just return false. */
-                    return false;
-                }
-        }
-
-        verified_block += EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size);
+    /** Authoritative, word-parallel run search on the free bitmap, starting at the
+     * lower-bound first_free hint and bounded by the category's last block (not by the
+     * drift-prone last_free hint). Reading use_count here was the root cause of
+     * multi-block aliasing: an inner block of a live multi-block allocation holds user
+     * data, and user data of 0xFF..FF (== NOT_SET) made the old block-by-block scanner
+     * treat a live inner block as free and hand out overlapping memory. The bitmap is
+     * immune to whatever the user writes into the block. */
+    if (EmbAllocFindFreeRunInternal (category,
+            EmbAllocBlockIndexInternal (category, category->first_free_address),
+            *blocks_count, &run_start)) {
+        *block = EmbAllocBlockFromIndexInternal (category, run_start);
+        return true;
     }
 
-    *block = NULL;
+    /** first_free_address is a lower bound on the free blocks, so the search covered
+     * every free block: no run of *blocks_count exists, tighten the bound. */
+    category->max_free_run = (EmbAllocCounter) (*blocks_count - 1);
 
     return false;
 }
@@ -1602,8 +3349,8 @@ void* EmbAllocMallocMultiBlocksInternal (const EmbAllocMemPoolSettings* settings
      */
 
     void* return_value = NULL;
-    size_t* used_block_count = NULL;
-    size_t* data_size = NULL;
+    EmbAllocCounter* used_block_count = NULL;
+    EmbAllocCounter* data_size = NULL;
 
     if (category->total_blocks <= category->occupied_blocks) {
         EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings), 
@@ -1621,14 +3368,15 @@ void* EmbAllocMallocMultiBlocksInternal (const EmbAllocMemPoolSettings* settings
         EmbAllocMarkBlocksInternal (category, category->start_address,
             category->total_blocks, true);
         category->occupied_blocks = category->total_blocks;
+        category->max_free_run = 0;
         category->first_free_address = NULL;
         category->last_free_address = NULL;
         return NULL;
     }
 
-    return_value = EMB_ALLOC_GET_PTR_FROM_BLOCK (block);
-    used_block_count = EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (block);
-    data_size = EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (block);
+    return_value = EMB_ALLOC_GET_CATEGORY_PTR_FROM_BLOCK (category, block);
+    used_block_count = EmbAllocUseCountInternal (category, block);
+    data_size = EmbAllocDataSizeInternal (category, block);
     
     EmbAllocMergeFreeBlocksInternal (settings, category, block, blocks_count, true, true);
 
@@ -1636,8 +3384,8 @@ void* EmbAllocMallocMultiBlocksInternal (const EmbAllocMemPoolSettings* settings
         memset (return_value, 0, size);
     }
 
-    *used_block_count = blocks_count;
-    *data_size = size;
+    *used_block_count = (EmbAllocCounter) blocks_count;
+    *data_size = (EmbAllocCounter) size;
 
     /** Record every spanned block as occupied, and the head block as the allocation
      * start, in the authoritative out-of-band bitmaps. Only the head gets the start
@@ -1645,7 +3393,7 @@ void* EmbAllocMallocMultiBlocksInternal (const EmbAllocMemPoolSettings* settings
     EmbAllocMarkBlocksInternal (category, block, blocks_count, true);
     EmbAllocSetAllocStartInternal (category, block, true);
 
-    category->occupied_blocks += blocks_count;
+    category->occupied_blocks += (EmbAllocCounter) blocks_count;
 
     if (category->occupied_blocks < category->total_blocks) {
         /** CanAlloc may have chosen a run above isolated lower free blocks, so the
@@ -1685,38 +3433,76 @@ void* EmbAllocMalloc (EmbAllocMempool mempool, size_t size)
         }
 #endif /** VERBOSE_DUMP_MEMPOOL */
 
-        if (size) {
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+        if (aux_data->remote_free_queues &&
+            (EmbAllocGetThreadIndex () == __atomic_load_n (&(aux_data->owner_thread), __ATOMIC_RELAXED))) {
+            EmbAllocDrainRemoteFreesInternal (mempool);
+        }
+
+        if (size && aux_data->lock_free_single_blocks) {
+            return_value = EmbAllocMallocLockFreeInternal (mempool, size);
+        }
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+        if (size && (NULL == return_value)) {
             bool lock_acquired = true;
             EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+            EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+            /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+            unsigned char i = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+            unsigned int lock_mask = EMB_ALLOC_ALL_CATEGORIES_MASK;
 
-            if (aux_data->thread_sync_mutex_initialized) {
-                lock_acquired = !EmbAllocLockMutex ( &(aux_data->thread_sync_mutex));
+            /**
+             * A size with a preferred category first tries it under that category's lock
+             * alone. Only the full category search, which may look at every category,
+             * takes all the category locks.
+             */
+            if (size <= (EMB_ALLOC_SIZE_CLASS_COUNT * EMB_ALLOC_SIZE_CLASS_BYTES)) {
+                i = aux_data->size_class_category [EMB_ALLOC_SIZE_CLASS (size)];
 
-                if (!lock_acquired) {
-                    /** Lock failed: report (if a callback is set) and fail immediately, without
-                    * reading the shared error slot unsynchronized or unlocking a mutex we
-                    * never acquired. */
-                    if (NULL != error_callback_fn) {
-                        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
-                    }
+                if (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) {
+                    lock_mask = EMB_ALLOC_CATEGORY_MASK (i);
                 }
             }
 
-            if (lock_acquired) {
-                ClearMempoolErrorInternal (aux_data);
+            ClearMempoolErrorInternal (aux_data);
 
-                return_value = EmbAllocMallocInternal (settings,
-                                                        EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool),
-                                                        size);
+            while (lock_acquired && (0 != lock_mask)) {
+                if (aux_data->thread_sync_mutex_initialized) {
+                    lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, lock_mask);
 
-                if (aux_data->thread_sync_mutex_initialized &&
-                    EmbAllocUnlockMutex ( &(aux_data->thread_sync_mutex)) &&
-                    (NULL != error_callback_fn)) {
-                    /** Unlock failed: the mutex is no longer reliably held, so report
-                     * via the callback directly rather than writing the shared error
-                     * slot unsynchronized (which would race a lock-holding writer). */
-                    error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+                    if (!lock_acquired) {
+                        /** Lock failed: report (if a callback is set) and fail immediately,
+                        * without reading the blocks management data unsynchronized or
+                        * unlocking a mutex we never acquired. */
+                        if (NULL != error_callback_fn) {
+                            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+                        }
+                    }
+                }
+
+                if (lock_acquired) {
+                    if (EMB_ALLOC_ALL_CATEGORIES_MASK == lock_mask) {
+                        return_value = EmbAllocMallocInternal (settings, categories, size);
+                    } else if (categories [i].occupied_blocks < categories [i].total_blocks) {
+                        return_value = EmbAllocMallocOneBlockInternal (settings,
+                            categories + i, size);
+                    }
+
+                    if (aux_data->thread_sync_mutex_initialized &&
+                        EmbAllocUnlockCategoriesInternal (aux_data, lock_mask) &&
+                        (NULL != error_callback_fn)) {
+                        /** Unlock failed: the mutex is no longer reliably held, so report
+                         * via the callback directly rather than writing the shared error
+                         * slot unsynchronized (which would race a lock-holding writer). */
+                        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+                    }
                 }
+
+                /** A full preferred category sends the allocation to the full search. */
+                lock_mask = ((NULL == return_value) && 
+                    (EMB_ALLOC_ALL_CATEGORIES_MASK != lock_mask)) ?
+                    EMB_ALLOC_ALL_CATEGORIES_MASK : 0;
             }
         }
 
@@ -1753,6 +3539,30 @@ void* EmbAllocMalloc (EmbAllocMempool mempool, size_t size)
     }
 }
 
+unsigned char EmbAllocCategoryIndexForPtrInternal (
+    const EmbAllocBlockCategory* categories, const void* ptr)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+    /** Same as EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (the header size is the same in
+     * every category), without dereferencing anything. */
+    uintptr_t block = (uintptr_t) ptr - categories->header_size;
+
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        if (((uintptr_t) categories [i].start_address <= block) &&
+            ((uintptr_t) categories [i].last_address >= block)) {
+            break;
+        }
+    }
+
+    return i;
+}
+
 EmbAllocBlockCategory* EmbAllocGetCategoryForPtr (EmbAllocBlockCategory* categories, 
     void* ptr)
 {
@@ -1764,8 +3574,8 @@ EmbAllocBlockCategory* EmbAllocGetCategoryForPtr (EmbAllocBlockCategory* categor
     /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
     unsigned char i = 0;
     void* block = NULL;
-    size_t* used_block_count = NULL;
-    size_t* data_size = NULL;
+    EmbAllocCounter* used_block_count = NULL;
+    EmbAllocCounter* data_size = NULL;
     void* mempool = EMB_ALLOC_GET_MEMPOOL_FROM_BLOCK_CATEGORIES_PTR (categories);
     EmbAllocBlockCategory* category = NULL;
     size_t block_total = 0;
@@ -1787,31 +3597,27 @@ EmbAllocBlockCategory* EmbAllocGetCategoryForPtr (EmbAllocBlockCategory* categor
         return NULL;
     }
 
-    block = EMB_ALLOC_GET_BLOCK_FROM_PTR (ptr);
-
     /** Prove category membership by address alone -- no block-relative metadata is
      * read or written until the pointer is shown to sit on a real block boundary. */
-    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
-        if (((uintptr_t) categories [i].start_address <= (uintptr_t) block) &&
-            ((uintptr_t) categories [i].last_address >= (uintptr_t) block)) {
-            category = categories + i;
-            break;
-        }
-    }
+    i = EmbAllocCategoryIndexForPtrInternal (categories, ptr);
 
-    if (NULL == category) {
+    if (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) {
+        category = categories + i;
+        block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+    } else {
         EmbAllocSetErrorInternal (mempool, kEmbAllocPointerParamError,
-            EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, block);
+            EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, 
+            EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (categories, ptr));
         return NULL;
     }
 
-    block_total = EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size);
-    block_index = ((uintptr_t) block - (uintptr_t) category->start_address) / block_total;
+    block_total = category->stride;
+    block_index = EmbAllocBlockIndexInternal (category, block);
 
     /** The block-start marker is forgeable; require the pointer to sit exactly on a
      * block boundary BEFORE touching the (caller-reachable) block header, so a forged
      * interior pointer cannot drive an in-pool metadata write. */
-    if (((uintptr_t) block - (uintptr_t) category->start_address) % block_total) {
+    if (((uintptr_t) block - (uintptr_t) category->start_address) != (block_index * block_total)) {
         EmbAllocSetErrorInternal (mempool, kEmbAllocPointerParamError,
             EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, block);
         return NULL;
@@ -1833,16 +3639,16 @@ EmbAllocBlockCategory* EmbAllocGetCategoryForPtr (EmbAllocBlockCategory* categor
     }
 
     /** The pointer is now a proven allocation head: its header is real block metadata. */
-    used_block_count = EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (block);
-    data_size = EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (block);
+    used_block_count = EmbAllocUseCountInternal (category, block);
+    data_size = EmbAllocDataSizeInternal (category, block);
 
-    if (EMB_ALLOC_VALUE_NOT_SET == *used_block_count) {
+    if (EMB_ALLOC_COUNTER_NOT_SET == *used_block_count) {
         EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
             EMB_ALLOC_OVERFLOW_ERROR, (void*) used_block_count);
         return NULL;
     }
 
-    if (EMB_ALLOC_VALUE_NOT_SET == *data_size) {
+    if (EMB_ALLOC_COUNTER_NOT_SET == *data_size) {
         EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
             EMB_ALLOC_OVERFLOW_ERROR, (void*) data_size);
         return NULL;
@@ -1874,7 +3680,8 @@ EmbAllocBlockCategory* EmbAllocGetCategoryForPtr (EmbAllocBlockCategory* categor
 
     block_end_padding = EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (block, block_data_size);
 
-    if (memcmp (block_end_padding, kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT)) {
+    if (EMB_ALLOC_CATEGORY_HAS_MARKERS (category) &&
+        memcmp (block_end_padding, kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT)) {
         EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
             EMB_ALLOC_OVERFLOW_ERROR, block_end_padding);
         memcpy (block_end_padding, kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT);
@@ -1909,14 +3716,31 @@ void EmbAllocFreeBlockInternal (const EmbAllocMemPoolSettings* settings,
      * Callers should make sure that the params are valid.
      */
 
-    size_t i = 0;
-    void* block = EMB_ALLOC_GET_BLOCK_FROM_PTR (ptr);
-    size_t used_block_count = *EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (block);
-    size_t data_size = *EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (block);
+    void* block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+    size_t used_block_count = EmbAllocCheckFreedTailInternal (settings, category, ptr);
+
+    /** Split the allocation back into individually-formatted free blocks. */
+    EmbAllocReleaseBlocksInternal (category, block, used_block_count);
+
+    /** Clear the head's allocation-start bit in the authoritative out-of-band bitmap:
+     * a later double-free of this head then fails validation. */
+    EmbAllocSetAllocStartInternal (category, block, false);
+}
+
+size_t EmbAllocCheckFreedTailInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* category, void* ptr)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    void* block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+    size_t used_block_count = *EmbAllocUseCountInternal (category, block);
+    size_t data_size = *EmbAllocDataSizeInternal (category, block);
     size_t block_data_size = category->block_data_size + 
         (   (used_block_count - 1) * 
-            EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size));
-    
+            category->stride);
 
     /**
      * Overflow check on free: the unused tail of the allocation -- the bytes between
@@ -1936,37 +3760,39 @@ void EmbAllocFreeBlockInternal (const EmbAllocMemPoolSettings* settings,
             (void*) ((unsigned char*) ptr + data_size));
     }
 
-    /** Wipe the whole freed payload back to the INIT fill: no stale user data lingers,
-     *  and the next overflow check on this span has a clean baseline. */
-    memset (ptr, EMB_ALLOC_INIT_VALUE, block_data_size);
+    return used_block_count;
+}
 
-    /**
-     * Restore the per-block control data to its "uninitialized / free" value for every
-     * block in the freed run: re-stamp each block's start and end markers and reset its
-     * use_count / data_size slots to EMB_ALLOC_VALUE_NOT_SET. This splits a multi-block
-     * allocation back into individually-formatted free blocks.
+void EmbAllocReleaseBlocksInternal (EmbAllocBlockCategory* category, 
+    void* block, size_t blocks_count)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
      */
-    for (i = 0; i < used_block_count; i++) {
-        void* freed_block = (void*) ((unsigned char*) block + 
-            (i * EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size)));
 
-        memcpy (freed_block, kEmbAllocBlockStart, EMB_ALLOC_ALIGN_AMOUNT);
-        memcpy (EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (freed_block, 
-            category->block_data_size), kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT);
-        *EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (freed_block) = EMB_ALLOC_VALUE_NOT_SET;
-        *EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (freed_block) = EMB_ALLOC_VALUE_NOT_SET;
-    }
+    void* last_block = (void*) ((unsigned char*) block + 
+        ((blocks_count - 1) * category->stride));
 
-    /** Clear the freed span (occupied) and the head's allocation-start bit in the
-     * authoritative out-of-band bitmaps. Clearing the start bit makes a later
-     * double-free of this head fail validation. */
-    EmbAllocMarkBlocksInternal (category, block, used_block_count, false);
-    EmbAllocSetAllocStartInternal (category, block, false);
+    EmbAllocWipeBlocksInternal (category, block, blocks_count);
+
+    /** Clear the run (occupied) in the authoritative out-of-band free bitmap. */
+    EmbAllocMarkBlocksInternal (category, block, blocks_count, false);
+
+    category->occupied_blocks -= (EmbAllocCounter) blocks_count;
 
-    category->occupied_blocks -= used_block_count;
+    /** The released run may join free neighbours into a run longer than the bound. */
+    {
+        size_t merged_run = EmbAllocFreeRunAroundInternal (category,
+            EmbAllocBlockIndexInternal (category, block), blocks_count);
+
+        if (merged_run > category->max_free_run) {
+            category->max_free_run = (EmbAllocCounter) merged_run;
+        }
+    }
 
     /**
-     * Extend the free-block hints to cover the just-freed head: first_free_address is
+     * Extend the free-block hints to cover the released run: first_free_address is
      * kept as a lower bound (the minimum free-block address) and last_free_address as
      * an upper bound (the maximum), so a later scan starts no later than the lowest
      * free block and stops no earlier than the highest.
@@ -1977,301 +3803,245 @@ void EmbAllocFreeBlockInternal (const EmbAllocMemPoolSettings* settings,
     }
     
     if ((NULL == category->last_free_address) ||
-        ((uintptr_t)category->last_free_address < (uintptr_t)block)) {
-       category->last_free_address = block; 
+        ((uintptr_t)category->last_free_address < (uintptr_t)last_block)) {
+       category->last_free_address = last_block; 
     } 
 }
 
-void EmbAllocFree (EmbAllocMempool mempool, void* ptr)
+void EmbAllocWipeBlocksInternal (EmbAllocBlockCategory* category, 
+    void* block, size_t blocks_count)
 {
-    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
-        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
-        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
-#ifdef VERBOSE_DUMP_MEMPOOL
-        bool valid_pointer_param = false;
-
-        if (strlen (settings->error_dump_file_name)) {
-            FILE* error_file = fopen (settings->error_dump_file_name, "a");
-
-            if (NULL != error_file) {
-                 fprintf(error_file, "\nTrying to free memory from the 0x%p location\n", ptr);
-
-                fflush (error_file);
-                fclose (error_file);
-            } else {
-                perror ("Error writing the error message in the mempool error dump file");
-            }
-        }
-#endif /** VERBOSE_DUMP_MEMPOOL */
-
-        if (ptr) {
-            bool lock_acquired = true;
-            EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
-
-            if (aux_data->thread_sync_mutex_initialized) {
-                lock_acquired = !EmbAllocLockMutex ( &(aux_data->thread_sync_mutex));
-
-                if (!lock_acquired) {
-                    /** Lock failed: report (if a callback is set) and fail immediately, without
-                    * reading the shared error slot unsynchronized or unlocking a mutex we
-                    * never acquired. */
-                    if (NULL != error_callback_fn) {
-                        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
-                    }
-                }
-            }
-
-            if (lock_acquired) {
-                ClearMempoolErrorInternal (aux_data);
-
-                /** GetCategoryForPtr (reached via FreeInternal) is now the single
-                 * validator; it rejects a foreign/interior/forged pointer with
-                 * kEmbAllocPointerParamError, so there is no duplicated pre-check. */
-                EmbAllocFreeInternal (settings,
-                    EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool),
-                    ptr);
-#ifdef VERBOSE_DUMP_MEMPOOL
-                valid_pointer_param = (kEmbAllocPointerParamError != aux_data->last_error);
-#endif /** VERBOSE_DUMP_MEMPOOL */
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
 
-                if (aux_data->thread_sync_mutex_initialized &&
-                    EmbAllocUnlockMutex ( &(aux_data->thread_sync_mutex)) &&
-                    (NULL != error_callback_fn)) {
-                    /** Unlock failed: the mutex is no longer reliably held, so report
-                     * via the callback directly rather than writing the shared error
-                     * slot unsynchronized (which would race a lock-holding writer). */
-                    error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
-                }
-            }
-        }
+    size_t i = 0;
 
-#ifdef VERBOSE_DUMP_MEMPOOL
-        if (strlen (settings->error_dump_file_name)) {
-            FILE* error_file = fopen (settings->error_dump_file_name, "a");
+    /** Wipe the whole run back to the INIT fill: no stale user data lingers,
+     *  and the next overflow check on these blocks has a clean baseline. */
+    memset (block, EMB_ALLOC_INIT_VALUE, 
+        blocks_count * category->stride);
 
-            if (NULL != error_file) {
-                if (valid_pointer_param) {
-                    size_t memory_offset = (unsigned char*) ptr - (unsigned char*) mempool;
+    /**
+     * Restore the per-block control data to its "uninitialized / free" value for every
+     * block in the run: re-stamp each block's start and end markers and reset its
+     * use_count / data_size slots to EMB_ALLOC_COUNTER_NOT_SET.
+     */
+    for (i = 0; i < blocks_count; i++) {
+        EmbAllocFormatFreeBlockInternal (category,
+            (void*) ((unsigned char*) block + (i * category->stride)));
+    }
+}
 
-                    fprintf(error_file, "Freed bytes at the 0x%p location "
-                        "/ %zu mempool offset\n", ptr,
-                        memory_offset);
+void EmbAllocClearFreeBitsInternal (EmbAllocBlockCategory* category, 
+    size_t word, uint64_t mask)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
 
-                    EmbAllocDumpMempoolInternal (mempool,  EmbAllocGetMemoryRequirementsInternal (settings), 
-                        error_file, memory_offset);
-                } else {
-                    fprintf(error_file, "\nFailed to free bytes at the 0x%p location\n", ptr);
-                }
+    EMB_ALLOC_FREE_BITMAP_WORD (category, word) &= ~mask;
 
-                fflush (error_file);
-                fclose (error_file);
-            } else {
-                perror ("Error writing the error message in the mempool error dump file");
-            }
-        }
-#endif /** VERBOSE_DUMP_MEMPOOL */
+    if (NULL != category->free_summary) {
+        EmbAllocSyncSummaryInternal (category, word);
     }
 }
 
-void* EmbAllocReallocInternal (const EmbAllocMemPoolSettings* settings, 
-    EmbAllocBlockCategory* categories, void* ptr, size_t size)
+void EmbAllocFreeBatchCategoryInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* categories, EmbAllocBlockCategory* category, 
+    void* const* ptrs, unsigned char* order, size_t order_count, EmbAllocCounter* run_counts)
 {
     /** 
      * No need to check for the (pointer) param validity inside static functions.
      * Callers should make sure that the params are valid.
      */
 
-    EmbAllocBlockCategory* category = EmbAllocGetCategoryForPtr (categories, ptr);
+    void* first_block = NULL;
+    void* last_block = NULL;
+    uint64_t clear_mask = 0;
+    size_t clear_word = 0;
+    size_t freed_blocks = 0;
+    size_t run_index = 0;
+    size_t run_length = 0;
+    size_t k = 0;
 
-    if (NULL != category) {
-        return EmbAllocReallocBlockInternal (settings, category, categories, ptr, size);
-    } else {
-        EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings), 
-            kEmbAllocPointerParamError, EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
+    /**
+     * Address order (an insertion sort: a group is small and usually sorted already),
+     * so the runs in one bitmap word are cleared with one write and neighbouring
+     * allocations are measured as one free run.
+     */
+    for (k = 1; k < order_count; k++) {
+        unsigned char position = order [k];
+        size_t j = k;
+
+        while ((j > 0) && ((uintptr_t) ptrs [order [j - 1]] > (uintptr_t) ptrs [position])) {
+            order [j] = order [j - 1];
+            j--;
+        }
+
+        order [j] = position;
     }
 
-    return NULL;
-}
+    for (k = 0; k < order_count; k++) {
+        void* ptr = ptrs [order [k]];
+        void* block = NULL;
+        size_t index = 0;
+        size_t blocks_count = 0;
 
+        run_counts [k] = 0;
 
-void* EmbAllocReallocBlockInternal (const EmbAllocMemPoolSettings* settings, 
-    EmbAllocBlockCategory* category, EmbAllocBlockCategory* categories, 
-    void* ptr, size_t size)
-{
-    /** 
-     * No need to check for the (pointer) param validity inside static functions.
-     * Callers should make sure that the params are valid.
-     */
+        /** The validation of EmbAllocFreeInternal. */
+        if (NULL == EmbAllocGetCategoryForPtr (categories, ptr)) {
+            EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings), 
+                kEmbAllocPointerParamError, EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
+            continue;
+        }
 
-    void* block = EMB_ALLOC_GET_BLOCK_FROM_PTR (ptr);
-    size_t* used_block_count = EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK (block);
-    size_t* data_size = EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK (block);
-    size_t block_data_size = category->block_data_size + 
-        (   (*used_block_count - 1) * 
-            EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size));
+        block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+        blocks_count = EmbAllocCheckFreedTailInternal (settings, category, ptr);
+        EmbAllocWipeBlocksInternal (category, block, blocks_count);
+        /** Right away, so that the pointer given twice in the batch is reported. */
+        EmbAllocSetAllocStartInternal (category, block, false);
 
-    if (settings->full_overflow_checks &&
-        !EmbAllocCheckBuffer (
-                (void*) ((unsigned char*) ptr + *data_size),
-                block_data_size - *data_size, 
-                EMB_ALLOC_INIT_VALUE)) {
-        EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings), 
-            kEmbAllocOverflow, EMB_ALLOC_OVERFLOW_ERROR, 
-            (void*) ((unsigned char*) ptr + *data_size));
-        memset ((unsigned char*) ptr + *data_size, EMB_ALLOC_INIT_VALUE, block_data_size - *data_size);
-    }
+        run_counts [k] = (EmbAllocCounter) blocks_count;
+        freed_blocks += blocks_count;
 
-    if (size == *data_size) {
-        /** Ih the new size is the same, do nothing, just return the same pointer. */
-        return ptr;
-    }
+        if (NULL == first_block) {
+            first_block = block;
+        }
+        last_block = (void*) ((unsigned char*) block + ((blocks_count - 1) * category->stride));
 
-    if (size < *data_size) {
-        /** 
-         * If the new size is smaller, just reset the extra buffer to EMB_ALLOC_INIT_VALUE. 
-         * WARNING: This function DOES NOT split blocks again if used_block_count is decremented.
-         * This will generate memory waste in this case.
-         * TODO: Free unused blocks if the allocated memory is partially freed.
-         */
-        memset ((unsigned char*) ptr + size, EMB_ALLOC_INIT_VALUE, *data_size - size);
-        *data_size = size;
-        return ptr;
-    } else {
-        if (size <= block_data_size) {
-            if (settings->init_allocated_memory) {
-                /**
-                 * If the new size is bigger, but still fits inside the current block,
-                 * just reset the extra buffer to 0.
-                 */
-                memset ((unsigned char*) ptr + *data_size, 0, size - *data_size);
-            }
+        /** Collect the bits to clear per word, as EmbAllocMarkBlocksInternal splits a run. */
+        index = EmbAllocBlockIndexInternal (category, block);
 
-            *data_size = size;
-            return ptr;
-        } else {
-            void* return_value = NULL;
-            /**
-             * Grow beyond the current block(s): `size` exceeds the existing capacity
-             * block_data_size. Round up the extra bytes (size - block_data_size) by the
-             * per-block stride to get how many additional blocks must be appended -- the
-             * code then tries to claim that many free blocks contiguously right after
-             * the current run (an in-place grow), falling back to allocate-copy-free.
-             */
-            size_t required_extra_blocks =
-                (size - block_data_size) / EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size) +
-                (((size - block_data_size) % EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size)) ?
-                1 : 0);
+        while (blocks_count) {
+            size_t word = index / EMB_ALLOC_BITMAP_WORD_BITS;
+            size_t bit = index % EMB_ALLOC_BITMAP_WORD_BITS;
+            size_t span = EMB_ALLOC_BITMAP_WORD_BITS - bit;
+            uint64_t mask = ~UINT64_C (0);
 
-            /**
-             * Try to realloc in the same category only if the new extra size 
-             * fits in the number of free blocks from this category. 
-             */
-            if ((category->occupied_blocks <= category->total_blocks) &&
-                (required_extra_blocks <= (category->total_blocks - category->occupied_blocks))) {
-                size_t i = 0;
-                bool can_realloc_continously = true;
+            if (span > blocks_count) {
+                span = blocks_count;
+            }
+            if (span < EMB_ALLOC_BITMAP_WORD_BITS) {
+                mask = ((UINT64_C (1) << span) - 1u) << bit;
+            }
 
-                /**
-                 * It is not sufficient to have the required number of free blocks,
-                 * they need to be continous as well. 
-                 */
-                for (i = 0; i < required_extra_blocks; i++) {
-                    void* next_block = (void*) ((unsigned char*) block +
-                        ((*used_block_count + i) *
-                            EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size)));
-
-                    if (((uintptr_t) next_block > (uintptr_t) category->last_address) ||
-                        (!EmbAllocBlockIsFreeInternal (category, next_block))) {
-                        can_realloc_continously = false;
-                        break;
-                    }
-                }
+            if ((word != clear_word) && (0 != clear_mask)) {
+                EmbAllocClearFreeBitsInternal (category, clear_word, clear_mask);
+                clear_mask = 0;
+            }
 
-                if (can_realloc_continously) {
-                    void* block_end_padding = EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (block, 
-                        block_data_size);
+            clear_word = word;
+            clear_mask |= mask;
+            index += span;
+            blocks_count -= span;
+        }
+    }
 
-                    EmbAllocMergeFreeBlocksInternal (settings, category,
-                        (void*)((unsigned char*) block +
-                            (   *used_block_count *
-                                EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size))),
-                            required_extra_blocks, false, true);
+    if (0 == freed_blocks) {
+        return;
+    }
 
-                    /** Mark the newly merged extension blocks occupied in the bitmap
-                     * (uses the pre-increment *used_block_count as the span offset). */
-                    EmbAllocMarkBlocksInternal (category,
-                        (void*) ((unsigned char*) block +
-                            (*used_block_count *
-                                EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE (category->block_data_size))),
-                        required_extra_blocks, true);
+    EmbAllocClearFreeBitsInternal (category, clear_word, clear_mask);
+    category->occupied_blocks -= (EmbAllocCounter) freed_blocks;
 
-                    /**
-                     * Reset the "old" block end padding to EMB_ALLOC_INIT_VALUE.
-                     */
-                    memset (block_end_padding, 
-                        EMB_ALLOC_INIT_VALUE, EMB_ALLOC_ALIGN_AMOUNT);
+    /** The same hints as EmbAllocReleaseBlocksInternal, for the lowest and highest run. */
+    if ((NULL == category->first_free_address) ||
+        ((uintptr_t) category->first_free_address > (uintptr_t) first_block)) {
+        category->first_free_address = first_block;
+    }
 
-                    if (settings->init_allocated_memory) {
-                        memset ((unsigned char*) ptr + *data_size, 0, size - *data_size);
-                    }
+    if ((NULL == category->last_free_address) ||
+        ((uintptr_t) category->last_free_address < (uintptr_t) last_block)) {
+        category->last_free_address = last_block;
+    }
 
-                    *used_block_count += required_extra_blocks;
-                    *data_size = size;
-                    category->occupied_blocks += required_extra_blocks;
+    /**
+     * The longest free run bound, once per run of neighbouring freed allocations, now
+     * that all their bits are clear. The pass runs one step past the end to measure
+     * the last run.
+     */
+    for (k = 0; k <= order_count; k++) {
+        size_t index = 0;
 
-                    if (category->occupied_blocks >= category->total_blocks) {
-                        category->occupied_blocks = category->total_blocks;
-                        category->first_free_address = NULL;
-                        category->last_free_address = NULL;
-                    } else {
-                        /** The grow consumed blocks above the original allocation;
-                         * first_free remains a valid lower bound, so refresh it
-                         * authoritatively rather than via stale-last_free rescans. */
-                        EmbAllocRefreshFirstFreeInternal (category);
-                    }
+        if ((k < order_count) && (0 == run_counts [k])) {
+            continue;
+        }
 
-                    return ptr;
-                }
+        if (k < order_count) {
+            index = EmbAllocBlockIndexInternal (category,
+                EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptrs [order [k]]));
+
+            if ((0 != run_length) && (index == (run_index + run_length))) {
+                run_length += run_counts [k];
+                continue;
             }
+        }
 
-            /**
-             * Malloc, copy and free only if the memory reallocation could not be done
-             * inside the same category continously.
-             */
-            return_value = EmbAllocMallocInternal (settings, categories, size);
+        if (0 != run_length) {
+            size_t merged_run = EmbAllocFreeRunAroundInternal (category, run_index, run_length);
 
-            if (NULL != return_value) {
-                memcpy (return_value, ptr, *data_size);
-                EmbAllocFreeBlockInternal (settings, category, ptr);
+            if (merged_run > category->max_free_run) {
+                category->max_free_run = (EmbAllocCounter) merged_run;
             }
+        }
 
-            return return_value;
+        if (k < order_count) {
+            run_index = index;
+            run_length = run_counts [k];
         }
     }
+}
 
-    return NULL;
+bool EmbAllocFreeSizedInternal (EmbAllocBlockCategory* category, void* ptr)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    void* block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+    size_t offset = (size_t) ((uintptr_t) block - (uintptr_t) category->start_address);
+    size_t block_total = category->stride;
+    size_t block_index = EmbAllocDivideByStrideInternal (category, offset);
+
+    /**
+     * The grid check keeps an interior pointer from naming the head of another
+     * allocation, the allocation-start bit rejects double and forged frees, and the
+     * use count (the header of a proven head) keeps a run on the regular path. The
+     * data size, end marker and category search of EmbAllocGetCategoryForPtr are skipped.
+     */
+    if ((block_index * block_total != offset) ||
+        (NULL == category->alloc_start_bitmap) ||
+        (0 == (EmbAllocLoadStartWordInternal (category, block_index / EMB_ALLOC_BITMAP_WORD_BITS) &
+            (UINT64_C (1) << (block_index % EMB_ALLOC_BITMAP_WORD_BITS)))) ||
+        (1 != *EmbAllocUseCountInternal (category, block))) {
+        return false;
+    }
+
+    EmbAllocReleaseBlocksInternal (category, block, 1);
+    EmbAllocSetAllocStartInternal (category, block, false);
+
+    return true;
 }
 
-void* EmbAllocRealloc (EmbAllocMempool mempool, void* ptr, size_t size)
+void EmbAllocFree (EmbAllocMempool mempool, void* ptr)
 {
     if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
         EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
         const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
-        void* return_value = NULL;
-
+        bool freed_lock_free = false;
 #ifdef VERBOSE_DUMP_MEMPOOL
+        bool valid_pointer_param = false;
+
         if (strlen (settings->error_dump_file_name)) {
-            size_t memory_offset = EMB_ALLOC_VALUE_NOT_SET;
             FILE* error_file = fopen (settings->error_dump_file_name, "a");
 
             if (NULL != error_file) {
-                if ((NULL != ptr) &&
-                    EMB_ALLOC_PTR_IS_IN_MEMPOOL(ptr, mempool, kEmbAllocMempoolStart)) {
-                    memory_offset = (unsigned char*) ptr - (unsigned char*) mempool;
-                }
-
-                fprintf(error_file, "\nTrying to reallocate %zu bytes from the 0x%p location "
-                    "/ %zu mempool offset\n", size, ptr, memory_offset);
+                 fprintf(error_file, "\nTrying to free memory from the 0x%p location\n", ptr);
 
                 fflush (error_file);
                 fclose (error_file);
@@ -2281,12 +4051,33 @@ void* EmbAllocRealloc (EmbAllocMempool mempool, void* ptr, size_t size)
         }
 #endif /** VERBOSE_DUMP_MEMPOOL */
 
-        if (ptr || size) {
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+        if (ptr && aux_data->remote_free_queues &&
+            (EmbAllocGetThreadIndex () != __atomic_load_n (&(aux_data->owner_thread), __ATOMIC_RELAXED))) {
+            freed_lock_free = EmbAllocQueueRemoteFreeInternal (mempool, ptr);
+        }
+
+        if (ptr && !freed_lock_free && aux_data->lock_free_single_blocks) {
+            freed_lock_free = EmbAllocFreeLockFreeInternal (mempool, ptr);
+#ifdef VERBOSE_DUMP_MEMPOOL
+            valid_pointer_param = freed_lock_free;
+#endif /** VERBOSE_DUMP_MEMPOOL */
+        }
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+        if (ptr && !freed_lock_free) {
             bool lock_acquired = true;
             EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+            EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+            /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+            unsigned char i = EmbAllocCategoryIndexForPtrInternal (categories, ptr);
+            /** Only the owning category is locked; a pointer outside all of them is
+             * rejected without touching any blocks management data. */
+            unsigned int lock_mask = (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) ?
+                EMB_ALLOC_CATEGORY_MASK (i) : 0;
 
             if (aux_data->thread_sync_mutex_initialized) {
-                lock_acquired = !EmbAllocLockMutex ( &(aux_data->thread_sync_mutex));
+                lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, lock_mask);
 
                 if (!lock_acquired) {
                     /** Lock failed: report (if a callback is set) and fail immediately, without
@@ -2301,24 +4092,16 @@ void* EmbAllocRealloc (EmbAllocMempool mempool, void* ptr, size_t size)
             if (lock_acquired) {
                 ClearMempoolErrorInternal (aux_data);
 
-                if (NULL == ptr) {
-                    if (size) {
-                        return_value = EmbAllocMallocInternal (settings,
-                            EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool),
-                            size);
-                    }
-                } else if (0 == size) {
-                    EmbAllocFreeInternal (settings,
-                        EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool),
-                        ptr);
-                } else {
-                    return_value = EmbAllocReallocInternal (settings,
-                        EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool),
-                        ptr, size);
-                }
+                /** GetCategoryForPtr (reached via FreeInternal) is now the single
+                 * validator; it rejects a foreign/interior/forged pointer with
+                 * kEmbAllocPointerParamError, so there is no duplicated pre-check. */
+                EmbAllocFreeInternal (settings, categories, ptr);
+#ifdef VERBOSE_DUMP_MEMPOOL
+                valid_pointer_param = (kEmbAllocPointerParamError != aux_data->last_error);
+#endif /** VERBOSE_DUMP_MEMPOOL */
 
                 if (aux_data->thread_sync_mutex_initialized &&
-                    EmbAllocUnlockMutex ( &(aux_data->thread_sync_mutex)) &&
+                    EmbAllocUnlockCategoriesInternal (aux_data, lock_mask) &&
                     (NULL != error_callback_fn)) {
                     /** Unlock failed: the mutex is no longer reliably held, so report
                      * via the callback directly rather than writing the shared error
@@ -2333,26 +4116,17 @@ void* EmbAllocRealloc (EmbAllocMempool mempool, void* ptr, size_t size)
             FILE* error_file = fopen (settings->error_dump_file_name, "a");
 
             if (NULL != error_file) {
-                size_t initial_memory_offset = EMB_ALLOC_VALUE_NOT_SET;
-
-                if ((NULL != ptr) &&
-                    EMB_ALLOC_PTR_IS_IN_MEMPOOL(ptr, mempool, kEmbAllocMempoolStart)) {
-                    initial_memory_offset = (unsigned char*) ptr - (unsigned char*) mempool;
-                }
-
-                if (NULL != return_value) {
-                    size_t final_memory_offset = (unsigned char*) return_value - (unsigned char*) mempool;
+                if (valid_pointer_param) {
+                    size_t memory_offset = (unsigned char*) ptr - (unsigned char*) mempool;
 
-                    fprintf(error_file, "Reallocated %zu bytes from the 0x%p location "
-                        "/ %zu mempool offset to the 0x%p location "
-                        "/ %zu mempool offset\n", size, ptr, initial_memory_offset,
-                        return_value, final_memory_offset);
+                    fprintf(error_file, "Freed bytes at the 0x%p location "
+                        "/ %zu mempool offset\n", ptr,
+                        memory_offset);
 
                     EmbAllocDumpMempoolInternal (mempool,  EmbAllocGetMemoryRequirementsInternal (settings), 
-                        error_file, final_memory_offset);
+                        error_file, memory_offset);
                 } else {
-                    fprintf(error_file, "\nFailed to reallocate %zu bytes from the 0x%p location "
-                        "/ %zu mempool offset\n", size, ptr, initial_memory_offset);
+                    fprintf(error_file, "\nFailed to free bytes at the 0x%p location\n", ptr);
                 }
 
                 fflush (error_file);
@@ -2362,111 +4136,2378 @@ void* EmbAllocRealloc (EmbAllocMempool mempool, void* ptr, size_t size)
             }
         }
 #endif /** VERBOSE_DUMP_MEMPOOL */
-
-        return return_value;
-    } else {
-        /** This is not a mempool, so we cannot send back a more detailed error message. */
-        return NULL;
     }
 }
 
-bool EmbAllocGetSettings (const EmbAllocMempool mempool, EmbAllocMemPoolSettings* settings)
+void EmbAllocFreeSized (EmbAllocMempool mempool, void* ptr, size_t size)
 {
     if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
-        EmbAllocMemPoolSettings* mempool_settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
         EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+        EmbAllocBlockCategory* category = NULL;
+        uintptr_t block = (uintptr_t) ptr - categories->header_size;
+        /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+        unsigned char i = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
 
-        if (NULL != settings) {
-            /** No need to threadsync here since the settings do not change after mempool create. */
-            *settings = *mempool_settings;
-            return true;
-        } else {
-            bool lock_acquired = true;
-            EmbAllocErrorCallback error_callback_fn = mempool_settings->error_callback_fn;
+        if (NULL == ptr) {
+            return;
+        }
 
-            if (aux_data->thread_sync_mutex_initialized) {
-                lock_acquired = !EmbAllocLockMutex ( &(aux_data->thread_sync_mutex));
+        /** The size names the category the allocation went to, without the category search. */
+        if ((0 != size) && (size <= (EMB_ALLOC_SIZE_CLASS_COUNT * EMB_ALLOC_SIZE_CLASS_BYTES))) {
+            i = aux_data->size_class_category [EMB_ALLOC_SIZE_CLASS (size)];
+        }
 
-                if (!lock_acquired) {
-                    /** Lock failed: report (if a callback is set) and fail immediately, without
-                    * reading the shared error slot unsynchronized or unlocking a mutex we
-                    * never acquired. */
-                    if (NULL != error_callback_fn) {
-                        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
-                    }
-                }
+        /**
+         * An allocation that landed elsewhere (its preferred category was full, or it
+         * spans several blocks), and the lock-free paths, take the regular free.
+         */
+        if ((EMB_ALLOC_NUM_BLOCK_CATEGORIES == i) ||
+            ((uintptr_t) categories [i].start_address > block) ||
+            ((uintptr_t) categories [i].last_address < block) ||
+            (size > categories [i].block_data_size)
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+            || aux_data->lock_free_single_blocks || aux_data->remote_free_queues
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+            ) {
+            EmbAllocFree (mempool, ptr);
+            return;
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocLockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (i))) {
+            /** Lock failed: report (if a callback is set) and fail immediately. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
             }
+            return;
+        }
 
-            if (lock_acquired) {
-                EmbAllocSetErrorInternal (mempool,
-                    kEmbAllocOutputParamError, EMB_ALLOC_INVALID_OUTPUT_PARAM_ERROR, NULL);
+        ClearMempoolErrorInternal (aux_data);
 
-                if (aux_data->thread_sync_mutex_initialized &&
-                    EmbAllocUnlockMutex ( &(aux_data->thread_sync_mutex)) &&
-                    (NULL != error_callback_fn)) {
-                    /** Unlock failed: the mutex is no longer reliably held, so report
-                     * via the callback directly rather than writing the shared error
-                     * slot unsynchronized (which would race a lock-holding writer). */
-                    error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        if (settings->full_overflow_checks) {
+            /** Full validation, plus the size the caller freed with. */
+            category = EmbAllocGetCategoryForPtr (categories, ptr);
+
+            if (NULL != category) {
+                if (size != *EmbAllocDataSizeInternal (category,
+                    EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr))) {
+                    EmbAllocSetErrorInternal (mempool, kEmbAllocSizeParamError,
+                        EMB_ALLOC_INVALID_SIZE_PARAM_ERROR, ptr);
                 }
+
+                EmbAllocFreeBlockInternal (settings, category, ptr);
+            } else {
+                EmbAllocSetErrorInternal (mempool, kEmbAllocPointerParamError,
+                    EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
             }
+        } else if (!EmbAllocFreeSizedInternal (categories + i, ptr)) {
+            /** Not a live single-block head: the regular free reports why. */
+            EmbAllocFreeInternal (settings, categories, ptr);
+        }
 
-            return false;
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocUnlockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (i)) &&
+            (NULL != error_callback_fn)) {
+            /** Unlock failed: the mutex is no longer reliably held, so report
+             * via the callback directly rather than writing the shared error
+             * slot unsynchronized (which would race a lock-holding writer). */
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
         }
-    } else {
-        /** This is not a mempool, so we cannot send back a more detailed error message. */
-        return false;
     }
 }
 
-bool EmbAllocGetLastErrorCodeAndMessage (EmbAllocMempool mempool, EmbAllocErrors *code, char *message, size_t message_len)
+size_t EmbAllocMallocBatch (EmbAllocMempool mempool, size_t size, size_t count, void** ptrs)
 {
     if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
         EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
         const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
         EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
-        bool ret_val = true;
+        EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
         bool lock_acquired = true;
+        size_t allocated = 0;
+        size_t j = 0;
+        /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+        unsigned char i = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+        unsigned int lock_mask = EMB_ALLOC_ALL_CATEGORIES_MASK;
+
+        if (NULL == ptrs) {
+            EmbAllocSetErrorInternal (mempool,
+                kEmbAllocOutputParamError, EMB_ALLOC_INVALID_OUTPUT_PARAM_ERROR, NULL);
+            return 0;
+        }
 
-        if (aux_data->thread_sync_mutex_initialized) {
-            lock_acquired = !EmbAllocLockMutex ( &(aux_data->thread_sync_mutex));
+        for (j = 0; j < count; j++) {
+            ptrs [j] = NULL;
         }
 
-        if (!lock_acquired) {
-            /** Lock failed: report (if a callback is set) and fail immediately, without
-             * reading the shared error slot unsynchronized or unlocking a mutex we
-             * never acquired. */
-            if (NULL != error_callback_fn) {
-                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
-            }
-            return false;
+        if ((0 == size) || (0 == count)) {
+            return 0;
         }
 
-        if (NULL != code) {
-            *code = aux_data->last_error;
-        } else {
-            ret_val = false;
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+        if (aux_data->remote_free_queues &&
+            (EmbAllocGetThreadIndex () == __atomic_load_n (&(aux_data->owner_thread), __ATOMIC_RELAXED))) {
+            EmbAllocDrainRemoteFreesInternal (mempool);
         }
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
 
-        if (ret_val && (NULL != message) &&
-            (message_len > strlen (aux_data->last_error_message))) {
-            strncpy (message, aux_data->last_error_message, message_len - 1);
-            message[message_len - 1] = '\0';
-        } else {
-            ret_val = false;
+        /**
+         * Same two steps as EmbAllocMalloc, each under its locks once for the whole
+         * batch: the preferred category of the size under its own lock, then the full
+         * category search under all the category locks for what is left.
+         */
+        if (size <= (EMB_ALLOC_SIZE_CLASS_COUNT * EMB_ALLOC_SIZE_CLASS_BYTES)) {
+            i = aux_data->size_class_category [EMB_ALLOC_SIZE_CLASS (size)];
+
+            if (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) {
+                lock_mask = EMB_ALLOC_CATEGORY_MASK (i);
+            }
+        }
+
+        ClearMempoolErrorInternal (aux_data);
+
+        while (lock_acquired && (0 != lock_mask)) {
+            if (aux_data->thread_sync_mutex_initialized) {
+                lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, lock_mask);
+
+                if (!lock_acquired) {
+                    if (NULL != error_callback_fn) {
+                        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+                    }
+                }
+            }
+
+            if (lock_acquired) {
+                if (EMB_ALLOC_ALL_CATEGORIES_MASK == lock_mask) {
+                    while (allocated < count) {
+                        void* ptr = EmbAllocMallocInternal (settings, categories, size);
+
+                        if (NULL == ptr) {
+                            break;
+                        }
+                        ptrs [allocated++] = ptr;
+                    }
+                } else {
+                    allocated += EmbAllocMallocBlocksInternal (settings, categories + i,
+                        size, count - allocated, ptrs + allocated);
+                }
+
+                if (aux_data->thread_sync_mutex_initialized &&
+                    EmbAllocUnlockCategoriesInternal (aux_data, lock_mask) &&
+                    (NULL != error_callback_fn)) {
+                    /** Unlock failed: the mutex is no longer reliably held, so report
+                     * via the callback directly rather than writing the shared error
+                     * slot unsynchronized (which would race a lock-holding writer). */
+                    error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+                }
+            }
+
+            lock_mask = ((allocated < count) && 
+                (EMB_ALLOC_ALL_CATEGORIES_MASK != lock_mask)) ?
+                EMB_ALLOC_ALL_CATEGORIES_MASK : 0;
+        }
+
+        return allocated;
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return 0;
+    }
+}
+
+void EmbAllocFreeBatch (EmbAllocMempool mempool, void* const* ptrs, size_t count)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+        bool lock_acquired = true;
+        bool invalid_pointers = false;
+        /** The category index of every pointer of the current group (see below). */
+        unsigned char group_categories [EMB_ALLOC_FREE_BATCH_GROUP_SIZE];
+        /** The positions in the group of its pointers, sorted by category. */
+        unsigned char group_order [EMB_ALLOC_FREE_BATCH_GROUP_SIZE];
+        /** The block counts of the pointers of one category of the group. */
+        EmbAllocCounter group_run_counts [EMB_ALLOC_FREE_BATCH_GROUP_SIZE];
+        /**
+         * Where the pointers of every category start (then end) in group_order; the
+         * pointers outside every category count as one more category, sorted last.
+         */
+        size_t category_offsets [EMB_ALLOC_NUM_BLOCK_CATEGORIES + 2];
+        size_t group_start = 0;
+        size_t group_size = 0;
+        size_t j = 0;
+        /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+        unsigned char i = 0;
+        unsigned int lock_mask = 0;
+
+        if ((NULL == ptrs) || (0 == count)) {
+            return;
+        }
+
+        /**
+         * Only the categories that own a pointer of the batch are locked, once. The
+         * categories of the first group are kept for the frees below.
+         */
+        for (j = 0; j < count; j++) {
+            i = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+
+            if (NULL != ptrs [j]) {
+                i = EmbAllocCategoryIndexForPtrInternal (categories, ptrs [j]);
+
+                if (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) {
+                    lock_mask |= EMB_ALLOC_CATEGORY_MASK (i);
+                } else {
+                    invalid_pointers = true;
+                }
+            }
+
+            if (j < EMB_ALLOC_FREE_BATCH_GROUP_SIZE) {
+                group_categories [j] = i;
+            }
+        }
+
+        if (aux_data->thread_sync_mutex_initialized) {
+            lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, lock_mask);
+
+            if (!lock_acquired) {
+                if (NULL != error_callback_fn) {
+                    error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+                }
+                return;
+            }
+        }
+
+        ClearMempoolErrorInternal (aux_data);
+
+        /**
+         * The pointers of every group are counting-sorted by category and freed one
+         * category after the other: each pointer is still validated on its own (see
+         * EmbAllocFree), but the bitmap words, counters and free-block hints of a
+         * category are written once for the group (see
+         * EmbAllocFreeBatchCategoryInternal).
+         */
+        for (group_start = 0; group_start < count; group_start += group_size) {
+            group_size = count - group_start;
+
+            if (group_size > EMB_ALLOC_FREE_BATCH_GROUP_SIZE) {
+                group_size = EMB_ALLOC_FREE_BATCH_GROUP_SIZE;
+            }
+
+            if (0 != group_start) {
+                for (j = 0; j < group_size; j++) {
+                    group_categories [j] = (NULL != ptrs [group_start + j]) ?
+                        EmbAllocCategoryIndexForPtrInternal (categories, ptrs [group_start + j]) :
+                        EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+                }
+            }
+
+            memset (category_offsets, 0, sizeof (category_offsets));
+
+            for (j = 0; j < group_size; j++) {
+                category_offsets [group_categories [j] + 1]++;
+            }
+
+            for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+                category_offsets [i + 1] += category_offsets [i];
+            }
+
+            /** Pointers outside every category sort last and are not freed. */
+            for (j = 0; j < group_size; j++) {
+                group_order [category_offsets [group_categories [j]]++] = (unsigned char) j;
+            }
+
+            /** category_offsets [i] is now where the pointers of category i end. */
+            for (i = 0, j = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+                if (category_offsets [i] > j) {
+                    EmbAllocFreeBatchCategoryInternal (settings, categories, categories + i,
+                        ptrs + group_start, group_order + j, category_offsets [i] - j,
+                        group_run_counts);
+                }
+
+                j = category_offsets [i];
+            }
+        }
+
+        /** Pointers outside every category are rejected without touching any block. */
+        if (invalid_pointers) {
+            EmbAllocSetErrorInternal (mempool, kEmbAllocPointerParamError,
+                EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
         }
 
         if (aux_data->thread_sync_mutex_initialized &&
-            EmbAllocUnlockMutex ( &(aux_data->thread_sync_mutex)) &&
+            EmbAllocUnlockCategoriesInternal (aux_data, lock_mask) &&
             (NULL != error_callback_fn)) {
             /** Unlock failed: the mutex is no longer reliably held, so report
-                * via the callback directly rather than writing the shared error
-                * slot unsynchronized (which would race a lock-holding writer). */
+             * via the callback directly rather than writing the shared error
+             * slot unsynchronized (which would race a lock-holding writer). */
             error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
         }
+    }
+}
 
-        return ret_val;
+void* EmbAllocReallocInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* categories, void* ptr, size_t size)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocBlockCategory* category = EmbAllocGetCategoryForPtr (categories, ptr);
+
+    if (NULL != category) {
+        return EmbAllocReallocBlockInternal (settings, category, categories, ptr, size);
     } else {
-        return false;
+        EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings), 
+            kEmbAllocPointerParamError, EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
+    }
+
+    return NULL;
+}
+
+
+void* EmbAllocReallocBlockInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* category, EmbAllocBlockCategory* categories, 
+    void* ptr, size_t size)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    void* block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+    EmbAllocCounter* used_block_count = EmbAllocUseCountInternal (category, block);
+    EmbAllocCounter* data_size = EmbAllocDataSizeInternal (category, block);
+    size_t block_data_size = category->block_data_size + 
+        (   (*used_block_count - 1) * 
+            category->stride);
+
+    if (settings->full_overflow_checks &&
+        !EmbAllocCheckBuffer (
+                (void*) ((unsigned char*) ptr + *data_size),
+                block_data_size - *data_size, 
+                EMB_ALLOC_INIT_VALUE)) {
+        EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings), 
+            kEmbAllocOverflow, EMB_ALLOC_OVERFLOW_ERROR, 
+            (void*) ((unsigned char*) ptr + *data_size));
+        memset ((unsigned char*) ptr + *data_size, EMB_ALLOC_INIT_VALUE, block_data_size - *data_size);
+    }
+
+    if (size == *data_size) {
+        /** Ih the new size is the same, do nothing, just return the same pointer. */
+        return ptr;
+    }
+
+    if (size < *data_size) {
+        /**
+         * If the new size is smaller, reset the extra buffer to EMB_ALLOC_INIT_VALUE and
+         * give the trailing blocks the new size no longer needs back to the category:
+         * the run is split in place (no copy) and the surplus is reusable right away.
+         */
+        size_t kept_blocks = 1;
+
+        if (size > category->block_data_size) {
+            kept_blocks += 
+                EmbAllocStrideBlocksInternal (category, size - category->block_data_size);
+        }
+
+        memset ((unsigned char*) ptr + size, EMB_ALLOC_INIT_VALUE, *data_size - size);
+        *data_size = (EmbAllocCounter) size;
+
+        if (kept_blocks < *used_block_count) {
+            EmbAllocReleaseBlocksInternal (category,
+                (void*) ((unsigned char*) block +
+                    (kept_blocks * category->stride)),
+                *used_block_count - kept_blocks);
+
+            /** Close the kept run with its own end marker. */
+            if (EMB_ALLOC_CATEGORY_HAS_MARKERS (category)) {
+                memcpy (EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (block, 
+                        category->block_data_size + 
+                        (   (kept_blocks - 1) * 
+                            category->stride)),
+                    kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT);
+            }
+
+            *used_block_count = (EmbAllocCounter) kept_blocks;
+        }
+
+        return ptr;
+    } else {
+        if (size <= block_data_size) {
+            if (settings->init_allocated_memory) {
+                /**
+                 * If the new size is bigger, but still fits inside the current block,
+                 * just reset the extra buffer to 0.
+                 */
+                memset ((unsigned char*) ptr + *data_size, 0, size - *data_size);
+            }
+
+            *data_size = (EmbAllocCounter) size;
+            return ptr;
+        } else {
+            void* return_value = NULL;
+            /**
+             * Grow beyond the current block(s): `size` exceeds the existing capacity
+             * block_data_size. Round up the extra bytes (size - block_data_size) by the
+             * per-block stride to get how many additional blocks must be appended -- the
+             * code then tries to claim that many free blocks contiguously right after
+             * the current run (an in-place grow), falling back to allocate-copy-free.
+             */
+            size_t required_extra_blocks =
+                EmbAllocStrideBlocksInternal (category, size - block_data_size);
+
+            /**
+             * Try to realloc in the same category only if the new extra size 
+             * fits in the number of free blocks from this category. 
+             */
+            if ((category->occupied_blocks <= category->total_blocks) &&
+                (required_extra_blocks <= (category->total_blocks - category->occupied_blocks))) {
+                size_t block_index = EmbAllocBlockIndexInternal (category, block);
+                size_t front_free_blocks = 0;
+                size_t back_free_blocks = 0;
+
+                /**
+                 * It is not sufficient to have the required number of free blocks,
+                 * they need to be continous as well: test the blocks right after the
+                 * current run a bitmap word at a time.
+                 */
+                if ((required_extra_blocks <= category->max_free_run) &&
+                    EmbAllocRunIsFreeInternal (category, block_index + *used_block_count,
+                        required_extra_blocks)) {
+                    EmbAllocGrowForwardInternal (settings, category, block,
+                        required_extra_blocks);
+
+                    if (settings->init_allocated_memory) {
+                        memset ((unsigned char*) ptr + *data_size, 0, size - *data_size);
+                    }
+
+                    *data_size = (EmbAllocCounter) size;
+                    return ptr;
+                }
+
+                /**
+                 * The blocks after the run are not enough on their own: count the free
+                 * blocks directly before the head as well. If both sides together cover
+                 * the growth, the head moves back over the preceding blocks and the
+                 * payload is moved down (memmove, the ranges overlap); this still
+                 * beats malloc + memcpy + free as no second run has to be found.
+                 */
+                back_free_blocks = EmbAllocFreeBlocksAfterInternal (category,
+                    block_index + *used_block_count, required_extra_blocks);
+                front_free_blocks = EmbAllocFreeBlocksBeforeInternal (category,
+                    block_index, required_extra_blocks - back_free_blocks);
+
+                if ((0 != front_free_blocks) &&
+                    ((front_free_blocks + back_free_blocks) >= required_extra_blocks)) {
+                    size_t back_blocks = back_free_blocks;
+                    size_t front_blocks = required_extra_blocks - back_blocks;
+                    /** The old head control is overwritten by the move, so keep copies. */
+                    size_t old_block_count = *used_block_count;
+                    size_t new_block_count = old_block_count + required_extra_blocks;
+                    size_t new_block_data_size = block_data_size +
+                        (   required_extra_blocks *
+                            category->stride);
+                    size_t old_data_size = *data_size;
+                    void* new_block = (void*) ((unsigned char*) block -
+                        (front_blocks * category->stride));
+                    void* new_ptr = EMB_ALLOC_GET_CATEGORY_PTR_FROM_BLOCK (category, new_block);
+
+                    /**
+                     * Claim the preceding blocks keeping their start control (it becomes
+                     * the new head) and the following blocks keeping their end marker
+                     * (it becomes the new tail), exactly like the forward grow does.
+                     */
+                    EmbAllocMergeFreeBlocksInternal (settings, category, new_block,
+                        front_blocks, true, false);
+
+                    if (0 != back_blocks) {
+                        EmbAllocMergeFreeBlocksInternal (settings, category,
+                            (void*) ((unsigned char*) block +
+                                (   *used_block_count *
+                                    category->stride)),
+                            back_blocks, false, true);
+                    }
+
+                    /**
+                     * Move the payload down, then turn everything past it (the old head
+                     * control, the old end marker and any merged tail) into
+                     * EMB_ALLOC_INIT_VALUE payload and close the run with its end marker.
+                     */
+                    memmove (new_ptr, ptr, old_data_size);
+                    memset ((unsigned char*) new_ptr + old_data_size, EMB_ALLOC_INIT_VALUE,
+                        new_block_data_size - old_data_size);
+                    if (EMB_ALLOC_CATEGORY_HAS_MARKERS (category)) {
+                        memcpy (EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (new_block,
+                                new_block_data_size),
+                            kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT);
+                    }
+
+                    if (settings->init_allocated_memory) {
+                        memset ((unsigned char*) new_ptr + old_data_size, 0, size - old_data_size);
+                    }
+
+                    *EmbAllocUseCountInternal (category, new_block) =
+                        (EmbAllocCounter) new_block_count;
+                    *EmbAllocDataSizeInternal (category, new_block) = (EmbAllocCounter) size;
+
+                    EmbAllocMarkBlocksInternal (category, new_block, front_blocks, true);
+
+                    if (0 != back_blocks) {
+                        EmbAllocMarkBlocksInternal (category,
+                            (void*) ((unsigned char*) new_block +
+                                (   (front_blocks + old_block_count) *
+                                    category->stride)),
+                            back_blocks, true);
+                    }
+
+                    EmbAllocSetAllocStartInternal (category, block, false);
+                    EmbAllocSetAllocStartInternal (category, new_block, true);
+
+                    category->occupied_blocks += (EmbAllocCounter) required_extra_blocks;
+
+                    if (category->occupied_blocks >= category->total_blocks) {
+                        category->occupied_blocks = category->total_blocks;
+                        category->first_free_address = NULL;
+                        category->last_free_address = NULL;
+                    } else {
+                        /** The head may have moved below first_free: rescan from it. */
+                        EmbAllocRefreshFirstFreeInternal (category);
+                    }
+
+                    return new_ptr;
+                }
+            }
+
+            /**
+             * Malloc, copy and free only if the memory reallocation could not be done
+             * inside the same category continously, and the caller holds the locks of
+             * all the categories.
+             */
+            if (NULL == categories) {
+                return NULL;
+            }
+
+            return_value = EmbAllocMallocInternal (settings, categories, size);
+
+            if (NULL != return_value) {
+                memcpy (return_value, ptr, *data_size);
+                EmbAllocFreeBlockInternal (settings, category, ptr);
+            }
+
+            return return_value;
+        }
     }
+
+    return NULL;
+}
+
+void EmbAllocGrowForwardInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* category, void* block, size_t extra_blocks)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocCounter* used_block_count = EmbAllocUseCountInternal (category, block);
+    void* extension = (void*) ((unsigned char*) block +
+        (*used_block_count * category->stride));
+    void* block_end_padding = EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (block, 
+        category->block_data_size +
+        (   (*used_block_count - 1) * 
+            category->stride));
+
+    EmbAllocMergeFreeBlocksInternal (settings, category, extension, extra_blocks,
+        false, true);
+
+    /** Mark the newly merged extension blocks occupied in the bitmap. */
+    EmbAllocMarkBlocksInternal (category, extension, extra_blocks, true);
+
+    /**
+     * Reset the "old" block end padding to EMB_ALLOC_INIT_VALUE.
+     */
+    if (EMB_ALLOC_CATEGORY_HAS_MARKERS (category)) {
+        memset (block_end_padding, 
+            EMB_ALLOC_INIT_VALUE, EMB_ALLOC_ALIGN_AMOUNT);
+    }
+
+    *used_block_count += (EmbAllocCounter) extra_blocks;
+    category->occupied_blocks += (EmbAllocCounter) extra_blocks;
+
+    if (category->occupied_blocks >= category->total_blocks) {
+        category->occupied_blocks = category->total_blocks;
+        category->first_free_address = NULL;
+        category->last_free_address = NULL;
+    } else {
+        /** The grow consumed blocks above the original allocation;
+         * first_free remains a valid lower bound, so refresh it
+         * authoritatively rather than via stale-last_free rescans. */
+        EmbAllocRefreshFirstFreeInternal (category);
+    }
+}
+
+size_t EmbAllocExpandInPlaceInternal (const EmbAllocMemPoolSettings* settings, 
+    EmbAllocBlockCategory* categories, void* ptr, size_t min_size, size_t max_size)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocBlockCategory* category = EmbAllocGetCategoryForPtr (categories, ptr);
+    void* block = NULL;
+    EmbAllocCounter* used_block_count = NULL;
+    EmbAllocCounter* data_size = NULL;
+    size_t block_data_size = 0;
+    size_t new_size = 0;
+
+    if (NULL == category) {
+        /** The pointer error is already set by EmbAllocGetCategoryForPtr. */
+        return 0;
+    }
+
+    block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+    used_block_count = EmbAllocUseCountInternal (category, block);
+    data_size = EmbAllocDataSizeInternal (category, block);
+    block_data_size = category->block_data_size + 
+        (   (*used_block_count - 1) * 
+            category->stride);
+
+    if (settings->full_overflow_checks &&
+        !EmbAllocCheckBuffer (
+                (void*) ((unsigned char*) ptr + *data_size),
+                block_data_size - *data_size, 
+                EMB_ALLOC_INIT_VALUE)) {
+        EmbAllocSetErrorInternal (EMB_ALLOC_GET_MEMPOOL_FROM_SETTINGS_PTR (settings), 
+            kEmbAllocOverflow, EMB_ALLOC_OVERFLOW_ERROR, 
+            (void*) ((unsigned char*) ptr + *data_size));
+        memset ((unsigned char*) ptr + *data_size, EMB_ALLOC_INIT_VALUE, block_data_size - *data_size);
+    }
+
+    /** Never shrink: the chunk already holds everything that was asked for. */
+    if (max_size <= *data_size) {
+        return *data_size;
+    }
+
+    if ((max_size > block_data_size) &&
+        (category->occupied_blocks < category->total_blocks)) {
+        /**
+         * Claim as many of the free blocks right after the run as max_size needs (the
+         * same contiguity walk the realloc grow uses), but only if they take the chunk
+         * to at least min_size: a partial grow that is still too small is useless.
+         */
+        size_t wanted_blocks = 
+            EmbAllocStrideBlocksInternal (category, max_size - block_data_size);
+        size_t extra_blocks = EmbAllocFreeBlocksAfterInternal (category,
+            EmbAllocBlockIndexInternal (category, block) + *used_block_count, wanted_blocks);
+        size_t extra_size = extra_blocks * 
+            category->stride;
+
+        if ((0 != extra_blocks) && ((block_data_size + extra_size) >= min_size)) {
+            EmbAllocGrowForwardInternal (settings, category, block, extra_blocks);
+            block_data_size += extra_size;
+        }
+    }
+
+    new_size = (max_size < block_data_size) ? max_size : block_data_size;
+
+    if ((new_size >= min_size) && (new_size > *data_size)) {
+        if (settings->init_allocated_memory) {
+            memset ((unsigned char*) ptr + *data_size, 0, new_size - *data_size);
+        }
+
+        *data_size = (EmbAllocCounter) new_size;
+    }
+
+    return *data_size;
+}
+
+size_t EmbAllocUsableSizeInternal (EmbAllocBlockCategory* categories, void* ptr)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocBlockCategory* category = EmbAllocGetCategoryForPtr (categories, ptr);
+
+    if (NULL != category) {
+        EmbAllocCounter* used_block_count = EmbAllocUseCountInternal (category, 
+            EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr));
+
+        return category->block_data_size + 
+            (   (*used_block_count - 1) * 
+                category->stride);
+    }
+
+    /** The pointer error is already set by EmbAllocGetCategoryForPtr. */
+    return 0;
+}
+
+size_t EmbAllocGoodSizeInternal (const EmbAllocBlockCategory* categories, size_t size)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+
+    /** The best fit: the smallest block that holds the whole size. */
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        if ((0 != categories [i].total_blocks) &&
+            (categories [i].block_data_size >= size)) {
+            return categories [i].block_data_size;
+        }
+    }
+
+    /**
+     * No single block is large enough: the allocation takes a multi-block run in the
+     * largest category that has enough blocks (same rounding as
+     * EmbAllocCanAllocInMultipleBlocksInternal).
+     */
+    for (i = EMB_ALLOC_NUM_BLOCK_CATEGORIES; i > 0; i--) {
+        const EmbAllocBlockCategory* category = categories + (i - 1);
+
+        if (0 != category->total_blocks) {
+            size_t blocks_count = EmbAllocStrideBlocksInternal (category,
+                size + EMB_ALLOC_CATEGORY_CONTROL_SIZE (category));
+
+            if (blocks_count <= category->total_blocks) {
+                return category->block_data_size + 
+                    (   (blocks_count - 1) * 
+                        category->stride);
+            }
+        }
+    }
+
+    return 0;
+}
+
+void* EmbAllocRealloc (EmbAllocMempool mempool, void* ptr, size_t size)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        void* return_value = NULL;
+
+#ifdef VERBOSE_DUMP_MEMPOOL
+        if (strlen (settings->error_dump_file_name)) {
+            size_t memory_offset = EMB_ALLOC_VALUE_NOT_SET;
+            FILE* error_file = fopen (settings->error_dump_file_name, "a");
+
+            if (NULL != error_file) {
+                if ((NULL != ptr) &&
+                    EMB_ALLOC_PTR_IS_IN_MEMPOOL(ptr, mempool, kEmbAllocMempoolStart)) {
+                    memory_offset = (unsigned char*) ptr - (unsigned char*) mempool;
+                }
+
+                fprintf(error_file, "\nTrying to reallocate %zu bytes from the 0x%p location "
+                    "/ %zu mempool offset\n", size, ptr, memory_offset);
+
+                fflush (error_file);
+                fclose (error_file);
+            } else {
+                perror ("Error writing the error message in the mempool error dump file");
+            }
+        }
+#endif /** VERBOSE_DUMP_MEMPOOL */
+
+        if (ptr || size) {
+            bool lock_acquired = true;
+            bool relocate = false;
+            EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+            EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+            /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+            unsigned char i = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+            unsigned int lock_mask = EMB_ALLOC_ALL_CATEGORIES_MASK;
+
+            /**
+             * Lock ordering protocol: an existing chunk is first resized in place under
+             * its category's lock alone. If it has to move, that lock is released and
+             * all the category locks are taken in ascending order, and the reallocation
+             * starts over: the chunk is the caller's, only its neighbourhood may have
+             * changed in between. A call never waits for a lock while holding one out of
+             * order, so the categories cannot deadlock.
+             */
+            if (NULL != ptr) {
+                i = EmbAllocCategoryIndexForPtrInternal (categories, ptr);
+                lock_mask = (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) ?
+                    EMB_ALLOC_CATEGORY_MASK (i) : 0;
+            }
+
+            ClearMempoolErrorInternal (aux_data);
+
+            do {
+                if (aux_data->thread_sync_mutex_initialized) {
+                    lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, lock_mask);
+
+                    if (!lock_acquired) {
+                        /** Lock failed: report (if a callback is set) and fail immediately,
+                        * without reading the blocks management data unsynchronized or
+                        * unlocking a mutex we never acquired. */
+                        if (NULL != error_callback_fn) {
+                            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+                        }
+                        break;
+                    }
+                }
+
+                if (NULL == ptr) {
+                    return_value = EmbAllocMallocInternal (settings, categories, size);
+                } else if (0 == size) {
+                    EmbAllocFreeInternal (settings, categories, ptr);
+                } else if (relocate) {
+                    return_value = EmbAllocReallocInternal (settings, categories, ptr, size);
+                    relocate = false;
+                } else {
+                    EmbAllocBlockCategory* category = EmbAllocGetCategoryForPtr (categories, ptr);
+
+                    if (NULL != category) {
+                        return_value = EmbAllocReallocBlockInternal (settings, category, NULL,
+                            ptr, size);
+                        relocate = (NULL == return_value);
+                    } else {
+                        EmbAllocSetErrorInternal (mempool, kEmbAllocPointerParamError,
+                            EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
+                    }
+                }
+
+                if (aux_data->thread_sync_mutex_initialized &&
+                    EmbAllocUnlockCategoriesInternal (aux_data, lock_mask) &&
+                    (NULL != error_callback_fn)) {
+                    /** Unlock failed: the mutex is no longer reliably held, so report
+                     * via the callback directly rather than writing the shared error
+                     * slot unsynchronized (which would race a lock-holding writer). */
+                    error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+                }
+
+                lock_mask = EMB_ALLOC_ALL_CATEGORIES_MASK;
+            } while (relocate);
+        }
+
+#ifdef VERBOSE_DUMP_MEMPOOL
+        if (strlen (settings->error_dump_file_name)) {
+            FILE* error_file = fopen (settings->error_dump_file_name, "a");
+
+            if (NULL != error_file) {
+                size_t initial_memory_offset = EMB_ALLOC_VALUE_NOT_SET;
+
+                if ((NULL != ptr) &&
+                    EMB_ALLOC_PTR_IS_IN_MEMPOOL(ptr, mempool, kEmbAllocMempoolStart)) {
+                    initial_memory_offset = (unsigned char*) ptr - (unsigned char*) mempool;
+                }
+
+                if (NULL != return_value) {
+                    size_t final_memory_offset = (unsigned char*) return_value - (unsigned char*) mempool;
+
+                    fprintf(error_file, "Reallocated %zu bytes from the 0x%p location "
+                        "/ %zu mempool offset to the 0x%p location "
+                        "/ %zu mempool offset\n", size, ptr, initial_memory_offset,
+                        return_value, final_memory_offset);
+
+                    EmbAllocDumpMempoolInternal (mempool,  EmbAllocGetMemoryRequirementsInternal (settings), 
+                        error_file, final_memory_offset);
+                } else {
+                    fprintf(error_file, "\nFailed to reallocate %zu bytes from the 0x%p location "
+                        "/ %zu mempool offset\n", size, ptr, initial_memory_offset);
+                }
+
+                fflush (error_file);
+                fclose (error_file);
+            } else {
+                perror ("Error writing the error message in the mempool error dump file");
+            }
+        }
+#endif /** VERBOSE_DUMP_MEMPOOL */
+
+        return return_value;
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return NULL;
+    }
+}
+
+size_t EmbAllocExpandInPlace (EmbAllocMempool mempool, void* ptr, size_t min_size, size_t max_size)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        bool lock_acquired = true;
+        size_t return_value = 0;
+        /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+        unsigned char i = EmbAllocCategoryIndexForPtrInternal (
+            EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool), ptr);
+        /** Only the owning category is locked (see EmbAllocFree). */
+        unsigned int lock_mask = (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) ?
+            EMB_ALLOC_CATEGORY_MASK (i) : 0;
+
+        if (aux_data->thread_sync_mutex_initialized) {
+            lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, lock_mask);
+        }
+
+        if (!lock_acquired) {
+            /** Lock failed: report (if a callback is set) and fail immediately, without
+             * reading the blocks management data unsynchronized or unlocking a mutex we
+             * never acquired. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+            }
+            return 0;
+        }
+
+        ClearMempoolErrorInternal (aux_data);
+
+        if (NULL == ptr) {
+            EmbAllocSetErrorInternal (mempool, kEmbAllocPointerParamError,
+                EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
+        } else if ((0 == max_size) || (min_size > max_size)) {
+            EmbAllocSetErrorInternal (mempool, kEmbAllocSizeParamError,
+                EMB_ALLOC_INVALID_SIZE_PARAM_ERROR, NULL);
+        } else {
+            return_value = EmbAllocExpandInPlaceInternal (settings,
+                EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool),
+                ptr, min_size, max_size);
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocUnlockCategoriesInternal (aux_data, lock_mask) &&
+            (NULL != error_callback_fn)) {
+            /** Unlock failed: the mutex is no longer reliably held, so report
+             * via the callback directly rather than writing the shared error
+             * slot unsynchronized (which would race a lock-holding writer). */
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+
+        return return_value;
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return 0;
+    }
+}
+
+size_t EmbAllocUsableSize (EmbAllocMempool mempool, void* ptr)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        bool lock_acquired = true;
+        size_t return_value = 0;
+        /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+        unsigned char i = EmbAllocCategoryIndexForPtrInternal (
+            EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool), ptr);
+        /** Only the owning category is locked (see EmbAllocFree). */
+        unsigned int lock_mask = (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) ?
+            EMB_ALLOC_CATEGORY_MASK (i) : 0;
+
+        if (aux_data->thread_sync_mutex_initialized) {
+            lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, lock_mask);
+        }
+
+        if (!lock_acquired) {
+            /** Lock failed: report (if a callback is set) and fail immediately, without
+             * reading the blocks management data unsynchronized or unlocking a mutex we
+             * never acquired. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+            }
+            return 0;
+        }
+
+        ClearMempoolErrorInternal (aux_data);
+
+        if (NULL != ptr) {
+            return_value = EmbAllocUsableSizeInternal (
+                EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool), ptr);
+        } else {
+            EmbAllocSetErrorInternal (mempool, kEmbAllocPointerParamError,
+                EMB_ALLOC_INVALID_POINTER_PARAM_ERROR, NULL);
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocUnlockCategoriesInternal (aux_data, lock_mask) &&
+            (NULL != error_callback_fn)) {
+            /** Unlock failed: the mutex is no longer reliably held, so report
+             * via the callback directly rather than writing the shared error
+             * slot unsynchronized (which would race a lock-holding writer). */
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+
+        return return_value;
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return 0;
+    }
+}
+
+size_t EmbAllocGoodSize (const EmbAllocMempool mempool, size_t size)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        /** No need to threadsync here since the blocks layout does not change after mempool create. */
+        size_t return_value = (0 != size) ? EmbAllocGoodSizeInternal (
+            EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool), size) : 0;
+
+        /** The error slot has its own lock (see EmbAllocSetErrorInternal). */
+        if (0 == size) {
+            EmbAllocSetErrorInternal (mempool, kEmbAllocSizeParamError,
+                EMB_ALLOC_INVALID_SIZE_PARAM_ERROR, NULL);
+        } else if (0 == return_value) {
+            EmbAllocSetErrorInternal (mempool, kEmbAllocNoMemory,
+                EMB_ALLOC_NOT_ENOUGH_MEMORY_ERROR, NULL);
+        }
+
+        return return_value;
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return 0;
+    }
+}
+
+bool EmbAllocSetOwnerThread (EmbAllocMempool mempool, bool owner)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        size_t owner_thread = owner? EmbAllocGetThreadIndex (): EMB_ALLOC_NO_OWNER_THREAD;
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+        __atomic_store_n (&(aux_data->owner_thread), owner_thread, __ATOMIC_RELAXED);
+#else
+        aux_data->owner_thread = owner_thread;
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+        return true;
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return false;
+    }
+}
+
+bool EmbAllocGetSettings (const EmbAllocMempool mempool, EmbAllocMemPoolSettings* settings)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMemPoolSettings* mempool_settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+
+        if (NULL != settings) {
+            /** No need to threadsync here since the settings do not change after mempool create. */
+            *settings = *mempool_settings;
+            return true;
+        } else {
+            /** The error slot has its own lock (see EmbAllocSetErrorInternal). */
+            EmbAllocSetErrorInternal (mempool,
+                kEmbAllocOutputParamError, EMB_ALLOC_INVALID_OUTPUT_PARAM_ERROR, NULL);
+            return false;
+        }
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return false;
+    }
+}
+
+bool EmbAllocGetStatistics (EmbAllocMempool mempool, EmbAllocStatistics* statistics)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        bool lock_acquired = true;
+
+        if (aux_data->thread_sync_mutex_initialized) {
+            lock_acquired = !EmbAllocLockCategoriesInternal (aux_data, EMB_ALLOC_ALL_CATEGORIES_MASK);
+        }
+
+        if (!lock_acquired) {
+            /** Lock failed: report (if a callback is set) and fail immediately, without
+             * reading the blocks management data unsynchronized or unlocking a mutex we
+             * never acquired. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+            }
+            return false;
+        }
+
+        ClearMempoolErrorInternal (aux_data);
+
+        if (NULL != statistics) {
+            EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+            unsigned char i = 0;
+
+            statistics->mempool_size = EmbAllocGetMemoryRequirementsInternal (settings);
+
+            for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+                size_t longest_run = EmbAllocLongestFreeRunInternal (categories + i);
+
+                statistics->categories [i].block_data_size = categories [i].block_data_size;
+                statistics->categories [i].total_blocks = categories [i].total_blocks;
+                statistics->categories [i].free_blocks =
+                    categories [i].total_blocks - categories [i].occupied_blocks;
+                statistics->categories [i].largest_free_run = longest_run;
+
+                /** The exact value is the tightest possible bound. */
+                categories [i].max_free_run = (EmbAllocCounter) longest_run;
+            }
+        } else {
+            EmbAllocSetErrorInternal (mempool,
+                kEmbAllocOutputParamError, EMB_ALLOC_INVALID_OUTPUT_PARAM_ERROR, NULL);
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocUnlockCategoriesInternal (aux_data, EMB_ALLOC_ALL_CATEGORIES_MASK) &&
+            (NULL != error_callback_fn)) {
+            /** Unlock failed: the mutex is no longer reliably held, so report
+             * via the callback directly rather than writing the shared error
+             * slot unsynchronized (which would race a lock-holding writer). */
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+
+        return (NULL != statistics);
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return false;
+    }
+}
+
+bool EmbAllocGetLastErrorCodeAndMessage (EmbAllocMempool mempool, EmbAllocErrors *code, char *message, size_t message_len)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        bool ret_val = true;
+        bool lock_acquired = true;
+
+        if (aux_data->thread_sync_mutex_initialized) {
+            lock_acquired = !EmbAllocAcquireLock ( &(aux_data->error_sync_mutex.lock));
+        }
+
+        if (!lock_acquired) {
+            /** Lock failed: report (if a callback is set) and fail immediately, without
+             * reading the shared error slot unsynchronized or unlocking a mutex we
+             * never acquired. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+            }
+            return false;
+        }
+
+        if (NULL != code) {
+            *code = aux_data->last_error;
+        } else {
+            ret_val = false;
+        }
+
+        if (ret_val && (NULL != message) &&
+            (message_len > strlen (aux_data->last_error_message))) {
+            strncpy (message, aux_data->last_error_message, message_len - 1);
+            message[message_len - 1] = '\0';
+        } else {
+            ret_val = false;
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocReleaseLock ( &(aux_data->error_sync_mutex.lock)) &&
+            (NULL != error_callback_fn)) {
+            /** Unlock failed: the mutex is no longer reliably held, so report
+                * via the callback directly rather than writing the shared error
+                * slot unsynchronized (which would race a lock-holding writer). */
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+
+        return ret_val;
+    } else {
+        return false;
+    }
+}
+
+EmbAllocBlockCategory* EmbAllocCacheableBlockInternal (void* mempool, void* ptr)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+    const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+    EmbAllocBlockCategory* category = NULL;
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+    void* block = NULL;
+    size_t block_index = 0;
+    size_t data_size = 0;
+
+    /**
+     * Everything read here is either fixed at creation (the categories layout) or owned
+     * by the caller (the header of its own live allocation), except for the
+     * allocation-start bitmap word, which every thread of a threadsafe mempool reads and
+     * writes atomically (see EmbAllocLoadStartWordInternal). Any doubt sends the
+     * pointer to the regular, locked free path, which reports the exact error.
+     */
+    if (!EMB_ALLOC_PTR_IS_IN_MEMPOOL (ptr, mempool, kEmbAllocMempoolStart)) {
+        return NULL;
+    }
+
+    i = EmbAllocCategoryIndexForPtrInternal (categories, ptr);
+
+    if (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) {
+        category = categories + i;
+    }
+
+    if (NULL == category) {
+        return NULL;
+    }
+
+    block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+
+    block_index = EmbAllocBlockIndexInternal (category, block);
+
+    if (((uintptr_t) block - (uintptr_t) category->start_address) !=
+        (block_index * category->stride)) {
+        return NULL;
+    }
+
+    if (0 == (EmbAllocLoadStartWordInternal (category, block_index / EMB_ALLOC_BITMAP_WORD_BITS) &
+            (UINT64_C (1) << (block_index % EMB_ALLOC_BITMAP_WORD_BITS)))) {
+        return NULL;
+    }
+
+    /** A cached block has data_size EMB_ALLOC_COUNTER_NOT_SET, so it fails here too. */
+    data_size = *EmbAllocDataSizeInternal (category, block);
+
+    if ((1 != *EmbAllocUseCountInternal (category, block)) ||
+        (data_size > category->block_data_size) ||
+        (EMB_ALLOC_CATEGORY_HAS_MARKERS (category) &&
+            memcmp (EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (block, category->block_data_size),
+                kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT))) {
+        return NULL;
+    }
+
+    if (settings->full_overflow_checks &&
+        !EmbAllocCheckBuffer (
+                (void*) ((unsigned char*) ptr + data_size),
+                category->block_data_size - data_size, 
+                EMB_ALLOC_INIT_VALUE)) {
+        return NULL;
+    }
+
+    return category;
+}
+
+void EmbAllocReleaseMagazineInternal (const EmbAllocMemPoolSettings* settings,
+    EmbAllocBlockCategory* category, EmbAllocMagazine* magazine)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    while (0 != magazine->rounds) {
+        void* ptr = magazine->blocks [--magazine->rounds];
+
+        /** An empty allocation: the whole (INIT filled) payload is checked for writes. */
+        *EmbAllocDataSizeInternal (category,
+                EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr)) = 0;
+        EmbAllocFreeBlockInternal (settings, category, ptr);
+    }
+}
+
+void EmbAllocCacheRefillInternal (EmbAllocThreadCacheData* cache,
+    unsigned char category_idx)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    void* mempool = cache->mempool;
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+    const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+    EmbAllocBlockCategory* category = 
+        EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool) + category_idx;
+    EmbAllocDepotCategory* depot = aux_data->depot + category_idx;
+    EmbAllocMagazine* magazine = cache->loaded + category_idx;
+    EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocAcquireLock ( &(aux_data->thread_sync_mutex.lock))) {
+        /** The caller falls back to the regular (locked) allocation, which reports it. */
+        return;
+    }
+
+    if (0 != depot->full_count) {
+        *magazine = depot->full [--depot->full_count];
+    } else if (!aux_data->thread_sync_mutex_initialized ||
+        !EmbAllocLockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (category_idx))) {
+        /** Claim a batch of blocks, leaving the others to the category search. */
+        while ((magazine->rounds < EMB_ALLOC_MAGAZINE_ROUNDS) &&
+            (category->occupied_blocks < category->total_blocks)) {
+            void* ptr = EmbAllocMallocOneBlockInternal (settings, category, 0);
+
+            if (NULL == ptr) {
+                break;
+            }
+
+            *EmbAllocDataSizeInternal (category,
+                EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr)) =
+                EMB_ALLOC_COUNTER_NOT_SET;
+            magazine->blocks [magazine->rounds++] = ptr;
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocUnlockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (category_idx)) &&
+            (NULL != error_callback_fn)) {
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+    }
+
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock)) &&
+        (NULL != error_callback_fn)) {
+        /** Unlock failed: the mutex is no longer reliably held, so report
+         * via the callback directly rather than writing the shared error
+         * slot unsynchronized (which would race a lock-holding writer). */
+        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+    }
+}
+
+bool EmbAllocCacheFlushInternal (EmbAllocThreadCacheData* cache,
+    unsigned char category_idx, EmbAllocMagazine* magazine)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    void* mempool = cache->mempool;
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+    const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+    EmbAllocDepotCategory* depot = aux_data->depot + category_idx;
+    EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+    bool flushed = true;
+
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocAcquireLock ( &(aux_data->thread_sync_mutex.lock))) {
+        if (NULL != error_callback_fn) {
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+        }
+        return false;
+    }
+
+    if (depot->full_count < EMB_ALLOC_DEPOT_MAGAZINES) {
+        depot->full [depot->full_count++] = *magazine;
+        magazine->rounds = 0;
+    } else if (!aux_data->thread_sync_mutex_initialized ||
+        !EmbAllocLockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (category_idx))) {
+        EmbAllocReleaseMagazineInternal (settings,
+            EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool) + category_idx, magazine);
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocUnlockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (category_idx)) &&
+            (NULL != error_callback_fn)) {
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+    } else {
+        if (NULL != error_callback_fn) {
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+        }
+        flushed = false;
+    }
+
+    if (aux_data->thread_sync_mutex_initialized &&
+        EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock)) &&
+        (NULL != error_callback_fn)) {
+        /** Unlock failed: the mutex is no longer reliably held, so report
+         * via the callback directly rather than writing the shared error
+         * slot unsynchronized (which would race a lock-holding writer). */
+        error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+    }
+
+    return flushed;
+}
+
+EmbAllocThreadCache EmbAllocCreateThreadCache (EmbAllocMempool mempool)
+{
+    if (EMB_ALLOC_PTR_IS_MEMPOOL (mempool, kEmbAllocMempoolStart)) {
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        EmbAllocThreadCacheData* cache = NULL;
+        bool lock_acquired = true;
+
+        if (aux_data->thread_sync_mutex_initialized) {
+            lock_acquired = !EmbAllocAcquireLock ( &(aux_data->thread_sync_mutex.lock));
+        }
+
+        if (!lock_acquired) {
+            /** Lock failed: report (if a callback is set) and fail immediately, without
+             * reading the shared error slot unsynchronized or unlocking a mutex we
+             * never acquired. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+            }
+            return NULL;
+        }
+
+        ClearMempoolErrorInternal (aux_data);
+
+        /** The first thread cache brings the depot along. */
+        if (NULL == aux_data->depot) {
+            aux_data->depot = (EmbAllocDepotCategory*) malloc (
+                EMB_ALLOC_NUM_BLOCK_CATEGORIES * sizeof (EmbAllocDepotCategory));
+
+            if (NULL != aux_data->depot) {
+                memset (aux_data->depot, 0, 
+                    EMB_ALLOC_NUM_BLOCK_CATEGORIES * sizeof (EmbAllocDepotCategory));
+            }
+        }
+
+        if (NULL != aux_data->depot) {
+            cache = (EmbAllocThreadCacheData*) malloc (sizeof (EmbAllocThreadCacheData));
+        }
+
+        if (NULL != cache) {
+            memset (cache, 0, sizeof (EmbAllocThreadCacheData));
+            cache->mempool = mempool;
+            aux_data->thread_cache_count++;
+        } else {
+            if (0 == aux_data->thread_cache_count) {
+                free (aux_data->depot);
+                aux_data->depot = NULL;
+            }
+
+            EmbAllocSetErrorInternal (mempool, kEmbAllocNoMemory,
+                EMB_ALLOC_NOT_ENOUGH_MEMORY_ERROR, NULL);
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock)) &&
+            (NULL != error_callback_fn)) {
+            /** Unlock failed: the mutex is no longer reliably held, so report
+             * via the callback directly rather than writing the shared error
+             * slot unsynchronized (which would race a lock-holding writer). */
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+
+        return (EmbAllocThreadCache) cache;
+    } else {
+        /** This is not a mempool, so we cannot send back a more detailed error message. */
+        return NULL;
+    }
+}
+
+bool EmbAllocDestroyThreadCache (EmbAllocThreadCache thread_cache)
+{
+    EmbAllocThreadCacheData* cache = (EmbAllocThreadCacheData*) thread_cache;
+
+    if ((NULL != cache) && EMB_ALLOC_PTR_IS_MEMPOOL (cache->mempool, kEmbAllocMempoolStart)) {
+        void* mempool = cache->mempool;
+        EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+        EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+        EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+        /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+        unsigned char i = 0;
+        bool lock_acquired = true;
+
+        if (aux_data->thread_sync_mutex_initialized) {
+            /** The depot, then every category a magazine may go back to. */
+            lock_acquired = !EmbAllocAcquireLock ( &(aux_data->thread_sync_mutex.lock));
+
+            if (lock_acquired &&
+                EmbAllocLockCategoriesInternal (aux_data, EMB_ALLOC_ALL_CATEGORIES_MASK)) {
+                EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock));
+                lock_acquired = false;
+            }
+        }
+
+        if (!lock_acquired) {
+            /** Lock failed: report (if a callback is set) and fail immediately, without
+             * reading the shared error slot unsynchronized or unlocking a mutex we
+             * never acquired. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+            }
+            return false;
+        }
+
+        ClearMempoolErrorInternal (aux_data);
+
+        /**
+         * Full magazines stay in the depot for the other threads, everything else goes
+         * back to the categories. The last thread cache empties the depot as well.
+         */
+        aux_data->thread_cache_count--;
+
+        for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+            EmbAllocDepotCategory* depot = aux_data->depot + i;
+            EmbAllocMagazine* magazines [2];
+            unsigned char m = 0;
+
+            magazines [0] = cache->loaded + i;
+            magazines [1] = cache->previous + i;
+
+            for (m = 0; m < 2; m++) {
+                if ((0 != aux_data->thread_cache_count) &&
+                    (EMB_ALLOC_MAGAZINE_ROUNDS == magazines [m]->rounds) &&
+                    (depot->full_count < EMB_ALLOC_DEPOT_MAGAZINES)) {
+                    depot->full [depot->full_count++] = *magazines [m];
+                } else {
+                    EmbAllocReleaseMagazineInternal (settings, categories + i, magazines [m]);
+                }
+            }
+
+            if (0 == aux_data->thread_cache_count) {
+                while (0 != depot->full_count) {
+                    EmbAllocReleaseMagazineInternal (settings, categories + i,
+                        depot->full + (--depot->full_count));
+                }
+            }
+        }
+
+        if (0 == aux_data->thread_cache_count) {
+            free (aux_data->depot);
+            aux_data->depot = NULL;
+        }
+
+        if (aux_data->thread_sync_mutex_initialized &&
+            (EmbAllocUnlockCategoriesInternal (aux_data, EMB_ALLOC_ALL_CATEGORIES_MASK) |
+                EmbAllocReleaseLock ( &(aux_data->thread_sync_mutex.lock))) &&
+            (NULL != error_callback_fn)) {
+            /** Unlock failed: the mutex is no longer reliably held, so report
+             * via the callback directly rather than writing the shared error
+             * slot unsynchronized (which would race a lock-holding writer). */
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+
+        memset (cache, 0, sizeof (EmbAllocThreadCacheData));
+        free (cache);
+        return true;
+    } else {
+        /** This is not a thread cache of a mempool. */
+        return false;
+    }
+}
+
+void* EmbAllocCacheMalloc (EmbAllocThreadCache thread_cache, size_t size)
+{
+    EmbAllocThreadCacheData* cache = (EmbAllocThreadCacheData*) thread_cache;
+
+    if ((NULL != cache) && EMB_ALLOC_PTR_IS_MEMPOOL (cache->mempool, kEmbAllocMempoolStart)) {
+        void* mempool = cache->mempool;
+        const EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+        const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+
+        /** Only the single blocks of a size class' preferred category are cached. */
+        if ((0 != size) && (size <= (EMB_ALLOC_SIZE_CLASS_COUNT * EMB_ALLOC_SIZE_CLASS_BYTES))) {
+            unsigned char i = aux_data->size_class_category [EMB_ALLOC_SIZE_CLASS (size)];
+
+            if (EMB_ALLOC_NUM_BLOCK_CATEGORIES != i) {
+                EmbAllocMagazine* loaded = cache->loaded + i;
+
+                if (0 == loaded->rounds) {
+                    if (0 != cache->previous [i].rounds) {
+                        EmbAllocMagazine empty = *loaded;
+
+                        *loaded = cache->previous [i];
+                        cache->previous [i] = empty;
+                    } else {
+                        EmbAllocCacheRefillInternal (cache, i);
+                    }
+                }
+
+                if (0 != loaded->rounds) {
+                    EmbAllocBlockCategory* category = 
+                        EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool) + i;
+                    void* ptr = loaded->blocks [--loaded->rounds];
+
+                    /** A write into a cached (free) block is a use after free. */
+                    if (settings->full_overflow_checks &&
+                        !EmbAllocCheckBuffer (ptr, category->block_data_size,
+                            EMB_ALLOC_INIT_VALUE)) {
+                        EmbAllocSetErrorInternal (mempool, kEmbAllocOverflow,
+                            EMB_ALLOC_OVERFLOW_ERROR, ptr);
+                        memset (ptr, EMB_ALLOC_INIT_VALUE, category->block_data_size);
+                    }
+
+                    if (settings->init_allocated_memory) {
+                        memset (ptr, 0, size);
+                    }
+
+                    *EmbAllocDataSizeInternal (category, 
+                        EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr)) =
+                        (EmbAllocCounter) size;
+                    return ptr;
+                }
+            }
+        }
+
+        /** Not cacheable, or the category is exhausted: take the regular path. */
+        return EmbAllocMalloc (mempool, size);
+    } else {
+        /** This is not a thread cache of a mempool. */
+        return NULL;
+    }
+}
+
+void EmbAllocCacheFree (EmbAllocThreadCache thread_cache, void* ptr)
+{
+    EmbAllocThreadCacheData* cache = (EmbAllocThreadCacheData*) thread_cache;
+
+    if ((NULL != cache) && EMB_ALLOC_PTR_IS_MEMPOOL (cache->mempool, kEmbAllocMempoolStart)) {
+        void* mempool = cache->mempool;
+        EmbAllocBlockCategory* category = NULL;
+
+        if (NULL == ptr) {
+            return;
+        }
+
+        category = EmbAllocCacheableBlockInternal (mempool, ptr);
+
+        if (NULL != category) {
+            unsigned char i = (unsigned char) (category - 
+                EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool));
+            EmbAllocMagazine* loaded = cache->loaded + i;
+
+            if ((EMB_ALLOC_MAGAZINE_ROUNDS == loaded->rounds) &&
+                ((0 == cache->previous [i].rounds) ||
+                    EmbAllocCacheFlushInternal (cache, i, cache->previous + i))) {
+                EmbAllocMagazine full = *loaded;
+
+                *loaded = cache->previous [i];
+                cache->previous [i] = full;
+            }
+
+            if (loaded->rounds < EMB_ALLOC_MAGAZINE_ROUNDS) {
+                memset (ptr, EMB_ALLOC_INIT_VALUE, category->block_data_size);
+                *EmbAllocDataSizeInternal (category,
+                EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr)) =
+                    EMB_ALLOC_COUNTER_NOT_SET;
+                loaded->blocks [loaded->rounds++] = ptr;
+                return;
+            }
+        }
+
+        /** Not cacheable (or invalid, which the regular path reports). */
+        EmbAllocFree (mempool, ptr);
+    }
+}
+
+int EmbAllocLockCategoriesInternal (EmbAllocMempoolAuxData* aux_data,
+    unsigned int mask)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        EmbAllocCategoryLock* category_lock = &(aux_data->category_locks [i].lock);
+
+        if (0 == (mask & EMB_ALLOC_CATEGORY_MASK (i))) {
+            continue;
+        }
+
+        if (EmbAllocAcquireLock ( &(category_lock->mutex))) {
+            /** Give back the ones already taken. */
+            EmbAllocUnlockCategoriesInternal (aux_data,
+                mask & (EMB_ALLOC_CATEGORY_MASK (i) - 1u));
+            return -1;
+        }
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+        /**
+         * Shut the lock-free calls out, then wait for the ones in progress. Both this
+         * store / load pair and the one in EmbAllocEnterLockFreeInternal are sequentially
+         * consistent: either the lock-free call sees the flag, or this loop sees the call.
+         */
+        if (aux_data->lock_free_single_blocks) {
+            __atomic_store_n (&(category_lock->lock_free_excluded), true, __ATOMIC_SEQ_CST);
+
+            while (0 != __atomic_load_n (&(category_lock->lock_free_calls), __ATOMIC_SEQ_CST)) {
+                EmbAllocYieldThread ();
+            }
+        }
+
+        __atomic_store_n (&(category_lock->holder_thread), EmbAllocGetThreadIndex (),
+            __ATOMIC_RELAXED);
+#else
+        category_lock->holder_thread = EmbAllocGetThreadIndex ();
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+    }
+
+    return 0;
+}
+
+int EmbAllocUnlockCategoriesInternal (EmbAllocMempoolAuxData* aux_data,
+    unsigned int mask)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = EMB_ALLOC_NUM_BLOCK_CATEGORIES;
+    int return_value = 0;
+
+    while (0 != i--) {
+        EmbAllocCategoryLock* category_lock = &(aux_data->category_locks [i].lock);
+
+        if (0 == (mask & EMB_ALLOC_CATEGORY_MASK (i))) {
+            continue;
+        }
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+        __atomic_store_n (&(category_lock->holder_thread), EMB_ALLOC_NO_OWNER_THREAD,
+            __ATOMIC_RELAXED);
+
+        if (aux_data->lock_free_single_blocks) {
+            __atomic_store_n (&(category_lock->lock_free_excluded), false, __ATOMIC_RELEASE);
+        }
+#else
+        category_lock->holder_thread = EMB_ALLOC_NO_OWNER_THREAD;
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+        if (EmbAllocReleaseLock ( &(category_lock->mutex))) {
+            return_value = -1;
+        }
+    }
+
+    return return_value;
+}
+
+#if EMB_ALLOC_LOCK_FREE_SUPPORTED
+bool EmbAllocEnterLockFreeInternal (EmbAllocCategoryLock* category_lock)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    __atomic_fetch_add (&(category_lock->lock_free_calls), 1, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n (&(category_lock->lock_free_excluded), __ATOMIC_SEQ_CST)) {
+        __atomic_fetch_sub (&(category_lock->lock_free_calls), 1, __ATOMIC_RELEASE);
+        return false;
+    }
+
+    return true;
+}
+
+void EmbAllocLeaveLockFreeInternal (EmbAllocCategoryLock* category_lock)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    /** Publishes the call's block and bitmap updates to the next category lock holder. */
+    __atomic_fetch_sub (&(category_lock->lock_free_calls), 1, __ATOMIC_RELEASE);
+}
+
+void EmbAllocUpdateBitAtomicInternal (uint64_t* word, size_t index, bool set)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    uint64_t mask = UINT64_C (1) << (index % EMB_ALLOC_BITMAP_WORD_BITS);
+
+    if (set) {
+        __atomic_fetch_or (word, mask, __ATOMIC_SEQ_CST);
+    } else {
+        __atomic_fetch_and (word, ~mask, __ATOMIC_SEQ_CST);
+    }
+}
+
+void* EmbAllocClaimFreeBlockInternal (EmbAllocBlockCategory* category)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    size_t word_count = EMB_ALLOC_CATEGORY_BITMAP_WORDS (category->total_blocks);
+    size_t start = __atomic_load_n (&(category->next_free_word), __ATOMIC_RELAXED);
+    size_t word = 0;
+    size_t scanned = 0;
+
+    if (start >= word_count) {
+        start = 0;
+    }
+
+    word = start;
+
+    for (scanned = 0; scanned < word_count; scanned++) {
+        uint64_t* bitmap_word = &EMB_ALLOC_FREE_BITMAP_WORD (category, word);
+        uint64_t occupied = __atomic_load_n (bitmap_word, __ATOMIC_RELAXED);
+
+        /**
+         * Try the lowest free bit until one is won or the word is full. A failed
+         * compare-and-swap reloads the word, so each retry sees the latest value. The
+         * padding bits past total_blocks are permanently set and are never claimed.
+         */
+        while (~UINT64_C (0) != occupied) {
+            unsigned bit = EmbAllocCountTrailingZerosInternal (~occupied);
+
+            if (__atomic_compare_exchange_n (bitmap_word, &occupied,
+                    occupied | (UINT64_C (1) << bit), false,
+                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+                if (word != start) {
+                    __atomic_store_n (&(category->next_free_word), word, __ATOMIC_RELAXED);
+                }
+                return EmbAllocBlockFromIndexInternal (category,
+                    (word * EMB_ALLOC_BITMAP_WORD_BITS) + bit);
+            }
+        }
+
+        if (++word == word_count) {
+            word = 0;
+        }
+    }
+
+    return NULL;
+}
+
+void* EmbAllocMallocLockFreeInternal (void* mempool, size_t size)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+    const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+    EmbAllocBlockCategory* category = NULL;
+    void* block = NULL;
+    void* return_value = NULL;
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+
+    /** Only the sizes whose category needs no placement decision (see EmbAllocCacheMalloc). */
+    if (size > (EMB_ALLOC_SIZE_CLASS_COUNT * EMB_ALLOC_SIZE_CLASS_BYTES)) {
+        return NULL;
+    }
+
+    i = aux_data->size_class_category [EMB_ALLOC_SIZE_CLASS (size)];
+
+    if (EMB_ALLOC_NUM_BLOCK_CATEGORIES == i) {
+        return NULL;
+    }
+
+    category = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool) + i;
+
+    if (!EmbAllocEnterLockFreeInternal (&(aux_data->category_locks [i].lock))) {
+        return NULL;
+    }
+
+    /** A full category is not scanned. */
+    if (__atomic_load_n (&(category->occupied_blocks), __ATOMIC_RELAXED) <
+            category->total_blocks) {
+        block = EmbAllocClaimFreeBlockInternal (category);
+    }
+
+    if (NULL != block) {
+        EmbAllocCounter* used_block_count = EmbAllocUseCountInternal (category, block);
+        EmbAllocCounter* data_size = EmbAllocDataSizeInternal (category, block);
+        size_t index = EmbAllocBlockIndexInternal (category, block);
+        size_t word = index / EMB_ALLOC_BITMAP_WORD_BITS;
+
+        return_value = EMB_ALLOC_GET_CATEGORY_PTR_FROM_BLOCK (category, block);
+
+        /**
+         * The block is ours now. One that does not look free (the checks of
+         * EmbAllocMergeFreeBlocksInternal) goes back, and the locked path, which may
+         * pick it again, reports the overflow.
+         */
+        if ((EMB_ALLOC_CATEGORY_HAS_MARKERS (category) &&
+                (memcmp (block, kEmbAllocBlockStart, EMB_ALLOC_BLOCK_START_MARKER_SIZE) ||
+                memcmp (EMB_ALLOC_GET_END_PADDING_FROM_BLOCK (block,
+                        category->block_data_size),
+                    kEmbAllocBlockEnd, EMB_ALLOC_ALIGN_AMOUNT))) ||
+            (EMB_ALLOC_COUNTER_NOT_SET != *used_block_count) ||
+            (EMB_ALLOC_COUNTER_NOT_SET != *data_size) ||
+            (settings->full_overflow_checks &&
+                !EmbAllocCheckBuffer (return_value, category->block_data_size,
+                    EMB_ALLOC_INIT_VALUE))) {
+            EmbAllocUpdateBitAtomicInternal (&EMB_ALLOC_FREE_BITMAP_WORD (category, word), index, false);
+            return_value = NULL;
+        } else {
+            if (settings->init_allocated_memory) {
+                memset (return_value, 0, size);
+            }
+
+            *used_block_count = 1;
+            *data_size = (EmbAllocCounter) size;
+
+            /**
+             * The free summary bit is left alone: clearing it for a word this filled
+             * could race with a free in the same word and hide a free block, while a
+             * stale set bit only costs the searches a word read.
+             */
+            __atomic_fetch_add (&(category->occupied_blocks), 1, __ATOMIC_RELAXED);
+            EmbAllocUpdateBitAtomicInternal (&EMB_ALLOC_START_BITMAP_WORD (category, word), index, true);
+        }
+    }
+
+    EmbAllocLeaveLockFreeInternal (&(aux_data->category_locks [i].lock));
+    return return_value;
+}
+
+bool EmbAllocFreeLockFreeInternal (void* mempool, void* ptr)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+    EmbAllocBlockCategory* category = NULL;
+    EmbAllocCategoryLock* category_lock = NULL;
+    EmbAllocCounter* data_size = NULL;
+    EmbAllocCounter expected_data_size = 0;
+    void* block = NULL;
+    size_t index = 0;
+    size_t word = 0;
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = EmbAllocCategoryIndexForPtrInternal (
+        EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool), ptr);
+
+    if (EMB_ALLOC_NUM_BLOCK_CATEGORIES == i) {
+        return false;
+    }
+
+    category_lock = &(aux_data->category_locks [i].lock);
+
+    if (!EmbAllocEnterLockFreeInternal (category_lock)) {
+        return false;
+    }
+
+    /** Multi-block runs and anything suspicious take the locked path. */
+    category = EmbAllocCacheableBlockInternal (mempool, ptr);
+
+    if (NULL == category) {
+        EmbAllocLeaveLockFreeInternal (category_lock);
+        return false;
+    }
+
+    block = EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr);
+    data_size = EmbAllocDataSizeInternal (category, block);
+    expected_data_size = __atomic_load_n (data_size, __ATOMIC_RELAXED);
+
+    /**
+     * Of two frees of the same pointer, only one claims the block; the other one takes
+     * the locked path, which waits for this call to leave and reports the double free.
+     */
+    if (!__atomic_compare_exchange_n (data_size, &expected_data_size, EMB_ALLOC_COUNTER_NOT_SET,
+            false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        EmbAllocLeaveLockFreeInternal (category_lock);
+        return false;
+    }
+
+    index = EmbAllocBlockIndexInternal (category, block);
+    word = index / EMB_ALLOC_BITMAP_WORD_BITS;
+
+    /** The head bit goes first: once the free bit is clear, another call may own the block. */
+    EmbAllocUpdateBitAtomicInternal (&EMB_ALLOC_START_BITMAP_WORD (category, word), index, false);
+
+    /** Same formatting as EmbAllocReleaseBlocksInternal. */
+    memset (block, EMB_ALLOC_INIT_VALUE, category->stride);
+    EmbAllocFormatFreeBlockInternal (category, block);
+
+    /** The counter drops before the bit, so it never exceeds the set bits. */
+    __atomic_fetch_sub (&(category->occupied_blocks), 1, __ATOMIC_RELAXED);
+    EmbAllocUpdateBitAtomicInternal (&EMB_ALLOC_FREE_BITMAP_WORD (category, word), index, false);
+
+    if (NULL != category->free_summary) {
+        size_t summary_word = word / EMB_ALLOC_BITMAP_WORD_BITS;
+
+        __atomic_fetch_or (category->free_summary + summary_word,
+            UINT64_C (1) << (word % EMB_ALLOC_BITMAP_WORD_BITS), __ATOMIC_SEQ_CST);
+        __atomic_fetch_or (category->free_summary_top + (summary_word / EMB_ALLOC_BITMAP_WORD_BITS),
+            UINT64_C (1) << (summary_word % EMB_ALLOC_BITMAP_WORD_BITS), __ATOMIC_SEQ_CST);
+    }
+
+    /**
+     * first_free_address stays a lower bound and last_free_address an upper bound. The
+     * next_free_word hint moves down to this word unless a concurrent free moved it lower.
+     */
+    {
+        void* hint = __atomic_load_n (&(category->first_free_address), __ATOMIC_RELAXED);
+        EmbAllocCounter hint_word = 0;
+
+        while (((NULL == hint) || ((uintptr_t) hint > (uintptr_t) block)) &&
+            !__atomic_compare_exchange_n (&(category->first_free_address), &hint, block,
+                false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+
+        hint = __atomic_load_n (&(category->last_free_address), __ATOMIC_RELAXED);
+
+        while (((NULL == hint) || ((uintptr_t) hint < (uintptr_t) block)) &&
+            !__atomic_compare_exchange_n (&(category->last_free_address), &hint, block,
+                false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+
+        hint_word = __atomic_load_n (&(category->next_free_word), __ATOMIC_RELAXED);
+
+        while (((size_t) hint_word > word) &&
+            !__atomic_compare_exchange_n (&(category->next_free_word), &hint_word,
+                (EmbAllocCounter) word, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    /**
+     * max_free_run stays an upper bound. The free bit was cleared with a sequentially
+     * consistent fetch_and and the walk reads the neighbouring words with sequentially
+     * consistent loads: of two frees next to each other, the later one measures the run
+     * of both.
+     */
+    {
+        size_t run = EmbAllocFreeRunAroundInternal (category, index, 1);
+        size_t bound = __atomic_load_n (&(category->max_free_run), __ATOMIC_RELAXED);
+
+        while ((bound < run) &&
+            !__atomic_compare_exchange_n (&(category->max_free_run), &bound, run,
+                false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    EmbAllocLeaveLockFreeInternal (category_lock);
+    return true;
+}
+
+bool EmbAllocQueueRemoteFreeInternal (void* mempool, void* ptr)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+    /** Multi-block runs and anything suspicious take the regular path. */
+    EmbAllocBlockCategory* category = EmbAllocCacheableBlockInternal (mempool, ptr);
+    EmbAllocCounter* data_size = NULL;
+    EmbAllocCounter expected_data_size = 0;
+    void** queue = NULL;
+    void* head = NULL;
+
+    if (NULL == category) {
+        return false;
+    }
+
+    data_size = EmbAllocDataSizeInternal (category,
+        EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (category, ptr));
+    expected_data_size = __atomic_load_n (data_size, __ATOMIC_RELAXED);
+
+    /** Of two frees of the same pointer, only one queues it; the other one is reported. */
+    if (!__atomic_compare_exchange_n (data_size, &expected_data_size, EMB_ALLOC_COUNTER_NOT_SET,
+            false, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return false;
+    }
+
+    memset (ptr, EMB_ALLOC_INIT_VALUE, category->block_data_size);
+
+    queue = aux_data->remote_frees + (category - EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool));
+    head = __atomic_load_n (queue, __ATOMIC_RELAXED);
+
+    /** The release publishes the payload writes (the link included) to the owner. */
+    do {
+        *(void**) ptr = head;
+    } while (!__atomic_compare_exchange_n (queue, &head, ptr,
+        true, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+
+    return true;
+}
+
+void EmbAllocDrainRemoteFreesInternal (void* mempool)
+{
+    /** 
+     * No need to check for the (pointer) param validity inside static functions.
+     * Callers should make sure that the params are valid.
+     */
+
+    EmbAllocMempoolAuxData* aux_data = EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool);
+    const EmbAllocMemPoolSettings* settings = EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR (mempool);
+    EmbAllocBlockCategory* categories = EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (mempool);
+    EmbAllocErrorCallback error_callback_fn = settings->error_callback_fn;
+    /** Make sure this fits into EMB_ALLOC_NUM_BLOCK_CATEGORIES. */
+    unsigned char i = 0;
+
+    for (i = 0; i < EMB_ALLOC_NUM_BLOCK_CATEGORIES; i++) {
+        void* ptr = NULL;
+
+        if (NULL == __atomic_load_n (aux_data->remote_frees + i, __ATOMIC_RELAXED)) {
+            continue;
+        }
+
+        /** remote_free_queues is only set on a threadsafe mempool. */
+        if (EmbAllocLockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (i))) {
+            /** The queue stays as it is, for the next drain. */
+            if (NULL != error_callback_fn) {
+                error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_LOCK_ERROR);
+            }
+            continue;
+        }
+
+        ptr = __atomic_exchange_n (aux_data->remote_frees + i, NULL, __ATOMIC_ACQUIRE);
+
+        while (NULL != ptr) {
+            void* next = *(void**) ptr;
+
+            /** Restore the INIT fill under the link, then free it like a cached block. */
+            memset (ptr, EMB_ALLOC_INIT_VALUE, sizeof (void*));
+            *EmbAllocDataSizeInternal (categories + i,
+                EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR (categories + i, ptr)) = 0;
+            EmbAllocFreeBlockInternal (settings, categories + i, ptr);
+            ptr = next;
+        }
+
+        if (EmbAllocUnlockCategoriesInternal (aux_data, EMB_ALLOC_CATEGORY_MASK (i)) &&
+            (NULL != error_callback_fn)) {
+            error_callback_fn (kEmbAllocThreadSyncError, EMB_ALLOC_MUTEX_UNLOCK_ERROR);
+        }
+    }
+}
+#endif /** EMB_ALLOC_LOCK_FREE_SUPPORTED */
+
+EmbAllocPoolSet EmbAllocCreatePoolSet (const EmbAllocMemPoolSettings* settings,
+    size_t num_pools, EmbAllocPoolSelection selection)
+{
+    EmbAllocPoolSetData* pool_set = NULL;
+    size_t i = 0;
+
+    if ((NULL == settings) ||
+        ((kEmbAllocPoolSelectCpu != selection) && (kEmbAllocPoolSelectThread != selection))) {
+        return NULL;
+    }
+
+    if (0 == num_pools) {
+        num_pools = EmbAllocGetCpuCount ();
+    }
+
+    /** The set itself, then its two arrays of sub-pool pointers. */
+    if (num_pools > ((SIZE_MAX - sizeof (EmbAllocPoolSetData)) / (2 * sizeof (void*)))) {
+        return NULL;
+    }
+
+    pool_set = (EmbAllocPoolSetData*) malloc (sizeof (EmbAllocPoolSetData) +
+        2 * num_pools * sizeof (void*));
+
+    if (NULL == pool_set) {
+        return NULL;
+    }
+
+    pool_set->num_pools = num_pools;
+    pool_set->selection = selection;
+    pool_set->pools = (void**) (pool_set + 1);
+    pool_set->pools_by_address = pool_set->pools + num_pools;
+
+    for (i = 0; i < num_pools; i++) {
+        size_t j = i;
+
+        pool_set->pools [i] = EmbAllocCreate (settings);
+
+        if (NULL == pool_set->pools [i]) {
+            while (0 != i) {
+                EmbAllocDestroy (pool_set->pools [--i]);
+            }
+
+            free (pool_set);
+            return NULL;
+        }
+
+        /** Insertion sort by the address of the first block (the set is small). */
+        while ((0 != j) &&
+            ((uintptr_t) EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR (pool_set->pools_by_address [j - 1]) >
+                (uintptr_t) EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR (pool_set->pools [i]))) {
+            pool_set->pools_by_address [j] = pool_set->pools_by_address [j - 1];
+            j--;
+        }
+
+        pool_set->pools_by_address [j] = pool_set->pools [i];
+    }
+
+    return (EmbAllocPoolSet) pool_set;
+}
+
+bool EmbAllocDestroyPoolSet (EmbAllocPoolSet pool_set)
+{
+    EmbAllocPoolSetData* set = (EmbAllocPoolSetData*) pool_set;
+    bool destroyed = true;
+    size_t i = 0;
+
+    if (NULL == set) {
+        return false;
+    }
+
+    for (i = 0; i < set->num_pools; i++) {
+        destroyed = EmbAllocDestroy (set->pools [i]) && destroyed;
+    }
+
+    free (set);
+    return destroyed;
+}
+
+void* EmbAllocPoolSetMalloc (EmbAllocPoolSet pool_set, size_t size)
+{
+    const EmbAllocPoolSetData* set = (const EmbAllocPoolSetData*) pool_set;
+    void* return_value = NULL;
+    size_t home = 0;
+    size_t i = 0;
+
+    if (NULL == set) {
+        return NULL;
+    }
+
+    home = EmbAllocPoolSetHomeInternal (set);
+    return_value = EmbAllocMalloc (set->pools [home], size);
+
+    /**
+     * Fall back to the other sub-pools in turn, unless the size can never be served
+     * (all the sub-pools share the blocks layout).
+     */
+    if ((NULL == return_value) &&
+        (0 != EmbAllocGoodSizeInternal (EMB_ALLOC_GET_MEMPOOL_BLOCK_CATEGORIES_PTR (set->pools [home]), size))) {
+        for (i = 1; (i < set->num_pools) && (NULL == return_value); i++) {
+            return_value = EmbAllocMalloc (set->pools [(home + i) % set->num_pools], size);
+        }
+    }
+
+    return return_value;
+}
+
+void EmbAllocPoolSetFree (EmbAllocPoolSet pool_set, void* ptr)
+{
+    const EmbAllocPoolSetData* set = (const EmbAllocPoolSetData*) pool_set;
+    void* mempool = NULL;
+
+    if ((NULL == set) || (NULL == ptr)) {
+        return;
+    }
+
+    mempool = EmbAllocPoolSetFindPoolInternal (set, ptr);
+
+    /** A pointer no sub-pool owns is rejected (and reported) by the thread's sub-pool. */
+    EmbAllocFree ((NULL != mempool)? mempool: set->pools [EmbAllocPoolSetHomeInternal (set)], ptr);
+}
+
+void* EmbAllocPoolSetRealloc (EmbAllocPoolSet pool_set, void* ptr, size_t size)
+{
+    const EmbAllocPoolSetData* set = (const EmbAllocPoolSetData*) pool_set;
+    void* mempool = NULL;
+    void* return_value = NULL;
+    size_t usable_size = 0;
+    size_t home = 0;
+    size_t i = 0;
+
+    if (NULL == set) {
+        return NULL;
+    }
+
+    if (NULL == ptr) {
+        return EmbAllocPoolSetMalloc (pool_set, size);
+    }
+
+    home = EmbAllocPoolSetHomeInternal (set);
+    mempool = EmbAllocPoolSetFindPoolInternal (set, ptr);
+
+    if (NULL == mempool) {
+        return EmbAllocRealloc (set->pools [home], ptr, size);
+    }
+
+    return_value = EmbAllocRealloc (mempool, ptr, size);
+
+    /**
+     * A chunk that is still allocated did not fit its own sub-pool: move it to another
+     * one (the home sub-pool first), like a reallocation that moves inside a mempool.
+     */
+    if ((NULL == return_value) && (0 != size) &&
+        (0 != (usable_size = EmbAllocUsableSize (mempool, ptr)))) {
+        for (i = 0; (i < set->num_pools) && (NULL == return_value); i++) {
+            void* target = set->pools [(home + i) % set->num_pools];
+
+            if (target != mempool) {
+                return_value = EmbAllocMalloc (target, size);
+            }
+        }
+
+        if (NULL != return_value) {
+            memcpy (return_value, ptr, (usable_size < size)? usable_size: size);
+            EmbAllocFree (mempool, ptr);
+        }
+    }
+
+    return return_value;
+}
+
+EmbAllocMempool EmbAllocPoolSetGetPool (EmbAllocPoolSet pool_set, size_t index)
+{
+    const EmbAllocPoolSetData* set = (const EmbAllocPoolSetData*) pool_set;
+
+    if ((NULL == set) || (index >= set->num_pools)) {
+        return NULL;
+    }
+
+    return set->pools [index];
+}
+
+EmbAllocMempool EmbAllocPoolSetFindPool (EmbAllocPoolSet pool_set, const void* ptr)
+{
+    const EmbAllocPoolSetData* set = (const EmbAllocPoolSetData*) pool_set;
+
+    if ((NULL == set) || (NULL == ptr)) {
+        return NULL;
+    }
+
+    return EmbAllocPoolSetFindPoolInternal (set, ptr);
+}
+
+size_t EmbAllocPoolSetHomeInternal (const EmbAllocPoolSetData* pool_set)
+{
+    size_t index = 0;
+
+    if (1 == pool_set->num_pools) {
+        return 0;
+    }
+
+    index = (kEmbAllocPoolSelectThread == pool_set->selection)?
+        EmbAllocGetThreadIndex (): EmbAllocGetCurrentCpu ();
+
+    return ((index < pool_set->num_pools)? index: (index % pool_set->num_pools));
+}
+
+void* EmbAllocPoolSetFindPoolInternal (const EmbAllocPoolSetData* pool_set, const void* ptr)
+{
+    size_t low = 0;
+    size_t high = pool_set->num_pools;
+    void* mempool = NULL;
+
+    /** The last sub-pool whose first block is at or below ptr. */
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+
+        if ((uintptr_t) EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR (pool_set->pools_by_address [middle]) <=
+            (uintptr_t) ptr) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+
+    if (0 == low) {
+        return NULL;
+    }
+
+    mempool = pool_set->pools_by_address [low - 1];
+    return (EMB_ALLOC_PTR_IS_IN_MEMPOOL (ptr, mempool, kEmbAllocMempoolStart)? mempool: NULL);
 }
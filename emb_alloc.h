@@ -67,7 +67,9 @@ typedef enum
     /** Inconsistent mempool blocks detected. */
     kEmbAllocInconsistentBlocks,
     /** Apointer parameter is not valid. */
-    kEmbAllocPointerParamError
+    kEmbAllocPointerParamError,
+    /** A size parameter is not valid. */
+    kEmbAllocSizeParamError
 } EmbAllocErrors;
 
 /**
@@ -77,7 +79,7 @@ typedef enum
  *
  * @warning The callback is invoked SYNCHRONOUSLY from inside the EmbAlloc call that
  *          raised the error, and for a threadsafe pool it runs while the pool's
- *          internal mutex is held. The callback MUST NOT re-enter any EmbAlloc
+ *          internal mutexes are held. The callback MUST NOT re-enter any EmbAlloc
  *          function on the SAME pool (EmbAllocMalloc / EmbAllocFree / EmbAllocRealloc
  *          / EmbAllocGetSettings / EmbAllocGetLastErrorCodeAndMessage / EmbAllocDestroy):
  *          re-entering self-deadlocks a non-recursive mutex, and on a recursive mutex
@@ -86,6 +88,66 @@ typedef enum
  */
 typedef void (*EmbAllocErrorCallback) (EmbAllocErrors error_code, const char* error_message);
 
+/**
+ * Placement policy: how an allocation chooses between a single larger-than-needed
+ * block and a run of several smaller continuous blocks when no block of the
+ * best-fit size is free. It is picked once, when the mempool is created.
+ */
+typedef enum
+{
+    /**
+     * Allocate where the category keeps more free memory afterwards (the default).
+     */
+    kEmbAllocPlaceMaxFreeAfter,
+    /**
+     * Allocate where the fewest bytes are wasted (minimum waste / best fit).
+     */
+    kEmbAllocPlaceBestFit,
+    /**
+     * Allocate in the category with the smaller percentage of occupied blocks
+     * before the allocation.
+     */
+    kEmbAllocPlaceLowestOccupancyBefore,
+    /**
+     * Allocate in the category with the smaller percentage of occupied blocks
+     * after the allocation.
+     */
+    kEmbAllocPlaceLowestOccupancyAfter,
+    /**
+     * Never use multiple blocks while a single (larger) block fits. This also
+     * skips the search for a run of continuous blocks in that case.
+     */
+    kEmbAllocPlaceSingleBlockFirst
+} EmbAllocPlacementPolicy;
+
+/**
+ * Lock backend: the primitive behind the internal locks of a threadsafe mempool. It is
+ * picked once, when the mempool is created. A backend the platform or the compiler
+ * cannot provide is replaced with kEmbAllocLockBackendMutex.
+ */
+typedef enum
+{
+    /** The OS mutex (pthread_mutex_t, a Windows mutex or critical section; the default). */
+    kEmbAllocLockBackendMutex,
+    /**
+     * A test-and-test-and-set spinlock with a pause / exponential backoff loop that
+     * yields the CPU once the backoff is exhausted (GCC / clang atomic builtins).
+     * Fits short critical sections with no more threads than CPUs.
+     */
+    kEmbAllocLockBackendSpin,
+    /**
+     * A glibc PTHREAD_MUTEX_ADAPTIVE_NP mutex: it spins for a while on a held lock
+     * before it sleeps in the kernel.
+     */
+    kEmbAllocLockBackendAdaptiveMutex,
+    /**
+     * A lock built straight on the Linux futex system call: an uncontended acquire
+     * and release are one atomic operation each, and only a contended lock enters
+     * the kernel.
+     */
+    kEmbAllocLockBackendFutex
+} EmbAllocLockBackend;
+
 /** EmbAlloc initialization settings. */
 typedef struct
 {
@@ -135,10 +197,108 @@ typedef struct
     bool init_allocated_memory;
     /**
      * The file name of the mempool dump file (in case of error).
+     * @note A threadsafe mempool dumps only its settings and the categories locked by
+     *       the failing call (the category, its block metadata and its blocks): the
+     *       other categories may be changing under their own locks.
      */
     char error_dump_file_name [EMB_ALLOC_ERROR_DUMP_FILE_NAME_SIZE];
+    /**
+     * The placement policy used when a best-fit block is not available.
+     * @note An unknown value is replaced with kEmbAllocPlaceMaxFreeAfter and the
+     *       mempool reports kEmbAllocInconsistentSettings.
+     */
+    EmbAllocPlacementPolicy placement_policy;
+    /**
+     * Round the block stride of every category (its block size plus the block control
+     * bytes) up to a power of two and start each category at a multiple of its stride.
+     * Every block is then aligned to its stride and a pointer maps to its block with a
+     * shift instead of a division. The padding is added to the usable size of the
+     * blocks (see EmbAllocUsableSize), so a category can serve larger requests than
+     * its nominal size, at the cost of a larger mempool.
+     */
+    bool power_of_two_strides;
+    /**
+     * Keep the use count and the data size of every block in per-category arrays next
+     * to the block bitmaps and drop the in-band start and end markers, so the block
+     * stride equals the block size (32 bytes instead of 80 for the smallest blocks on
+     * a 64-bit target) and a multi-block run holds exactly the size of its blocks.
+     * @note Without the end markers an overflow into a neighbouring live block is not
+     *       detected; full_overflow_checks still checks the unused tail of a chunk and
+     *       the payload of the free blocks.
+     */
+    bool compact_metadata;
+    /**
+     * Place the block metadata (the block bitmaps, their summaries and the
+     * compact_metadata counters) right after the management data at the start of the
+     * mempool instead of after the data blocks, so all the data an allocation or a
+     * free reads besides the block itself shares a few pages, however large the
+     * mempool. The metadata is padded to a cache line, where the first block starts.
+     */
+    bool metadata_before_blocks;
+    /**
+     * Interleave the free bitmap and the allocation-start bitmap of every category:
+     * the two 64-bit words that describe the same 64 blocks are stored next to each
+     * other, so an allocation or a free updates both bits, and the pointer validation
+     * reads the start bit, in one cache line. The mempool size does not change.
+     */
+    bool interleaved_bitmaps;
+    /**
+     * Threadsafe pools only: the primitive used for the internal locks.
+     * @note An unknown value is replaced with kEmbAllocLockBackendMutex and the
+     *       mempool reports kEmbAllocInconsistentSettings.
+     */
+    EmbAllocLockBackend lock_backend;
+    /**
+     * Threadsafe pools only: allocate and free single blocks without the category
+     * locks, claiming and releasing their bits in the block bitmaps with atomic
+     * compare-and-swap operations. Multi-block allocations, reallocations and the
+     * other calls still take the category locks; while one of them holds the lock of a
+     * category, the single-block calls on that category wait for it like any other
+     * call.
+     * @note A single-block call that succeeds this way does not clear the last error.
+     *       Ignored when the compiler has no atomic builtins (GCC / clang).
+     */
+    bool lock_free_single_blocks;
+    /**
+     * Threadsafe pools only: a single-block free from a thread other than the mempool's
+     * owner (see EmbAllocSetOwnerThread) takes no lock. It pushes the block onto a
+     * lock-free list of its category, linked through the freed payload, and the owner
+     * returns the listed blocks to their categories in one batch per category on its
+     * next EmbAllocMalloc. Multi-block frees and the owner's own frees take the usual
+     * path.
+     * @note A queued block is reported as occupied by EmbAllocGetStatistics() until it
+     *       is drained, and an overflow into it found while draining is reported to
+     *       error_callback_fn. A queued free does not clear the last error.
+     *       Ignored when the compiler has no atomic builtins (GCC / clang).
+     */
+    bool remote_free_queues;
 } EmbAllocMemPoolSettings;
 
+/** The number of block size categories (32 bytes up to 4 kB). */
+#define EMB_ALLOC_NUM_BLOCK_SIZES 8
+
+/** Usage statistics of the blocks of a certain size. */
+typedef struct
+{
+    /** The usable size of each block. */
+    size_t block_data_size;
+    /** The total number of blocks. */
+    size_t total_blocks;
+    /** The number of free blocks. */
+    size_t free_blocks;
+    /** The length (in blocks) of the longest run of continuous free blocks. */
+    size_t largest_free_run;
+} EmbAllocCategoryStatistics;
+
+/** Mempool usage statistics. */
+typedef struct
+{
+    /** The total memory allocated for the mempool, management data included. */
+    size_t mempool_size;
+    /** One entry per block size, ordered from 32 bytes up to 4 kB. */
+    EmbAllocCategoryStatistics categories [EMB_ALLOC_NUM_BLOCK_SIZES];
+} EmbAllocStatistics;
+
 /**
  * Mempool declaration.
  * The implementation is hidden from the user behind a void* pointer.
@@ -150,12 +310,18 @@ typedef struct
  * For a threadsafe pool (EmbAllocMemPoolSettings::threadsafe == true), the calls
  * EmbAllocMalloc / EmbAllocFree / EmbAllocRealloc / EmbAllocGetSettings /
  * EmbAllocGetLastErrorCodeAndMessage MAY run concurrently from several threads on
- * the SAME pool; they are serialized internally by the pool's mutex.
+ * the SAME pool; they are serialized internally by one lock per block size category,
+ * so calls working on different categories (e.g. a 4 kB and a 32 B allocation) do not
+ * wait for each other. Only an allocation that does not fit its preferred category,
+ * a reallocation that has to move the chunk and EmbAllocGetStatistics take all the
+ * category locks (single-block allocations and frees of a lock_free_single_blocks pool
+ * synchronize through atomic bitmap operations instead). So may the thread cache
+ * calls, each thread using its own EmbAllocThreadCache.
  *
  * EmbAllocDestroy is the one EXCLUSIVE operation: the caller must guarantee it does
  * not run concurrently with any other call on that pool (including another
  * EmbAllocDestroy) and that it happens-after every such call has returned. The
- * pool's mutex and metadata live inside the buffer EmbAllocDestroy frees, so
+ * pool's mutexes and metadata live inside the buffer EmbAllocDestroy frees, so
  * destroying a pool that is concurrently in use, or destroying it twice, is
  * undefined behaviour (use-after-free / double-free) — exactly as for free() /
  * fclose() / pthread_mutex_destroy(). Establishing this happens-before is the
@@ -164,6 +330,58 @@ typedef struct
  */
 typedef void* EmbAllocMempool;
 
+/**
+ * Thread cache declaration.
+ * A per-thread cache of free single blocks (a magazine of blocks per category) in
+ * front of a mempool, so that most allocations and frees of a thread do not take any
+ * mempool lock. Blocks move between a thread cache and the mempool in batches, through
+ * a depot of full magazines shared by all the thread caches of the mempool.
+ * The implementation is hidden from the user behind a void* pointer.
+ *
+ * @note THREADING & LIFETIME CONTRACT.
+ * A thread cache must only be used by one thread at a time (typically the thread that
+ * created it). Any number of thread caches, and the regular calls, may be used
+ * concurrently on the same threadsafe pool. Memory allocated through a thread cache
+ * can be freed through another one or through EmbAllocFree, and vice versa.
+ * Every thread cache must be destroyed before its mempool.
+ */
+typedef void* EmbAllocThreadCache;
+
+/**
+ * How a pool set picks the sub-pool of an allocation (see EmbAllocPoolSet).
+ */
+typedef enum
+{
+    /**
+     * The sub-pool of the CPU the calling thread runs on (sched_getcpu () on Linux),
+     * modulo the number of sub-pools (the default). Where the platform cannot tell the
+     * CPU, this works like kEmbAllocPoolSelectThread.
+     */
+    kEmbAllocPoolSelectCpu,
+    /**
+     * A sub-pool per thread: threads are numbered in the order of their first pool set
+     * call (a thread-local index), modulo the number of sub-pools.
+     */
+    kEmbAllocPoolSelectThread
+} EmbAllocPoolSelection;
+
+/**
+ * Pool set declaration.
+ * A set of independent mempools (sub-pools or shards) created from one settings
+ * template, so that threads spread over them instead of all waiting for the locks of
+ * a single mempool. An allocation is served by the sub-pool picked for the calling
+ * thread and falls back to the other sub-pools when that one cannot serve it; a free
+ * or a reallocation goes to the sub-pool that owns the pointer, found by address.
+ * The implementation is hidden from the user behind a void* pointer.
+ *
+ * @note THREADING & LIFETIME CONTRACT.
+ * The sub-pools follow the EmbAllocMempool contract: with threadsafe settings, the
+ * pool set calls may run concurrently from several threads, and memory allocated on
+ * one thread can be freed on any other. EmbAllocDestroyPoolSet is EXCLUSIVE, like
+ * EmbAllocDestroy.
+ */
+typedef void* EmbAllocPoolSet;
+
 /**
  * Creates a new mempool.
  * @note Use error_callback_fn for extra details in case of error.
@@ -216,6 +434,47 @@ void* EmbAllocMalloc (EmbAllocMempool mempool, size_t size);
  */
 void EmbAllocFree (EmbAllocMempool mempool, void* ptr);
 
+/**
+ * Deallocates the space previously allocated by EmbAllocMalloc or EmbAllocRealloc,
+ * given the size it was allocated (or last reallocated) with, like C++ sized delete.
+ * The size names the block category directly. Without full_overflow_checks, a
+ * single-block chunk of that category is only checked to be a live allocation; with
+ * them, the chunk gets every check of EmbAllocFree and a different size is reported
+ * (kEmbAllocSizeParamError, the chunk is still freed). Other chunks are freed by
+ * EmbAllocFree. If ptr is a null pointer, the function does nothing.
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param ptr pointer to the memory to deallocate.
+ * @param size the size ptr was allocated with.
+ */
+void EmbAllocFreeSized (EmbAllocMempool mempool, void* ptr, size_t size);
+
+/**
+ * Allocates count chunks of size bytes of uninitialized storage, taking the mempool
+ * locks once for the whole batch (e.g. for the buffers of a burst of packets).
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param size number of bytes to be allocated for each chunk.
+ * @param count number of chunks to be allocated.
+ * @param ptrs receives the pointers to the count chunks; the entries past the
+ *             returned number are set to NULL.
+ * @return the number of chunks allocated: count on success, less than count when
+ *         the mempool runs out of memory (the chunks allocated are kept).
+ * @see EmbAllocMalloc for the allocation rules.
+ */
+size_t EmbAllocMallocBatch (EmbAllocMempool mempool, size_t size, size_t count, void** ptrs);
+
+/**
+ * Deallocates count chunks previously allocated by EmbAllocMalloc, EmbAllocMallocBatch
+ * or EmbAllocRealloc, taking the locks of their block categories once for the whole
+ * batch. NULL entries are skipped.
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param ptrs the pointers to the memory to deallocate.
+ * @param count number of entries in ptrs.
+ */
+void EmbAllocFreeBatch (EmbAllocMempool mempool, void* const* ptrs, size_t count);
+
 /**
  * Reallocates the given area of memory.
  * It must be previously allocated by EmbAllocMalloc() or EmbAllocRealloc() and
@@ -237,6 +496,109 @@ void EmbAllocFree (EmbAllocMempool mempool, void* ptr);
  */
 void* EmbAllocRealloc (EmbAllocMempool mempool, void* ptr, size_t size);
 
+/**
+ * Expands the given area of memory in place, never moving it (e.g. for containers that
+ * hold pointers into their own storage). The area grows over the free blocks right
+ * after it, up to max_size bytes; if even the largest possible expansion stays below
+ * min_size, the area is left unchanged. The area is never shrunk.
+ * It must be previously allocated by EmbAllocMalloc() or EmbAllocRealloc() and
+ * not yet freed with a call to EmbAllocFree().
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param ptr pointer to the memory area to be expanded.
+ * @param min_size the smallest size worth expanding to.
+ * @param max_size the size to expand to when enough free blocks follow the area.
+ *                 @note It must not be 0 or smaller than min_size.
+ * @return the size of the memory area after the call (compare it with min_size to
+ *         know whether the expansion succeeded), 0 in case of error.
+ */
+size_t EmbAllocExpandInPlace (EmbAllocMempool mempool, void* ptr, size_t min_size, size_t max_size);
+
+/**
+ * Retrieves the capacity of the given area of memory: the number of bytes its blocks
+ * can hold, which can be larger than the size it was allocated with.
+ * It must be previously allocated by EmbAllocMalloc() or EmbAllocRealloc() and
+ * not yet freed with a call to EmbAllocFree().
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param ptr pointer to the memory area.
+ * @return the capacity of the memory area, 0 in case of error.
+ * @warning The bytes past the allocated size are still checked for overflow: grow the
+ *          area to its capacity with EmbAllocRealloc() or EmbAllocExpandInPlace()
+ *          (always done in place) before writing there.
+ */
+size_t EmbAllocUsableSize (EmbAllocMempool mempool, void* ptr);
+
+/**
+ * Retrieves the capacity an allocation of the given size receives with the mempool's
+ * blocks layout (the smallest block that fits or, above the largest block size, the
+ * run of blocks that fits), so that buffers can be sized to the real capacity.
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param size number of bytes to be allocated.
+ * @return the capacity of such an allocation, 0 if size is 0 or can never be allocated.
+ * @note The allocation can land in another category (with another capacity) when the
+ *       preferred one is full or the placement policy chooses otherwise; use
+ *       EmbAllocUsableSize() for the capacity actually received.
+ */
+size_t EmbAllocGoodSize (const EmbAllocMempool mempool, size_t size);
+
+/**
+ * Creates a thread cache for a mempool.
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @return the new thread cache, NULL in case of error.
+ * @see EmbAllocThreadCache for the threading contract.
+ */
+EmbAllocThreadCache EmbAllocCreateThreadCache (EmbAllocMempool mempool);
+
+/**
+ * Destroys a thread cache: its cached blocks go back to the mempool (full magazines
+ * are kept in the depot for the other thread caches, while there are any).
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param thread_cache the thread cache to be destroyed.
+ * @return true if the thread cache has been destroyed, false otherwise.
+ */
+bool EmbAllocDestroyThreadCache (EmbAllocThreadCache thread_cache);
+
+/**
+ * Allocates size bytes of uninitialized storage, from the thread cache when a single
+ * block of the size's best fit category can be used, otherwise like EmbAllocMalloc().
+ * Only refilling an empty magazine takes the mempool lock.
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param thread_cache the thread cache of the calling thread.
+ * @param size number of bytes to br allocated.
+ * @return the pointer to the beginning of newly allocated memory on success,
+ *         NULL otherwise.
+ * @note An allocation served from the thread cache does not clear the last error.
+ * @note Blocks held by thread caches are reported as occupied by EmbAllocGetStatistics().
+ */
+void* EmbAllocCacheMalloc (EmbAllocThreadCache thread_cache, size_t size);
+
+/**
+ * Deallocates the space previously allocated by EmbAllocMalloc, EmbAllocRealloc or
+ * EmbAllocCacheMalloc, into the thread cache when it is a single block, otherwise
+ * like EmbAllocFree(). Only emptying a full magazine takes the mempool lock.
+ * If ptr is a null pointer, the function does nothing.
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param thread_cache the thread cache of the calling thread.
+ * @param ptr pointer to the memory to deallocate
+ */
+void EmbAllocCacheFree (EmbAllocThreadCache thread_cache, void* ptr);
+
+/**
+ * Makes the calling thread the owner of a mempool, or leaves the mempool without one. Only the
+ * owner drains the remote free queues (see EmbAllocMemPoolSettings::remote_free_queues),
+ * and the frees of every other thread are queued. The thread that creates a mempool is
+ * its first owner; a mempool without an owner queues every single-block free until a
+ * thread claims it.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param owner true to make the calling thread the owner, false to leave the mempool
+ *              without an owner.
+ * @return true if the owner could be set, false otherwise.
+ */
+bool EmbAllocSetOwnerThread (EmbAllocMempool mempool, bool owner);
+
 /**
  * Retrieves the actual setting that were used to create the mempool.
  * If the initial creation settings are inconsistent
@@ -263,6 +625,90 @@ bool EmbAllocGetSettings (const EmbAllocMempool mempool, EmbAllocMemPoolSettings
  */
 bool EmbAllocGetLastErrorCodeAndMessage (EmbAllocMempool mempool, EmbAllocErrors *code, char *message, size_t message_len);
 
+/**
+ * Retrieves the current usage statistics of the mempool (e.g. to measure fragmentation:
+ * a category whose largest free run is much shorter than its free blocks count is
+ * fragmented).
+ * @note Use error_callback_fn for extra details in case of error.
+ * @param mempool the chuck that holds all pre-allocated memory.
+ * @param statistics the output param that will hold the statistics.
+ *                   @note It should point to a valid memory address.
+ * @return true if the statistics could be retrieved, false otherwise.
+ */
+bool EmbAllocGetStatistics (EmbAllocMempool mempool, EmbAllocStatistics* statistics);
+
+/**
+ * Creates a pool set of independent mempools.
+ * @param settings the settings of every sub-pool (each one gets all the blocks, so the
+ *                 set takes num_pools times the memory of one mempool).
+ * @param num_pools the number of sub-pools, 0 for one per online CPU.
+ * @param selection how a sub-pool is picked for an allocation.
+ * @return the new pool set, NULL in case of error (invalid parameters, or a sub-pool
+ *         that could not be created).
+ */
+EmbAllocPoolSet EmbAllocCreatePoolSet (const EmbAllocMemPoolSettings* settings,
+    size_t num_pools, EmbAllocPoolSelection selection);
+
+/**
+ * Destroys a pool set and all its sub-pools.
+ * @param pool_set the pool set to be destroyed.
+ * @return true if every sub-pool has been destroyed, false otherwise.
+ * @warning EXCLUSIVE, happens-after operation (see EmbAllocDestroy).
+ */
+bool EmbAllocDestroyPoolSet (EmbAllocPoolSet pool_set);
+
+/**
+ * Allocates size bytes of uninitialized storage from the sub-pool of the calling
+ * thread or, when that one cannot serve the allocation, from the next sub-pools in turn.
+ * @note Errors are reported by the sub-pools (see EmbAllocPoolSetGetPool()): every
+ *       sub-pool that could not serve the allocation reports it, even when a later one
+ *       does.
+ * @param pool_set the pool set.
+ * @param size number of bytes to be allocated.
+ * @return the pointer to the beginning of newly allocated memory on success,
+ *         NULL otherwise.
+ */
+void* EmbAllocPoolSetMalloc (EmbAllocPoolSet pool_set, size_t size);
+
+/**
+ * Deallocates the space previously allocated from the pool set, on the sub-pool that
+ * owns it. A pointer that no sub-pool owns is rejected by the sub-pool of the calling
+ * thread. If ptr is a null pointer, the function does nothing.
+ * @param pool_set the pool set.
+ * @param ptr pointer to the memory to deallocate.
+ */
+void EmbAllocPoolSetFree (EmbAllocPoolSet pool_set, void* ptr);
+
+/**
+ * Reallocates the given area of memory on the sub-pool that owns it. When that sub-pool
+ * cannot hold the new size, the area moves to another sub-pool.
+ * If ptr is NULL, the behavior is the same as calling EmbAllocPoolSetMalloc (pool_set, size).
+ * @param pool_set the pool set.
+ * @param ptr pointer to the memory area to be reallocated.
+ * @param size number of bytes to reallocated.
+ * @return the pointer to the beginning of newly allocated memory on success,
+ *         NULL otherwise (the area is left unchanged).
+ */
+void* EmbAllocPoolSetRealloc (EmbAllocPoolSet pool_set, void* ptr, size_t size);
+
+/**
+ * Retrieves a sub-pool of a pool set, e.g. for its statistics, its last error or its
+ * thread caches.
+ * @param pool_set the pool set.
+ * @param index the index of the sub-pool, below the number of sub-pools.
+ * @return the sub-pool, NULL if the index is out of range.
+ * @warning The sub-pool must not be destroyed with EmbAllocDestroy().
+ */
+EmbAllocMempool EmbAllocPoolSetGetPool (EmbAllocPoolSet pool_set, size_t index);
+
+/**
+ * Retrieves the sub-pool that owns the given pointer (e.g. for EmbAllocUsableSize()).
+ * @param pool_set the pool set.
+ * @param ptr a pointer inside the memory of one of the sub-pools.
+ * @return the sub-pool, NULL if no sub-pool owns the pointer.
+ */
+EmbAllocMempool EmbAllocPoolSetFindPool (EmbAllocPoolSet pool_set, const void* ptr);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
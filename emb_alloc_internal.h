@@ -30,6 +30,7 @@
 
 #include "emb_alloc.h"
 #include "emb_alloc_util.h"
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
@@ -58,34 +59,55 @@ extern "C" {
 #define EMB_ALLOC_ALIGN_SIZE(size)  (   (~(EMB_ALLOC_ALIGN_AMOUNT - 1)) & \
                                         ((size) + (EMB_ALLOC_ALIGN_AMOUNT - 1)))
 
+/**
+ * The cache line size the mempool control data is laid out for: the mempool starts
+ * on a cache line, and so do the block categories, the locks and the auxiliary data.
+ * Define it (as a power of two, at least EMB_ALLOC_ALIGN_AMOUNT) before compiling
+ * emb_alloc.c to match a different target.
+ */
+#ifndef EMB_ALLOC_CACHE_LINE_SIZE
+#define EMB_ALLOC_CACHE_LINE_SIZE 64u
+#endif /** EMB_ALLOC_CACHE_LINE_SIZE */
+
+/**
+ * Macro for rounding a certain memory size up to whole cache lines.
+ */
+#define EMB_ALLOC_CACHE_LINE_ALIGN_SIZE(size) \
+    ((~((size_t) EMB_ALLOC_CACHE_LINE_SIZE - 1)) & \
+    ((size) + ((size_t) EMB_ALLOC_CACHE_LINE_SIZE - 1)))
+
 /**
  * The actual aaligned size in the mempool occupied by the blocks management data.
  * There are 8 block size categories (see EmbAllocMemPoolSettings structure).
  * @note The EMB_ALLOC_NUM_BLOCK_CATEGORIES must be kept in sync
  * with the number of "num_<size>_bytes_blocks" fields inside EmbAllocMemPoolSettings.
  */
-#define EMB_ALLOC_NUM_BLOCK_CATEGORIES 8
+#define EMB_ALLOC_NUM_BLOCK_CATEGORIES EMB_ALLOC_NUM_BLOCK_SIZES
 #define EMB_ALLOC_BLOCK_CATEGORY_ALIGN_SIZE \
-    EMB_ALLOC_ALIGN_SIZE (EMB_ALLOC_NUM_BLOCK_CATEGORIES * sizeof (EmbAllocBlockCategory))
+    EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (EMB_ALLOC_NUM_BLOCK_CATEGORIES * sizeof (EmbAllocBlockCategory))
 
 /**
- * The aligned size in the mempool occupied by the settings data.
+ * The aligned size in the mempool occupied by the settings data. The settings follow
+ * the mempool start padding and are padded up to the next cache line, where the block
+ * categories start.
  */
 #define EMB_ALLOC_MEMPOOL_SETTINGS_ALIGN_SIZE \
-    EMB_ALLOC_ALIGN_SIZE (sizeof (EmbAllocMemPoolSettings))
+    (EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (EMB_ALLOC_ALIGN_AMOUNT + \
+    sizeof (EmbAllocMemPoolSettings)) - EMB_ALLOC_ALIGN_AMOUNT)
 
 /**
- * The aligned size in the mempool occupied by the  auxiliary data.
+ * The aligned size in the mempool occupied by the  auxiliary data (whole cache lines,
+ * so the first block starts on a cache line too).
  */
 #define EMB_ALLOC_MEMPOOL_AUX_DATA_ALIGN_SIZE \
-    EMB_ALLOC_ALIGN_SIZE (sizeof (EmbAllocMempoolAuxData))
+    EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (sizeof (EmbAllocMempoolAuxData))
 
 /**
  * The total aligned size in the mempool occupied by the control data
  * - start and end markers
  * - settings
  * - blocks management
- * - auxiliary (thread mutex, error storage, similar to Linux errno)
+ * - auxiliary (thread mutexes, error storage, similar to Linux errno)
  *
  * The control data is split in 2:
  * - start marker, settings, blocks management and auxiliary
@@ -117,19 +139,46 @@ extern "C" {
     EMB_ALLOC_BLOCK_CATEGORY_ALIGN_SIZE)
 
 /**
- * The control sections of a block are the 2*EMB_ALLOC_ALIGN_AMOUNT
- * (start & end paddings) + (2 * sizeof (size_t))
- * (same as EMB_ALLOC_ALIGN_AMOUNT; for blocks usage and data size)
+ * The type of the block counters (use_count and data_size) and of the block counts
+ * and sizes of a category. Building with EMB_ALLOC_32_BIT_COUNTERS defined makes them
+ * 32 bits wide on every target, which shrinks the block header and the category
+ * table of 64-bit builds, and limits the blocks of a mempool to less than 4 GiB.
  */
-#define EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE (3 * EMB_ALLOC_ALIGN_AMOUNT)
+#ifdef EMB_ALLOC_32_BIT_COUNTERS
+typedef uint32_t EmbAllocCounter;
+#else
+typedef size_t EmbAllocCounter;
+#endif /** EMB_ALLOC_32_BIT_COUNTERS */
 
 /**
- * The size of the control region at the START of a block:
- * EMB_ALLOC_ALIGN_AMOUNT (the block start padding marker) + (2 * sizeof (size_t))
- * (same as EMB_ALLOC_ALIGN_AMOUNT; the block usage and data size counters).
+ * The "uninitialized / free" value of a block counter: EMB_ALLOC_VALUE_NOT_SET
+ * truncated to the width of EmbAllocCounter.
+ */
+#define EMB_ALLOC_COUNTER_NOT_SET ((EmbAllocCounter) EMB_ALLOC_VALUE_NOT_SET)
+
+/**
+ * The size of the control region at the START of a block: the block start padding
+ * marker (at least sizeof (size_t) bytes) and the block usage and data size counters,
+ * rounded up to EMB_ALLOC_ALIGN_AMOUNT. That is 2 * EMB_ALLOC_ALIGN_AMOUNT with the
+ * default counters, and EMB_ALLOC_ALIGN_AMOUNT with 32-bit counters on 64-bit targets.
  * This is the leading block header only -- it does NOT include the end padding.
  */
-#define EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE (2 * EMB_ALLOC_ALIGN_AMOUNT)
+#define EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE \
+    EMB_ALLOC_ALIGN_SIZE (sizeof (size_t) + 2 * sizeof (EmbAllocCounter))
+
+/**
+ * The block start padding marker fills the block header in front of the counters.
+ */
+#define EMB_ALLOC_BLOCK_START_MARKER_SIZE \
+    (EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE - 2 * sizeof (EmbAllocCounter))
+
+/**
+ * The control sections of a block are the block header (start padding, blocks usage
+ * and data size, see EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE) + EMB_ALLOC_ALIGN_AMOUNT
+ * (the end padding).
+ */
+#define EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE \
+    (EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE + EMB_ALLOC_ALIGN_AMOUNT)
 
 /**
  * Retrieves the EmbAllocMemPoolSettings* associated with the mempool param.
@@ -164,17 +213,27 @@ extern "C" {
     EMB_ALLOC_MEMPOOL_SETTINGS_ALIGN_SIZE + EMB_ALLOC_BLOCK_CATEGORY_ALIGN_SIZE))
 
 /**
- * Retrieves the first allocated block associated with the mempool param.
+ * Retrieves the end of the control data at the start of the mempool, where the data
+ * blocks start, or the block metadata with EmbAllocMemPoolSettings::metadata_before_blocks.
  * Since this define is internal, its usage is restricted
  * to the emb_alloc.c file alone. It should only be called after validating that the
  * mempool is ok (by comparing the start padding with kEmbAllocMempoolStart).
  * EMB_ALLOC_ALIGN_AMOUNT is the kEmbAllocMempoolStart size that is compared.
  */
-#define EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR(mempool) \
+#define EMB_ALLOC_GET_MEMPOOL_CONTROL_END_PTR(mempool) \
     ((void*) ((unsigned char*) (mempool) + EMB_ALLOC_ALIGN_AMOUNT + \
     EMB_ALLOC_MEMPOOL_SETTINGS_ALIGN_SIZE + EMB_ALLOC_BLOCK_CATEGORY_ALIGN_SIZE + \
     EMB_ALLOC_MEMPOOL_AUX_DATA_ALIGN_SIZE))
 
+/**
+ * Retrieves the first allocated block associated with the mempool param.
+ * Since this define is internal, its usage is restricted
+ * to the emb_alloc.c file alone. It should only be called after validating that the
+ * mempool is ok (by comparing the start padding with kEmbAllocMempoolStart).
+ */
+#define EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR(mempool) \
+    (EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR (mempool)->first_block)
+
 /**
  * This is the allocated size of a block.
  * It assumes that data_size is already aligned to EMB_ALLOC_ALIGN_AMOUNT.
@@ -190,23 +249,14 @@ extern "C" {
 #define EMB_ALLOC_BLOCK_TOTAL_ALIGN_SIZE(data_size) \
     ((data_size) + EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE)
 
-/**
- * Retrieves the block start memory address from the raw pointer.
- * Since this define is internal, its usage is restricted
- * to the emb_alloc.c file alone.
- */
-#define EMB_ALLOC_GET_BLOCK_FROM_PTR(pointer) \
-    ((void*) ((unsigned char*) (pointer) - \
-    (2 * EMB_ALLOC_ALIGN_AMOUNT /*block start padding, blocks usage and data size offset*/)))
-
 /**
  * Retrieves the block usage counter from the raw pointer.
  * Since this define is internal, its usage is restricted
  * to the emb_alloc.c file alone.
  */
 #define EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_PTR(pointer) \
-    ((size_t*) ((unsigned char*) (pointer) - \
-    (EMB_ALLOC_ALIGN_AMOUNT /*data size offset*/)))
+    ((EmbAllocCounter*) ((unsigned char*) (pointer) - \
+    (2 * sizeof (EmbAllocCounter) /*data size offset*/)))
 
 /**
  * Retrieves the block used bytes from the raw pointer.
@@ -214,15 +264,8 @@ extern "C" {
  * to the emb_alloc.c file alone.
  */
 #define EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_PTR(pointer) \
-    ((size_t*) ((unsigned char*) (pointer) - \
-    sizeof(size_t)/*memory usage offset*/))
-
-/**
- * Retrieves the raw pointer from the block start memory address.
- */
-#define EMB_ALLOC_GET_PTR_FROM_BLOCK(block) \
-    ((void*) ((unsigned char*) (block) + \
-    (2 * EMB_ALLOC_ALIGN_AMOUNT /*block start padding, blocks usage and data size offset*/)))
+    ((EmbAllocCounter*) ((unsigned char*) (pointer) - \
+    sizeof (EmbAllocCounter)/*memory usage offset*/))
 
 /**
  * Retrieves the block usage counter from the block start memory address.
@@ -230,8 +273,8 @@ extern "C" {
  * to the emb_alloc.c file alone.
  */
 #define EMB_ALLOC_GET_BLOCK_USE_COUNT_FROM_BLOCK(block) \
-    ((size_t*) ((unsigned char*) (block) + \
-    (EMB_ALLOC_ALIGN_AMOUNT /*block start padding*/)))
+    ((EmbAllocCounter*) ((unsigned char*) (block) + \
+    (EMB_ALLOC_BLOCK_START_MARKER_SIZE /*block start padding*/)))
 
 /**
  * Retrieves the block used bytes from the block start memory address.
@@ -239,8 +282,8 @@ extern "C" {
  * to the emb_alloc.c file alone.
  */
 #define EMB_ALLOC_GET_MEMORY_USE_COUNT_FROM_BLOCK(block) \
-    ((size_t*) ((unsigned char*) (block) + \
-    (EMB_ALLOC_ALIGN_AMOUNT + sizeof(size_t)/*memory usage offset*/)))
+    ((EmbAllocCounter*) ((unsigned char*) (block) + \
+    (EMB_ALLOC_BLOCK_START_MARKER_SIZE + sizeof (EmbAllocCounter)/*memory usage offset*/)))
 
 /**
  * Retrieves the block end padding from the block start memory address.
@@ -249,40 +292,83 @@ extern "C" {
  */
 #define EMB_ALLOC_GET_END_PADDING_FROM_BLOCK(block, size) \
     ((void*) ((unsigned char*) (block) + \
-    (2 * EMB_ALLOC_ALIGN_AMOUNT /*block start padding and counters*/) + (size)))
+    (EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE /*block start padding and counters*/) + (size)))
 
 /**
- * Total number of data blocks across all 8 size categories in the settings.
+ * The bitmaps are scanned and updated one 64-bit word at a time.
+ * Block index i lives in word (i / EMB_ALLOC_BITMAP_WORD_BITS),
+ * at bit position (i % EMB_ALLOC_BITMAP_WORD_BITS).
  */
-#define GET_TOTAL_NUM_BLOCKS_FROM_SETTINGS_PTR(settings) \
-    ((settings)->num_32_bytes_blocks + \
-    (settings)->num_64_bytes_blocks + \
-    (settings)->num_128_bytes_blocks + \
-    (settings)->num_256_bytes_blocks + \
-    (settings)->num_512_bytes_blocks + \
-    (settings)->num_1k_bytes_blocks + \
-    (settings)->num_2k_bytes_blocks + \
-    (settings)->num_4k_bytes_blocks)
+#define EMB_ALLOC_BITMAP_WORD_BITS 64u
 
 /**
- * Total bytes of per-block control overhead (start/end padding + counters)
- * across every block described by the settings.
+ * Number of 64-bit words needed for a category's bitmap that tracks `num_blocks`
+ * blocks at 1 bit per block.
  */
-#define GET_TOTAL_BLOCKS_CONTROL_SIZE_FROM_SETTINGS_PTR(settings) \
-    (EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE * GET_TOTAL_NUM_BLOCKS_FROM_SETTINGS_PTR(settings))
+#define EMB_ALLOC_CATEGORY_BITMAP_WORDS(num_blocks) \
+    (((num_blocks) + (EMB_ALLOC_BITMAP_WORD_BITS - 1u)) / EMB_ALLOC_BITMAP_WORD_BITS)
 
 /**
  * Number of bytes needed for a category's out-of-band free bitmap that tracks
  * `num_blocks` blocks at 1 bit per block (bit set == occupied, clear == free).
- * Each category's slice is byte-aligned, so a block's index within its category
- * maps directly to (byte, bit) with no cross-category bit packing.
+ * Each category's slice is rounded up to whole 64-bit words, so a block's index
+ * within its category maps directly to (word, bit) with no cross-category bit packing
+ * and every slice stays naturally aligned for word access.
  * @note This bitmap is the AUTHORITATIVE free/occupied oracle. Free detection must
  *       never be inferred from a block's in-band use_count slot: the inner blocks of
  *       a multi-block allocation overlay user data on that slot, so user data equal
- *       to EMB_ALLOC_VALUE_NOT_SET would otherwise masquerade as a free block and let
+ *       to EMB_ALLOC_COUNTER_NOT_SET would otherwise masquerade as a free block and let
  *       a scanner hand out an allocation overlapping live data.
+ * @note The unused padding bits of the last free-bitmap word are permanently set
+ *       (occupied), so word scans never report a block past total_blocks.
+ */
+#define EMB_ALLOC_CATEGORY_BITMAP_BYTES(num_blocks) \
+    (EMB_ALLOC_CATEGORY_BITMAP_WORDS (num_blocks) * sizeof (uint64_t))
+
+/**
+ * Word `word` (the one for blocks [64 * word, 64 * word + 64)) of the free bitmap and
+ * of the allocation-start bitmap of a category, as lvalues. The word number is scaled
+ * by EmbAllocBlockCategory::bitmap_word_shift, so the same code walks the separate
+ * and the interleaved bitmap layouts.
+ */
+#define EMB_ALLOC_FREE_BITMAP_WORD(category, word) \
+    ((category)->free_bitmap [(size_t) (word) << (category)->bitmap_word_shift])
+#define EMB_ALLOC_START_BITMAP_WORD(category, word) \
+    ((category)->alloc_start_bitmap [(size_t) (word) << (category)->bitmap_word_shift])
+
+/**
+ * Categories whose free bitmap spans more than this many 64-bit words also get the
+ * two "any-free" summary levels (see EmbAllocBlockCategory::free_summary). Smaller
+ * categories are scanned flat, which is already only a handful of word reads.
+ * Define it before compiling emb_alloc.c to move the threshold (SIZE_MAX disables
+ * the summaries altogether).
+ */
+#ifndef EMB_ALLOC_SUMMARY_BITMAP_MIN_WORDS
+#define EMB_ALLOC_SUMMARY_BITMAP_MIN_WORDS 8u
+#endif /** EMB_ALLOC_SUMMARY_BITMAP_MIN_WORDS */
+
+/**
+ * True if a category of `num_blocks` blocks keeps the free-bitmap summary levels.
  */
-#define EMB_ALLOC_CATEGORY_BITMAP_BYTES(num_blocks) (((num_blocks) + 7u) / 8u)
+#define EMB_ALLOC_CATEGORY_HAS_SUMMARY(num_blocks) \
+    (EMB_ALLOC_CATEGORY_BITMAP_WORDS (num_blocks) > EMB_ALLOC_SUMMARY_BITMAP_MIN_WORDS)
+
+/**
+ * Number of 64-bit words of the second level (1 bit per free-bitmap word)
+ * and of the third level (1 bit per second-level word) of a category's summary.
+ */
+#define EMB_ALLOC_CATEGORY_SUMMARY_WORDS(num_blocks) \
+    EMB_ALLOC_CATEGORY_BITMAP_WORDS (EMB_ALLOC_CATEGORY_BITMAP_WORDS (num_blocks))
+#define EMB_ALLOC_CATEGORY_SUMMARY_TOP_WORDS(num_blocks) \
+    EMB_ALLOC_CATEGORY_BITMAP_WORDS (EMB_ALLOC_CATEGORY_SUMMARY_WORDS (num_blocks))
+
+/**
+ * Number of bytes needed for both summary levels of a category (0 if it has none).
+ */
+#define EMB_ALLOC_CATEGORY_SUMMARY_BYTES(num_blocks) \
+    (EMB_ALLOC_CATEGORY_HAS_SUMMARY (num_blocks) ? \
+        ((EMB_ALLOC_CATEGORY_SUMMARY_WORDS (num_blocks) + \
+            EMB_ALLOC_CATEGORY_SUMMARY_TOP_WORDS (num_blocks)) * sizeof (uint64_t)) : 0u)
 
 /**
  * True if `pointer` lies within `mempool`'s data-block region.
@@ -293,9 +379,7 @@ extern "C" {
         ((uintptr_t)(pointer) >= (uintptr_t)EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR(mempool)) && \
         ((size_t) ((uintptr_t)(pointer) - \
                 (uintptr_t)EMB_ALLOC_GET_MEMPOOL_FIRST_BLOCK_PTR(mempool))) \
-            < ((EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR(mempool))->total_size + \
-                GET_TOTAL_BLOCKS_CONTROL_SIZE_FROM_SETTINGS_PTR( \
-                    EMB_ALLOC_GET_MEMPOOL_SETTINGS_PTR(mempool))))
+            < (EMB_ALLOC_GET_MEMPOOL_AUX_DATA_PTR(mempool))->blocks_size)
 
 /**
  * Retrieves the mempool associated with the EmbAllocMemPoolSettings param.
@@ -347,60 +431,441 @@ extern "C" {
     (   ((category).block_data_size >= (size)) && \
         ((category).occupied_blocks < ((category).total_blocks)))
 
-/** Management structure for the blocks of a certain dimension in the mempool. */
+/**
+ * The block index arithmetic divides by the block stride with a multiply and a shift
+ * (see EmbAllocBlockCategory::stride_magic). Offsets below 2^31 bytes take a 64-bit
+ * product; larger categories need the 128-bit product of GCC / clang on 64-bit
+ * targets, and fall back to the division elsewhere.
+ */
+#define EMB_ALLOC_STRIDE_DIVIDEND_BITS_64 31u
+#if defined (__SIZEOF_INT128__)
+#define EMB_ALLOC_UINT128_SUPPORTED 1
+__extension__ typedef unsigned __int128 EmbAllocUint128;
+/** The largest offsets (in bits) the 128-bit product divides; keeps the magic in 64 bits. */
+#define EMB_ALLOC_STRIDE_DIVIDEND_BITS_128 62u
+#else
+#define EMB_ALLOC_UINT128_SUPPORTED 0
+#endif /** __SIZEOF_INT128__ */
+
+/**
+ * The size of the fields of EmbAllocBlockCategory, without its cache line padding:
+ * 10 pointers, stride_magic, 7 EmbAllocCounter fields and 4 unsigned char fields.
+ * The fields are ordered so that there is no hole between them on any target
+ * (stride_magic first, the counters in even groups between the pointers, the
+ * unsigned char fields last), which EmbAllocBlockCategorySizeCheck verifies.
+ */
+#define EMB_ALLOC_BLOCK_CATEGORY_FIELDS_SIZE \
+    ((10 * sizeof (void*)) + sizeof (uint64_t) + (7 * sizeof (EmbAllocCounter)) + 4)
+
+/**
+ * Management structure for the blocks of a certain dimension in the mempool.
+ * A category takes whole cache lines (see EMB_ALLOC_CACHE_LINE_SIZE), and the fields
+ * the allocations and frees touch come first: on 64-bit targets the fields up to
+ * data_sizes fill the first two cache lines, the lock-free search hint, the last
+ * summary level and the stride division details follow. The categories are written
+ * under their own locks, so no two categories share a cache line.
+ */
 typedef struct {
+    /**
+     * Division by the block stride as a multiply and a shift, computed at creation:
+     * offset / stride == (offset * stride_magic) >> stride_shift for every offset
+     * below 2^stride_dividend_bits, which covers every offset inside the category.
+     * 0 when no product wide enough is available (the division is used instead).
+     */
+    uint64_t stride_magic;
     /** The start address for the first block of this dimension. */
     void* start_address;
     /** The first free block in the continous pool of blocks of this dimension. */
     void* first_free_address;
     /** The last free block in the continous pool of blocks of this dimension. */
     void* last_free_address;
-    /** The start address for the last block address of this dimension.  */
-    void* last_address;
-    /** The size of each block. */
-    size_t block_data_size;
-    /** The total number allocated of blocks. */
-    size_t total_blocks;
-    /** The number of occupied (in-use) blocks; the free count is total_blocks - occupied_blocks. */
-    size_t occupied_blocks;
     /**
      * Out-of-band free bitmap for this category: 1 bit per block (set == occupied,
-     * clear == free), EMB_ALLOC_CATEGORY_BITMAP_BYTES(total_blocks) bytes, byte-aligned.
-     * Points into a region the mempool reserves after the data blocks. This is the
+     * clear == free), EMB_ALLOC_CATEGORY_BITMAP_BYTES(total_blocks) bytes, as 64-bit words.
+     * Points into the block metadata region the mempool reserves after the data blocks
+     * (before them with EmbAllocMemPoolSettings::metadata_before_blocks). This is the
      * AUTHORITATIVE free/occupied oracle; scanners must consult it rather than reading
      * a block's use_count slot (which is user data for multi-block inner blocks).
      * NULL only for an empty category (total_blocks == 0).
      */
-    void* free_bitmap;
+    uint64_t* free_bitmap;
     /**
      * Out-of-band allocation-start bitmap for this category: 1 bit per block, set
      * iff the block is the FIRST (head) block of a live allocation. Same size and
-     * layout as free_bitmap, laid out immediately after it. The validator
+     * layout as free_bitmap, laid out immediately after it, or interleaved with it
+     * (see bitmap_word_shift). The validator
      * (EmbAllocGetCategoryForPtr) requires this bit before accepting a Free/Realloc,
      * so a forged inner-block header (inner-block headers are user-writable payload)
      * cannot masquerade as an allocation head. NULL only for an empty category.
      */
-    void* alloc_start_bitmap;
+    uint64_t* alloc_start_bitmap;
+    /** The number of occupied (in-use) blocks; the free count is total_blocks - occupied_blocks. */
+    EmbAllocCounter occupied_blocks;
+    /** The total number allocated of blocks. */
+    EmbAllocCounter total_blocks;
+    /** The size of each block. */
+    EmbAllocCounter block_data_size;
+    /**
+     * The distance between the starts of two neighbouring blocks: block_data_size plus
+     * the in-band control bytes of a block (none in the compact layout, see
+     * EmbAllocMemPoolSettings::compact_metadata).
+     */
+    EmbAllocCounter stride;
+    /**
+     * The in-band control bytes in front of the payload of a block: the start marker,
+     * use_count and data_size (EMB_ALLOC_BLOCK_START_CONTROL_ALIGN_SIZE), or 0 in the
+     * compact layout, whose blocks carry no markers at all.
+     */
+    EmbAllocCounter header_size;
+    /**
+     * Upper bound on the longest run of consecutive free blocks. Never below the true
+     * value: a failed run search from first_free_address tightens it to the length
+     * that was just proven unavailable minus one, and every free loosens it to at least
+     * the length of the merged run around the freed blocks. Lets multi-block requests
+     * that cannot fit be rejected in O(1) (see EmbAllocCanAllocInMultipleBlocksInternal).
+     */
+    EmbAllocCounter max_free_run;
+    /**
+     * Second level of the free bitmap: 1 bit per free_bitmap word, set iff that word
+     * still has at least one free block. Lets a search skip 64 fully occupied words
+     * (4096 blocks) per word read. Kept in sync by EmbAllocMarkBlocksInternal; a
+     * lock-free single-block allocation may leave the bit of a word it filled set.
+     * NULL when the category is small enough for a flat scan
+     * (see EMB_ALLOC_CATEGORY_HAS_SUMMARY).
+     */
+    uint64_t* free_summary;
+    /** The start address for the last block address of this dimension.  */
+    void* last_address;
+    /**
+     * Compact layout only: the use_count of every block, indexed like the blocks and
+     * placed after the bitmaps. NULL when the counters are kept inside the blocks.
+     */
+    EmbAllocCounter* use_counts;
+    /** Compact layout only: the data_size of every block, laid out like use_counts. */
+    EmbAllocCounter* data_sizes;
+    /**
+     * Third level of the free bitmap: 1 bit per free_summary word, set iff that
+     * summary word is non-zero. NULL whenever free_summary is NULL.
+     */
+    uint64_t* free_summary_top;
+    /**
+     * The free-bitmap word the lock-free single-block allocations start their search
+     * from (see EmbAllocMemPoolSettings::lock_free_single_blocks): the word of the last
+     * lock-free allocation, moved down by the lock-free frees below it. Only a hint,
+     * the search wraps around to cover the whole bitmap.
+     */
+    EmbAllocCounter next_free_word;
+    /** The shift that goes with stride_magic. */
+    unsigned char stride_shift;
+    /**
+     * The number of bits of the largest offset stride_magic divides exactly.
+     * stride_magic is 1 for a power-of-two stride: the offset is only shifted.
+     */
+    unsigned char stride_dividend_bits;
+    /**
+     * The shift that turns a bitmap word number into the index of the word in
+     * free_bitmap and alloc_start_bitmap (see EMB_ALLOC_FREE_BITMAP_WORD): 0 for
+     * separate bitmaps, 1 for interleaved ones (see
+     * EmbAllocMemPoolSettings::interleaved_bitmaps), where the free word and the start
+     * word of every 64 blocks are neighbours and alloc_start_bitmap is free_bitmap + 1.
+     */
+    unsigned char bitmap_word_shift;
+    /**
+     * 1 when the allocation-start bits are read and written without the category lock
+     * by other threads (thread caches, remote free queues, lock-free single blocks of a
+     * threadsafe mempool), so every access to them is atomic; 0 otherwise.
+     */
+    unsigned char concurrent_start_bitmap;
+    /** Pads the category up to whole cache lines. */
+    unsigned char cache_line_padding [EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (
+        EMB_ALLOC_BLOCK_CATEGORY_FIELDS_SIZE + 1) - EMB_ALLOC_BLOCK_CATEGORY_FIELDS_SIZE];
 } EmbAllocBlockCategory;
 
-/** Auxiliary data structure for handling multithreading and errors in the mempool */
+/**
+ * Fails to compile unless the fields end exactly at EMB_ALLOC_BLOCK_CATEGORY_FIELDS_SIZE
+ * (a missed field or hole, or a miscount, moves the padding) and the padding brings the
+ * category to the size of its cache lines.
+ */
+typedef char EmbAllocBlockCategorySizeCheck [
+    ((offsetof (EmbAllocBlockCategory, cache_line_padding) == EMB_ALLOC_BLOCK_CATEGORY_FIELDS_SIZE) &&
+    (sizeof (EmbAllocBlockCategory) ==
+        EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (EMB_ALLOC_BLOCK_CATEGORY_FIELDS_SIZE + 1))) ? 1 : -1];
+
+/**
+ * The in-band control bytes of a block (start marker, counters and end marker) of the
+ * mempool described by the settings: none in the compact layout.
+ */
+#define EMB_ALLOC_BLOCK_CONTROL_SIZE_FROM_SETTINGS_PTR(settings) \
+    ((settings)->compact_metadata ? (size_t) 0 : (size_t) EMB_ALLOC_BLOCK_CONTROL_ALIGN_SIZE)
+
+/**
+ * The in-band control bytes of a block of the category (stride - block_data_size).
+ * An n-block run holds n * stride - EMB_ALLOC_CATEGORY_CONTROL_SIZE bytes.
+ */
+#define EMB_ALLOC_CATEGORY_CONTROL_SIZE(category) \
+    ((category)->stride - (category)->block_data_size)
+
+/** True if the blocks of the category carry the in-band start and end markers. */
+#define EMB_ALLOC_CATEGORY_HAS_MARKERS(category) \
+    (0 != (category)->header_size)
+
+/**
+ * Retrieves the raw pointer from the block start memory address of the category.
+ */
+#define EMB_ALLOC_GET_CATEGORY_PTR_FROM_BLOCK(category, block) \
+    ((void*) ((unsigned char*) (block) + (category)->header_size))
+
+/**
+ * Retrieves the block start memory address of the category from the raw pointer.
+ * The header size is the same in every category of a mempool.
+ */
+#define EMB_ALLOC_GET_CATEGORY_BLOCK_FROM_PTR(category, pointer) \
+    ((void*) ((unsigned char*) (pointer) - (category)->header_size))
+
+/**
+ * Placement policy function (see EmbAllocPlacementPolicy): decides between a single
+ * block in one category and a multi-block run in a smaller one.
+ * @param single_block_category the category that can hold the allocation in one block.
+ * @param multi_block_category the category that can hold it in a run of blocks.
+ * @param size the size that needs to be allocated.
+ * @param multi_block_count the number of blocks the run would use.
+ * @return true to allocate a single block, false to allocate the multi-block run.
+ */
+typedef bool (*EmbAllocPlacementFn) (const EmbAllocBlockCategory* single_block_category,
+    const EmbAllocBlockCategory* multi_block_category, size_t size, size_t multi_block_count);
+
+/**
+ * Size classes of the size-to-category lookup table: one entry per 32 bytes (the
+ * smallest block size) of request size, up to the largest block size (4 kB). Every
+ * block size is a multiple of 32, so all the sizes of one class share the same
+ * best-fit category.
+ */
+#define EMB_ALLOC_SIZE_CLASS_BYTES 32u
+#define EMB_ALLOC_SIZE_CLASS_COUNT (4096u / EMB_ALLOC_SIZE_CLASS_BYTES)
+/** The size class of a (non-zero) size; valid for sizes up to 4 kB. */
+#define EMB_ALLOC_SIZE_CLASS(size) (((size) - 1u) / EMB_ALLOC_SIZE_CLASS_BYTES)
+
+/**
+ * The number of pointers EmbAllocFreeBatch sorts by category at a time, keeping their
+ * category indexes on the stack. The pointers of a batch up to this size are looked up
+ * once, before the category locks are taken; a larger batch looks the pointers past
+ * the first group up once more, a group at a time.
+ * @note At most 256, so a position in a group fits into an unsigned char.
+ */
+#ifndef EMB_ALLOC_FREE_BATCH_GROUP_SIZE
+    #define EMB_ALLOC_FREE_BATCH_GROUP_SIZE 64u
+#endif /** EMB_ALLOC_FREE_BATCH_GROUP_SIZE */
+
+/** Fails to compile when EMB_ALLOC_FREE_BATCH_GROUP_SIZE is 0 or above 256. */
+typedef char EmbAllocFreeBatchGroupSizeCheck [((EMB_ALLOC_FREE_BATCH_GROUP_SIZE > 0u) &&
+    (EMB_ALLOC_FREE_BATCH_GROUP_SIZE <= 256u)) ? 1 : -1];
+
+/**
+ * The lock-free single-block paths use the GCC / clang __atomic builtins. Elsewhere
+ * EmbAllocMemPoolSettings::lock_free_single_blocks is ignored and every call takes
+ * the category locks.
+ */
+#if defined (__GNUC__) || defined (__clang__)
+#define EMB_ALLOC_LOCK_FREE_SUPPORTED 1
+#else
+#define EMB_ALLOC_LOCK_FREE_SUPPORTED 0
+#endif /** __GNUC__ || __clang__ */
+
+/** EmbAllocMempoolAuxData::owner_thread of a mempool without an owner. */
+#define EMB_ALLOC_NO_OWNER_THREAD SIZE_MAX
+
+/** The number of free blocks a thread cache magazine holds. */
+#define EMB_ALLOC_MAGAZINE_ROUNDS 16u
+/** The number of full magazines the mempool depot keeps for each category. */
+#define EMB_ALLOC_DEPOT_MAGAZINES 8u
+
+/**
+ * A magazine: a stack of free single blocks of one category held outside the free
+ * bitmap. The blocks stay marked occupied and allocation heads in the bitmaps, with
+ * use_count 1, data_size EMB_ALLOC_COUNTER_NOT_SET and an EMB_ALLOC_INIT_VALUE payload.
+ */
+typedef struct {
+    /** The number of blocks in the magazine. */
+    size_t rounds;
+    /** The data pointers of the blocks, the most recently freed last. */
+    void* blocks [EMB_ALLOC_MAGAZINE_ROUNDS];
+} EmbAllocMagazine;
+
+/** The full magazines the mempool keeps for one category, shared by all thread caches. */
+typedef struct {
+    /** The number of full magazines in the depot. */
+    size_t full_count;
+    /** The full magazines. */
+    EmbAllocMagazine full [EMB_ALLOC_DEPOT_MAGAZINES];
+} EmbAllocDepotCategory;
+
+/** Thread cache (see EmbAllocThreadCache): two magazines per category, owned by one thread. */
+typedef struct {
+    /** The mempool the cached blocks belong to. */
+    void* mempool;
+    /** The magazines allocations are taken from and frees are put into. */
+    EmbAllocMagazine loaded [EMB_ALLOC_NUM_BLOCK_CATEGORIES];
+    /**
+     * The previously loaded magazines, always either full or empty: swapped with the
+     * loaded ones, so that alternating allocations and frees at a magazine boundary
+     * do not reach the depot every time.
+     */
+    EmbAllocMagazine previous [EMB_ALLOC_NUM_BLOCK_CATEGORIES];
+} EmbAllocThreadCacheData;
+
+/** The lock bit of a category in a category lock mask. */
+#define EMB_ALLOC_CATEGORY_MASK(index) (1u << (index))
+/** The category lock mask of all the categories. */
+#define EMB_ALLOC_ALL_CATEGORIES_MASK ((1u << EMB_ALLOC_NUM_BLOCK_CATEGORIES) - 1u)
+
+/** The lock of one block category of a threadsafe mempool. */
 typedef struct {
-    /** OS generic mutex used for thread synchronization. */
-    EmbAllocMutex thread_sync_mutex;
+    /** Guards the blocks management data of the category and its blocks. */
+    EmbAllocLock mutex;
+    /**
+     * Set by the mutex holder of a lock_free_single_blocks mempool: new lock-free
+     * calls on the category fall back to the mutex, so the holder has the category to
+     * itself once lock_free_calls drops to 0.
+     */
+    bool lock_free_excluded;
+    /** The number of lock-free single-block calls in progress on the category. */
+    size_t lock_free_calls;
     /**
-     * Bool flag to mark that the thread sync mutex can be used.
+     * The EmbAllocGetThreadIndex () of the thread that holds the mutex, or
+     * EMB_ALLOC_NO_OWNER_THREAD, so that the error dump can tell the categories locked
+     * by its own thread (see EmbAllocSetErrorInternal). Accessed atomically.
+     */
+    size_t holder_thread;
+} EmbAllocCategoryLock;
+
+/**
+ * A lock in cache lines of its own: taking it does not invalidate the cache lines of
+ * the data it guards, nor those of the other locks.
+ */
+typedef union {
+    /** The lock. */
+    EmbAllocLock lock;
+    /** Pads the lock up to whole cache lines. */
+    unsigned char cache_lines [EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (sizeof (EmbAllocLock))];
+} EmbAllocLockLine;
+
+/** A category lock in cache lines of its own (see EmbAllocLockLine). */
+typedef union {
+    /** The category lock. */
+    EmbAllocCategoryLock lock;
+    /** Pads the category lock up to whole cache lines. */
+    unsigned char cache_lines [EMB_ALLOC_CACHE_LINE_ALIGN_SIZE (sizeof (EmbAllocCategoryLock))];
+} EmbAllocCategoryLockLine;
+
+/**
+ * Auxiliary data structure for handling multithreading and errors in the mempool.
+ *
+ * A threadsafe mempool has three kinds of locks, always taken in this order:
+ *   1. thread_sync_mutex, for the magazine depot and the thread cache count;
+ *   2. the category locks, in ascending category index order;
+ *   3. error_sync_mutex, for the last error (no other lock is taken while it is held).
+ * A call only takes the category locks of the categories it works on: one for free,
+ * realloc in place and the other calls on an existing allocation, all of them for the
+ * full category search of malloc and for the statistics.
+ *
+ * The structure starts on a cache line. The locks come first, each in cache lines of
+ * its own, then the remote free queues, then the fields read by every call, and the
+ * cold data last: the depot, the thread cache count and the last error message.
+ */
+typedef struct {
+    /** Guards the magazine depot and the thread cache count. */
+    EmbAllocLockLine thread_sync_mutex;
+    /** Guards last_error and last_error_message. */
+    EmbAllocLockLine error_sync_mutex;
+    /** The locks of the block categories, indexed like the categories. */
+    EmbAllocCategoryLockLine category_locks [EMB_ALLOC_NUM_BLOCK_CATEGORIES];
+    /**
+     * The remote free queues, one per category: lock-free stacks of freed single blocks
+     * (formatted like the blocks of a magazine), linked through the first word of their
+     * payload. Pushed with a compare-and-swap, taken whole by the owner.
+     */
+    void* remote_frees [EMB_ALLOC_NUM_BLOCK_CATEGORIES];
+    /**
+     * Bool flag to mark that the thread sync mutexes can be used.
      * It will be set to true when the EmbAllocMemPoolSettings.threadsafe is true
-     * and the thread_sync_mutex has been initialized successfully.
-     * If true, then thread_sync_mutex will be used when allocating, dealocating
+     * and all the mutexes have been initialized successfully.
+     * If true, then the mutexes will be used when allocating, dealocating
      * or freeing memory blocks.
      */
     bool thread_sync_mutex_initialized;
+    /**
+     * True when single blocks are allocated and freed without the category locks
+     * (EmbAllocMemPoolSettings::lock_free_single_blocks on a threadsafe mempool).
+     */
+    bool lock_free_single_blocks;
+    /**
+     * True when the single-block frees of the threads other than owner_thread are queued
+     * (EmbAllocMemPoolSettings::remote_free_queues on a threadsafe mempool).
+     */
+    bool remote_free_queues;
     /** The last error code (similar to Linux errno). */
     EmbAllocErrors last_error;
+    /**
+     * The EmbAllocGetThreadIndex () of the thread that drains the remote free queues,
+     * EMB_ALLOC_NO_OWNER_THREAD when no thread does. Accessed atomically.
+     */
+    size_t owner_thread;
+    /**
+     * The placement policy function, chosen at creation from
+     * EmbAllocMemPoolSettings.placement_policy. NULL for kEmbAllocPlaceSingleBlockFirst,
+     * which never has to choose (multi-block runs are only searched when no single
+     * block fits).
+     */
+    EmbAllocPlacementFn placement_fn;
+    /**
+     * The size of the data-block region: from the first block of the mempool to the
+     * end of the blocks of the last category, the alignment padding between the
+     * categories (see EmbAllocMemPoolSettings::power_of_two_strides) included.
+     */
+    size_t blocks_size;
+    /**
+     * The first block of the mempool: the end of the control data, or the end of the
+     * block metadata that follows it with EmbAllocMemPoolSettings::metadata_before_blocks.
+     */
+    void* first_block;
+    /**
+     * Size class (see EMB_ALLOC_SIZE_CLASS) to preferred category table, built at
+     * creation. An entry is the category a single-block allocation of that size goes
+     * to whenever it has a free block, without consulting the placement policy, or
+     * EMB_ALLOC_NUM_BLOCK_CATEGORIES when the full category search is needed.
+     */
+    unsigned char size_class_category [EMB_ALLOC_SIZE_CLASS_COUNT];
+    /**
+     * The magazine depot, one entry per category. Allocated with the first thread cache
+     * and released with the last one, NULL while there is no thread cache.
+     */
+    EmbAllocDepotCategory* depot;
+    /** The number of live thread caches of the mempool. */
+    size_t thread_cache_count;
+    /**
+     * The address malloc returned for the mempool, which starts at the first cache line
+     * boundary in it. Only read by EmbAllocDestroy.
+     */
+    void* allocation;
     /** The human readable last error message (similar to Linux strerror(errno)). */
     char last_error_message [EMB_ALLOC_ERROR_MESSAGE_SIZE];
 } EmbAllocMempoolAuxData;
 
+/** Pool set (see EmbAllocPoolSet), allocated together with its two arrays. */
+typedef struct {
+    /** The number of sub-pools. */
+    size_t num_pools;
+    /** How the sub-pool of an allocation is picked. */
+    EmbAllocPoolSelection selection;
+    /** The sub-pools, in creation order (indexed by the CPU / thread index). */
+    void** pools;
+    /**
+     * The sub-pools sorted by the address of their first block, so that the owner of a
+     * pointer is found with a binary search.
+     */
+    void** pools_by_address;
+} EmbAllocPoolSetData;
+
 /** Error strings. */
 #define EMB_ALLOC_INCONSISTENT_SETTINGS "The mempool settings are inconsistent."
 #define EMB_ALLOC_NOT_A_MEMPOOL_ERROR "The mempool is invalid."
@@ -414,6 +879,7 @@ typedef struct {
 #define EMB_ALLOC_MUTEX_UNLOCK_ERROR "Could not unlock the threadsync mutex."
 #define EMB_ALLOC_MUTEX_DESTROY_ERROR "Could not destroy the threadsync mutex."
 #define EMB_ALLOC_INVALID_POINTER_PARAM_ERROR "Invalid pointer input parameter."
+#define EMB_ALLOC_INVALID_SIZE_PARAM_ERROR "Invalid size input parameter."
 
 #define EMB_ALLOC_MEMORY_LOCATION_ERROR_FORMAT "(at the 0x%p location / %zu mempool offset)"
 
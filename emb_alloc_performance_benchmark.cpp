@@ -24,15 +24,19 @@
  * https://en.wikipedia.org/wiki/MIT_License#License_terms
  */
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <cstring>
 #include <cstdlib>
 #include <ctime>
 #include <iostream>
 #include <stdlib.h>
+#include <thread>
 #include <vector>
 
 #include "emb_alloc.h"
+#include "emb_alloc_util.h"
 #include "emb_alloc_performance_benchmark.h"
 
 #ifdef RUN_WOF_ALLOCATOR_COMPARISON
@@ -52,6 +56,17 @@ namespace {
     void EmbAllocPrintErrorInternal (EmbAllocErrors error_code, const char* error_message);
 
     void EmbAllocRunPerformanceBenchmarkInternal (const EmbAllocMemPoolSettings& mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunPlacementPolicyBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocPrintFragmentationInternal (EmbAllocMempool mempool);
+    void EmbAllocRunThreadScalingBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunLockContentionBenchmarkInternal (size_t iterations);
+    void EmbAllocRunRemoteFreeBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunBatchBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunSizedFreeBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunPowerOfTwoStridesBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunCompactMetadataBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunMetadataPlacementBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
+    void EmbAllocRunInterleavedBitmapsBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes);
     void libcRunPerformanceBenchmarkInternal (std::vector <size_t> memory_blocks_sizes);
 
     #ifdef RUN_WOF_ALLOCATOR_COMPARISON
@@ -169,6 +184,40 @@ void EmbAllocRunPerformanceBenchmark (size_t scale_multiplier)
 
     std::cout << std::endl << "Full safety enabled" << std::endl;
     EmbAllocRunPerformanceBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    mempool_settings.init_allocated_memory = false;
+    mempool_settings.full_overflow_checks = false;
+    mempool_settings.threadsafe = false;
+
+    std::cout << std::endl << "Placement policies (full safety disabled)" << std::endl;
+    EmbAllocRunPlacementPolicyBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Lock contention (EmbAllocLockMutex/EmbAllocUnlockMutex vs the lock backends)" << std::endl;
+    EmbAllocRunLockContentionBenchmarkInternal (memory_blocks_sizes.size ());
+
+    std::cout << std::endl << "Thread scaling (threadsafe, category locks per lock backend vs lock-free single blocks vs thread caches vs pool set)" << std::endl;
+    EmbAllocRunThreadScalingBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Cross-thread frees (threadsafe, one allocating thread, regular frees vs remote free queues)" << std::endl;
+    EmbAllocRunRemoteFreeBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Bursts of same-sized allocations (threadsafe, single calls vs batch calls)" << std::endl;
+    EmbAllocRunBatchBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Frees (full safety disabled, EmbAllocFree vs EmbAllocFreeSized)" << std::endl;
+    EmbAllocRunSizedFreeBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Block strides per category (full safety disabled, default vs power_of_two_strides)" << std::endl;
+    EmbAllocRunPowerOfTwoStridesBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Block metadata (full safety disabled, in-band vs compact_metadata)" << std::endl;
+    EmbAllocRunCompactMetadataBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Block metadata placement (full safety disabled, after the blocks vs metadata_before_blocks)" << std::endl;
+    EmbAllocRunMetadataPlacementBenchmarkInternal (mempool_settings, memory_blocks_sizes);
+
+    std::cout << std::endl << "Block bitmaps (full safety disabled, separate vs interleaved_bitmaps)" << std::endl;
+    EmbAllocRunInterleavedBitmapsBenchmarkInternal (mempool_settings, memory_blocks_sizes);
 }
 
 namespace {
@@ -352,6 +401,720 @@ namespace {
         std::cout << "Operation took " << std::chrono::duration<double, std::milli>(t_end-t_start).count () << " ms" <<std::endl;
     }
 
+    void EmbAllocRunPlacementPolicyBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        const struct {
+            EmbAllocPlacementPolicy policy;
+            const char* name;
+        } policies [] = {
+            { kEmbAllocPlaceMaxFreeAfter, "max free after" },
+            { kEmbAllocPlaceBestFit, "best fit" },
+            { kEmbAllocPlaceLowestOccupancyBefore, "lowest occupancy before" },
+            { kEmbAllocPlaceLowestOccupancyAfter, "lowest occupancy after" },
+            { kEmbAllocPlaceSingleBlockFirst, "single block first" } };
+
+        for (size_t p = 0; p < sizeof (policies) / sizeof (policies [0]); p++) {
+            mempool_settings.placement_policy = policies [p].policy;
+
+            EmbAllocMempool mempool = EmbAllocCreate (&mempool_settings);
+
+            if (NULL == mempool) {
+                std::cout << "Could not create the mempool" << std::endl;
+                return;
+            }
+
+            std::cout << std::endl << "Policy: " << policies [p].name << std::endl;
+
+            std::vector <void*> allocations (memory_blocks_sizes.size (), NULL);
+            size_t operations = 0;
+            size_t failures = 0;
+
+            /**
+             * Doubled sizes (102..128 bytes) have no best-fit category in the benchmark
+             * mempool, so every one of them asks the policy to choose between a 256 bytes
+             * block and a run of 32 or 64 bytes blocks. Random frees and re-allocations of
+             * mixed sizes then churn the resulting layout.
+             */
+            auto t_start = std::chrono::high_resolution_clock::now ();
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                allocations [i] = EmbAllocMalloc (mempool,
+                    (i % 2) ? memory_blocks_sizes [i] : memory_blocks_sizes [i] * 2);
+                operations++;
+                failures += (NULL == allocations [i]) ? 1 : 0;
+            }
+
+            std::srand (0);
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                size_t index = std::rand () % memory_blocks_sizes.size ();
+
+                EmbAllocFree (mempool, allocations [index]);
+                allocations [index] = EmbAllocMalloc (mempool,
+                    (std::rand () % 2) ? memory_blocks_sizes [i] : memory_blocks_sizes [i] * 2);
+                operations += 2;
+                failures += (NULL == allocations [index]) ? 1 : 0;
+            }
+
+            auto t_end = std::chrono::high_resolution_clock::now ();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+
+            std::cout << "Operation took " << elapsed_ms << " ms (" <<
+                (elapsed_ms > 0 ? operations / elapsed_ms : 0) << " operations/ms, " <<
+                failures << " failed allocations)" << std::endl;
+
+            EmbAllocPrintFragmentationInternal (mempool);
+
+            for (size_t i = 0; i < allocations.size (); i++) {
+                EmbAllocFree (mempool, allocations [i]);
+            }
+
+            EmbAllocDestroy (mempool);
+        }
+    }
+
+    void EmbAllocRunThreadScalingBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        const size_t max_threads = std::max (1u, std::min (16u, std::thread::hardware_concurrency ()));
+
+        mempool_settings.threadsafe = true;
+
+        /**
+         * Every thread runs the whole workload on its own: a window of live allocations
+         * that is refilled as it is freed, so the blocks keep cycling through the pool
+         * (or the thread caches). Ideal scaling keeps the time flat as threads are added.
+         */
+        for (size_t threads_count = 1; threads_count <= max_threads; threads_count *= 2) {
+            /**
+             * 0-3: category locks with each EmbAllocLockBackend (in enum order),
+             * 4: lock-free single blocks, 5: thread caches, 6: a pool set of one sub-pool
+             * per thread, each with its share of the blocks, picked by the current CPU.
+             */
+            static const char* const mode_names [] = {
+                "category locks, mutex         ",
+                "category locks, spinlock      ",
+                "category locks, adaptive mutex",
+                "category locks, futex         ",
+                "lock-free                     ",
+                "thread caches                 ",
+                "pool set (per CPU)            "
+            };
+
+            for (int mode = 0; mode < 7; mode++) {
+                const bool use_thread_cache = (5 == mode);
+                const bool use_pool_set = (6 == mode);
+                EmbAllocMempool mempool = NULL;
+                EmbAllocPoolSet pool_set = NULL;
+                std::vector <std::thread> threads;
+                std::atomic <size_t> failures (0);
+
+                mempool_settings.lock_backend = (mode < 4) ?
+                    (EmbAllocLockBackend) mode : kEmbAllocLockBackendMutex;
+                mempool_settings.lock_free_single_blocks = (4 == mode);
+
+                if (use_pool_set) {
+                    EmbAllocMemPoolSettings sub_pool_settings = mempool_settings;
+
+                    sub_pool_settings.total_size /= threads_count;
+                    sub_pool_settings.num_32_bytes_blocks /= threads_count;
+                    sub_pool_settings.num_64_bytes_blocks /= threads_count;
+                    sub_pool_settings.num_256_bytes_blocks /= threads_count;
+                    pool_set = EmbAllocCreatePoolSet (&sub_pool_settings, threads_count, kEmbAllocPoolSelectCpu);
+                    mempool = EmbAllocPoolSetGetPool (pool_set, 0);
+                } else {
+                    mempool = EmbAllocCreate (&mempool_settings);
+                }
+
+                if (NULL == mempool) {
+                    std::cout << "Could not create the mempool" << std::endl;
+                    return;
+                }
+
+                auto t_start = std::chrono::high_resolution_clock::now ();
+
+                for (size_t t = 0; t < threads_count; t++) {
+                    threads.push_back (std::thread ([&, use_thread_cache] () {
+                        const size_t window = 64;
+                        void* allocations [window] = { NULL };
+                        EmbAllocThreadCache cache = use_thread_cache ?
+                            EmbAllocCreateThreadCache (mempool) : NULL;
+
+                        for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                            void*& allocation = allocations [i % window];
+
+                            if (use_thread_cache) {
+                                EmbAllocCacheFree (cache, allocation);
+                                allocation = EmbAllocCacheMalloc (cache, memory_blocks_sizes [i]);
+                            } else if (use_pool_set) {
+                                EmbAllocPoolSetFree (pool_set, allocation);
+                                allocation = EmbAllocPoolSetMalloc (pool_set, memory_blocks_sizes [i]);
+                            } else {
+                                EmbAllocFree (mempool, allocation);
+                                allocation = EmbAllocMalloc (mempool, memory_blocks_sizes [i]);
+                            }
+
+                            if (NULL == allocation) {
+                                failures++;
+                            }
+                        }
+
+                        for (size_t i = 0; i < window; i++) {
+                            if (use_thread_cache) {
+                                EmbAllocCacheFree (cache, allocations [i]);
+                            } else if (use_pool_set) {
+                                EmbAllocPoolSetFree (pool_set, allocations [i]);
+                            } else {
+                                EmbAllocFree (mempool, allocations [i]);
+                            }
+                        }
+
+                        if (use_thread_cache) {
+                            EmbAllocDestroyThreadCache (cache);
+                        }
+                    }));
+                }
+
+                for (size_t t = 0; t < threads.size (); t++) {
+                    threads [t].join ();
+                }
+
+                auto t_end = std::chrono::high_resolution_clock::now ();
+                double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+                size_t operations = 2 * threads_count * memory_blocks_sizes.size ();
+
+                std::cout << threads_count << " thread(s), " << mode_names [mode] << ": " <<
+                    elapsed_ms << " ms (" << (elapsed_ms > 0 ? operations / elapsed_ms : 0) <<
+                    " operations/ms, " << failures << " failed allocations)" << std::endl;
+
+                if (use_pool_set) {
+                    EmbAllocDestroyPoolSet (pool_set);
+                } else {
+                    EmbAllocDestroy (mempool);
+                }
+            }
+        }
+    }
+
+    void EmbAllocRunRemoteFreeBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        /** At least one freeing thread besides the allocating one, even on a single CPU. */
+        const size_t consumers_count = std::max (1u, std::min (15u, std::thread::hardware_concurrency () - 1));
+        const size_t slots = 64;
+
+        mempool_settings.threadsafe = true;
+
+        /**
+         * The thread that creates the mempool (its owner) allocates and hands every
+         * allocation over to a freeing thread through a slot of that thread's ring; the
+         * freeing threads free what they find. A full slot is freed by the owner itself.
+         */
+        for (int mode = 0; mode < 2; mode++) {
+            EmbAllocMempool mempool = NULL;
+            std::vector <std::thread> threads;
+            std::vector <std::atomic <void*>> rings (consumers_count * slots);
+            std::atomic <bool> done (false);
+            size_t failures = 0;
+
+            mempool_settings.remote_free_queues = (1 == mode);
+            mempool = EmbAllocCreate (&mempool_settings);
+
+            if (NULL == mempool) {
+                std::cout << "Could not create the mempool" << std::endl;
+                return;
+            }
+
+            for (size_t i = 0; i < rings.size (); i++) {
+                rings [i].store (NULL);
+            }
+
+            auto t_start = std::chrono::high_resolution_clock::now ();
+
+            for (size_t t = 0; t < consumers_count; t++) {
+                threads.push_back (std::thread ([&, t] () {
+                    bool drained = false;
+
+                    while (!drained) {
+                        bool finished = done.load ();
+                        bool found = false;
+
+                        for (size_t i = 0; i < slots; i++) {
+                            void* allocation = rings [t * slots + i].exchange (NULL);
+
+                            if (NULL != allocation) {
+                                EmbAllocFree (mempool, allocation);
+                                found = true;
+                            }
+                        }
+
+                        drained = finished && !found;
+
+                        if (!found) {
+                            std::this_thread::yield ();
+                        }
+                    }
+                }));
+            }
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                void* allocation = EmbAllocMalloc (mempool, memory_blocks_sizes [i]);
+
+                if (NULL == allocation) {
+                    failures++;
+                    continue;
+                }
+
+                allocation = rings [(i % consumers_count) * slots + (i / consumers_count) % slots].exchange (allocation);
+                EmbAllocFree (mempool, allocation);
+            }
+
+            done.store (true);
+
+            for (size_t t = 0; t < threads.size (); t++) {
+                threads [t].join ();
+            }
+
+            auto t_end = std::chrono::high_resolution_clock::now ();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+            size_t operations = 2 * memory_blocks_sizes.size ();
+
+            std::cout << "1 + " << consumers_count << " thread(s), " <<
+                (mode ? "remote free queues" : "regular frees     ") << ": " <<
+                elapsed_ms << " ms (" << (elapsed_ms > 0 ? operations / elapsed_ms : 0) <<
+                " operations/ms, " << failures << " failed allocations)" << std::endl;
+
+            EmbAllocDestroy (mempool);
+        }
+    }
+
+    void EmbAllocRunBatchBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        const size_t burst = 64;
+        std::vector <void*> ptrs (burst);
+
+        mempool_settings.threadsafe = true;
+
+        /**
+         * Every burst allocates `burst` chunks of one size (taken from the workload) and
+         * frees them again, either one call per chunk or one batch call per burst.
+         */
+        for (int mode = 0; mode < 2; mode++) {
+            EmbAllocMempool mempool = EmbAllocCreate (&mempool_settings);
+            size_t failures = 0;
+
+            if (NULL == mempool) {
+                std::cout << "Could not create the mempool" << std::endl;
+                return;
+            }
+
+            auto t_start = std::chrono::high_resolution_clock::now ();
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                size_t allocated = 0;
+
+                if (mode) {
+                    allocated = EmbAllocMallocBatch (mempool, memory_blocks_sizes [i], burst, ptrs.data ());
+                    EmbAllocFreeBatch (mempool, ptrs.data (), allocated);
+                } else {
+                    for (; allocated < burst; allocated++) {
+                        ptrs [allocated] = EmbAllocMalloc (mempool, memory_blocks_sizes [i]);
+
+                        if (NULL == ptrs [allocated]) {
+                            break;
+                        }
+                    }
+
+                    for (size_t j = 0; j < allocated; j++) {
+                        EmbAllocFree (mempool, ptrs [j]);
+                    }
+                }
+
+                failures += burst - allocated;
+            }
+
+            auto t_end = std::chrono::high_resolution_clock::now ();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+            size_t operations = 2 * burst * memory_blocks_sizes.size ();
+
+            std::cout << burst << " chunks per burst, " << (mode ? "batch calls " : "single calls") << ": " <<
+                elapsed_ms << " ms (" << (elapsed_ms > 0 ? operations / elapsed_ms : 0) <<
+                " operations/ms, " << failures << " failed allocations)" << std::endl;
+
+            EmbAllocDestroy (mempool);
+        }
+    }
+
+    void EmbAllocRunSizedFreeBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        std::vector <void*> ptrs (memory_blocks_sizes.size ());
+
+        mempool_settings.init_allocated_memory = false;
+        mempool_settings.full_overflow_checks = false;
+        mempool_settings.threadsafe = false;
+
+        /** The whole workload is allocated, then only the frees are timed. */
+        for (int mode = 0; mode < 2; mode++) {
+            EmbAllocMempool mempool = EmbAllocCreate (&mempool_settings);
+            size_t failures = 0;
+
+            if (NULL == mempool) {
+                std::cout << "Could not create the mempool" << std::endl;
+                return;
+            }
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                ptrs [i] = EmbAllocMalloc (mempool, memory_blocks_sizes [i]);
+                failures += (NULL == ptrs [i]) ? 1 : 0;
+            }
+
+            auto t_start = std::chrono::high_resolution_clock::now ();
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                if (mode) {
+                    EmbAllocFreeSized (mempool, ptrs [i], memory_blocks_sizes [i]);
+                } else {
+                    EmbAllocFree (mempool, ptrs [i]);
+                }
+            }
+
+            auto t_end = std::chrono::high_resolution_clock::now ();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+
+            std::cout << (mode ? "EmbAllocFreeSized" : "EmbAllocFree     ") << ": " <<
+                elapsed_ms << " ms (" << (elapsed_ms > 0 ? memory_blocks_sizes.size () / elapsed_ms : 0) <<
+                " frees/ms, " << failures << " failed allocations)" << std::endl;
+
+            EmbAllocDestroy (mempool);
+        }
+    }
+
+    void EmbAllocRunPowerOfTwoStridesBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        static const size_t block_sizes [EMB_ALLOC_NUM_BLOCK_SIZES] = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+        size_t EmbAllocMemPoolSettings::* const block_counts [EMB_ALLOC_NUM_BLOCK_SIZES] = {
+            &EmbAllocMemPoolSettings::num_32_bytes_blocks,  &EmbAllocMemPoolSettings::num_64_bytes_blocks,
+            &EmbAllocMemPoolSettings::num_128_bytes_blocks, &EmbAllocMemPoolSettings::num_256_bytes_blocks,
+            &EmbAllocMemPoolSettings::num_512_bytes_blocks, &EmbAllocMemPoolSettings::num_1k_bytes_blocks,
+            &EmbAllocMemPoolSettings::num_2k_bytes_blocks,  &EmbAllocMemPoolSettings::num_4k_bytes_blocks };
+        const size_t blocks = 1024;
+        const size_t rounds = std::max <size_t> (1, memory_blocks_sizes.size () / blocks);
+        std::vector <void*> ptrs (blocks);
+
+        mempool_settings.init_allocated_memory = false;
+        mempool_settings.full_overflow_checks = false;
+        mempool_settings.threadsafe = false;
+
+        /**
+         * One pool per category and layout, holding only that category. Every round
+         * fills the category with chunks of its nominal size and frees them again, so
+         * each operation maps a pointer to its block once.
+         */
+        for (size_t category = 0; category < EMB_ALLOC_NUM_BLOCK_SIZES; category++) {
+            for (int mode = 0; mode < 2; mode++) {
+                EmbAllocStatistics statistics;
+                EmbAllocMempool mempool = NULL;
+                size_t failures = 0;
+
+                for (size_t i = 0; i < EMB_ALLOC_NUM_BLOCK_SIZES; i++) {
+                    mempool_settings.*block_counts [i] = (i == category) ? blocks : 0;
+                }
+                mempool_settings.total_size = blocks * block_sizes [category];
+                mempool_settings.power_of_two_strides = (1 == mode);
+                mempool = EmbAllocCreate (&mempool_settings);
+
+                if ((NULL == mempool) || !EmbAllocGetStatistics (mempool, &statistics)) {
+                    std::cout << "Could not create the mempool" << std::endl;
+                    EmbAllocDestroy (mempool);
+                    return;
+                }
+
+                auto t_start = std::chrono::high_resolution_clock::now ();
+
+                for (size_t round = 0; round < rounds; round++) {
+                    for (size_t i = 0; i < blocks; i++) {
+                        ptrs [i] = EmbAllocMalloc (mempool, block_sizes [category]);
+                        failures += (NULL == ptrs [i]) ? 1 : 0;
+                    }
+
+                    for (size_t i = 0; i < blocks; i++) {
+                        EmbAllocFree (mempool, ptrs [i]);
+                    }
+                }
+
+                auto t_end = std::chrono::high_resolution_clock::now ();
+                double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+                size_t operations = 2 * blocks * rounds;
+
+                std::cout << block_sizes [category] << " bytes, " << (mode ? "power-of-two strides" : "default strides     ") <<
+                    ": " << statistics.mempool_size << " bytes pool, " <<
+                    statistics.categories [category].block_data_size << " bytes usable per block, " <<
+                    (elapsed_ms > 0 ? operations / elapsed_ms : 0) << " operations/ms (" <<
+                    failures << " failed allocations)" << std::endl;
+
+                EmbAllocDestroy (mempool);
+            }
+        }
+    }
+
+    void EmbAllocRunCompactMetadataBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        std::vector <void*> ptrs (memory_blocks_sizes.size ());
+
+        mempool_settings.init_allocated_memory = false;
+        mempool_settings.full_overflow_checks = false;
+        mempool_settings.threadsafe = false;
+
+        /**
+         * The whole pool is written when it is created, so its size is the resident
+         * memory it costs. The workload is allocated and freed again in full.
+         */
+        for (int mode = 0; mode < 2; mode++) {
+            EmbAllocStatistics statistics;
+            EmbAllocMempool mempool = NULL;
+            size_t failures = 0;
+
+            mempool_settings.compact_metadata = (1 == mode);
+            mempool = EmbAllocCreate (&mempool_settings);
+
+            if ((NULL == mempool) || !EmbAllocGetStatistics (mempool, &statistics)) {
+                std::cout << "Could not create the mempool" << std::endl;
+                EmbAllocDestroy (mempool);
+                return;
+            }
+
+            auto t_start = std::chrono::high_resolution_clock::now ();
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                ptrs [i] = EmbAllocMalloc (mempool, memory_blocks_sizes [i]);
+                failures += (NULL == ptrs [i]) ? 1 : 0;
+            }
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                EmbAllocFree (mempool, ptrs [i]);
+            }
+
+            auto t_end = std::chrono::high_resolution_clock::now ();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+            size_t operations = 2 * memory_blocks_sizes.size ();
+
+            std::cout << (mode ? "compact metadata" : "in-band metadata") << ": " <<
+                statistics.mempool_size << " bytes pool (" << mempool_settings.total_size <<
+                " bytes of blocks), " << elapsed_ms << " ms (" <<
+                (elapsed_ms > 0 ? operations / elapsed_ms : 0) << " operations/ms, " <<
+                failures << " failed allocations)" << std::endl;
+
+            EmbAllocDestroy (mempool);
+        }
+    }
+
+    void EmbAllocRunMetadataPlacementBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        std::vector <void*> ptrs (memory_blocks_sizes.size ());
+
+        mempool_settings.init_allocated_memory = false;
+        mempool_settings.full_overflow_checks = false;
+        mempool_settings.threadsafe = false;
+
+        /**
+         * Same workload with the block metadata behind the blocks and in front of them.
+         * The gap between the first block and the bitmaps is the distance every
+         * allocation and free spans besides the block itself.
+         */
+        for (int mode = 0; mode < 2; mode++) {
+            EmbAllocStatistics statistics;
+            EmbAllocMempool mempool = NULL;
+            size_t failures = 0;
+
+            mempool_settings.metadata_before_blocks = (1 == mode);
+            mempool = EmbAllocCreate (&mempool_settings);
+
+            if ((NULL == mempool) || !EmbAllocGetStatistics (mempool, &statistics)) {
+                std::cout << "Could not create the mempool" << std::endl;
+                EmbAllocDestroy (mempool);
+                return;
+            }
+
+            auto t_start = std::chrono::high_resolution_clock::now ();
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                ptrs [i] = EmbAllocMalloc (mempool, memory_blocks_sizes [i]);
+                failures += (NULL == ptrs [i]) ? 1 : 0;
+            }
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                EmbAllocFree (mempool, ptrs [i]);
+            }
+
+            auto t_end = std::chrono::high_resolution_clock::now ();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+            size_t operations = 2 * memory_blocks_sizes.size ();
+
+            std::cout << (mode ? "metadata before the blocks" : "metadata after the blocks ") << ": " <<
+                statistics.mempool_size << " bytes pool, " << elapsed_ms << " ms (" <<
+                (elapsed_ms > 0 ? operations / elapsed_ms : 0) << " operations/ms, " <<
+                failures << " failed allocations)" << std::endl;
+
+            EmbAllocDestroy (mempool);
+        }
+    }
+
+    void EmbAllocRunInterleavedBitmapsBenchmarkInternal (EmbAllocMemPoolSettings mempool_settings, std::vector <size_t> memory_blocks_sizes)
+    {
+        std::vector <void*> ptrs (memory_blocks_sizes.size ());
+
+        mempool_settings.init_allocated_memory = false;
+        mempool_settings.full_overflow_checks = false;
+        mempool_settings.threadsafe = false;
+
+        /**
+         * Same workload with the free and allocation-start bitmaps apart and with their
+         * words interleaved. Each allocation and free sets or clears one bit of both.
+         */
+        for (int mode = 0; mode < 2; mode++) {
+            EmbAllocStatistics statistics;
+            EmbAllocMempool mempool = NULL;
+            size_t failures = 0;
+
+            mempool_settings.interleaved_bitmaps = (1 == mode);
+            mempool = EmbAllocCreate (&mempool_settings);
+
+            if ((NULL == mempool) || !EmbAllocGetStatistics (mempool, &statistics)) {
+                std::cout << "Could not create the mempool" << std::endl;
+                EmbAllocDestroy (mempool);
+                return;
+            }
+
+            auto t_start = std::chrono::high_resolution_clock::now ();
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                ptrs [i] = EmbAllocMalloc (mempool, memory_blocks_sizes [i]);
+                failures += (NULL == ptrs [i]) ? 1 : 0;
+            }
+
+            for (size_t i = 0; i < memory_blocks_sizes.size (); i++) {
+                EmbAllocFree (mempool, ptrs [i]);
+            }
+
+            auto t_end = std::chrono::high_resolution_clock::now ();
+            double elapsed_ms = std::chrono::duration<double, std::milli>(t_end-t_start).count ();
+            size_t operations = 2 * memory_blocks_sizes.size ();
+
+            std::cout << (mode ? "interleaved bitmaps" : "separate bitmaps   ") << ": " <<
+                statistics.mempool_size << " bytes pool, " << elapsed_ms << " ms (" <<
+                (elapsed_ms > 0 ? operations / elapsed_ms : 0) << " operations/ms, " <<
+                failures << " failed allocations)" << std::endl;
+
+            EmbAllocDestroy (mempool);
+        }
+    }
+
+    void EmbAllocRunLockContentionBenchmarkInternal (size_t iterations)
+    {
+        /** At least two threads, so that the locks are contended even on a single CPU. */
+        const size_t max_threads = std::max (2u, std::min (16u, std::thread::hardware_concurrency ()));
+        /** -1: the bare EmbAllocMutex, 0-3: EmbAllocLock with each EmbAllocLockBackend. */
+        static const char* const lock_names [] = {
+            "EmbAllocLockMutex",
+            "mutex            ",
+            "spinlock         ",
+            "adaptive mutex   ",
+            "futex            "
+        };
+
+        /**
+         * Every thread takes the lock, updates a shared counter and a few shared words
+         * (a critical section as short as a single-block allocation) and releases it.
+         * The counter also checks the mutual exclusion: no increment may get lost.
+         */
+        for (size_t threads_count = 1; threads_count <= max_threads; threads_count *= 2) {
+            for (int backend = -1; backend < 4; backend++) {
+                EmbAllocMutex mutex;
+                EmbAllocLock lock;
+                size_t counter = 0;
+                size_t shared_words [8] = { 0 };
+                std::vector <std::thread> threads;
+                std::atomic <size_t> failures (0);
+
+                if ((backend < 0) ?
+                        EmbAllocInitMutex (&mutex) :
+                        EmbAllocInitLock (&lock, (EmbAllocLockBackend) backend)) {
+                    std::cout << "Could not create the lock" << std::endl;
+                    return;
+                }
+
+                auto t_start = std::chrono::high_resolution_clock::now ();
+
+                for (size_t t = 0; t < threads_count; t++) {
+                    threads.push_back (std::thread ([&] () {
+                        for (size_t i = 0; i < iterations; i++) {
+                            if ((backend < 0) ? EmbAllocLockMutex (&mutex) : EmbAllocAcquireLock (&lock)) {
+                                failures++;
+                                continue;
+                            }
+
+                            counter++;
+                            shared_words [i % 8] += i;
+
+                            if ((backend < 0) ? EmbAllocUnlockMutex (&mutex) : EmbAllocReleaseLock (&lock)) {
+                                failures++;
+                            }
+                        }
+                    }));
+                }
+
+                for (size_t t = 0; t < threads.size (); t++) {
+                    threads [t].join ();
+                }
+
+                auto t_end = std::chrono::high_resolution_clock::now ();
+                double elapsed_ns = std::chrono::duration<double, std::nano>(t_end-t_start).count ();
+                size_t operations = threads_count * iterations;
+
+                std::cout << threads_count << " thread(s), " <<
+                    ((backend < 0) ? lock_names [0] :
+                        (lock.backend == (EmbAllocLockBackend) backend) ? lock_names [backend + 1] :
+                        "unsupported      ") << ": " <<
+                    (operations ? elapsed_ns / operations : 0) << " ns per lock/unlock pair (" <<
+                    failures << " lock failures, " << (operations - counter) << " lost updates)" << std::endl;
+
+                if (backend < 0) {
+                    EmbAllocDestroyMutex (&mutex);
+                } else {
+                    EmbAllocDestroyLock (&lock);
+                }
+            }
+        }
+    }
+
+    void EmbAllocPrintFragmentationInternal (EmbAllocMempool mempool)
+    {
+        EmbAllocStatistics statistics;
+
+        if (!EmbAllocGetStatistics (mempool, &statistics)) {
+            std::cout << "Could not retrieve the mempool statistics" << std::endl;
+            return;
+        }
+
+        /**
+         * Fragmentation of a category: the share of its free blocks that are NOT part
+         * of its longest free run (0% means all the free blocks are continuous).
+         */
+        for (size_t i = 0; i < EMB_ALLOC_NUM_BLOCK_SIZES; i++) {
+            const EmbAllocCategoryStatistics& category = statistics.categories [i];
+
+            if (0 == category.total_blocks) {
+                continue;
+            }
+
+            std::cout << "  " << category.block_data_size << " bytes blocks: " <<
+                category.free_blocks << "/" << category.total_blocks << " free, longest free run " <<
+                category.largest_free_run << ", fragmentation " <<
+                (category.free_blocks ?
+                    100.0 * (double) (category.free_blocks - category.largest_free_run) /
+                        (double) category.free_blocks :
+                    0.0) << "%" << std::endl;
+        }
+    }
+
     void libcRunPerformanceBenchmarkInternal (std::vector <size_t> memory_blocks_sizes)
     {
         std::cout << "Starting the memory allocation." << std::endl;
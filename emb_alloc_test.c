@@ -30,8 +30,8 @@
  * Build it together with the allocator sources, e.g.:
  *   cc -std=c99 -Wall -Wextra emb_alloc.c emb_alloc_util.c emb_alloc_test.c \
  *      -pthread -o emb_alloc_test && ./emb_alloc_test
- * (-pthread is only needed on some Linux libc versions; drop it on Windows/MSVC.
- *  This test never creates a threadsafe pool, so no runtime threading is used.)
+ * (-pthread is needed on Linux, where a few cases run real threads against a
+ *  threadsafe pool; on other platforms those cases are compiled out.)
  *
  * The test drives the allocator through the public emb_alloc.h API only. The few
  * cases that must point inside a block (forged-free, interior-pointer) derive
@@ -49,6 +49,22 @@
  *   7  realloc grow (in place and relocate) and shrink preserve the contents
  *   8  buffer overflow on the unused tail is detected on free
  *   9  randomized stress: live allocations never alias / overlap each other
+ *
+ * Further cases cover the settings, error reporting and the word-at-a-time
+ * free-bitmap scans (block counts that straddle 64-bit bitmap words, and categories
+ * large enough to carry the summary bitmap levels), the word-parallel search for
+ * runs of free blocks, the per-category bound on the longest free run, the placement
+ * policies, the usage statistics, the size-to-category lookup, the realloc shrink
+ * that gives surplus blocks back, the realloc grow over free blocks before the head,
+ * the in-place expansion, the usable / good size queries, the batch allocations and
+ * frees, the sized frees, the block index arithmetic, the power-of-two strides, the
+ * compact block metadata, the block metadata ahead of the blocks, the interleaved
+ * bitmaps, the block counter width, the cache line layout of the mempool, the thread
+ * caches, the lock-free single-block allocations, the per-category locks, the lock
+ * backends, the pool sets, the remote free queues and the error dumps. On Linux, real
+ * threads also run concurrent lock-free allocations and frees, producer threads freeing
+ * into the remote queues while the owner drains them, and error dumps next to a busy
+ * category.
  */
 
 #include "emb_alloc.h"
@@ -57,9 +73,25 @@
 #include <stdio.h>
 #include <string.h>
 
+/* The concurrent cases need POSIX threads; elsewhere they are compiled out. */
+#if defined (__linux__)
+#define EA_THREADS        1
+#include <pthread.h>
+#include <sched.h>
+#else
+#define EA_THREADS        0
+#endif
+
 /* ---- block layout, derived only from sizeof(size_t) (see emb_alloc_internal.h) ---- */
+#ifdef EMB_ALLOC_32_BIT_COUNTERS
+#define EA_COUNTER        4u                                /* use_count / data_size   */
+#else
+#define EA_COUNTER        sizeof (size_t)
+#endif
 #define EA_ALIGN          (2u * sizeof (size_t))            /* GNU libc alignment      */
-#define EA_BLOCK_CONTROL  (3u * EA_ALIGN)                   /* 2 markers + 2 counters  */
+#define EA_HEADER         ((sizeof (size_t) + 2u * EA_COUNTER + EA_ALIGN - 1u) / \
+                           EA_ALIGN * EA_ALIGN)             /* start marker + counters */
+#define EA_BLOCK_CONTROL  (EA_HEADER + EA_ALIGN)            /* header + end marker     */
 #define EA_STRIDE(d)      ((size_t) (d) + EA_BLOCK_CONTROL) /* head-to-head distance   */
 
 /* ---- minimal harness ---- */
@@ -181,6 +213,1346 @@ static void TestMultiBlock (void)
     EmbAllocDestroy (pool);
 }
 
+static void TestWordScan (void)
+{
+    /* 130 blocks: two full 64-bit bitmap words plus a 2-bit tail word. */
+    enum { kBlocks = 130 };
+    EmbAllocMempool pool = MakePool32 (kBlocks, false);
+    unsigned char* a[kBlocks];
+    size_t k, got = 0;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    for (k = 0; k < kBlocks; ++k) {
+        a[k] = (unsigned char*) EmbAllocMalloc (pool, 32);
+        if (NULL != a[k]) { ++got; }
+    }
+    CHECK (kBlocks == got, "every block across several bitmap words is handed out");
+    CHECK (NULL == EmbAllocMalloc (pool, 32), "bitmap padding bits are never handed out");
+
+    if (kBlocks == got) {
+        /* Blocks are handed out in address order, so the lowest free one wins. */
+        EmbAllocFree (pool, a[129]);
+        EmbAllocFree (pool, a[70]);
+        CHECK ((void*) a[70] == EmbAllocMalloc (pool, 32), "scan finds the free block in word 1");
+        CHECK ((void*) a[129] == EmbAllocMalloc (pool, 32), "scan finds the free block in the tail word");
+        CHECK (NULL == EmbAllocMalloc (pool, 32), "pool is full again");
+    }
+
+    for (k = 0; k < kBlocks; ++k) { if (a[k]) { EmbAllocFree (pool, a[k]); } }
+    EmbAllocDestroy (pool);
+}
+
+static void TestSummaryScan (void)
+{
+    /* 5000 blocks: 79 bitmap words, so the category gets summary levels whose
+     * top level spans two summary words. */
+    enum { kBlocks = 5000 };
+    static unsigned char* a[kBlocks];
+    EmbAllocMempool pool = MakePool32 (kBlocks, false);
+    size_t k, got = 0;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    for (k = 0; k < kBlocks; ++k) {
+        a[k] = (unsigned char*) EmbAllocMalloc (pool, 32);
+        if (NULL != a[k]) { ++got; }
+    }
+    CHECK (kBlocks == got, "every block of a summarised category is handed out");
+    CHECK (NULL == EmbAllocMalloc (pool, 32), "full summarised category reports no block");
+
+    if (kBlocks == got) {
+        /* Free blocks in different summary words; the lowest free one wins each time. */
+        EmbAllocFree (pool, a[4999]);
+        EmbAllocFree (pool, a[4100]);
+        EmbAllocFree (pool, a[3]);
+        CHECK ((void*) a[3] == EmbAllocMalloc (pool, 32), "summary scan finds the first word");
+        CHECK ((void*) a[4100] == EmbAllocMalloc (pool, 32), "summary scan crosses a top-level word");
+        CHECK ((void*) a[4999] == EmbAllocMalloc (pool, 32), "summary scan finds the tail word");
+        CHECK (NULL == EmbAllocMalloc (pool, 32), "summarised category is full again");
+    }
+
+    for (k = 0; k < kBlocks; ++k) { if (a[k]) { EmbAllocFree (pool, a[k]); a[k] = NULL; } }
+    EmbAllocDestroy (pool);
+}
+
+static void TestRunSearch (void)
+{
+    /* 200 blocks; free runs of 1, 3 and 10 (the last straddling bitmap words 0/1). */
+    enum { kBlocks = 200 };
+    EmbAllocMempool pool = MakePool32 (kBlocks, false);
+    unsigned char* a[kBlocks];
+    size_t k, got = 0;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    for (k = 0; k < kBlocks; ++k) {
+        a[k] = (unsigned char*) EmbAllocMalloc (pool, 32);
+        if (NULL != a[k]) { ++got; }
+    }
+    CHECK (kBlocks == got, "fill pool for the run search");
+
+    if (kBlocks == got) {
+#define RUN_SIZE(n) (32u + ((n) - 1u) * EA_STRIDE (32))
+        EmbAllocFree (pool, a[5]);
+        for (k = 10; k < 13; ++k) { EmbAllocFree (pool, a[k]); a[k] = NULL; }
+        for (k = 60; k < 70; ++k) { EmbAllocFree (pool, a[k]); a[k] = NULL; }
+
+        a[10] = (unsigned char*) EmbAllocMalloc (pool, RUN_SIZE (3));
+        CHECK (NULL != a[10] && a[10] == (unsigned char*) a[9] + EA_STRIDE (32),
+            "3-block run found inside one bitmap word");
+        a[60] = (unsigned char*) EmbAllocMalloc (pool, RUN_SIZE (8));
+        CHECK (NULL != a[60] && a[60] == (unsigned char*) a[59] + EA_STRIDE (32),
+            "8-block run found across a bitmap word boundary");
+        a[68] = (unsigned char*) EmbAllocMalloc (pool, RUN_SIZE (2));
+        CHECK (NULL != a[68] && a[68] == (unsigned char*) a[70] - 2u * EA_STRIDE (32),
+            "2-block run found in the tail of the freed span");
+        CHECK (NULL == EmbAllocMalloc (pool, RUN_SIZE (2)), "no 2-block run is left");
+        a[5] = (unsigned char*) EmbAllocMalloc (pool, 32);
+        CHECK (NULL != a[5], "the lone free block is still handed out");
+#undef RUN_SIZE
+    }
+
+    for (k = 0; k < kBlocks; ++k) { if (a[k]) { EmbAllocFree (pool, a[k]); } }
+    EmbAllocDestroy (pool);
+}
+
+static void TestFragmentedRunBound (void)
+{
+    /* Every other block free: plenty of free blocks, but no run of two. */
+    enum { kBlocks = 96 };
+    EmbAllocMempool pool = MakePool32 (kBlocks, false);
+    unsigned char* a[kBlocks];
+    unsigned char* p;
+    size_t k, got = 0;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    for (k = 0; k < kBlocks; ++k) {
+        a[k] = (unsigned char*) EmbAllocMalloc (pool, 32);
+        if (NULL != a[k]) { ++got; }
+    }
+    CHECK (kBlocks == got, "fill pool for the run bound");
+
+    if (kBlocks == got) {
+        for (k = 0; k < kBlocks; k += 2) { EmbAllocFree (pool, a[k]); a[k] = NULL; }
+
+        CHECK (NULL == EmbAllocMalloc (pool, 32u + EA_STRIDE (32)), "no 2-block run in a checkerboard");
+        CHECK (kEmbAllocNoMemory == LastError (pool), "checkerboard failure is a no-memory error");
+        CHECK (NULL == EmbAllocMalloc (pool, 32u + EA_STRIDE (32)), "repeated request is still rejected");
+
+        /* Freeing an odd block joins three free blocks into one run. */
+        EmbAllocFree (pool, a[41]);
+        a[41] = NULL;
+        p = (unsigned char*) EmbAllocMalloc (pool, 32u + 2u * EA_STRIDE (32));
+        CHECK (NULL != p && p == a[39] + EA_STRIDE (32), "a free re-opens the merged 3-block run");
+        a[40] = p;
+    }
+
+    for (k = 0; k < kBlocks; ++k) { if (a[k]) { EmbAllocFree (pool, a[k]); } }
+    EmbAllocDestroy (pool);
+}
+
+/** Mallocs 100 bytes after one 32-byte allocation; returns true if a 256-byte block was used. */
+static int PlacedInSingleBlock (EmbAllocPlacementPolicy policy, EmbAllocErrors* create_error)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    int single = -1;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 64;
+    s.num_256_bytes_blocks = 16;
+    s.total_size = 64u * 32u + 16u * 256u;
+    s.placement_policy = policy;
+
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { return -1; }
+    *create_error = LastError (pool);
+
+    /* 100 bytes: one 256-byte block (156 bytes wasted) or a 2-block run of 32-byte
+     * blocks (less waste); the 32-byte category starts with one block occupied. */
+    if ((NULL != EmbAllocMalloc (pool, 32)) && (NULL != EmbAllocMalloc (pool, 100)) &&
+        EmbAllocGetStatistics (pool, &stats)) {
+        single = (15u == stats.categories [3].free_blocks) ? 1 : 0;
+    }
+
+    EmbAllocDestroy (pool);
+    return single;
+}
+
+static void TestPlacementPolicies (void)
+{
+    EmbAllocErrors err = kEmbAllocNoErr;
+
+    CHECK (1 == PlacedInSingleBlock (kEmbAllocPlaceMaxFreeAfter, &err),
+        "max-free-after keeps the fuller 32-byte category intact");
+    CHECK (kEmbAllocNoErr == err, "known policy is a consistent setting");
+    CHECK (0 == PlacedInSingleBlock (kEmbAllocPlaceBestFit, &err), "best fit picks the multi-block run");
+    CHECK (1 == PlacedInSingleBlock (kEmbAllocPlaceLowestOccupancyBefore, &err),
+        "lowest occupancy before picks the untouched category");
+    CHECK (0 == PlacedInSingleBlock (kEmbAllocPlaceLowestOccupancyAfter, &err),
+        "lowest occupancy after picks the multi-block run");
+    CHECK (1 == PlacedInSingleBlock (kEmbAllocPlaceSingleBlockFirst, &err),
+        "single block first never goes multi-block");
+    CHECK (1 == PlacedInSingleBlock ((EmbAllocPlacementPolicy) 99, &err),
+        "unknown policy falls back to the default");
+    CHECK (kEmbAllocInconsistentSettings == err, "unknown policy is reported as inconsistent");
+}
+
+static void TestStatistics (void)
+{
+    EmbAllocMempool pool = MakePool32 (70, false);
+    EmbAllocStatistics stats;
+    void* a;
+    void* b;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    a = EmbAllocMalloc (pool, 32);
+    b = EmbAllocMalloc (pool, 32);
+    EmbAllocFree (pool, a);
+    CHECK (EmbAllocGetStatistics (pool, &stats), "statistics are available");
+    CHECK (32u == stats.categories [0].block_data_size && 70u == stats.categories [0].total_blocks,
+        "statistics report the category layout");
+    CHECK (69u == stats.categories [0].free_blocks, "statistics report the free blocks");
+    CHECK (68u == stats.categories [0].largest_free_run, "statistics report the longest free run");
+    CHECK (0u == stats.categories [1].total_blocks, "empty categories report no blocks");
+    CHECK (stats.mempool_size > 70u * EA_STRIDE (32), "mempool size includes the management data");
+    CHECK (!EmbAllocGetStatistics (pool, NULL), "NULL statistics output is rejected");
+    CHECK (kEmbAllocOutputParamError == LastError (pool), "NULL statistics output error code");
+
+    EmbAllocFree (pool, b);
+    EmbAllocDestroy (pool);
+}
+
+static void TestSizeClassLookup (void)
+{
+    /* Only 128-byte and 1 kB blocks: the 64-byte class has no blocks of its own. */
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    void* a[6];
+    size_t k;
+
+    memset (&s, 0, sizeof s);
+    s.num_128_bytes_blocks = 4;
+    s.num_1k_bytes_blocks = 2;
+    s.total_size = 4u * 128u + 2u * 1024u;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    for (k = 0; k < 4; ++k) { a[k] = EmbAllocMalloc (pool, (k % 2) ? 40 : 100); }
+    CHECK (EmbAllocGetStatistics (pool, &stats) &&
+        0u == stats.categories [2].free_blocks && 2u == stats.categories [5].free_blocks,
+        "small sizes go to the smallest non-empty category");
+    a[4] = EmbAllocMalloc (pool, 100);
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 1u == stats.categories [5].free_blocks,
+        "a full best-fit category falls back to a larger block");
+    a[5] = EmbAllocMalloc (pool, 600);
+    CHECK (NULL != a[5], "the exact best-fit category is used directly");
+    CHECK (NULL == EmbAllocMalloc (pool, 10), "a full pool still reports no memory");
+    CHECK (kEmbAllocNoMemory == LastError (pool), "full pool error code");
+
+    for (k = 0; k < 6; ++k) { EmbAllocFree (pool, a[k]); }
+    EmbAllocDestroy (pool);
+}
+
+static void TestReallocShrinkReleases (void)
+{
+    EmbAllocMempool pool = MakePool32 (8, true);
+    EmbAllocStatistics stats;
+    unsigned char* p;
+    unsigned char* q;
+    size_t k;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    /* A 5-block run shrinks to 2 blocks, then to 1: the surplus goes back each time. */
+    p = (unsigned char*) EmbAllocMalloc (pool, 32u + 4u * EA_STRIDE (32));
+    CHECK (NULL != p, "alloc 5-block run");
+    if (NULL == p) { EmbAllocDestroy (pool); return; }
+    Fingerprint (p, 40, 0x21);
+
+    CHECK (p == EmbAllocRealloc (pool, p, 40), "shrink to 2 blocks stays in place");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 6u == stats.categories [0].free_blocks,
+        "shrink returns the 3 surplus blocks");
+    CHECK (p == EmbAllocRealloc (pool, p, 20), "shrink to 1 block stays in place");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 7u == stats.categories [0].free_blocks &&
+        7u == stats.categories [0].largest_free_run, "released blocks merge into one free run");
+    CHECK (FingerprintOk (p, 20, 0x21), "shrink keeps the payload");
+
+    /* The released blocks are handed out again, straight after the kept head. */
+    q = (unsigned char*) EmbAllocMalloc (pool, 32u + 6u * EA_STRIDE (32));
+    CHECK (q == p + EA_STRIDE (32), "released blocks are reusable as one run");
+    CHECK (kEmbAllocNoErr == LastError (pool), "released blocks pass the overflow checks");
+
+    EmbAllocFree (pool, p);
+    CHECK (kEmbAllocNoErr == LastError (pool), "shrunk allocation frees cleanly");
+    EmbAllocFree (pool, q);
+    for (k = 0; k < 8; ++k) {
+        CHECK (NULL != EmbAllocMalloc (pool, 32), "every block is free again");
+    }
+    EmbAllocDestroy (pool);
+}
+
+static void TestReallocGrowBackward (void)
+{
+    EmbAllocMempool pool = MakePool32 (8, true);
+    EmbAllocStatistics stats;
+    unsigned char* b [8];
+    unsigned char* p;
+    size_t k;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    for (k = 0; k < 8; ++k) {
+        b [k] = (unsigned char*) EmbAllocMalloc (pool, 32);
+        CHECK (NULL != b [k], "fill the category with single blocks");
+        if (NULL == b [k]) { EmbAllocDestroy (pool); return; }
+    }
+
+    /* Only the blocks before #2 are free: the head moves back over both of them. */
+    EmbAllocFree (pool, b [0]);
+    EmbAllocFree (pool, b [1]);
+    Fingerprint (b [2], 32, 0x31);
+    p = (unsigned char*) EmbAllocRealloc (pool, b [2], 32u + 2u * EA_STRIDE (32));
+    CHECK (p == b [0], "grow moves the head back over the free blocks before it");
+    CHECK (FingerprintOk (p, 32, 0x31), "backward grow keeps the payload");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 0u == stats.categories [0].free_blocks,
+        "backward grow claims exactly 2 blocks");
+    CHECK (kEmbAllocNoErr == LastError (pool), "backward grow passes the overflow checks");
+
+    /* One free block on each side of #4: the grow takes both. */
+    EmbAllocFree (pool, b [3]);
+    EmbAllocFree (pool, b [5]);
+    Fingerprint (b [4], 32, 0x41);
+    CHECK (b [3] == (unsigned char*) EmbAllocRealloc (pool, b [4], 32u + 2u * EA_STRIDE (32)),
+        "grow combines the free blocks on both sides");
+    CHECK (FingerprintOk (b [3], 32, 0x41), "two-sided grow keeps the payload");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 0u == stats.categories [0].free_blocks,
+        "two-sided grow claims exactly 2 blocks");
+
+    /* Both moved runs free cleanly and every block is reusable afterwards. */
+    EmbAllocFree (pool, p);
+    EmbAllocFree (pool, b [3]);
+    CHECK (kEmbAllocNoErr == LastError (pool), "moved runs free cleanly");
+    for (k = 0; k < 6; ++k) {
+        CHECK (NULL != EmbAllocMalloc (pool, 32), "every released block is free again");
+    }
+    CHECK (kEmbAllocNoErr == LastError (pool), "released blocks pass the overflow checks");
+    EmbAllocDestroy (pool);
+}
+
+static void TestExpandInPlace (void)
+{
+    EmbAllocMempool pool = MakePool32 (8, true);
+    EmbAllocStatistics stats;
+    unsigned char* p;
+    unsigned char* x;
+    unsigned char* y;
+    size_t k;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    p = (unsigned char*) EmbAllocMalloc (pool, 20);
+    CHECK (NULL != p, "alloc the area to expand");
+    if (NULL == p) { EmbAllocDestroy (pool); return; }
+    Fingerprint (p, 20, 0x51);
+
+    /* Within the current block, then over the free blocks right after it. */
+    CHECK (32u == EmbAllocExpandInPlace (pool, p, 25, 32), "expand inside the block");
+    CHECK (32u + 2u * EA_STRIDE (32) == EmbAllocExpandInPlace (pool, p, 40,
+        32u + 2u * EA_STRIDE (32)), "expand over the following free blocks");
+    CHECK (FingerprintOk (p, 20, 0x51), "expand keeps the payload in place");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 5u == stats.categories [0].free_blocks,
+        "expand claims exactly 2 blocks");
+
+    /* Blocks #3 free, #4 taken: a partial expansion that still reaches min_size. */
+    x = (unsigned char*) EmbAllocMalloc (pool, 32);
+    y = (unsigned char*) EmbAllocMalloc (pool, 32);
+    CHECK ((NULL != x) && (NULL != y), "alloc the blockers");
+    EmbAllocFree (pool, x);
+    CHECK (32u + 2u * EA_STRIDE (32) == EmbAllocExpandInPlace (pool, p,
+        32u + 4u * EA_STRIDE (32), 32u + 5u * EA_STRIDE (32)),
+        "expand below min_size leaves the area unchanged");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 4u == stats.categories [0].free_blocks,
+        "failed expand claims no blocks");
+    CHECK (32u + 3u * EA_STRIDE (32) == EmbAllocExpandInPlace (pool, p, 40,
+        32u + 5u * EA_STRIDE (32)), "expand stops at the next allocation");
+    CHECK (EmbAllocExpandInPlace (pool, p, 40, 50) == 32u + 3u * EA_STRIDE (32),
+        "expand never shrinks");
+
+    /* Parameter errors. */
+    CHECK (0u == EmbAllocExpandInPlace (pool, p, 80, 40) &&
+        kEmbAllocSizeParamError == LastError (pool), "min_size above max_size is rejected");
+    CHECK (0u == EmbAllocExpandInPlace (pool, NULL, 1, 40) &&
+        kEmbAllocPointerParamError == LastError (pool), "NULL pointer is rejected");
+    CHECK (0u == EmbAllocExpandInPlace (pool, p + EA_STRIDE (32), 1, 40) &&
+        kEmbAllocPointerParamError == LastError (pool), "interior pointer is rejected");
+
+    EmbAllocFree (pool, p);
+    EmbAllocFree (pool, y);
+    CHECK (kEmbAllocNoErr == LastError (pool), "expanded area frees cleanly");
+    for (k = 0; k < 8; ++k) {
+        CHECK (NULL != EmbAllocMalloc (pool, 32), "every block is free again");
+    }
+    EmbAllocDestroy (pool);
+}
+
+static void TestUsableAndGoodSize (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocMempool pool;
+    unsigned char* p;
+    unsigned char* q;
+    /* One byte more than the whole 256-byte category holds. */
+    size_t run = 256u + 15u * EA_STRIDE (256) + 1u;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 128;
+    s.num_256_bytes_blocks = 16;
+    s.total_size = 128u * 32u + 16u * 256u;
+    s.full_overflow_checks = true;
+
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    /* Best fit block, then runs: first in the largest category, then wherever they fit. */
+    CHECK (32u == EmbAllocGoodSize (pool, 1), "good size of a small request");
+    CHECK (256u == EmbAllocGoodSize (pool, 33), "good size rounds up to the next block");
+    CHECK (256u + EA_STRIDE (256) == EmbAllocGoodSize (pool, 257),
+        "good size above the largest block is a run");
+    CHECK ((run + EA_BLOCK_CONTROL + EA_STRIDE (32) - 1u) / EA_STRIDE (32) * EA_STRIDE (32) -
+        EA_BLOCK_CONTROL == EmbAllocGoodSize (pool, run),
+        "good size of a run only the small category can hold");
+    CHECK (0u == EmbAllocGoodSize (pool, 0) && kEmbAllocSizeParamError == LastError (pool),
+        "good size of 0 is rejected");
+    CHECK (0u == EmbAllocGoodSize (pool, 100000) && kEmbAllocNoMemory == LastError (pool),
+        "good size of a request that never fits is 0");
+
+    /* The capacity is what the allocation really got, and it is usable in place. */
+    p = (unsigned char*) EmbAllocMalloc (pool, 300);
+    q = (unsigned char*) EmbAllocMalloc (pool, 20);
+    CHECK ((NULL != p) && (NULL != q), "alloc for usable size");
+    if ((NULL == p) || (NULL == q)) { EmbAllocDestroy (pool); return; }
+    CHECK (EmbAllocGoodSize (pool, 300) == EmbAllocUsableSize (pool, p),
+        "usable size of a run matches the good size");
+    CHECK (32u == EmbAllocUsableSize (pool, q), "usable size of a single block");
+    CHECK (q == EmbAllocRealloc (pool, q, EmbAllocUsableSize (pool, q)),
+        "grow to the usable size stays in place");
+    memset (q, 0x5A, 32);
+    CHECK (0u == EmbAllocUsableSize (pool, NULL) && kEmbAllocPointerParamError == LastError (pool),
+        "usable size of NULL is rejected");
+    CHECK (0u == EmbAllocUsableSize (pool, p + EA_STRIDE (256)) &&
+        kEmbAllocPointerParamError == LastError (pool), "usable size of an interior pointer is rejected");
+
+    EmbAllocFree (pool, q);
+    CHECK (kEmbAllocNoErr == LastError (pool), "area written up to its usable size frees cleanly");
+    EmbAllocFree (pool, p);
+    EmbAllocDestroy (pool);
+}
+
+static void TestBatches (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    void* p [120];
+    void* q [4];
+    size_t n;
+    size_t k;
+    size_t j;
+    int distinct = 1;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 100;                /* straddles two bitmap words */
+    s.num_256_bytes_blocks = 16;
+    s.total_size = 100u * 32u + 16u * 256u;
+    s.full_overflow_checks = true;
+
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    CHECK (0u == EmbAllocMallocBatch (pool, 20, 4, NULL) &&
+        kEmbAllocOutputParamError == LastError (pool), "batch without output array is rejected");
+    CHECK (0u == EmbAllocMallocBatch (pool, 0, 4, q) && NULL == q [0] && NULL == q [3],
+        "batch of size 0 allocates nothing");
+
+    /* The whole small category in one call, then the rest lands in the larger blocks. */
+    n = EmbAllocMallocBatch (pool, 20, 100, p);
+    CHECK (100u == n, "batch fills the preferred category");
+    for (k = 0; k < n; ++k) {
+        Fingerprint ((unsigned char*) p [k], 20, (unsigned char) k);
+        for (j = 0; j < k; ++j) { if (p [j] == p [k]) { distinct = 0; } }
+    }
+    CHECK (distinct, "batch pointers are distinct");
+    n = EmbAllocMallocBatch (pool, 20, 20, p + 100);
+    CHECK (16u == n && NULL == p [116] && NULL == p [119] && kEmbAllocNoMemory == LastError (pool),
+        "batch falls back to the larger blocks, then runs out of memory");
+    CHECK (256u == EmbAllocUsableSize (pool, p [100]), "fallback chunk is a larger block");
+    for (k = 0, distinct = 1; k < 100; ++k) {
+        if (!FingerprintOk ((const unsigned char*) p [k], 20, (unsigned char) k)) { distinct = 0; }
+    }
+    CHECK (distinct, "batch chunks do not overlap");
+
+    /* Blocks freed on both sides of the bitmap word boundary are found again. */
+    EmbAllocFree (pool, p [70]);
+    EmbAllocFree (pool, p [3]);
+    CHECK (2u == EmbAllocMallocBatch (pool, 20, 4, q) && NULL == q [2], "batch reuses freed blocks");
+    CHECK ((q [0] == p [3] && q [1] == p [70]) || (q [0] == p [70] && q [1] == p [3]),
+        "batch claims the free blocks of every bitmap word");
+    p [3] = q [0];
+    p [70] = q [1];
+
+    /* Frees of both categories, with NULL entries, in one call. */
+    p [116] = NULL;
+    ((unsigned char*) p [5]) [20] = 0x5A;      /* write past the requested size */
+    EmbAllocFreeBatch (pool, p, 117);
+    CHECK (kEmbAllocOverflow == LastError (pool), "batch free reports an overflow");
+    EmbAllocGetStatistics (pool, &stats);
+    CHECK (100u == stats.categories [0].free_blocks && 16u == stats.categories [3].free_blocks,
+        "batch free releases every chunk");
+    EmbAllocFreeBatch (pool, p + 10, 1);
+    CHECK (kEmbAllocPointerParamError == LastError (pool), "batch double free is rejected");
+    q [0] = &stats;
+    EmbAllocFreeBatch (pool, q, 1);
+    CHECK (kEmbAllocPointerParamError == LastError (pool), "batch free of a foreign pointer is rejected");
+
+    /* A foreign pointer among valid ones of both categories does not stop their frees. */
+    q [0] = EmbAllocMalloc (pool, 200);
+    q [1] = &stats;
+    q [2] = EmbAllocMalloc (pool, 20);
+    q [3] = NULL;
+    CHECK ((NULL != q [0]) && (NULL != q [2]), "allocations for a mixed batch");
+    EmbAllocFreeBatch (pool, q, 4);
+    CHECK (kEmbAllocPointerParamError == LastError (pool), "mixed batch reports the foreign pointer");
+    EmbAllocGetStatistics (pool, &stats);
+    CHECK (100u == stats.categories [0].free_blocks && 16u == stats.categories [3].free_blocks,
+        "mixed batch frees the valid pointers");
+
+    EmbAllocDestroy (pool);
+
+    /* Neighbouring runs across a bitmap word boundary, freed out of order in one call. */
+    pool = MakePool32 (70, true);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+#define RUN_SIZE(n) (32u + ((n) - 1u) * EA_STRIDE (32))
+    p [0] = EmbAllocMalloc (pool, RUN_SIZE (30));
+    p [1] = EmbAllocMalloc (pool, RUN_SIZE (30));
+    p [2] = EmbAllocMalloc (pool, RUN_SIZE (8));
+    p [3] = EmbAllocMalloc (pool, 32);
+    p [4] = EmbAllocMalloc (pool, 32);
+    CHECK ((NULL != p [0]) && (NULL != p [1]) && (NULL != p [2]) && (NULL != p [3]) &&
+        (NULL != p [4]), "fill pool with runs");
+    q [0] = p [2];
+    q [1] = p [0];
+    q [2] = p [1];
+    q [3] = p [0];                              /* freed twice in the same batch */
+    EmbAllocFreeBatch (pool, q, 4);
+    CHECK (kEmbAllocPointerParamError == LastError (pool), "double free within a batch is rejected");
+    EmbAllocFreeBatch (pool, p + 3, 1);
+    EmbAllocGetStatistics (pool, &stats);
+    CHECK (69u == stats.categories [0].free_blocks && 69u == stats.categories [0].largest_free_run,
+        "batch free merges neighbouring runs");
+    q [0] = EmbAllocMalloc (pool, RUN_SIZE (69));
+    CHECK (p [0] == q [0], "merged run is found again");
+#undef RUN_SIZE
+    EmbAllocFree (pool, q [0]);
+    EmbAllocFree (pool, p [4]);
+    CHECK (kEmbAllocNoErr == LastError (pool), "merged run frees cleanly");
+
+    EmbAllocDestroy (pool);
+}
+
+static void TestFreeSized (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    unsigned char* p;
+    unsigned char* q;
+    unsigned char* r;
+    int round;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 70;
+    s.num_256_bytes_blocks = 16;
+    s.total_size = 70u * 32u + 16u * 256u;
+
+    /* Round 0: only the allocation-start check; round 1: every check, and the size. */
+    for (round = 0; round < 2; ++round) {
+        s.full_overflow_checks = (1 == round);
+        pool = EmbAllocCreate (&s);
+        if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+        p = (unsigned char*) EmbAllocMalloc (pool, 20);
+        q = (unsigned char*) EmbAllocMalloc (pool, 200);
+        r = (unsigned char*) EmbAllocMalloc (pool, 300);
+        CHECK ((NULL != p) && (NULL != q) && (NULL != r), "alloc for sized free");
+        if ((NULL == p) || (NULL == q) || (NULL == r)) { EmbAllocDestroy (pool); return; }
+
+        EmbAllocFreeSized (pool, p + 16, 20);
+        CHECK (kEmbAllocPointerParamError == LastError (pool), "sized free of an interior pointer is rejected");
+        EmbAllocFreeSized (pool, p, 20);
+        CHECK (kEmbAllocNoErr == LastError (pool), "sized free of a single block");
+        EmbAllocFreeSized (pool, p, 20);
+        CHECK (kEmbAllocPointerParamError == LastError (pool), "sized double free is rejected");
+
+        /* A size naming another category, or a run, takes the regular free. */
+        EmbAllocFreeSized (pool, q, 20);
+        CHECK (kEmbAllocNoErr == LastError (pool), "sized free outside the size's category");
+        EmbAllocFreeSized (pool, r, 300);
+        CHECK (kEmbAllocNoErr == LastError (pool), "sized free of a run");
+
+        p = (unsigned char*) EmbAllocMalloc (pool, 20);
+        CHECK (NULL != p, "alloc for sized free with another size");
+        if (NULL != p) {
+            EmbAllocFreeSized (pool, p, 24);
+            CHECK ((round ? kEmbAllocSizeParamError : kEmbAllocNoErr) == LastError (pool),
+                round ? "size mismatch reported with full checks" : "size not checked without full checks");
+        }
+
+        if (round) {
+            p = (unsigned char*) EmbAllocMalloc (pool, 20);
+            CHECK (NULL != p, "alloc for sized free overflow");
+            if (NULL != p) {
+                p [20] = 0x5A;
+                EmbAllocFreeSized (pool, p, 20);
+                CHECK (kEmbAllocOverflow == LastError (pool), "sized free reports an overflow");
+            }
+        }
+
+        EmbAllocGetStatistics (pool, &stats);
+        CHECK (70u == stats.categories [0].free_blocks && 16u == stats.categories [3].free_blocks,
+            "sized frees release every chunk");
+        EmbAllocDestroy (pool);
+    }
+}
+
+static void TestBlockIndexing (void)
+{
+    static const size_t sizes [8] = { 32, 64, 128, 256, 512, 1024, 2048, 4096 };
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    void* p [8 * 67];
+    size_t c;
+    size_t k;
+    int ok = 1;
+
+    /* 67 blocks per category: a full bitmap word and a partial one, every stride. */
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = s.num_64_bytes_blocks = s.num_128_bytes_blocks = 67;
+    s.num_256_bytes_blocks = s.num_512_bytes_blocks = s.num_1k_bytes_blocks = 67;
+    s.num_2k_bytes_blocks = s.num_4k_bytes_blocks = 67;
+    s.total_size = 67u * (32u + 64u + 128u + 256u + 512u + 1024u + 2048u + 4096u);
+
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    for (c = 0; c < 8; ++c) {
+        for (k = 0; k < 67; ++k) {
+            p [c * 67 + k] = EmbAllocMalloc (pool, sizes [c]);
+            if ((NULL == p [c * 67 + k]) || (sizes [c] != EmbAllocUsableSize (pool, p [c * 67 + k]))) { ok = 0; }
+        }
+    }
+    CHECK (ok, "every block of every category is found from its pointer");
+
+    /* Interior pointers one alignment unit off the grid, before and after a head. */
+    for (c = 0, ok = 1; c < 8; ++c) {
+        for (k = 0; k < 67; k += 11) {
+            unsigned char* q = (unsigned char*) p [c * 67 + k];
+            if ((0u != EmbAllocUsableSize (pool, q + EA_ALIGN)) ||
+                (0u != EmbAllocUsableSize (pool, q - EA_ALIGN))) { ok = 0; }
+        }
+    }
+    CHECK (ok, "pointers off the block grid are rejected");
+
+    for (c = 0; c < 8 * 67; ++c) { EmbAllocFree (pool, p [c]); }
+    CHECK (kEmbAllocNoErr == LastError (pool), "every block frees cleanly");
+    EmbAllocGetStatistics (pool, &stats);
+    for (c = 0, ok = 1; c < 8; ++c) { if (67u != stats.categories [c].free_blocks) { ok = 0; } }
+    CHECK (ok, "every category is free again");
+    EmbAllocDestroy (pool);
+}
+
+static void TestPowerOfTwoStrides (void)
+{
+    static const size_t sizes [3] = { 32, 256, 1024 };
+    static const size_t cats [3] = { 0, 3, 5 };
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    size_t plain_size = 0;
+    size_t stride [3];
+    unsigned char* p [3][2];
+    unsigned char* run;
+    size_t c;
+    int ok = 1;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 40;
+    s.num_256_bytes_blocks = 20;
+    s.num_1k_bytes_blocks = 10;
+    s.total_size = 40u * 32u + 20u * 256u + 10u * 1024u;
+
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+    if (EmbAllocGetStatistics (pool, &stats)) { plain_size = stats.mempool_size; }
+    EmbAllocDestroy (pool);
+
+    s.power_of_two_strides = true;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+    CHECK (kEmbAllocNoErr == LastError (pool), "the option is a consistent setting");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && stats.mempool_size > plain_size,
+        "the padded strides take more memory");
+
+    /* The stride is the next power of two, its padding is usable payload. */
+    for (c = 0; c < 3; ++c) {
+        for (stride [c] = EA_ALIGN; stride [c] < EA_STRIDE (sizes [c]); stride [c] <<= 1) { }
+        if ((stride [c] - EA_BLOCK_CONTROL) != stats.categories [cats [c]].block_data_size) { ok = 0; }
+    }
+    CHECK (ok, "every block size is a power-of-two stride minus the block control bytes");
+
+    for (c = 0, ok = 1; c < 3; ++c) {
+        p [c][0] = (unsigned char*) EmbAllocMalloc (pool, sizes [c]);
+        p [c][1] = (unsigned char*) EmbAllocMalloc (pool, stride [c] - EA_BLOCK_CONTROL);
+        if ((NULL == p [c][0]) || (NULL == p [c][1]) ||
+            ((stride [c] - EA_BLOCK_CONTROL) != EmbAllocUsableSize (pool, p [c][1])) ||
+            (0u != (((uintptr_t) p [c][0] - EA_HEADER) & (stride [c] - 1u))) ||
+            (stride [c] != (size_t) (p [c][1] - p [c][0]))) { ok = 0; }
+    }
+    CHECK (ok, "blocks are aligned to their stride and the padding fills a single block");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 38u == stats.categories [0].free_blocks &&
+        18u == stats.categories [3].free_blocks && 8u == stats.categories [5].free_blocks,
+        "each request stays in its own category");
+
+    for (c = 0, ok = 1; c < 3; ++c) {
+        if ((0u != EmbAllocUsableSize (pool, p [c][0] + EA_ALIGN)) ||
+            (0u != EmbAllocUsableSize (pool, p [c][1] - EA_ALIGN))) { ok = 0; }
+    }
+    CHECK (ok, "pointers off the block grid are rejected");
+
+    /* Larger than any block: a run of blocks, spanning whole strides. */
+    run = (unsigned char*) EmbAllocMalloc (pool, stride [2] - EA_BLOCK_CONTROL + 1u);
+    CHECK ((NULL != run) && (EmbAllocUsableSize (pool, run) > stride [2] - EA_BLOCK_CONTROL) &&
+        (0u == ((EmbAllocUsableSize (pool, run) + EA_BLOCK_CONTROL) & (stride [0] - 1u))),
+        "a multi-block run of power-of-two strides");
+    if (NULL != run) {
+        Fingerprint (run, EmbAllocUsableSize (pool, run), 0x5a);
+        EmbAllocFree (pool, run);
+    }
+
+    for (c = 0; c < 3; ++c) {
+        EmbAllocFree (pool, p [c][0]);
+        EmbAllocFree (pool, p [c][1]);
+    }
+    CHECK (kEmbAllocNoErr == LastError (pool), "every block frees cleanly");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 40u == stats.categories [0].free_blocks &&
+        20u == stats.categories [3].free_blocks && 10u == stats.categories [5].free_blocks,
+        "every category is free again");
+    EmbAllocDestroy (pool);
+}
+
+static void TestCompactMetadata (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    size_t default_size = 0;
+    unsigned char* p [3];
+    unsigned char* run;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 64;
+    s.num_256_bytes_blocks = 8;
+    s.total_size = 64u * 32u + 8u * 256u;
+    s.full_overflow_checks = true;
+
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+    if (EmbAllocGetStatistics (pool, &stats)) { default_size = stats.mempool_size; }
+    EmbAllocDestroy (pool);
+
+    s.compact_metadata = true;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+    CHECK (kEmbAllocNoErr == LastError (pool), "the option is a consistent setting");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && stats.mempool_size < default_size,
+        "the compact layout takes less memory");
+
+    /* No in-band control bytes: the blocks sit back to back. */
+    p [0] = (unsigned char*) EmbAllocMalloc (pool, 32);
+    p [1] = (unsigned char*) EmbAllocMalloc (pool, 1);
+    p [2] = (unsigned char*) EmbAllocMalloc (pool, 200);
+    CHECK ((NULL != p [0]) && (NULL != p [1]) && (NULL != p [2]) &&
+        (32 == (size_t) (p [1] - p [0])), "adjacent blocks are their data size apart");
+    CHECK ((NULL != p [1]) && (NULL != p [2]) && (32u == EmbAllocUsableSize (pool, p [1])) &&
+        (256u == EmbAllocUsableSize (pool, p [2])), "the whole block is usable");
+
+    /* A run of blocks holds exactly its blocks. */
+    run = (unsigned char*) EmbAllocMalloc (pool, 300);
+    CHECK ((NULL != run) && (512u == EmbAllocUsableSize (pool, run)),
+        "a multi-block run is a whole number of blocks");
+    CHECK ((NULL != run) && (0u == EmbAllocUsableSize (pool, run + 256)),
+        "a pointer into the run is rejected");
+    if (NULL != run) {
+        Fingerprint (run, 300u, 0x3c);
+        EmbAllocFree (pool, run);
+    }
+    CHECK (kEmbAllocNoErr == LastError (pool), "the run frees cleanly");
+
+    /* The counters are out of band, an overflow into the unused tail is still seen. */
+    if (NULL != p [1]) {
+        p [1][8] = 0x00;
+        EmbAllocFree (pool, p [1]);
+        CHECK (kEmbAllocOverflow == LastError (pool), "overflow detected on free");
+        EmbAllocFree (pool, p [1]);
+        CHECK (kEmbAllocNoErr != LastError (pool), "double free is rejected");
+    }
+
+    EmbAllocFree (pool, p [0]);
+    EmbAllocFree (pool, p [2]);
+    CHECK (kEmbAllocNoErr == LastError (pool), "every block frees cleanly");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 64u == stats.categories [0].free_blocks &&
+        8u == stats.categories [3].free_blocks, "every category is free again");
+    EmbAllocDestroy (pool);
+}
+
+static void TestMetadataBeforeBlocks (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pools [2];
+    unsigned char* first [2];
+    unsigned char* p [200];
+    size_t count = 0;
+    size_t i;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 200;                    /* bitmaps of 4 words, padding bits */
+    s.num_256_bytes_blocks = 4;
+    s.total_size = 200u * 32u + 4u * 256u;
+    s.full_overflow_checks = true;
+
+    for (i = 0; i < 2u; i++) {
+        s.metadata_before_blocks = (1u == i);
+        pools [i] = EmbAllocCreate (&s);
+        first [i] = (NULL != pools [i]) ? (unsigned char*) EmbAllocMalloc (pools [i], 32) : NULL;
+        CHECK ((NULL != first [i]) && (kEmbAllocNoErr == LastError (pools [i])) &&
+            (0u == ((uintptr_t) first [i] - EA_HEADER) % 64u),
+            "the first block starts on a cache line with either layout");
+    }
+
+    /* The bitmaps now sit between the control data and the first block. */
+    CHECK ((NULL != first [0]) && (NULL != first [1]) &&
+        ((size_t) (first [1] - (unsigned char*) pools [1]) >
+            (size_t) (first [0] - (unsigned char*) pools [0])),
+        "the blocks start after the metadata");
+    CHECK ((NULL != first [1]) && (0u == EmbAllocUsableSize (pools [1], first [1] - EA_HEADER - 8u)),
+        "a pointer into the metadata is not a block");
+    EmbAllocFree (pools [1], first [1] - EA_HEADER - 8u);
+    CHECK (kEmbAllocNoErr != LastError (pools [1]), "freeing the metadata is rejected");
+
+    /* Every block is still handed out exactly once, the padding bits stay occupied. */
+    if (NULL != pools [1]) {
+        p [count++] = first [1];
+        while ((count < 200u) &&
+            (NULL != (p [count] = (unsigned char*) EmbAllocMalloc (pools [1], 32)))) {
+            count++;
+        }
+        CHECK ((200u == count) && EmbAllocGetStatistics (pools [1], &stats) &&
+            (0u == stats.categories [0].free_blocks), "the whole category is allocated");
+        CHECK (200u == stats.categories [0].total_blocks - stats.categories [0].free_blocks,
+            "no block past the last one is handed out");
+        for (i = 0; i < count; i++) {
+            EmbAllocFree (pools [1], p [i]);
+        }
+        CHECK ((kEmbAllocNoErr == LastError (pools [1])) &&
+            EmbAllocGetStatistics (pools [1], &stats) && (200u == stats.categories [0].free_blocks),
+            "every block frees cleanly");
+    }
+
+    EmbAllocFree (pools [0], first [0]);
+    EmbAllocDestroy (pools [0]);
+    EmbAllocDestroy (pools [1]);
+
+    /* Together with the compact layout all the block metadata leads the blocks. */
+    s.compact_metadata = true;
+    pools [0] = EmbAllocCreate (&s);
+    first [0] = (NULL != pools [0]) ? (unsigned char*) EmbAllocMalloc (pools [0], 300) : NULL;
+    CHECK ((NULL != first [0]) && (512u == EmbAllocUsableSize (pools [0], first [0])),
+        "a run of the compact layout holds its blocks");
+    if (NULL != first [0]) {
+        Fingerprint (first [0], 300u, 0x5a);
+        EmbAllocFree (pools [0], first [0]);
+    }
+    CHECK ((NULL != pools [0]) && (kEmbAllocNoErr == LastError (pools [0])),
+        "the run frees cleanly");
+    EmbAllocDestroy (pools [0]);
+}
+
+static void TestInterleavedBitmaps (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    size_t default_size = 0;
+    void* batch [70];
+    void* all [200];
+    unsigned char* run;
+    unsigned char* single;
+    size_t count;
+    size_t i;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 200;                    /* bitmap words 0..3, padding bits */
+    s.total_size = 200u * 32u;
+    s.full_overflow_checks = true;
+
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+    if (EmbAllocGetStatistics (pool, &stats)) { default_size = stats.mempool_size; }
+    EmbAllocDestroy (pool);
+
+    s.interleaved_bitmaps = true;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+    CHECK (kEmbAllocNoErr == LastError (pool), "the option is a consistent setting");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (stats.mempool_size == default_size),
+        "the interleaved bitmaps take the same memory");
+
+    /* A batch crosses the first bitmap word, then a run is placed after it. */
+    count = EmbAllocMallocBatch (pool, 32, 70, batch);
+    CHECK (70u == count, "a batch spans two bitmap words");
+    run = (unsigned char*) EmbAllocMalloc (pool, 60);
+    CHECK ((NULL != run) && (EmbAllocUsableSize (pool, run) >= 60u),
+        "a multi-block run is allocated");
+    CHECK (EmbAllocGetStatistics (pool, &stats) &&
+        (70u + 2u == 200u - stats.categories [0].free_blocks) &&
+        (200u - 72u == stats.categories [0].largest_free_run),
+        "the free bits follow the allocations");
+
+    /* The start bits are checked next to the free bits: forged and double frees fail. */
+    if (NULL != run) {
+        EmbAllocFree (pool, run + EA_STRIDE (32));
+        CHECK (kEmbAllocNoErr != LastError (pool), "an inner block of a run is not a head");
+        Fingerprint (run, 60u, 0x6b);
+        EmbAllocFree (pool, run);
+        CHECK (kEmbAllocNoErr == LastError (pool), "the run frees cleanly");
+        EmbAllocFree (pool, run);
+        CHECK (kEmbAllocNoErr != LastError (pool), "double free is rejected");
+    }
+
+    EmbAllocFreeBatch (pool, batch, count);
+    single = (unsigned char*) EmbAllocMalloc (pool, 32);
+    EmbAllocFreeSized (pool, single, 32);
+    CHECK (kEmbAllocNoErr == LastError (pool), "the batch and the sized free are clean");
+
+    /* Every block is handed out once, in ascending order, and no padding bit is. */
+    count = EmbAllocMallocBatch (pool, 32, 200, all);
+    for (i = 1; i < count; i++) {
+        if ((size_t) ((unsigned char*) all [i] - (unsigned char*) all [i - 1]) != EA_STRIDE (32)) {
+            break;
+        }
+    }
+    CHECK ((200u == count) && (200u == i) && EmbAllocGetStatistics (pool, &stats) &&
+        (0u == stats.categories [0].free_blocks), "the whole category is allocated");
+    EmbAllocFreeBatch (pool, all, count);
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (200u == stats.categories [0].free_blocks) &&
+        (200u == stats.categories [0].largest_free_run), "the whole category is free again");
+    EmbAllocDestroy (pool);
+}
+
+static void TestBlockCounters (void)
+{
+    EmbAllocMempool pool = MakePool32 (8, true);
+    EmbAllocStatistics stats;
+    unsigned char* p [2];
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    /* The block header holds the start marker and the two counters of the build. */
+    p [0] = (unsigned char*) EmbAllocMalloc (pool, 32);
+    p [1] = (unsigned char*) EmbAllocMalloc (pool, 32);
+    CHECK ((NULL != p [0]) && (NULL != p [1]) && (EA_STRIDE (32) == (size_t) (p [1] - p [0])),
+        "the block control bytes follow the counter width");
+    CHECK ((NULL != p [0]) && (32u == EmbAllocUsableSize (pool, p [0])),
+        "the counters hold the block size");
+    EmbAllocFree (pool, p [1]);
+    EmbAllocFree (pool, p [0]);
+    CHECK (kEmbAllocNoErr == LastError (pool), "every block frees cleanly");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 8u == stats.categories [0].free_blocks &&
+        (8u * EA_STRIDE (32) < stats.mempool_size), "the category is free again");
+    EmbAllocDestroy (pool);
+
+#ifdef EMB_ALLOC_32_BIT_COUNTERS
+    /* 4 GiB of blocks do not fit 32-bit counters: nothing is allocated. */
+    if (sizeof (size_t) > 4u) {
+        EmbAllocMemPoolSettings s;
+
+        memset (&s, 0, sizeof s);
+        s.num_4k_bytes_blocks = (size_t) 1u << 20;
+        s.total_size = s.num_4k_bytes_blocks * 4096u;
+        CHECK (NULL == EmbAllocCreate (&s), "a pool too large for 32-bit counters is rejected");
+    }
+#endif
+}
+
+static void TestCacheLineLayout (void)
+{
+    EmbAllocMempool pools [4];
+    unsigned char* p;
+    size_t i;
+
+    /* Whatever malloc returns, every mempool starts on a 64-byte cache line... */
+    for (i = 0; i < 4u; i++) {
+        pools [i] = MakePool32 (1u + i, true);
+        CHECK ((NULL != pools [i]) && (0u == (uintptr_t) pools [i] % 64u),
+            "the mempool starts on a cache line");
+    }
+
+    /* ...and so does its first block, right after the control data. */
+    p = (NULL != pools [3]) ? (unsigned char*) EmbAllocMalloc (pools [3], 32) : NULL;
+    CHECK ((NULL != p) && (0u == ((uintptr_t) p - EA_HEADER) % 64u),
+        "the first block starts on a cache line");
+    EmbAllocFree (pools [3], p);
+    CHECK ((NULL != pools [3]) && (kEmbAllocNoErr == LastError (pools [3])),
+        "the block frees cleanly");
+
+    for (i = 0; i < 4u; i++) {
+        CHECK (EmbAllocDestroy (pools [i]), "the aligned mempool is destroyed");
+    }
+}
+
+static void TestThreadCache (void)
+{
+    EmbAllocMempool pool = MakePool32 (40, true);
+    EmbAllocStatistics stats;
+    EmbAllocThreadCache cache;
+    EmbAllocThreadCache other;
+    unsigned char* p [40];
+    unsigned char* q;
+    unsigned char* r;
+    size_t k;
+
+    if (NULL == pool) { CHECK (0, "create pool"); return; }
+
+    cache = EmbAllocCreateThreadCache (pool);
+    other = EmbAllocCreateThreadCache (pool);
+    CHECK ((NULL != cache) && (NULL != other), "create thread caches");
+    if ((NULL == cache) || (NULL == other)) { EmbAllocDestroy (pool); return; }
+
+    /* The first allocation claims a whole magazine; frees stay in the cache (LIFO). */
+    q = (unsigned char*) EmbAllocCacheMalloc (cache, 20);
+    CHECK (NULL != q, "cached alloc");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 24u == stats.categories [0].free_blocks,
+        "a refill claims a magazine of blocks at once");
+    Fingerprint (q, 20, 0x61);
+    EmbAllocCacheFree (cache, q);
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 24u == stats.categories [0].free_blocks,
+        "a cached free does not reach the pool");
+    CHECK (q == (unsigned char*) EmbAllocCacheMalloc (cache, 10), "the cache hands out the last freed block");
+
+    /* Double and forged frees are still rejected. */
+    EmbAllocCacheFree (cache, q);
+    EmbAllocCacheFree (cache, q);
+    CHECK (kEmbAllocNoErr != LastError (pool), "double free into the cache is rejected");
+    q = (unsigned char*) EmbAllocCacheMalloc (cache, 32);
+    r = (unsigned char*) EmbAllocCacheMalloc (cache, 32);
+    CHECK ((NULL != q) && (NULL != r) && (q != r), "a rejected double free is not cached twice");
+    EmbAllocCacheFree (cache, q);
+    EmbAllocCacheFree (cache, r);
+    q = (unsigned char*) EmbAllocMalloc (pool, 100);
+    CHECK (NULL != q, "alloc a multi-block run");
+    if (NULL != q) {
+        EmbAllocCacheFree (cache, q + EA_STRIDE (32));
+        CHECK (kEmbAllocPointerParamError == LastError (pool), "forged inner free is rejected");
+        EmbAllocCacheFree (cache, q);
+        CHECK (kEmbAllocNoErr == LastError (pool), "a multi-block run is freed to the pool");
+    }
+
+    /* An overflow past the requested size is caught on a cached free. */
+    q = (unsigned char*) EmbAllocCacheMalloc (cache, 20);
+    CHECK (NULL != q, "cached alloc for overflow");
+    if (NULL != q) {
+        memset (q, 0x11, 21);
+        EmbAllocCacheFree (cache, q);
+        CHECK (kEmbAllocOverflow == LastError (pool), "overflow detected on a cached free");
+    }
+
+    /* Exhaust the pool through the cache, then free through another cache. */
+    for (k = 0; k < 40; ++k) {
+        p [k] = (unsigned char*) EmbAllocCacheMalloc (cache, 32);
+        CHECK (NULL != p [k], "every block can be allocated through the cache");
+    }
+    CHECK (NULL == EmbAllocCacheMalloc (cache, 32), "an exhausted pool fails the cached alloc");
+    for (k = 0; k < 40; ++k) {
+        EmbAllocCacheFree ((0 == (k % 2)) ? cache : other, p [k]);
+    }
+    CHECK (EmbAllocGetStatistics (pool, &stats) && kEmbAllocNoErr == LastError (pool),
+        "cross-cache frees are clean");
+
+    /* Destroying the caches gives every block back. */
+    CHECK (EmbAllocDestroyThreadCache (other), "destroy the first thread cache");
+    CHECK (EmbAllocDestroyThreadCache (cache), "destroy the last thread cache");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && 40u == stats.categories [0].free_blocks &&
+        40u == stats.categories [0].largest_free_run, "all the cached blocks are back in the pool");
+    CHECK (kEmbAllocNoErr == LastError (pool), "cached blocks pass the overflow checks");
+    CHECK (!EmbAllocDestroyThreadCache (NULL), "NULL thread cache is rejected");
+    EmbAllocDestroy (pool);
+}
+
+static void TestLockFreeSingleBlocks (void)
+{
+    /* 1000 blocks: 16 bitmap words, so the category has summary levels too. */
+    enum { kBlocks = 1000 };
+    static unsigned char* a[kBlocks];
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    unsigned char* run;
+    size_t k, got = 0;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = kBlocks;
+    s.total_size = kBlocks * 32u;
+    s.threadsafe = true;
+    s.lock_free_single_blocks = true;
+    s.full_overflow_checks = true;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create lock-free pool"); return; }
+
+    memset (&s, 0, sizeof s);
+    CHECK (EmbAllocGetSettings (pool, &s) && s.lock_free_single_blocks,
+        "the lock-free setting is kept");
+
+    /* Fill the first 640 blocks (10 whole bitmap words) one block at a time. */
+    for (k = 0; k < 640; ++k) {
+        a[k] = (unsigned char*) EmbAllocMalloc (pool, 1 + (k % 32));
+        if ((NULL != a[k]) && ((0 == k) || (a[k] == a[k - 1] + EA_STRIDE (32)))) { ++got; }
+    }
+    CHECK (640u == got, "single blocks are handed out in address order");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (kBlocks - 640u) == stats.categories [0].free_blocks,
+        "the lock-free allocations are counted");
+
+    /* The run search skips the words the lock-free allocations filled. */
+    run = (unsigned char*) EmbAllocMalloc (pool, 100);
+    CHECK (run == a[639] + EA_STRIDE (32), "a multi-block run follows the filled words");
+
+    /* Free every other block, then the run: the freed blocks are reused lowest first. */
+    for (k = 0; k < 640; k += 2) {
+        EmbAllocFree (pool, a[k]);
+    }
+    EmbAllocFree (pool, run);
+    CHECK (kEmbAllocNoErr == LastError (pool), "lock-free frees are clean");
+    CHECK (EmbAllocGetStatistics (pool, &stats) &&
+        (kBlocks - 320u) == stats.categories [0].free_blocks &&
+        (kBlocks - 640u) == stats.categories [0].largest_free_run,
+        "the lock-free frees are counted");
+    CHECK (a[0] == (unsigned char*) EmbAllocMalloc (pool, 32), "a freed block is reused");
+
+    /* Double frees, forged frees and overflows still reach the checks of the locked path. */
+    EmbAllocFree (pool, a[2]);
+    CHECK (kEmbAllocPointerParamError == LastError (pool), "double free is rejected");
+    run = (unsigned char*) EmbAllocMalloc (pool, 100);
+    CHECK (NULL != run, "alloc a multi-block run");
+    if (NULL != run) {
+        EmbAllocFree (pool, run + EA_STRIDE (32));
+        CHECK (kEmbAllocPointerParamError == LastError (pool), "forged inner free is rejected");
+        EmbAllocFree (pool, run);
+    }
+    memset (a[1], 0x11, 3);
+    EmbAllocFree (pool, a[1]);
+    CHECK (kEmbAllocOverflow == LastError (pool), "overflow detected on free");
+
+    for (k = 0; k < 640; k += 2) { if (k) { a[k] = NULL; } }
+    for (k = 0; k < 640; ++k) { if ((1u != k) && (NULL != a[k])) { EmbAllocFree (pool, a[k]); } }
+    CHECK (EmbAllocGetStatistics (pool, &stats) && kBlocks == stats.categories [0].free_blocks &&
+        kBlocks == stats.categories [0].largest_free_run, "every block is back");
+    CHECK (EmbAllocDestroy (pool), "destroy lock-free pool");
+}
+
+static void TestCategoryLocks (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    unsigned char* p[4];
+    unsigned char* q;
+    unsigned char* r;
+    size_t k, got = 0;
+
+    /* Threadsafe: every call goes through the per-category locks. */
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 4;
+    s.num_256_bytes_blocks = 4;
+    s.num_4k_bytes_blocks = 2;
+    s.total_size = 4u * 32u + 4u * 256u + 2u * 4096u;
+    s.threadsafe = true;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create threadsafe pool"); return; }
+
+    for (k = 0; k < 4; ++k) {
+        p[k] = (unsigned char*) EmbAllocMalloc (pool, 32);
+        if ((NULL != p[k]) && (32u == EmbAllocUsableSize (pool, p[k]))) { ++got; }
+    }
+    CHECK (4u == got, "the preferred category serves its size class");
+
+    /* A full preferred category sends the allocation to the search over all categories. */
+    q = (unsigned char*) EmbAllocMalloc (pool, 32);
+    CHECK ((NULL != q) && (256u == EmbAllocUsableSize (pool, q)),
+        "a full preferred category falls back to the full search");
+
+    /* Growing past the category moves the chunk, under all the category locks. */
+    Fingerprint (p[0], 32, 7);
+    r = (unsigned char*) EmbAllocRealloc (pool, p[0], 300);
+    CHECK ((NULL != r) && (r != p[0]) && FingerprintOk (r, 32, 7) &&
+        (EmbAllocUsableSize (pool, r) >= 300u), "a cross-category realloc moves the chunk");
+    CHECK (kEmbAllocNoErr == LastError (pool), "the cross-category realloc is clean");
+    CHECK ((NULL != r) && (r == (unsigned char*) EmbAllocRealloc (pool, r, 40)),
+        "a shrink stays in place");
+
+    /* The old head was freed by the move: its category lock still guards the checks. */
+    EmbAllocFree (pool, p[0]);
+    CHECK (kEmbAllocPointerParamError == LastError (pool), "double free is rejected");
+
+    for (k = 1; k < 4; ++k) { EmbAllocFree (pool, p[k]); }
+    EmbAllocFree (pool, q);
+    EmbAllocFree (pool, r);
+    CHECK (kEmbAllocNoErr == LastError (pool), "frees are clean");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (4u == stats.categories [0].free_blocks) &&
+        (4u == stats.categories [3].free_blocks) && (2u == stats.categories [7].free_blocks),
+        "every block is back");
+    CHECK (EmbAllocDestroy (pool), "destroy threadsafe pool");
+}
+
+static void TestLockBackends (void)
+{
+    EmbAllocMemPoolSettings s, out;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    unsigned char* p[4];
+    unsigned char* r;
+    size_t k, got;
+    int backend;
+
+    /* Every backend drives the same threadsafe calls (a missing one runs on the OS mutex). */
+    for (backend = kEmbAllocLockBackendMutex; backend <= kEmbAllocLockBackendFutex; ++backend) {
+        memset (&s, 0, sizeof s);
+        s.num_32_bytes_blocks = 4;
+        s.num_256_bytes_blocks = 2;
+        s.total_size = 4u * 32u + 2u * 256u;
+        s.threadsafe = true;
+        s.lock_backend = (EmbAllocLockBackend) backend;
+        pool = EmbAllocCreate (&s);
+        if (NULL == pool) { CHECK (0, "create a pool with a lock backend"); continue; }
+        CHECK (kEmbAllocNoErr == LastError (pool), "a known lock backend is a consistent setting");
+
+        got = 0;
+        for (k = 0; k < 4; ++k) {
+            p[k] = (unsigned char*) EmbAllocMalloc (pool, 32);
+            if (NULL != p[k]) { ++got; }
+        }
+        CHECK (4u == got, "malloc under the lock backend");
+
+        Fingerprint (p[1], 32, 11);
+        r = (unsigned char*) EmbAllocRealloc (pool, p[1], 200);
+        CHECK ((NULL != r) && FingerprintOk (r, 32, 11), "realloc under the lock backend");
+
+        EmbAllocFree (pool, p[0]);
+        EmbAllocFree (pool, p[2]);
+        EmbAllocFree (pool, p[3]);
+        EmbAllocFree (pool, r);
+        CHECK (kEmbAllocNoErr == LastError (pool), "free under the lock backend");
+        CHECK (EmbAllocGetStatistics (pool, &stats) && (4u == stats.categories [0].free_blocks) &&
+            (2u == stats.categories [3].free_blocks), "every block is back under the lock backend");
+        CHECK (EmbAllocDestroy (pool), "destroy a pool with a lock backend");
+    }
+
+    /* An unknown backend falls back to the OS mutex and is reported. */
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 4;
+    s.total_size = 4u * 32u;
+    s.threadsafe = true;
+    s.lock_backend = (EmbAllocLockBackend) 99;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create a pool with an unknown lock backend"); return; }
+    CHECK (kEmbAllocInconsistentSettings == LastError (pool), "unknown lock backend is reported as inconsistent");
+    CHECK (EmbAllocGetSettings (pool, &out) && (kEmbAllocLockBackendMutex == out.lock_backend),
+        "unknown lock backend falls back to the mutex");
+    p[0] = (unsigned char*) EmbAllocMalloc (pool, 32);
+    CHECK (NULL != p[0], "malloc with the fallback lock backend");
+    EmbAllocFree (pool, p[0]);
+    CHECK (EmbAllocDestroy (pool), "destroy a pool with the fallback lock backend");
+}
+
+static void TestPoolSet (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocPoolSet set;
+    EmbAllocMempool home;
+    unsigned char* p[13];
+    unsigned char* r;
+    unsigned char local[64];
+    size_t k, got = 0, free_blocks = 0;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 4;
+    s.total_size = 4u * 32u;
+    CHECK (NULL == EmbAllocCreatePoolSet (NULL, 2, kEmbAllocPoolSelectThread), "pool set without settings");
+    CHECK (NULL == EmbAllocCreatePoolSet (&s, 2, (EmbAllocPoolSelection) 99), "pool set with an unknown selection");
+
+    set = EmbAllocCreatePoolSet (&s, 3, kEmbAllocPoolSelectThread);
+    if (NULL == set) { CHECK (0, "create pool set"); return; }
+    CHECK ((NULL != EmbAllocPoolSetGetPool (set, 2)) && (NULL == EmbAllocPoolSetGetPool (set, 3)),
+        "a pool set has the requested sub-pools");
+
+    /* The thread's sub-pool serves first; the others take over once it is full. */
+    for (k = 0; k < 13; ++k) {
+        p[k] = (unsigned char*) EmbAllocPoolSetMalloc (set, 32);
+        if (NULL != p[k]) { ++got; }
+    }
+    home = EmbAllocPoolSetFindPool (set, p[0]);
+    CHECK ((NULL != home) && (home == EmbAllocPoolSetFindPool (set, p[3])),
+        "the first allocations share the thread's sub-pool");
+    CHECK ((NULL != p[4]) && (home != EmbAllocPoolSetFindPool (set, p[4])), "a full sub-pool falls back to another one");
+    CHECK ((12u == got) && (NULL == p[12]), "the set is full once every sub-pool is");
+    CHECK (NULL == EmbAllocPoolSetFindPool (set, local), "a foreign pointer has no sub-pool");
+
+    /* Freeing the other sub-pools' blocks leaves room only outside the full home. */
+    for (k = 4; k < 12; ++k) { EmbAllocPoolSetFree (set, p[k]); }
+    Fingerprint (p[0], 32, 21);
+    r = (unsigned char*) EmbAllocPoolSetRealloc (set, p[0], 64);
+    CHECK ((NULL != r) && (home != EmbAllocPoolSetFindPool (set, r)) && FingerprintOk (r, 32, 21),
+        "a realloc that does not fit its sub-pool moves to another one");
+
+    EmbAllocPoolSetFree (set, local);
+    CHECK (kEmbAllocPointerParamError == LastError (home), "a foreign free is rejected by the thread's sub-pool");
+    EmbAllocPoolSetFree (set, r);
+    for (k = 1; k < 4; ++k) { EmbAllocPoolSetFree (set, p[k]); }
+    for (k = 0; k < 3; ++k) {
+        if (EmbAllocGetStatistics (EmbAllocPoolSetGetPool (set, k), &stats)) {
+            free_blocks += stats.categories [0].free_blocks;
+        }
+    }
+    CHECK (12u == free_blocks, "every block is back in its sub-pool");
+    CHECK (EmbAllocDestroyPoolSet (set), "destroy pool set");
+
+    /* One threadsafe sub-pool per CPU. */
+    s.threadsafe = true;
+    set = EmbAllocCreatePoolSet (&s, 0, kEmbAllocPoolSelectCpu);
+    if (NULL == set) { CHECK (0, "create per-CPU pool set"); return; }
+    r = (unsigned char*) EmbAllocPoolSetMalloc (set, 32);
+    CHECK ((NULL != r) && (NULL != EmbAllocPoolSetFindPool (set, r)), "malloc on a per-CPU pool set");
+    EmbAllocPoolSetFree (set, r);
+    CHECK (EmbAllocDestroyPoolSet (set), "destroy per-CPU pool set");
+}
+
 static void TestForgedInnerFree (void)
 {
     EmbAllocMempool pool = MakePool32 (16, false);
@@ -603,6 +1975,71 @@ static void CountingErrorCallback (EmbAllocErrors code, const char* message)
     g_cb_code = code;
 }
 
+#define EA_DUMP_FILE "emb_alloc_test_dump.txt"
+
+/** Reads the dump file into a buffer (truncated to its size). */
+static const char* ReadDumpFile (void)
+{
+    static char text [256 * 1024];
+    size_t length = 0;
+    FILE* file = fopen (EA_DUMP_FILE, "r");
+
+    text [0] = '\0';
+    if (NULL != file) {
+        length = fread (text, 1, sizeof text - 1, file);
+        text [length] = '\0';
+        fclose (file);
+    }
+    return text;
+}
+
+static void TestErrorDump (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocMempool pool;
+    const char* text;
+    FILE* file;
+    void* p;
+    void* q;
+
+    /* EmbAllocCreate deletes the previous dump, and reports it when there is none. */
+    file = fopen (EA_DUMP_FILE, "w");
+    if (NULL != file) { fclose (file); }
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 4;
+    s.num_64_bytes_blocks = 4;
+    s.total_size = 4u * 32u + 4u * 64u;
+    strcpy (s.error_dump_file_name, EA_DUMP_FILE);
+
+    /* A single-threaded pool dumps all of its memory. */
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool with a dump file"); return; }
+    p = EmbAllocMalloc (pool, 20);
+    EmbAllocFree (pool, p);
+    EmbAllocFree (pool, p);
+    text = ReadDumpFile ();
+    CHECK ((NULL != strstr (text, "lines)")) && (NULL == strstr (text, "Category")),
+        "the whole mempool is dumped on error");
+    EmbAllocDestroy (pool);
+
+    /* A threadsafe pool dumps only the categories the failing call has locked. */
+    s.threadsafe = true;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create threadsafe pool with a dump file"); return; }
+    p = EmbAllocMalloc (pool, 20);
+    q = EmbAllocMalloc (pool, 50);
+    EmbAllocFree (pool, p);
+    EmbAllocFree (pool, p);
+    text = ReadDumpFile ();
+    CHECK ((NULL != strstr (text, "locked categories only")) &&
+        (NULL != strstr (text, "Category 0 ")) && (NULL == strstr (text, "Category 1 ")),
+        "a threadsafe mempool dumps the locked category only");
+    EmbAllocFree (pool, q);
+    CHECK (kEmbAllocNoErr == LastError (pool), "the dump leaves the category locks usable");
+    EmbAllocDestroy (pool);
+    remove (EA_DUMP_FILE);
+}
+
 static void TestErrorCallback (void)
 {
     EmbAllocMemPoolSettings s;
@@ -625,6 +2062,305 @@ static void TestErrorCallback (void)
     EmbAllocDestroy (pool);
 }
 
+static void TestRemoteFreeQueues (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    unsigned char* p[4];
+    unsigned char* run;
+    size_t k;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 8;
+    s.total_size = 8u * 32u;
+    s.threadsafe = true;
+    s.remote_free_queues = true;
+    s.full_overflow_checks = true;
+    s.error_callback_fn = CountingErrorCallback;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create pool with remote free queues"); return; }
+
+    for (k = 0; k < 4; ++k) { p[k] = (unsigned char*) EmbAllocMalloc (pool, 10); }
+    run = (unsigned char*) EmbAllocMalloc (pool, 64);
+    CHECK ((NULL != p[3]) && (NULL != run), "allocations on a pool with remote free queues");
+
+    /* Without an owner, this thread frees like a remote one: single blocks are queued. */
+    CHECK (EmbAllocSetOwnerThread (pool, false), "give the ownership up");
+    EmbAllocFree (pool, p[0]);
+    EmbAllocFree (pool, p[1]);
+    EmbAllocFree (pool, run);
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (4u == stats.categories [0].free_blocks),
+        "queued single blocks stay occupied, a multi-block free is immediate");
+    EmbAllocFree (pool, p[0]);
+    CHECK (kEmbAllocPointerParamError == LastError (pool), "a queued block cannot be freed again");
+
+    /* The owner drains the queues on its next allocation; a write after the free shows up then. */
+    p[1][20] = 0x5A;
+    g_cb_count = 0;
+    g_cb_code = kEmbAllocNoErr;
+    CHECK (EmbAllocSetOwnerThread (pool, true), "claim the ownership");
+    p[0] = (unsigned char*) EmbAllocMalloc (pool, 10);
+    CHECK ((1 == g_cb_count) && (kEmbAllocOverflow == g_cb_code), "a write into a queued block is reported");
+    CHECK ((NULL != p[0]) && EmbAllocGetStatistics (pool, &stats) && (5u == stats.categories [0].free_blocks),
+        "the owner drains the queues");
+
+    /* The owner's own frees are immediate. */
+    EmbAllocFree (pool, p[2]);
+    CHECK (kEmbAllocNoErr == LastError (pool), "owner free is clean");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (6u == stats.categories [0].free_blocks),
+        "the owner's free is not queued");
+
+    EmbAllocFree (pool, p[0]);
+    EmbAllocFree (pool, p[3]);
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (8u == stats.categories [0].free_blocks) &&
+        (8u == stats.categories [0].largest_free_run), "every block is back");
+    CHECK (!EmbAllocSetOwnerThread (NULL, true), "ownership of an invalid mempool");
+    CHECK (EmbAllocDestroy (pool), "destroy pool with remote free queues");
+}
+
+#if EA_THREADS
+/** One thread of TestLockFreeThreads: its pool and what it found wrong. */
+typedef struct {
+    EmbAllocMempool pool;
+    unsigned seed;
+    size_t failed;
+    size_t corrupt;
+} EaLockFreeWorker;
+
+/** Keeps a few blocks alive, freeing and reallocating them in a pseudo-random order. */
+static void* LockFreeWorker (void* arg)
+{
+    EaLockFreeWorker* w = (EaLockFreeWorker*) arg;
+    unsigned char* live [8] = { NULL };
+    size_t sizes [8] = { 0 };
+    unsigned char tag = (unsigned char) w->seed;
+    unsigned r = w->seed;
+    size_t k, n;
+
+    for (n = 0; n < 5000u; ++n) {
+        r = r * 1103515245u + 12345u;
+        k = (r >> 16) % 8u;
+        if (NULL != live [k]) {
+            if ((tag != live [k][0]) || (tag != live [k][sizes [k] - 1u])) { ++w->corrupt; }
+            EmbAllocFree (w->pool, live [k]);
+        }
+        /* Every 16th allocation is a two-block run, which takes the locked path. */
+        sizes [k] = (0 == (n % 16u))? 60u: 1u + (r >> 8) % 24u;
+        live [k] = (unsigned char*) EmbAllocMalloc (w->pool, sizes [k]);
+        if (NULL == live [k]) {
+            ++w->failed;
+        } else {
+            memset (live [k], tag, sizes [k]);
+        }
+    }
+    for (k = 0; k < 8u; ++k) {
+        if (NULL != live [k]) { EmbAllocFree (w->pool, live [k]); }
+    }
+    return NULL;
+}
+
+static void TestLockFreeThreads (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    EaLockFreeWorker workers [4];
+    pthread_t threads [4];
+    size_t started = 0, failed = 0, corrupt = 0;
+    size_t k;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 128;
+    s.total_size = 128u * 32u;
+    s.threadsafe = true;
+    s.lock_free_single_blocks = true;
+    s.full_overflow_checks = true;
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create lock-free pool"); return; }
+
+    for (k = 0; k < 4u; ++k) {
+        memset (&workers [k], 0, sizeof workers [k]);
+        workers [k].pool = pool;
+        workers [k].seed = (unsigned) (k + 1u);
+        if (0 == pthread_create (&threads [k], NULL, LockFreeWorker, &workers [k])) { ++started; }
+    }
+    CHECK (4u == started, "start the lock-free threads");
+    for (k = 0; k < started; ++k) {
+        pthread_join (threads [k], NULL);
+        failed += workers [k].failed;
+        corrupt += workers [k].corrupt;
+    }
+
+    /* 4 threads x 8 live allocations of at most 2 blocks never exhaust 128 blocks. */
+    CHECK ((0u == failed) && (0u == corrupt), "concurrent allocations never fail or overlap");
+    CHECK (kEmbAllocNoErr == LastError (pool), "concurrent frees raise no error");
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (128u == stats.categories [0].free_blocks) &&
+        (128u == stats.categories [0].largest_free_run), "every block is back after the threads");
+    CHECK (EmbAllocDestroy (pool), "destroy lock-free pool");
+}
+
+/** Allocates and frees in the 64-byte category until the error thread is done. */
+static void* DumpChurnThread (void* arg)
+{
+    EmbAllocMempool pool = (EmbAllocMempool) arg;
+    void* p;
+    size_t n;
+
+    for (n = 0; n < 2000u; ++n) {
+        p = EmbAllocMalloc (pool, 50);
+        EmbAllocFree (pool, p);
+    }
+    return NULL;
+}
+
+static void TestErrorDumpThreads (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EmbAllocMempool pool;
+    pthread_t churn;
+    FILE* file;
+    void* p;
+    size_t k;
+
+    /* The dumps of the 32-byte category errors never read the churned category. */
+    file = fopen (EA_DUMP_FILE, "w");
+    if (NULL != file) { fclose (file); }
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 4;
+    s.num_64_bytes_blocks = 4;
+    s.total_size = 4u * 32u + 4u * 64u;
+    s.threadsafe = true;
+    strcpy (s.error_dump_file_name, EA_DUMP_FILE);
+    pool = EmbAllocCreate (&s);
+    if (NULL == pool) { CHECK (0, "create threadsafe pool with a dump file"); return; }
+
+    CHECK (0 == pthread_create (&churn, NULL, DumpChurnThread, pool), "start the churn thread");
+    for (k = 0; k < 20u; ++k) {
+        p = EmbAllocMalloc (pool, 20);
+        EmbAllocFree (pool, p);
+        EmbAllocFree (pool, p);
+    }
+    pthread_join (churn, NULL);
+
+    CHECK (EmbAllocGetStatistics (pool, &stats) && (4u == stats.categories [0].free_blocks) &&
+        (4u == stats.categories [1].free_blocks), "errors with dumps next to a busy category");
+    EmbAllocDestroy (pool);
+    remove (EA_DUMP_FILE);
+}
+
+/** The hand-off between the owner of a pool and the threads that free its blocks. */
+typedef struct {
+    EmbAllocMempool pool;
+    pthread_mutex_t mutex;
+    unsigned char* slots [16];
+    size_t count;
+    int done;
+    size_t freed;
+    size_t corrupt;
+} EaMailbox;
+
+/** Takes blocks out of the mailbox and frees them remotely until the owner is done. */
+static void* RemoteFreeProducer (void* arg)
+{
+    EaMailbox* box = (EaMailbox*) arg;
+    unsigned char* p;
+    size_t freed = 0;
+    size_t corrupt = 0;
+    int done = 0;
+
+    while (!done) {
+        p = NULL;
+        pthread_mutex_lock (&box->mutex);
+        if (box->count > 0) {
+            p = box->slots [--box->count];
+        } else {
+            done = box->done;
+        }
+        pthread_mutex_unlock (&box->mutex);
+
+        if (NULL == p) {
+            sched_yield ();
+            continue;
+        }
+        if ((0xA5 != p [0]) || (0xA5 != p [9])) { ++corrupt; }
+        p [0] = 0;
+        EmbAllocFree (box->pool, p);
+        ++freed;
+    }
+
+    pthread_mutex_lock (&box->mutex);
+    box->freed += freed;
+    box->corrupt += corrupt;
+    pthread_mutex_unlock (&box->mutex);
+    return NULL;
+}
+
+static void TestRemoteFreeThreads (void)
+{
+    EmbAllocMemPoolSettings s;
+    EmbAllocStatistics stats;
+    EaMailbox box;
+    pthread_t producers [3];
+    unsigned char* p;
+    size_t started = 0;
+    size_t handed = 0;
+    size_t k;
+
+    memset (&s, 0, sizeof s);
+    s.num_32_bytes_blocks = 64;
+    s.total_size = 64u * 32u;
+    s.threadsafe = true;
+    s.remote_free_queues = true;
+    s.full_overflow_checks = true;
+    memset (&box, 0, sizeof box);
+    box.pool = EmbAllocCreate (&s);
+    if (NULL == box.pool) { CHECK (0, "create pool with remote free queues"); return; }
+    pthread_mutex_init (&box.mutex, NULL);
+
+    for (k = 0; k < 3; ++k) {
+        if (0 == pthread_create (&producers [k], NULL, RemoteFreeProducer, &box)) { ++started; }
+    }
+    CHECK (3u == started, "start the producer threads");
+
+    /* The creator owns the pool: it allocates (draining the queues) while the producers free. */
+    for (k = 0; (k < 20000u) && (3u == started); ++k) {
+        p = (unsigned char*) EmbAllocMalloc (box.pool, 10);
+        if (NULL == p) { break; }
+        memset (p, 0xA5, 10);
+        pthread_mutex_lock (&box.mutex);
+        if (box.count < sizeof box.slots / sizeof box.slots [0]) {
+            box.slots [box.count++] = p;
+            p = NULL;
+        }
+        pthread_mutex_unlock (&box.mutex);
+        if (NULL != p) {
+            EmbAllocFree (box.pool, p);                 /* the mailbox is full: free it locally */
+        } else {
+            ++handed;
+        }
+    }
+    CHECK (20000u == k, "the owner never runs out of blocks");
+
+    pthread_mutex_lock (&box.mutex);
+    box.done = 1;
+    pthread_mutex_unlock (&box.mutex);
+    for (k = 0; k < started; ++k) { pthread_join (producers [k], NULL); }
+    CHECK ((handed == box.freed) && (0u == box.corrupt), "every handed block is freed remotely and intact");
+
+    /* The owner's next allocation drains whatever the producers queued last. */
+    p = (unsigned char*) EmbAllocMalloc (box.pool, 10);
+    EmbAllocFree (box.pool, p);
+    CHECK (kEmbAllocNoErr == LastError (box.pool), "remote frees raise no error");
+    CHECK (EmbAllocGetStatistics (box.pool, &stats) && (64u == stats.categories [0].free_blocks) &&
+        (64u == stats.categories [0].largest_free_run), "every block is back after the drain");
+
+    pthread_mutex_destroy (&box.mutex);
+    CHECK (EmbAllocDestroy (box.pool), "destroy pool with remote free queues");
+}
+#endif /* EA_THREADS */
+
 static void TestThreadsafeSmoke (void)
 {
     EmbAllocMemPoolSettings s;
@@ -665,6 +2401,31 @@ int main (void)
     RUN (TestMultiBlock);
     RUN (TestCrossCategory);
     RUN (TestExhaustion);
+    RUN (TestWordScan);
+    RUN (TestSummaryScan);
+    RUN (TestRunSearch);
+    RUN (TestFragmentedRunBound);
+    RUN (TestPlacementPolicies);
+    RUN (TestStatistics);
+    RUN (TestSizeClassLookup);
+    RUN (TestReallocShrinkReleases);
+    RUN (TestReallocGrowBackward);
+    RUN (TestExpandInPlace);
+    RUN (TestUsableAndGoodSize);
+    RUN (TestBatches);
+    RUN (TestFreeSized);
+    RUN (TestBlockIndexing);
+    RUN (TestPowerOfTwoStrides);
+    RUN (TestCompactMetadata);
+    RUN (TestMetadataBeforeBlocks);
+    RUN (TestInterleavedBitmaps);
+    RUN (TestBlockCounters);
+    RUN (TestCacheLineLayout);
+    RUN (TestThreadCache);
+    RUN (TestLockFreeSingleBlocks);
+    RUN (TestCategoryLocks);
+    RUN (TestLockBackends);
+    RUN (TestPoolSet);
     RUN (TestForgedInnerFree);
     RUN (TestDoubleFree);
     RUN (TestBadPointers);
@@ -674,6 +2435,13 @@ int main (void)
     RUN (TestOverflowDetect);
     RUN (TestEndMarkerGuard);
     RUN (TestErrorCallback);
+    RUN (TestErrorDump);
+    RUN (TestRemoteFreeQueues);
+#if EA_THREADS
+    RUN (TestLockFreeThreads);
+    RUN (TestRemoteFreeThreads);
+    RUN (TestErrorDumpThreads);
+#endif
     RUN (TestThreadsafeSmoke);
     RUN (TestStressNoAlias);
 
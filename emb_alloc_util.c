@@ -24,8 +24,67 @@
  * https://en.wikipedia.org/wiki/MIT_License#License_terms
  */
 
+#if defined (__linux__) && !defined (_GNU_SOURCE)
+    /** PTHREAD_MUTEX_ADAPTIVE_NP, pthread_mutexattr_settype and syscall under -std=c99. */
+    #define _GNU_SOURCE
+#endif /** __linux__ && !_GNU_SOURCE */
+
 #include "emb_alloc_util.h"
 #include <string.h>
+#if defined (__linux__)
+    #include <sched.h>
+    #include <unistd.h>
+    #include <sys/syscall.h>
+    #include <linux/futex.h>
+#endif /** __linux__ */
+
+/** The spinlock and the futex lock need the GCC / clang atomic builtins. */
+#if defined (__GNUC__) || defined (__clang__)
+    #define EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED 1
+#else
+    #define EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED 0
+#endif /** __GNUC__ || __clang__ */
+
+#if defined (__linux__) && defined (SYS_futex) && EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED
+    #define EMB_ALLOC_FUTEX_LOCK_SUPPORTED 1
+#else
+    #define EMB_ALLOC_FUTEX_LOCK_SUPPORTED 0
+#endif /** __linux__ && SYS_futex */
+
+/** PTHREAD_MUTEX_ADAPTIVE_NP is a glibc enumerator (not a macro), with _GNU_SOURCE. */
+#if defined (__linux__) && defined (__GLIBC__) && defined (_GNU_SOURCE)
+    #define EMB_ALLOC_ADAPTIVE_MUTEX_SUPPORTED 1
+#else
+    #define EMB_ALLOC_ADAPTIVE_MUTEX_SUPPORTED 0
+#endif /** __linux__ && __GLIBC__ && _GNU_SOURCE */
+
+/** Thread-local storage, for EmbAllocGetThreadIndex (). */
+#if defined (__GNUC__) || defined (__clang__)
+    #define EMB_ALLOC_THREAD_LOCAL __thread
+#elif defined (_MSC_VER)
+    #define EMB_ALLOC_THREAD_LOCAL __declspec (thread)
+#endif /** __GNUC__ || __clang__ / _MSC_VER */
+
+/**
+ * The longest spin, in pause instructions, between two looks at a held spinlock.
+ * The spinlock yields the CPU instead once its backoff has grown this far.
+ */
+#ifndef EMB_ALLOC_SPIN_LOCK_MAX_BACKOFF
+    #define EMB_ALLOC_SPIN_LOCK_MAX_BACKOFF 64u
+#endif /** EMB_ALLOC_SPIN_LOCK_MAX_BACKOFF */
+
+/**
+ * Tells the CPU that the thread is busy waiting (frees pipeline resources for the
+ * sibling hyperthread and avoids the memory order flush at the end of the loop).
+ */
+static void EmbAllocCpuRelaxInternal (void)
+{
+    #if (defined (__GNUC__) || defined (__clang__)) && (defined (__x86_64__) || defined (__i386__))
+        __builtin_ia32_pause ();
+    #elif (defined (__GNUC__) || defined (__clang__)) && defined (__aarch64__)
+        __asm__ __volatile__ ("yield" ::: "memory");
+    #endif /** x86 / aarch64 */
+}
 
 /**
  * https://www.codeproject.com/Articles/25569/Cross-Platform-Mutex
@@ -115,6 +174,72 @@ int EmbAllocUnlockMutex (EmbAllocMutex *mutex)
     #endif /** __linux__ || _WIN32/_WIN64 */
 }
 
+void EmbAllocYieldThread (void)
+{
+    #if defined (__linux__)
+        sched_yield ();
+    #elif defined (_WIN32) || defined (_WIN64 )
+        SwitchToThread ();
+    #else /** Neither __linux__ nor  _WIN32/_WIN64 are defined*/
+        #error Cannot determine how to yield the thread on this platform
+    #endif /** __linux__ || _WIN32/_WIN64 */
+}
+
+size_t EmbAllocGetCpuCount (void)
+{
+    #if defined (__linux__)
+        long count = sysconf (_SC_NPROCESSORS_ONLN);
+
+        return ((count > 0)? (size_t) count: 1u);
+    #elif defined (_WIN32) || defined (_WIN64 )
+        SYSTEM_INFO system_info;
+
+        GetSystemInfo (&system_info);
+        return ((system_info.dwNumberOfProcessors > 0)? (size_t) system_info.dwNumberOfProcessors: 1u);
+    #else /** Neither __linux__ nor  _WIN32/_WIN64 are defined*/
+        #error Cannot determine how to count the CPUs on this platform
+    #endif /** __linux__ || _WIN32/_WIN64 */
+}
+
+size_t EmbAllocGetCurrentCpu (void)
+{
+    #if defined (__linux__)
+        int cpu = sched_getcpu ();
+
+        if (cpu >= 0) {
+            return (size_t) cpu;
+        }
+    #elif (defined (_WIN32) || defined (_WIN64 )) && defined (_WIN32_WINNT) && (_WIN32_WINNT >= 0x0600)
+        return (size_t) GetCurrentProcessorNumber ();
+    #endif /** __linux__ || _WIN32/_WIN64 */
+
+    return EmbAllocGetThreadIndex ();
+}
+
+size_t EmbAllocGetThreadIndex (void)
+{
+    #if defined (EMB_ALLOC_THREAD_LOCAL)
+        /** The index plus 1, so that 0 marks a thread without an index yet. */
+        static EMB_ALLOC_THREAD_LOCAL size_t thread_index = 0;
+
+        if (0 == thread_index) {
+            #if defined (__GNUC__) || defined (__clang__)
+                static size_t thread_count = 0;
+
+                thread_index = __atomic_add_fetch (&thread_count, 1, __ATOMIC_RELAXED);
+            #else /** _MSC_VER */
+                static volatile LONG thread_count = 0;
+
+                thread_index = (size_t) InterlockedIncrement (&thread_count);
+            #endif /** __GNUC__ || __clang__ */
+        }
+
+        return thread_index - 1;
+    #else /** EMB_ALLOC_THREAD_LOCAL */
+        return 0;
+    #endif /** EMB_ALLOC_THREAD_LOCAL */
+}
+
 bool EmbAllocCheckBuffer (void* buffer, size_t size, unsigned char reference_value)
 {
     if ((NULL == buffer) ||
@@ -124,4 +249,172 @@ bool EmbAllocCheckBuffer (void* buffer, size_t size, unsigned char reference_val
 
     return ((*((unsigned char*) buffer) == reference_value) &&
             (0 == memcmp (buffer, ((unsigned char*) buffer + 1), size - 1)));
-}
\ No newline at end of file
+}
+
+int EmbAllocInitLock (EmbAllocLock *lock, EmbAllocLockBackend backend)
+{
+    if (NULL == lock) {
+        return -1;
+    }
+
+    lock->state = 0;
+
+    switch (backend) {
+        case kEmbAllocLockBackendSpin:
+            lock->backend = EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED? backend: kEmbAllocLockBackendMutex;
+            break;
+        case kEmbAllocLockBackendAdaptiveMutex:
+            lock->backend = EMB_ALLOC_ADAPTIVE_MUTEX_SUPPORTED? backend: kEmbAllocLockBackendMutex;
+            break;
+        case kEmbAllocLockBackendFutex:
+            lock->backend = EMB_ALLOC_FUTEX_LOCK_SUPPORTED? backend: kEmbAllocLockBackendMutex;
+            break;
+        case kEmbAllocLockBackendMutex:
+        default:
+            lock->backend = kEmbAllocLockBackendMutex;
+            break;
+    }
+
+    #if EMB_ALLOC_ADAPTIVE_MUTEX_SUPPORTED
+        if (kEmbAllocLockBackendAdaptiveMutex == lock->backend) {
+            pthread_mutexattr_t attributes;
+            int result = -1;
+
+            if (0 != pthread_mutexattr_init (&attributes)) {
+                return -1;
+            }
+
+            if ((0 == pthread_mutexattr_settype (&attributes, PTHREAD_MUTEX_ADAPTIVE_NP)) &&
+                (0 == pthread_mutex_init (&(lock->mutex), &attributes))) {
+                result = 0;
+            }
+
+            pthread_mutexattr_destroy (&attributes);
+            return result;
+        }
+    #endif /** EMB_ALLOC_ADAPTIVE_MUTEX_SUPPORTED */
+
+    if (kEmbAllocLockBackendMutex == lock->backend) {
+        return EmbAllocInitMutex (&(lock->mutex));
+    }
+
+    return 0;
+}
+
+int EmbAllocDestroyLock (EmbAllocLock *lock)
+{
+    if (NULL == lock) {
+        return -1;
+    }
+
+    switch (lock->backend) {
+        case kEmbAllocLockBackendSpin:
+        case kEmbAllocLockBackendFutex:
+            /** Nothing to release, but a held lock cannot be destroyed. */
+            return ((0 != lock->state)? -1: 0);
+        case kEmbAllocLockBackendMutex:
+        case kEmbAllocLockBackendAdaptiveMutex:
+        default:
+            return EmbAllocDestroyMutex (&(lock->mutex));
+    }
+}
+
+int EmbAllocAcquireLock (EmbAllocLock *lock)
+{
+    if (NULL == lock) {
+        return -1;
+    }
+
+    switch (lock->backend) {
+        #if EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED
+        case kEmbAllocLockBackendSpin:
+        {
+            /**
+             * Test-and-test-and-set: the exchange that takes the lock writes its cache
+             * line, so the waiters only read the lock word until it looks free.
+             */
+            while (__atomic_exchange_n (&(lock->state), 1, __ATOMIC_ACQUIRE)) {
+                unsigned backoff = 1;
+
+                do {
+                    if (backoff < EMB_ALLOC_SPIN_LOCK_MAX_BACKOFF) {
+                        unsigned i = 0;
+
+                        for (i = 0; i < backoff; i++) {
+                            EmbAllocCpuRelaxInternal ();
+                        }
+
+                        backoff <<= 1;
+                    } else {
+                        /** The holder may be waiting for this CPU: let it run. */
+                        EmbAllocYieldThread ();
+                    }
+                } while (__atomic_load_n (&(lock->state), __ATOMIC_RELAXED));
+            }
+
+            return 0;
+        }
+        #endif /** EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED */
+        #if EMB_ALLOC_FUTEX_LOCK_SUPPORTED
+        case kEmbAllocLockBackendFutex:
+        {
+            /**
+             * U. Drepper, "Futexes Are Tricky", mutex3: a held lock is marked 2 by any
+             * waiter, so the holder only makes the wake-up system call when needed.
+             */
+            int state = 0;
+
+            if (!__atomic_compare_exchange_n (&(lock->state), &state, 1, false,
+                    __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+                if (2 != state) {
+                    state = __atomic_exchange_n (&(lock->state), 2, __ATOMIC_ACQUIRE);
+                }
+
+                while (0 != state) {
+                    /** EAGAIN (the word changed) and EINTR simply retry. */
+                    syscall (SYS_futex, &(lock->state), FUTEX_WAIT_PRIVATE, 2, NULL, NULL, 0);
+                    state = __atomic_exchange_n (&(lock->state), 2, __ATOMIC_ACQUIRE);
+                }
+            }
+
+            return 0;
+        }
+        #endif /** EMB_ALLOC_FUTEX_LOCK_SUPPORTED */
+        case kEmbAllocLockBackendMutex:
+        case kEmbAllocLockBackendAdaptiveMutex:
+        default:
+            return EmbAllocLockMutex (&(lock->mutex));
+    }
+}
+
+int EmbAllocReleaseLock (EmbAllocLock *lock)
+{
+    if (NULL == lock) {
+        return -1;
+    }
+
+    switch (lock->backend) {
+        #if EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED
+        case kEmbAllocLockBackendSpin:
+            __atomic_store_n (&(lock->state), 0, __ATOMIC_RELEASE);
+            return 0;
+        #endif /** EMB_ALLOC_ATOMIC_LOCKS_SUPPORTED */
+        #if EMB_ALLOC_FUTEX_LOCK_SUPPORTED
+        case kEmbAllocLockBackendFutex:
+            if (1 != __atomic_fetch_sub (&(lock->state), 1, __ATOMIC_RELEASE)) {
+                /** There were waiters: free the lock and wake one of them. */
+                __atomic_store_n (&(lock->state), 0, __ATOMIC_RELEASE);
+
+                if (-1 == syscall (SYS_futex, &(lock->state), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0)) {
+                    return -1;
+                }
+            }
+
+            return 0;
+        #endif /** EMB_ALLOC_FUTEX_LOCK_SUPPORTED */
+        case kEmbAllocLockBackendMutex:
+        case kEmbAllocLockBackendAdaptiveMutex:
+        default:
+            return EmbAllocUnlockMutex (&(lock->mutex));
+    }
+}
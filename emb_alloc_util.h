@@ -27,6 +27,9 @@
 #ifndef __EMB_ALLOC_UTIL_H__
 #define __EMB_ALLOC_UTIL_H__
 
+/** EmbAllocLockBackend declaration */
+#include "emb_alloc.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif /* __cplusplus */
@@ -56,6 +59,18 @@ extern "C" {
     #error Cannot determine how to create mutexes on this platform
 #endif /** __linux__ || _WIN32/_WIN64 */
 
+/** A lock with a selectable backend (see EmbAllocLockBackend). */
+typedef struct {
+    /** The backend in use: the requested one, or the OS mutex if that is unavailable. */
+    EmbAllocLockBackend backend;
+    /** The mutex of kEmbAllocLockBackendMutex and kEmbAllocLockBackendAdaptiveMutex. */
+    EmbAllocMutex mutex;
+    /**
+     * The lock word of kEmbAllocLockBackendSpin (0 free, 1 held) and of
+     * kEmbAllocLockBackendFutex (0 free, 1 held, 2 held with waiters).
+     */
+    int state;
+} EmbAllocLock;
 
 /**
  * Initializes an OS independent mutex.
@@ -85,6 +100,62 @@ int EmbAllocLockMutex (EmbAllocMutex *mutex);
  */
 int EmbAllocUnlockMutex (EmbAllocMutex *mutex);
 
+/**
+ * Initializes a lock.
+ * @param lock the lock to be initialized.
+ * @param backend the requested backend. One that is not available on this platform
+ *        (or is unknown) is replaced with kEmbAllocLockBackendMutex.
+ * @return 0 in case of success, -1 otherwise.
+ */
+int EmbAllocInitLock (EmbAllocLock *lock, EmbAllocLockBackend backend);
+
+/**
+ * Destroys a lock.
+ * @param lock the lock to be destroyed.
+ * @return 0 in case of success, -1 otherwise.
+ */
+int EmbAllocDestroyLock (EmbAllocLock *lock);
+
+/**
+ * Acquires a lock, waiting for as long as another thread holds it.
+ * @param lock the lock to be acquired.
+ * @return 0 in case of success, -1 otherwise.
+ */
+int EmbAllocAcquireLock (EmbAllocLock *lock);
+
+/**
+ * Releases a lock held by the calling thread.
+ * @param lock the lock to be released.
+ * @return 0 in case of success, -1 otherwise.
+ */
+int EmbAllocReleaseLock (EmbAllocLock *lock);
+
+/**
+ * Gives the rest of the calling thread's time slice to another ready thread (OS
+ * independent), for the short waits that are not worth blocking on a mutex.
+ */
+void EmbAllocYieldThread (void);
+
+/**
+ * Retrieves the number of CPUs online (OS independent).
+ * @return the number of CPUs, at least 1.
+ */
+size_t EmbAllocGetCpuCount (void);
+
+/**
+ * Retrieves the index of the CPU the calling thread runs on (OS independent). The
+ * thread may move to another CPU right after the call, so use it only as a hint.
+ * @return the CPU index, or EmbAllocGetThreadIndex () where the platform cannot tell.
+ */
+size_t EmbAllocGetCurrentCpu (void);
+
+/**
+ * Retrieves a small index of the calling thread: threads are numbered 0, 1, 2, ...
+ * in the order of their first call (indices of exited threads are not reused).
+ * @return the thread index, always 0 if the compiler has no thread-local storage.
+ */
+size_t EmbAllocGetThreadIndex (void);
+
 /**
  * Checks whether the whole buffer is initialized to a predefined value.
  * @param buffer the buffer to be checked. A NULL buffer is treated as a match.